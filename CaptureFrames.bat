@@ -1,3 +1,3 @@
 @echo off
-"C:\Specify-Your-Path-Here\ConfigAndCapture.exe" %1 %2 %3 %4 %5 %6 %7 %8
+"C:\Specify-Your-Path-Here\ConfigAndCapture.exe" %*
 exit
\ No newline at end of file
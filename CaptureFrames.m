@@ -23,6 +23,15 @@ dy = 1024;
 x0 = 0;
 y0 = 0;
 
+% On-chip binning of the ROI above, [x y].  Binned pixels are summed on the
+% sensor, so fewer pixels are read out and the frame rate goes up.
+Binning = [1 1];
+
+% Further ROIs read out in the same frames, one row each:
+% [x0 y0 dx dy xbin ybin].  e.g. a few narrow bands instead of the full chip:
+% ExtraRois = [0 500 1024 8 1 8; 0 900 1024 8 1 8];
+ExtraRois = [];
+
 % Number of Frames
 NFrames = 5;
 
@@ -35,10 +44,113 @@ DT = 6;
 
 %% Create Tiff File
 % Default: do not create tiff file (to save disk space)
-% In the future you may want to create TIFFs for compatibility reason.  Or
-% modify the executeable to save TIFFs (not sure how to do that yet).
+% The executeable writes the TIFF itself (BigTIFF past 4 GB) as the frames
+% are stored, one page per frame; extra ROIs go to <TiffName>_roi2.tif, ...
 CreateTiffFile = true;
 
+%% Stream To Disk
+% Default: acquire everything before writing.  Set to true for long runs so
+% each frame is copied to the file as it is read out through a small buffer.
+StreamToDisk = false;
+
+%% Writer Thread
+% Default: readouts go into a memory-mapped file.  Set to true to have a
+% background thread write them with direct I/O instead; the executeable then
+% reports the sustained write rate and any stalls waiting for the disk.
+WriterThread = false;
+
+%% Dark and Flat Correction
+% Default: save raw counts.  Give earlier captures taken with the same ROIs
+% (and, for the dark, the same exposure) to have every frame dark subtracted
+% and/or flat fielded by the executeable before it is saved.  FloatOutput
+% saves the corrected frames as single instead of rounding to uint16.
+DarkFile = '';
+FlatFile = '';
+FloatOutput = false;
+
+%% Co-adding
+% Default: save every frame.  Set CoaddCount to K to have the executeable
+% combine every K frames into one as they arrive, so only NFrames/K frames
+% are written and loaded (NFrames must be a multiple of K).  CoaddMode is
+% 'sum', 'mean' or 'sigma-clip'; VarianceMaps also saves the per-pixel
+% variance of each group (returned by ReadCaptureFile as its 4th output).
+CoaddCount = 1;
+CoaddMode = 'mean';
+VarianceMaps = false;
+
+%% Sensor Temperature
+% Default: start at once and read the temperature only before the run.  Set
+% WaitForLock to have the executeable hold the acquisition until the sensor
+% temperature is locked (at most LockTimeout seconds) instead of waiting a
+% fixed time by hand, and TelemetryInterval (ms) to have it read the
+% temperature throughout the run (returned as CaptureHeader.Telemetry).
+WaitForLock = false;
+LockTimeout = 600;
+TelemetryInterval = 0;
+
+%% Exposure Sequence
+% Default: every frame at DT.  Give rows of [exposure (ms), frames] to take
+% each in turn in one run, e.g. [1 10; 10 10; 100 10] for a bracketed HDR
+% series; DT and NFrames are then ignored and CaptureHeader.Exposures says
+% which exposure each frame actually got.
+ExposureSequence = [];
+
+%% Frame Statistics
+% Default: none.  Set FrameStats to have the executeable work out the min,
+% max, mean, std, saturated pixels and a histogram of every frame as it is
+% read out (returned as CaptureHeader.Stats).  AbortIf, e.g.
+% 'saturated>0.01' or 'mean<50', stops a run whose frames meet it instead of
+% wasting the rest of it (the capture then fails with exit code 9).
+FrameStats = false;
+AbortIf = '';
+
+%% Spot Centroiding
+% Default: none.  Set Centroid to have the executeable find the spots of
+% every frame as it is read out (returned as CaptureHeader.Spots: frame, x, y,
+% flux, FWHM, ...) and CentroidOnly to keep only the spots and not the
+% frames, so ImageMatrix comes back empty.  SpotThreshold is in noise sigma
+% above the local background; ThumbnailRadius R > 0 also keeps the
+% (2R+1) x (2R+1) pixels around each spot (CaptureHeader.Thumbnails).
+Centroid = false;
+CentroidOnly = false;
+SpotThreshold = 5;
+ThumbnailRadius = 0;
+
+%% Readout Mode
+% Default: 'full-frame'.  'frame-transfer' exposes the next frame while the
+% last is read out; 'kinetics' exposes KineticsWindow rows at a time and reads
+% every window of the sensor out together, one frame per window (keep dy at
+% most KineticsWindow).
+ReadoutMode = 'full-frame';
+KineticsWindow = 64;
+
+%% Acquisition Profile
+% Default: the built-in camera setup.  Give the name of a [section] of
+% ProfileFile (default profiles.txt next to the executeable) to take the
+% camera parameters from it instead, e.g. 'fast-kinetics'.  Set
+% ProfileRoi to capture the ROIs of the profile rather than x0, y0, dx, dy
+% and ExtraRois.
+Profile = '';
+ProfileFile = '';
+ProfileRoi = false;
+
+%% Capture Server
+% Default: launch the executeable for every capture.  Set to true to send the
+% capture to a server that keeps the camera open and configured between
+% captures instead.  Start the server once with:
+%   dos('start /MIN CaptureFrames.bat --server');
+UseCaptureServer = false;
+CaptureServerPort = 5757;
+
+%% MEX Capture
+% Default: capture through the executeable and a file.  Set to true to have
+% the PicamCapture MEX function (built from PicamCapture.cpp) acquire the
+% frames straight into ImageMatrix, keeping the camera open between runs.
+% Nothing is written to disk, so correction, co-adding and TIFF files are
+% not available, and only the ROI x0, y0, dx, dy is returned (ExtraRois is
+% an error); PicamCapture('close') releases the camera.
+UseMexCapture = false;
+
 %% Display Images
 % Default: do not display images (allow processing function to display
 % images)
@@ -65,27 +177,117 @@ FileDir = [RootFileDir today '\'];
 
 display(['Waiting for acquisition of ' FilePath]);
 
-doscmd = ['start /MIN CaptureFrames.bat ' FileDir ' ' FileName ' ' int2str(x0) ' ' int2str(y0) ' ' int2str(dx) ' ' int2str(dy) ' ' num2str(DT) ' ' int2str(NFrames)];
+if(ProfileRoi)
+    CaptureArgs = ['- - - - ' num2str(DT) ' ' int2str(NFrames)];
+else
+    CaptureArgs = [int2str(x0) ' ' int2str(y0) ' ' int2str(dx) ' ' int2str(dy) ' ' num2str(DT) ' ' int2str(NFrames)];
+end
+if(any(Binning ~= 1))
+    CaptureArgs = [CaptureArgs ' --bin=' int2str(Binning(1)) ',' int2str(Binning(2))];
+end
+for kk = 1:size(ExtraRois, 1)
+    CaptureArgs = [CaptureArgs ' --roi=' sprintf('%d,', ExtraRois(kk, 1:5)) int2str(ExtraRois(kk, 6))];
+end
+if(StreamToDisk)
+    CaptureArgs = [CaptureArgs ' --stream'];
+end
+if(WriterThread)
+    CaptureArgs = [CaptureArgs ' --writer-thread'];
+end
+if(~isempty(DarkFile))
+    CaptureArgs = [CaptureArgs ' --dark=' DarkFile];
+end
+if(~isempty(FlatFile))
+    CaptureArgs = [CaptureArgs ' --flat=' FlatFile];
+end
+if(FloatOutput)
+    CaptureArgs = [CaptureArgs ' --output-type=float32'];
+end
+if(CreateTiffFile)
+    CaptureArgs = [CaptureArgs ' --tiff=' TiffPath];
+end
+if(CoaddCount > 1)
+    CaptureArgs = [CaptureArgs ' --coadd=' int2str(CoaddCount) ' --coadd-mode=' CoaddMode];
+    if(VarianceMaps)
+        CaptureArgs = [CaptureArgs ' --variance'];
+    end
+end
+if(WaitForLock)
+    CaptureArgs = [CaptureArgs ' --wait-for-lock=' int2str(LockTimeout)];
+end
+if(~isempty(ExposureSequence))
+    CaptureArgs = [CaptureArgs ' --sequence=' strjoin(arrayfun(@(kk) sprintf('%g:%d', ExposureSequence(kk, 1), ExposureSequence(kk, 2)), ...
+        1:size(ExposureSequence, 1), 'UniformOutput', false), ',')];
+end
+if(TelemetryInterval > 0)
+    CaptureArgs = [CaptureArgs ' --telemetry=' int2str(TelemetryInterval)];
+end
+if(FrameStats)
+    CaptureArgs = [CaptureArgs ' --stats'];
+end
+if(~isempty(AbortIf))
+    % quoted, or the shell takes > and < as redirection
+    CaptureArgs = [CaptureArgs ' "--abort-if=' AbortIf '"'];
+end
+if(Centroid || CentroidOnly)
+    if(CentroidOnly)
+        CaptureArgs = [CaptureArgs ' --centroid-only'];
+    else
+        CaptureArgs = [CaptureArgs ' --centroid'];
+    end
+    CaptureArgs = [CaptureArgs ' --spot-threshold=' num2str(SpotThreshold)];
+    if(ThumbnailRadius > 0)
+        CaptureArgs = [CaptureArgs ' --thumbnails=' int2str(ThumbnailRadius)];
+    end
+end
+if(~isempty(Profile))
+    CaptureArgs = [CaptureArgs ' --profile=' Profile];
+    if(~isempty(ProfileFile))
+        CaptureArgs = [CaptureArgs ' "--profiles=' ProfileFile '"'];
+    end
+end
+if(~strcmp(ReadoutMode, 'full-frame'))
+    CaptureArgs = [CaptureArgs ' --readout-mode=' ReadoutMode];
+    if(strcmp(ReadoutMode, 'kinetics'))
+        CaptureArgs = [CaptureArgs ' --kinetics-window=' int2str(KineticsWindow)];
+    end
+end
 
-[status,stdout]  = dos(doscmd);
+if(UseMexCapture)
+    if(~isempty(ExtraRois))
+        error('PicamCapture returns only the ROI x0, y0, dx, dy: clear ExtraRois or set UseMexCapture = false');
+    end
+    BinArgs = '';
+    if(any(Binning ~= 1))
+        BinArgs = ['--bin=' int2str(Binning(1)) ',' int2str(Binning(2))];
+    end
+    ImageMatrix = PicamCapture('capture', x0, y0, dx, dy, DT, NFrames, BinArgs);
+    CaptureHeader = [];
+    VarianceMatrix = [];
+elseif(UseCaptureServer)
+    % The server replies once the file is on disk
+    Reply = SendCaptureCommand(['CAPTURE "' FileDir '" "' FileName '" ' CaptureArgs], CaptureServerPort);
+    if(~strncmp(Reply, 'OK', 2))
+        error(['Capture failed: ' Reply]);
+    end
+else
+    % Listen for the executeable's completion report before launching it
+    Listener = java.net.ServerSocket(0, 1, java.net.InetAddress.getByName('127.0.0.1'));
+    doscmd = ['start /MIN CaptureFrames.bat ' FileDir ' ' FileName ' ' CaptureArgs ' --notify=' int2str(Listener.getLocalPort())];
 
-disp('Waiting for file to arrive... ')
-while(exist(FilePath) == 0)
-    pause(0.75)
-end
+    [status,stdout]  = dos(doscmd);
 
-% Load raw data into Matlab.
-FileID = fopen(FilePath);
-for kk = 1:NFrames
-    ImageMatrix(:,:,kk) = fread(FileID, [dx, dy], '*uint16')';
+    disp('Waiting for capture to finish... ')
+    [Saved, Reply] = WaitForCapture(Listener);
+    if(~Saved)
+        error(['Capture failed: ' Reply]);
+    end
 end
-fclose(FileID);
 
-% Optionally write TIFF file
-if(CreateTiffFile)
-    for kk = 1:NFrames
-        imwrite(ImageMatrix(:,:,kk),TiffPath,'writemode','append');
-    end  
+if(~UseMexCapture)
+    % Load the frames into Matlab.  The file header describes the layout.
+    % Frames of the extra ROIs are returned by ReadCaptureFile(FilePath, k).
+    [ImageMatrix, CaptureHeader, ~, VarianceMatrix] = ReadCaptureFile(FilePath);
 end
    
 display(['Completed acquisition of ' TiffName  ' at: ' datestr(now,'yyyy-mm-dd HH:MM:SS')]);
\ No newline at end of file
@@ -0,0 +1,97 @@
+////////////////////////////////////////////////////////////////////////////////
+// Capture Library
+// - what PicamCapture.cpp (the MEX function) calls of ConfigAndCapture.cpp,
+//   which is compiled without main (CONFIG_AND_CAPTURE_LIBRARY) and linked
+//   into it:
+//     mex -DCONFIG_AND_CAPTURE_LIBRARY PicamCapture.cpp ConfigAndCapture.cpp
+//         -I<PICAM Includes> <PICAM Library>\Picam.lib
+// - CaptureSession keeps the camera open and configured between captures and
+//   acquires straight into memory the caller owns, laid out as a MATLAB
+//   array: rows x columns x frames, column-major, uint16
+////////////////////////////////////////////////////////////////////////////////
+#ifndef CAPTURE_LIBRARY_H
+#define CAPTURE_LIBRARY_H
+
+#include <string>
+#include <cstdint>
+#include "picam.h"
+
+// - how a capture ended; also the exit code of the executeable
+enum CaptureResult
+{
+	CaptureResult_Saved        = 0,
+	CaptureResult_BadArguments = 1,
+	CaptureResult_InvalidRoi   = 2,
+	CaptureResult_CameraError  = 3,
+	CaptureResult_FileError    = 4,
+	CaptureResult_Incomplete   = 5,
+	CaptureResult_TestFailed   = 6,
+	CaptureResult_BadCalibration = 7,
+	CaptureResult_NotLocked    = 8,
+	CaptureResult_Aborted      = 9,
+	CaptureResult_TestSkipped  = 10
+};
+
+std::string CaptureResultString(CaptureResult result);
+
+// - memory the frames of ROI 1 are acquired into; with allocate set it is
+//   asked for once the size is known (a kinetics readout holds several
+//   frames), otherwise data must already have room for exactly the capture
+struct FrameArray
+{
+	uint16_t*	data;
+	piint		rows;
+	piint		columns;
+	pi64s		frames;
+	uint16_t*	(*allocate)(piint rows, piint columns, pi64s frames, void* context);
+	void*		context;	/* passed to allocate */
+
+	FrameArray() : data(0), rows(0), columns(0), frames(0), allocate(0), context(0) {}
+};
+
+// - copies a row-major frame into column-major order
+void TransposeFrame(const uint16_t* frame, piint rows, piint columns, uint16_t* out);
+
+struct CaptureOptions;
+struct ConstraintCache;
+
+// - a camera held open across captures
+struct CaptureSession
+{
+	PicamHandle		camera;
+	PicamCameraID	id;
+	bool			open;
+	bool			configured;
+	ConstraintCache*	constraints;	/* learned, and what the last profile set */
+
+	CaptureSession();
+	~CaptureSession();
+
+	// - opens the camera with the given serial number, or the first one (a
+	//   demo camera if there is none) for an empty serial
+	CaptureResult Open(const std::string& serial);
+
+	// - configures the camera (on later captures only the parameters that
+	//   differ), then acquires into array, and into the capture file
+	//   FullFilePath as well if one is given
+	CaptureResult Capture(int x0, int y0, int dx, int dy, piflt dt, int NFrames, const CaptureOptions& options, FrameArray& array, const std::string& FullFilePath = std::string());
+
+	// - the same, with the executeable's --options in one string
+	CaptureResult Capture(int x0, int y0, int dx, int dy, piflt dt, int NFrames, const std::string& options, FrameArray& array);
+
+	void Close();
+};
+
+// - copies ROI 1 of the newest readout in the shared ring NAME of a running
+//   capture into frame, which it allocates (frame.allocate must be set);
+//   returns the readout's number counting from 1, or 0 if there is none
+//   (frame may have been allocated all the same)
+double LatestRingReadout(const std::string& name, FrameArray& frame);
+
+// - lets go of the ring LatestRingReadout follows
+void CloseLatestRing();
+
+// - prints how long each stage of the last capture took
+void PrintCaptureTiming();
+
+#endif
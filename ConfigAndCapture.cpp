@@ -9,13 +9,561 @@
 
 #include <string>
 #include <iostream>
+#include <vector>
+#include <cstdlib>
+#include <cstring>
+#include <cctype>
+#include <climits>
+#include <cerrno>
+#include <cmath>
+#include <algorithm>
+#include <map>
+#include <sstream>
+#include <chrono>
+#include <cstdint>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <new>
+#include <memory>
 #include "picam.h"
+#include "picam_advanced.h"
+#include "CaptureLibrary.h"
+#ifdef _WIN32
 #include <process.h>
+#include <io.h>
+#include <winsock2.h>
+#include <windows.h>
+#pragma comment(lib, "ws2_32.lib")
+#pragma comment(lib, "advapi32.lib")
+#else
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+typedef int SOCKET;
+#define INVALID_SOCKET -1
+#define closesocket close
+#endif
 #include "stdio.h"
+#if defined(__x86_64__) || defined(_M_X64)
+#define CORRECTION_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define CORRECTION_AVX2_TARGET
+#else
+#define CORRECTION_AVX2_TARGET __attribute__((target("avx2")))
+#endif
+#endif
 #define NO_TIMEOUT  -1
 #define TIMEOUT 10000
+#define STREAM_BUFFER_READOUTS 64
+#define CAPTURE_SERVER_PORT 5757
+#define SHARED_RING_SLOTS 8
+#define CENTROID_THRESHOLD 5		/* noise sigma above the background */
+#define CENTROID_MIN_PIXELS 3
+#define CENTROID_MAX_SPOTS 32		/* per frame, brightest first */
+#define PROFILE_FILE "profiles.txt"	/* next to the executeable */
 using namespace std;
 
+// - one step of an exposure sequence
+struct ExposureStep
+{
+	piflt exposure;         /* ms */
+	pi64s readouts;
+};
+
+// - a PICAM parameter of an acquisition profile, resolved against the camera
+//   when it is configured
+struct ProfileSetting
+{
+	string name;
+	string value;
+	int    line;            /* in the profile file */
+};
+
+// - optional settings that follow the eight positional arguments
+struct CaptureOptions
+{
+	bool  Streaming;        /* --stream: write each readout as it arrives   */
+	piint BufferReadouts;   /* --buffer-readouts=N: circular buffer size    */
+	piint ServerPort;       /* --server[=port]: run as a capture server     */
+	bool  LegacyConfigure;  /* --legacy-configure: commit one at a time     */
+	bool  RawFile;          /* --raw: no header, readouts only              */
+	piint NotifyPort;       /* --notify=port: report progress to a listener */
+	piint XBinning;         /* --bin=X[,Y]: binning of the positional ROI   */
+	piint YBinning;
+	vector<PicamRoi> ExtraRois;	/* --roi=x,y,w,h[,xbin[,ybin]], repeatable */
+	bool  Metadata;         /* --metadata: time stamp and track each frame  */
+	bool  WriterThread;     /* --writer-thread: write on a background thread */
+	vector<string> Cameras;	/* --cameras=SN1,SN2,... or all                 */
+	piint DemoCameras;      /* --demo-cameras=N: connect N demo cameras     */
+	bool  ScalingTest;      /* --scaling-test: 1 camera vs all of them      */
+	bool  ListCameras;      /* --list-cameras                               */
+	piflt AdcSpeed;         /* --adc-speed=MHz                              */
+	string Benchmark;       /* --benchmark=results.csv|.json                */
+	vector<piflt> SweepSizes;	/* --sweep-size=64,256,... (square ROIs)   */
+	vector<piflt> SweepBinning;	/* --sweep-bin=1,2,...                     */
+	vector<piflt> SweepAdcSpeeds;	/* --sweep-adc=0.1,2,... (MHz)         */
+	vector<piflt> SweepExposures;	/* --sweep-exposure=1,10,... (ms)      */
+	vector<piflt> SweepFrames;	/* --sweep-frames=10,100,...               */
+	string DarkFile;        /* --dark=FILE: master dark to subtract         */
+	string FlatFile;        /* --flat=FILE: master flat to divide by        */
+	bool  FloatOutput;      /* --output-type=float32                        */
+	bool  CorrectionBenchmark;	/* --benchmark-correction                   */
+	piint CoaddCount;       /* --coadd=K: combine every K readouts          */
+	piint CoaddMethod;      /* --coadd-mode=sum|mean|sigma-clip (CoaddMode) */
+	piflt ClipSigma;        /* --clip-sigma=S                               */
+	bool  VarianceMaps;     /* --variance: store a variance map per group   */
+	piint CompressThreads;  /* --compress[=THREADS]: compress losslessly    */
+	string DecompressFrom;  /* --decompress=FILE                            */
+	string DecompressTo;    /* --decompress-to=FILE                         */
+	bool  Tiff;             /* --tiff[=FILE]: also write a multi-page TIFF  */
+	bool  LibraryTest;      /* --library-test: drive the capture library    */
+	bool  SequenceTest;     /* --sequence-test: online exposure steps       */
+	string TiffPath;        /* default the capture file with .tif appended  */
+	string SharedRing;      /* --shared-ring=NAME: publish every readout    */
+	piint RingSlots;        /* --ring-slots=N                               */
+	string WatchRing;       /* --watch=NAME: follow a shared ring           */
+	string CapabilityDir;   /* --capability-dir=DIR: capability files       */
+	bool  RefreshCapabilities;	/* --refresh-capabilities                   */
+	string LogPath;         /* --log=FILE: JSON lines log of the run        */
+	piint ConsoleLevel;     /* --log-level=debug|info|warning|error         */
+	bool  Trace;            /* --trace: timed spans and their breakdown     */
+	piint TelemetryInterval;	/* --telemetry[=MS]: read the temperature   */
+	piint LockTimeout;      /* --wait-for-lock[=SECONDS]                    */
+	vector<ExposureStep> Sequence;	/* --sequence=ms:N,...: exposure steps  */
+	piint ReadoutMode;      /* --readout-mode=full-frame|frame-transfer|kinetics */
+	piint KineticsWindow;   /* --kinetics-window=ROWS                       */
+	piint KineticsFrames;   /* --kinetics-frames=N: window = sensor height / N */
+	vector<piint> SweepModes;	/* --sweep-mode=full-frame,kinetics,...     */
+	piint StatsThreads;     /* --stats[=THREADS]: per-frame statistics      */
+	string AbortIf;         /* --abort-if=METRIC>VALUE                      */
+	piint AbortFrames;      /* --abort-frames=N in a row                    */
+	piint CentroidThreads;  /* --centroid[=THREADS]: find the spots         */
+	bool CentroidOnly;      /* --centroid-only: store the spots, not frames */
+	piflt SpotThreshold;    /* --spot-threshold=SIGMA                       */
+	piint SpotMinPixels;    /* --spot-min-pixels=N                          */
+	piint MaxSpots;         /* --max-spots=N per frame                      */
+	piint ThumbnailRadius;  /* --thumbnails=R: (2R+1)^2 pixels per spot     */
+	string Profile;         /* --profile=NAME: camera setup, ROIs and run   */
+	string ProfileFile;     /* --profiles=FILE                              */
+	vector<ProfileSetting> ProfileSettings;	/* its PICAM parameters         */
+	vector<PicamRoi> ProfileRois;	/* its roi= lines                       */
+	piflt ProfileExposure;  /* its exposure=, -1 if none                    */
+	piint ProfileFrames;    /* its frames=, 0 if none                       */
+	bool  UseArena;         /* --no-arena: allocate buffers per capture     */
+
+	CaptureOptions() : Streaming(false), BufferReadouts(STREAM_BUFFER_READOUTS), ServerPort(0), LegacyConfigure(false), RawFile(false), NotifyPort(0), XBinning(1), YBinning(1), Metadata(false), WriterThread(false), DemoCameras(0), ScalingTest(false), ListCameras(false), AdcSpeed(2), FloatOutput(false), CorrectionBenchmark(false), CoaddCount(0), CoaddMethod(2), ClipSigma(3), VarianceMaps(false), CompressThreads(0), Tiff(false), LibraryTest(false), SequenceTest(false), RingSlots(SHARED_RING_SLOTS), RefreshCapabilities(false), ConsoleLevel(1), Trace(false), TelemetryInterval(0), LockTimeout(0), ReadoutMode(PicamReadoutControlMode_FullFrame), KineticsWindow(0), KineticsFrames(0), StatsThreads(0), AbortFrames(1), CentroidThreads(0), CentroidOnly(false), SpotThreshold(CENTROID_THRESHOLD), SpotMinPixels(CENTROID_MIN_PIXELS), MaxSpots(CENTROID_MAX_SPOTS), ThumbnailRadius(0), ProfileFile(PROFILE_FILE), ProfileExposure(-1), ProfileFrames(0), UseArena(true) {}
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// Logging and Tracing
+// - --log=FILE sends everything the tool prints through an in-memory ring:
+//   each line becomes a record (time, thread, level) that a background
+//   thread writes to the console and, one JSON object per line, to FILE, so
+//   nothing is lost when the minimized console closes and printing a line
+//   never waits on the console
+// - lines starting with WARNING are warnings, with ERROR or FAILED errors;
+//   --log-level=debug|info|warning|error picks what still reaches the
+//   console, FILE gets everything
+// - --trace also records timed spans: every Timing stage (library init,
+//   configuration, ROI setup, acquisition, file flush), each parameter set
+//   and commit, every wait for and store of readouts, writer thread blocks
+//   and compressed readouts, and prints a breakdown per span at the end
+// - producers never wait: a full ring drops the record and counts it, and
+//   with tracing off a span costs one relaxed atomic load
+////////////////////////////////////////////////////////////////////////////////
+#define LOG_RING_RECORDS   8192		/* a power of two */
+#define LOG_RECORD_TEXT    232
+#define LOG_DRAIN_INTERVAL 20		/* ms between drains */
+
+enum LogLevel
+{
+	LogLevel_Debug,
+	LogLevel_Info,
+	LogLevel_Warning,
+	LogLevel_Error
+};
+
+enum LogKind
+{
+	LogKind_Line,
+	LogKind_Span
+};
+
+// - one slot of the ring
+struct LogRecord
+{
+	std::atomic<size_t>	sequence;		/* whose turn the slot is */
+	int64_t				time;			/* us since the log started; a span's start */
+	double				milliseconds;	/* span length */
+	uint32_t			thread;
+	uint8_t				kind;			/* LogKind  */
+	uint8_t				level;			/* LogLevel */
+	char				text[LOG_RECORD_TEXT];
+};
+
+// - per span name, for the breakdown
+struct SpanTotal
+{
+	pi64s	count;
+	double	total;
+	double	longest;
+	SpanTotal() : count(0), total(0), longest(0) {}
+};
+
+// - collects whole lines written to std::cout, per thread, into the log
+struct LogLineBuffer : std::streambuf
+{
+	int overflow(int c);
+	std::streamsize xsputn(const char* text, std::streamsize count);
+	int sync() { return 0; }	/* std::endl no longer waits on the console */
+};
+
+// - the line being printed on this thread
+thread_local string LogLine;
+
+struct TraceLog
+{
+	std::atomic<bool>		tracing;
+	bool					active;
+	LogLevel				consoleLevel;
+	FILE*					file;
+	std::streambuf*			console;
+	LogLineBuffer			lines;
+	std::unique_ptr<LogRecord[]>	ring;
+	std::atomic<size_t>		tail;		/* next slot to fill       */
+	size_t					head;		/* next to drain (drainer) */
+	std::atomic<pi64s>		dropped;
+	std::atomic<bool>		stopping;
+	std::atomic<uint32_t>	threads;
+	std::thread				drainer;
+	std::chrono::steady_clock::time_point	start;
+	std::map<string, SpanTotal>	spans;	/* drainer only */
+
+	TraceLog() : tracing(false), active(false), consoleLevel(LogLevel_Info), file(0), console(0), tail(0), head(0), dropped(0), stopping(false), threads(0) {}
+
+	// - starts logging to path (if not empty) and tracing if asked to
+	bool Start(const string& path, LogLevel level, bool trace)
+	{
+		if( active || ( path.empty() && !trace ) )
+			return true;
+		if( !path.empty() )
+		{
+			file = fopen( path.c_str(), "w" );
+			if( !file )
+			{
+				std::cout << "FAILED TO OPEN LOG FILE: " << path << std::endl;
+				return false;
+			}
+		}
+		ring.reset( new LogRecord[LOG_RING_RECORDS] );
+		for( size_t i = 0; i < LOG_RING_RECORDS; ++i )
+			ring[i].sequence.store( i, std::memory_order_relaxed );
+		consoleLevel = level;
+		start = std::chrono::steady_clock::now();
+		std::cout.flush();
+		console = std::cout.rdbuf( &lines );
+		active = true;
+		tracing = trace;
+		drainer = std::thread( &TraceLog::Drain, this );
+		return true;
+	}
+
+	// - writes out what is left and the span breakdown, and gives std::cout
+	//   back to the console
+	void Stop()
+	{
+		if( !active )
+			return;
+		std::cout.flush();
+		if( !LogLine.empty() )
+			lines.sputc( '\n' );
+		stopping = true;
+		drainer.join();
+		std::cout.rdbuf( console );
+		active = false;
+		tracing = false;
+		if( !spans.empty() )
+		{
+			std::cout << "Trace Summary" << std::endl
+			          << "=============" << std::endl;
+			for( std::map<string, SpanTotal>::const_iterator it = spans.begin(); it != spans.end(); ++it )
+			{
+				const SpanTotal& span = it->second;
+				std::cout << "    " << it->first << ": " << span.count << " x, " << span.total << " ms in total, " << span.total / span.count
+				          << " ms on average, " << span.longest << " ms at most" << std::endl;
+				if( file )
+					fprintf( file, "{\"summary\":\"%s\",\"count\":%lld,\"ms\":%.3f,\"max_ms\":%.3f}\n", Escape( it->first ).c_str(),
+					         (long long)span.count, span.total, span.longest );
+			}
+		}
+		if( dropped > 0 )
+			std::cout << "WARNING: " << dropped << " log records were dropped because the log ring was full" << std::endl;
+		if( file )
+			fclose( file );
+		file = 0;
+	}
+
+	int64_t Microseconds(std::chrono::steady_clock::time_point when) const
+	{
+		return std::chrono::duration_cast<std::chrono::microseconds>( when - start ).count();
+	}
+
+	// - small number of the calling thread, for the records
+	uint32_t ThreadNumber()
+	{
+		thread_local uint32_t number = ++threads;
+		return number;
+	}
+
+	// - records a timed span; safe from any thread
+	void Span(const string& name, std::chrono::steady_clock::time_point begun, std::chrono::steady_clock::time_point ended)
+	{
+		if( !tracing.load( std::memory_order_relaxed ) )
+			return;
+		Push( LogKind_Span, LogLevel_Debug, Microseconds( begun ), std::chrono::duration<double, std::milli>( ended - begun ).count(), name.c_str(), name.size() );
+	}
+
+	// - queues a record, or drops it if the ring is full
+	void Push(LogKind kind, LogLevel level, int64_t time, double milliseconds, const char* text, size_t length)
+	{
+		size_t position = tail.load( std::memory_order_relaxed );
+		LogRecord* record;
+		while( true )
+		{
+			record = &ring[position & ( LOG_RING_RECORDS - 1 )];
+			size_t sequence = record->sequence.load( std::memory_order_acquire );
+			if( sequence == position )
+			{
+				if( tail.compare_exchange_weak( position, position + 1, std::memory_order_relaxed ) )
+					break;
+			}
+			else if( sequence < position )
+			{
+				dropped++;
+				return;
+			}
+			else
+				position = tail.load( std::memory_order_relaxed );
+		}
+		record->time = time;
+		record->milliseconds = milliseconds;
+		record->thread = ThreadNumber();
+		record->kind = (uint8_t)kind;
+		record->level = (uint8_t)level;
+		length = std::min( length, (size_t)LOG_RECORD_TEXT - 1 );
+		memcpy( record->text, text, length );
+		record->text[length] = 0;
+		record->sequence.store( position + 1, std::memory_order_release );
+	}
+
+	static string Escape(const string& text)
+	{
+		string escaped;
+		for( size_t i = 0; i < text.size(); ++i )
+		{
+			unsigned char c = (unsigned char)text[i];
+			if( c == '"' || c == '\\' )
+				escaped += '\\';
+			if( c < 0x20 )
+			{
+				char code[8];
+				snprintf( code, sizeof(code), "\\u%04x", c );
+				escaped += code;
+			}
+			else
+				escaped += (char)c;
+		}
+		return escaped;
+	}
+
+private:
+	// - the background thread: empties the ring every LOG_DRAIN_INTERVAL ms
+	void Drain()
+	{
+		static const char* levels[] = { "debug", "info", "warning", "error" };
+		while( true )
+		{
+			bool last = stopping.load();
+			bool wrote = false;
+			while( true )
+			{
+				LogRecord& record = ring[head & ( LOG_RING_RECORDS - 1 )];
+				if( record.sequence.load( std::memory_order_acquire ) != head + 1 )
+					break;
+				if( record.kind == LogKind_Line )
+				{
+					if( record.level >= consoleLevel )
+					{
+						console->sputn( record.text, (std::streamsize)strlen( record.text ) );
+						console->sputc( '\n' );
+						wrote = true;
+					}
+					if( file )
+						fprintf( file, "{\"t_us\":%lld,\"thread\":%u,\"level\":\"%s\",\"msg\":\"%s\"}\n", (long long)record.time, record.thread,
+						         levels[record.level], Escape( record.text ).c_str() );
+				}
+				else
+				{
+					SpanTotal& total = spans[record.text];
+					total.count++;
+					total.total += record.milliseconds;
+					total.longest = std::max( total.longest, record.milliseconds );
+					if( file )
+						fprintf( file, "{\"t_us\":%lld,\"thread\":%u,\"span\":\"%s\",\"ms\":%.3f}\n", (long long)record.time, record.thread,
+						         Escape( record.text ).c_str(), record.milliseconds );
+				}
+				record.sequence.store( head + LOG_RING_RECORDS, std::memory_order_release );
+				head++;
+			}
+			if( wrote )
+				console->pubsync();
+			if( file )
+				fflush( file );
+			if( last )
+				return;
+			std::this_thread::sleep_for( std::chrono::milliseconds( LOG_DRAIN_INTERVAL ) );
+		}
+	}
+};
+
+TraceLog Logging;
+
+// - level of a line from the way the tool words it
+LogLevel LineLevel(const string& line)
+{
+	size_t first = line.find_first_not_of( " " );
+	if( first == string::npos )
+		return LogLevel_Info;
+	if( line.compare( first, 7, "WARNING" ) == 0 )
+		return LogLevel_Warning;
+	if( line.compare( first, 5, "ERROR" ) == 0 || line.compare( first, 6, "FAILED" ) == 0 )
+		return LogLevel_Error;
+	return LogLevel_Info;
+}
+
+std::streamsize LogLineBuffer::xsputn(const char* text, std::streamsize count)
+{
+	for( std::streamsize i = 0; i < count; ++i )
+		overflow( (unsigned char)text[i] );
+	return count;
+}
+
+int LogLineBuffer::overflow(int c)
+{
+	if( c == EOF )
+		return 0;
+	if( c != '\n' )
+	{
+		LogLine += (char)c;
+		return c;
+	}
+	int64_t now = Logging.Microseconds( std::chrono::steady_clock::now() );
+	LogLevel level = LineLevel( LogLine );
+	size_t at = 0;
+	do
+	{
+		/* Lines longer than a record take several */
+		size_t length = std::min( LogLine.size() - at, (size_t)LOG_RECORD_TEXT - 1 );
+		Logging.Push( LogKind_Line, level, now, 0, LogLine.c_str() + at, length );
+		at += length;
+	}
+	while( at < LogLine.size() );
+	LogLine.clear();
+	return c;
+}
+
+// - times the enclosing block when tracing
+struct TraceSpan
+{
+	const char*		name;
+	string			detail;
+	bool			timed;
+	std::chrono::steady_clock::time_point	begun;
+
+	TraceSpan(const char* name) : name(name), timed( Logging.tracing.load( std::memory_order_relaxed ) )
+	{
+		if( timed )
+			begun = std::chrono::steady_clock::now();
+	}
+
+	TraceSpan(const char* name, const string& detail) : name(name), detail(detail), timed( Logging.tracing.load( std::memory_order_relaxed ) )
+	{
+		if( timed )
+			begun = std::chrono::steady_clock::now();
+	}
+
+	~TraceSpan()
+	{
+		if( timed )
+			Logging.Span( detail.empty() ? string( name ) : string( name ) + " " + detail, begun, std::chrono::steady_clock::now() );
+	}
+};
+
+// - keeps the log going until the scope is left, whichever way that is
+struct LogSession
+{
+	bool Start(const CaptureOptions& options) { return Logging.Start( options.LogPath, (LogLevel)options.ConsoleLevel, options.Trace ); }
+	~LogSession() { Logging.Stop(); }
+};
+
+// - wall time spent in each stage of a run, from startup to the first frame
+struct TimingReport
+{
+	std::chrono::steady_clock::time_point	start;
+	std::chrono::steady_clock::time_point	last;
+	vector< pair<string, double> >			stages;		/* stage, milliseconds */
+
+	TimingReport() { Reset(); }
+
+	void Reset()
+	{
+		start = last = std::chrono::steady_clock::now();
+		stages.clear();
+	}
+
+	// - milliseconds recorded under the given stage name, 0 if it was not reached
+	double Stage(const string& stage) const
+	{
+		double ms = 0;
+		for( size_t i = 0; i < stages.size(); ++i )
+			if( stages[i].first == stage )
+				ms += stages[i].second;
+		return ms;
+	}
+
+	// - records the time since the previous mark under the given stage name
+	void Mark(const string& stage)
+	{
+		std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+		stages.push_back(make_pair(stage, std::chrono::duration<double, std::milli>(now - last).count()));
+		Logging.Span(stage, last, now);
+		last = now;
+	}
+
+	void Print() const
+	{
+		std::cout << "Timing Report" << std::endl
+		          << "=============" << std::endl;
+		double total = 0;
+		for( size_t i = 0; i < stages.size(); ++i )
+		{
+			total += stages[i].second;
+			std::cout << "    " << stages[i].first << ": " << stages[i].second << " ms (at " << total << " ms)" << std::endl;
+		}
+		std::cout << std::endl;
+	}
+};
+
+/* Each camera thread of a multi-camera run keeps its own report */
+thread_local TimingReport Timing;
+
 // - prints any picam enum
 void PrintEnumString( PicamEnumeratedType type, piint value )
 {
@@ -49,634 +597,8323 @@ void PrintError( PicamError error )
     }
 }
 
-void SetFltParameter(PicamHandle camera, PicamParameter parameter, piflt floatval)
+////////////////////////////////////////////////////////////////////////////////
+// Capture File
+// - a fixed header followed by the readouts at a page-aligned offset, so
+//   MATLAB memmapfile or numpy.memmap can map the frames in place
+// - the file is created at its full size and memory-mapped; readouts are
+//   placed straight into the mapping instead of going through fwrite
+// - all fields are little-endian.  readout_count and complete are filled in
+//   once the acquisition is over
+////////////////////////////////////////////////////////////////////////////////
+#define CAPTURE_FILE_MAGIC        "PICAPTUR"
+#define CAPTURE_FILE_VERSION      10
+#define CAPTURE_FILE_HEADER_SIZE  4096
+#define CAPTURE_FILE_MAX_ROIS     16
+#define CAPTURE_FILE_PAGE_SIZE    4096
+#define CAPTURE_FILE_FLUSH_BYTES  (32 * 1024 * 1024)
+#define CAPTURE_PIXEL_UINT16      0	/* header.pixel_type */
+#define CAPTURE_PIXEL_FLOAT32     1
+#define CAPTURE_PIXEL_UINT32      2
+#define CAPTURE_CODEC_NONE        0	/* header.codec */
+#define CAPTURE_CODEC_DELTA_PACK  1
+
+// - where one ROI's pixels sit inside each frame
+struct CaptureFileRoi
 {
-	PicamError error;
-	pibln committed;
-	piflt CurrentFltVal;
-	piflt DefaultFltVal;
+	uint32_t x, width, x_binning;
+	uint32_t y, height, y_binning;
+	uint32_t columns, rows;           /* pixels after binning          */
+	uint64_t offset;                  /* bytes from the start of frame */
+};
 
-	std::cout << "= = = = = = = = = " << std::endl;
+struct CaptureFileHeader
+{
+	char     magic[8];                /* CAPTURE_FILE_MAGIC            */
+	uint32_t version;
+	uint32_t header_size;
+	uint64_t data_offset;             /* first readout, page aligned   */
+	uint64_t readout_count;           /* readouts in the file          */
+	uint64_t readout_stride;          /* bytes from readout to readout */
+	uint32_t frames_per_readout;
+	uint32_t frame_size;              /* bytes of pixels in a frame    */
+	uint32_t frame_stride;            /* bytes from frame to frame     */
+	uint32_t pixel_bit_depth;
+	uint32_t pixel_format;            /* PicamPixelFormat              */
+	uint32_t bytes_per_pixel;
+	uint32_t roi_count;
+	uint32_t complete;                /* 1 once all readouts are in    */
+	double   exposure_time;           /* ms                            */
+	double   readout_time;            /* ms                            */
+	double   sensor_temperature;      /* degrees C at the start        */
+	double   sensor_temperature_set_point;
+	int64_t  start_time;              /* microseconds since 1970 UTC   */
+	int64_t  end_time;
+	int32_t  camera_model;            /* PicamModel                    */
+	uint32_t reserved;
+	char     serial_number[64];
+	CaptureFileRoi rois[CAPTURE_FILE_MAX_ROIS];
 
-	// Display Current Val
-	std::cout << "Getting value of ";
-	PrintEnumString(PicamEnumeratedType_Parameter, parameter);
-	std::cout << ": ";
-	error = Picam_GetParameterFloatingPointValue(camera, parameter, &CurrentFltVal);
-	PrintError(error);
-	if(error == PicamError_None)
+	/* version 2: the per-frame metadata table (see Frame Metadata) */
+	uint64_t metadata_offset;         /* 0 when there is no table      */
+	uint64_t metadata_count;          /* entries, one per frame        */
+	int64_t  time_stamp_resolution;   /* ticks per second              */
+	uint64_t missing_frames;          /* gaps in the tracking counter  */
+	uint64_t long_intervals;          /* likely missed triggers        */
+	uint32_t corrections;             /* version 3: CORRECTION_* bits  */
+	uint32_t reserved3;
+	double   trigger_interval_mean;   /* ms between exposure starts    */
+	double   trigger_interval_std;
+	double   trigger_interval_min;
+	double   trigger_interval_max;
+
+	/* version 4: pixel type and co-adding (see Co-adding) */
+	uint32_t pixel_type;              /* CAPTURE_PIXEL_*               */
+	uint32_t coadd_count;             /* camera readouts per readout, 0 if not co-added */
+	uint32_t coadd_mode;              /* CoaddMode                     */
+	uint32_t variance_offset;         /* bytes into each readout, 0 if no variance maps */
+	double   clip_sigma;
+	uint64_t clipped_values;          /* pixel values left out by sigma-clip */
+
+	/* version 5: compression (see Compression) */
+	uint32_t codec;                   /* CAPTURE_CODEC_*               */
+	uint32_t codec_block;             /* pixels per bit-packed block   */
+	uint64_t chunk_index_offset;      /* CaptureFileChunk per readout, 0 if uncompressed */
+	uint64_t compressed_bytes;        /* of readout data               */
+
+	/* version 6: temperature telemetry (see Temperature Telemetry) */
+	uint64_t telemetry_offset;        /* 0 when there is no table      */
+	uint64_t telemetry_count;         /* CaptureFileTemperature entries */
+	double   telemetry_interval;      /* ms between readings           */
+	double   sensor_temperature_min;  /* degrees C during the run      */
+	double   sensor_temperature_max;
+	double   lock_wait;               /* ms waited for the lock        */
+	uint32_t unlocked_samples;        /* readings not Locked           */
+	uint32_t reserved6;
+
+	/* version 7: exposure sequences (see Exposure Sequences) */
+	uint64_t exposure_table_offset;   /* 0 when there is no table      */
+	uint64_t exposure_table_count;    /* CaptureFileExposure entries   */
+	uint32_t sequence_steps;          /* 0 without --sequence          */
+	uint32_t sequence_online;         /* 1 if changed while acquiring  */
+
+	/* version 8: readout mode (see Readout Modes) */
+	uint32_t readout_mode;            /* PicamReadoutControlMode       */
+	uint32_t kinetics_window;         /* rows, 0 unless kinetics       */
+	double   frame_rate_predicted;    /* FrameRateCalculation, frames/s */
+	double   frame_rate_achieved;
+
+	/* version 9: per-frame statistics (see Frame Statistics) */
+	uint64_t stats_offset;            /* 0 when there is no table      */
+	uint64_t stats_count;             /* CaptureFileFrameStats entries */
+	uint32_t stats_saturation;        /* value counted as saturated    */
+	uint32_t stats_shift;             /* histogram bin = pixel >> this */
+	uint32_t aborted;                 /* 1 if --abort-if stopped it    */
+	uint32_t reserved9;
+
+	/* version 10: spot centroids (see Spot Centroiding) */
+	uint64_t spot_table_offset;       /* 0 when there is no table      */
+	uint64_t spot_table_count;        /* CaptureFileSpot entries       */
+	uint64_t spot_frames;             /* frames searched               */
+	uint64_t thumbnail_offset;        /* uint16, one per spot, or 0    */
+	uint32_t thumbnail_size;          /* pixels across, 2R+1           */
+	uint32_t spots_only;              /* 1: the frames were not stored */
+	double   spot_threshold;          /* noise sigma                   */
+};
+static_assert( sizeof(CaptureFileHeader) <= CAPTURE_FILE_HEADER_SIZE, "capture file header does not fit" );
+
+// - microseconds since 1970 UTC
+int64_t WallClockMicroseconds()
+{
+	return std::chrono::duration_cast<std::chrono::microseconds>( std::chrono::system_clock::now().time_since_epoch() ).count();
+}
+
+// - a file created at a fixed size and mapped into memory for writing
+struct MappedFile
+{
+	pibyte*	data;
+	pi64s	size;
+#ifdef _WIN32
+	HANDLE	file;
+	HANDLE	mapping;
+#else
+	int		file;
+#endif
+
+	MappedFile() : data(0), size(0)
 	{
-		PrintEnumString(PicamEnumeratedType_Parameter, parameter);
-		std::cout << " is set to: " << CurrentFltVal << std::endl;
+#ifdef _WIN32
+		file = INVALID_HANDLE_VALUE;
+		mapping = 0;
+#else
+		file = -1;
+#endif
 	}
+	~MappedFile() { Close(size); }
 
-	// Display read value
-	pibln readable;
-	std::cout << "Checking if value is readable from hardware: ";
-	error = Picam_CanReadParameter( camera, parameter, &readable );
-	PrintError(error);
-	std::cout << "Readability is: " << readable << std::endl;
-
-	// Display Default Val
-	std::cout << "Reading Default Value: ";
-	error = Picam_GetParameterFloatingPointDefaultValue(camera, parameter, &DefaultFltVal);
-	PrintError(error);
-	if(error == PicamError_None)
+	// - creates (or replaces) the file with room for the whole capture
+	bool Create(const string& path, pi64s bytes)
 	{
-		PrintEnumString(PicamEnumeratedType_Parameter, parameter);
-		std::cout << " default value is: " << DefaultFltVal << std::endl;
+		Close(size);
+#ifdef _WIN32
+		file = CreateFileA( path.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, 0, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, 0 );
+		if( file == INVALID_HANDLE_VALUE )
+			return false;
+		mapping = CreateFileMappingA( file, 0, PAGE_READWRITE, (DWORD)(bytes >> 32), (DWORD)(bytes & 0xFFFFFFFF), 0 );
+		if( mapping )
+			data = static_cast<pibyte*>( MapViewOfFile( mapping, FILE_MAP_WRITE, 0, 0, 0 ) );
+#else
+		file = open( path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644 );
+		if( file < 0 )
+			return false;
+		/* Reserve the blocks now so a full disk fails here, not as a crash mid-run */
+#if defined(__linux__)
+		bool sized = posix_fallocate( file, 0, bytes ) == 0;
+#else
+		bool sized = ftruncate( file, bytes ) == 0;
+#endif
+		if( sized )
+		{
+			void* view = mmap( 0, (size_t)bytes, PROT_READ | PROT_WRITE, MAP_SHARED, file, 0 );
+			data = view == MAP_FAILED ? 0 : static_cast<pibyte*>( view );
+		}
+#endif
+		size = bytes;
+		if( !data )
+		{
+			Close(0);
+			return false;
+		}
+		return true;
 	}
 
+	// - starts writing a finished range to disk without waiting for it
+	void Flush(pi64s offset, pi64s length)
+	{
+		pi64s start = offset / CAPTURE_FILE_PAGE_SIZE * CAPTURE_FILE_PAGE_SIZE;
+#ifdef _WIN32
+		FlushViewOfFile( data + start, (SIZE_T)(offset + length - start) );
+#else
+		msync( data + start, (size_t)(offset + length - start), MS_ASYNC );
+#endif
+	}
 
-	// Get Constraint Types
-	PicamConstraintType ConstraintType;
-	std::cout << "Getting Constraint Type: ";
-	error = Picam_GetParameterConstraintType(camera, parameter, &ConstraintType);
-	PrintError(error);
-	if(error == PicamError_None)
+	// - drops a finished, page aligned range from our working set; the pages
+	//   stay in the file cache until they are written, so nothing is lost
+	void Release(pi64s offset, pi64s length)
 	{
-		std::cout << "Constraint Type is: ";\
-		PrintEnumString(PicamEnumeratedType_ConstraintType, ConstraintType);
-		std::cout << std::endl;
+#ifdef _WIN32
+		VirtualUnlock( data + offset, (SIZE_T)length );
+#else
+		madvise( data + offset, (size_t)length, MADV_DONTNEED );
+#endif
 	}
-	if(ConstraintType == PicamConstraintType_Range)
+
+	// - unmaps, trims the file to finalSize and flushes it all the way to disk
+	bool Close(pi64s finalSize)
 	{
-		const PicamRangeConstraint* RecConstraint;
-		const PicamRangeConstraint* ReqConstraint;
-		std::cout << "Getting Range Constraints: ";
-		// error = Picam_GetParameterRangeConstraint( camera, parameter, PicamConstraintCategory category, const PicamRangeConstraint** constraint );
-		error = Picam_GetParameterRangeConstraint( camera, parameter, PicamConstraintCategory_Required, &ReqConstraint );
-		PrintError(error);
-		error = Picam_GetParameterRangeConstraint( camera, parameter, PicamConstraintCategory_Recommended, &RecConstraint );
-		PrintError(error);
-		std::cout << "Max Possible Val is: " << ReqConstraint-> maximum << std::endl;
-		std::cout << "Min Possible val is: " << ReqConstraint-> minimum << std::endl;
-		std::cout << "Possible Increment is: " << ReqConstraint -> increment << std::endl;
+		bool synced = true;
+#ifdef _WIN32
+		if( data )
+			synced = FlushViewOfFile( data, 0 ) != 0 && UnmapViewOfFile( data ) != 0;
+		if( mapping )
+			CloseHandle( mapping );
+		if( file != INVALID_HANDLE_VALUE )
+		{
+			LARGE_INTEGER end;
+			end.QuadPart = finalSize;
+			if( finalSize < size )
+				synced = SetFilePointerEx( file, end, 0, FILE_BEGIN ) && SetEndOfFile( file ) && synced;
+			synced = FlushFileBuffers( file ) && synced;
+			CloseHandle( file );
+		}
+		mapping = 0;
+		file = INVALID_HANDLE_VALUE;
+#else
+		if( data )
+			synced = munmap( data, (size_t)size ) == 0;
+		if( file >= 0 )
+		{
+			if( finalSize < size )
+				synced = ftruncate( file, finalSize ) == 0 && synced;
+			synced = fsync( file ) == 0 && synced;
+			close( file );
+		}
+		file = -1;
+#endif
+		data = 0;
+		size = 0;
+		return synced;
+	}
+};
 
-		std::cout << "Max Recommended Val is: " << RecConstraint-> maximum << std::endl;
-		std::cout << "Min Recommended val is: " << RecConstraint-> minimum << std::endl;
-		std::cout << "Recommended Increment is: " << RecConstraint -> increment << std::endl;
+// - describes the committed camera state and ROIs in a capture file header
+void FillCaptureHeader(PicamHandle camera, const PicamRois* region, piint readoutstride, CaptureFileHeader& header)
+{
+	memset( &header, 0, sizeof(header) );
+	memcpy( header.magic, CAPTURE_FILE_MAGIC, sizeof(header.magic) );
+	header.version = CAPTURE_FILE_VERSION;
+	header.header_size = CAPTURE_FILE_HEADER_SIZE;
+	header.data_offset = CAPTURE_FILE_HEADER_SIZE;
+	header.readout_stride = readoutstride;
 
-		std::cout << "Destroying range constraints: ";
-		error = Picam_DestroyRangeConstraints(RecConstraint);
-		PrintError(error);
-		error = Picam_DestroyRangeConstraints(ReqConstraint);
-		PrintError(error);
+	piint value = 0;
+	Picam_GetParameterIntegerValue( camera, PicamParameter_FramesPerReadout, &value );
+	header.frames_per_readout = value;
+	Picam_GetParameterIntegerValue( camera, PicamParameter_FrameSize, &value );
+	header.frame_size = value;
+	Picam_GetParameterIntegerValue( camera, PicamParameter_FrameStride, &value );
+	header.frame_stride = value;
+	Picam_GetParameterIntegerValue( camera, PicamParameter_PixelBitDepth, &value );
+	header.pixel_bit_depth = value;
+	Picam_GetParameterIntegerValue( camera, PicamParameter_PixelFormat, &value );
+	header.pixel_format = value;
+	header.bytes_per_pixel = 2;
+
+	Picam_GetParameterFloatingPointValue( camera, PicamParameter_ExposureTime, &header.exposure_time );
+	Picam_GetParameterFloatingPointValue( camera, PicamParameter_ReadoutTimeCalculation, &header.readout_time );
+	Picam_GetParameterFloatingPointValue( camera, PicamParameter_SensorTemperatureSetPoint, &header.sensor_temperature_set_point );
+	Picam_ReadParameterFloatingPointValue( camera, PicamParameter_SensorTemperatureReading, &header.sensor_temperature );
+	Picam_GetParameterFloatingPointValue( camera, PicamParameter_FrameRateCalculation, &header.frame_rate_predicted );
+	Picam_GetParameterIntegerValue( camera, PicamParameter_ReadoutControlMode, &value );
+	header.readout_mode = value;
+	if( value == PicamReadoutControlMode_Kinetics && Picam_GetParameterIntegerValue( camera, PicamParameter_KineticsWindowHeight, &value ) == PicamError_None )
+		header.kinetics_window = value;
+
+	PicamCameraID id;
+	if( Picam_GetCameraID( camera, &id ) == PicamError_None )
+	{
+		header.camera_model = id.model;
+		snprintf( header.serial_number, sizeof(header.serial_number), "%s", id.serial_number );
 	}
-	if(ConstraintType == PicamConstraintType_Collection)
+
+	/* PICAM packs the ROIs one after another inside each frame; in kinetics
+	   a frame is one window, so no taller than that */
+	uint64_t offset = 0;
+	for( piint i = 0; i < region->roi_count && i < CAPTURE_FILE_MAX_ROIS; ++i )
 	{
-		const PicamCollectionConstraint* RecConstraint;
-		const PicamCollectionConstraint* ReqConstraint;
-		std::cout << "Getting Collection Constraints: ";
-		// error = Picam_GetParameterCollectionConstraint( camera, parameter, PicamConstraintCategory_Required, &constraint );
-		error = Picam_GetParameterCollectionConstraint( camera, parameter, PicamConstraintCategory_Required, &ReqConstraint );
-		PrintError(error);
-		error = Picam_GetParameterCollectionConstraint( camera, parameter, PicamConstraintCategory_Recommended, &RecConstraint );
-		PrintError(error);
+		const PicamRoi& roi = region->roi_array[i];
+		CaptureFileRoi& entry = header.rois[i];
+		entry.x = roi.x;
+		entry.width = roi.width;
+		entry.x_binning = roi.x_binning;
+		entry.y = roi.y;
+		entry.height = roi.height;
+		entry.y_binning = roi.y_binning;
+		entry.columns = roi.width / roi.x_binning;
+		entry.rows = ( header.kinetics_window > 0 ? std::min( (uint32_t)roi.height, header.kinetics_window ) : roi.height ) / roi.y_binning;
+		entry.offset = offset;
+		offset += (uint64_t)entry.columns * entry.rows * header.bytes_per_pixel;
+		header.roi_count++;
+	}
+	if( offset != header.frame_size || (uint64_t)header.frame_stride * header.frames_per_readout > header.readout_stride )
+		std::cout << "WARNING: the ROIs take " << offset << " bytes of a " << header.frame_size << " byte frame ("
+		          << header.frames_per_readout << " x " << header.frame_stride << " bytes in a " << header.readout_stride
+		          << " byte readout); frames may not be sliced as the camera lays them out" << std::endl;
+}
 
-		std::cout << "Number of allowable values is: " << ReqConstraint -> values_count << std::endl;
-		std::cout << "Allowable values are: ";
-		piint maxval = ReqConstraint->values_count;
-		int count = 0;
-		for ( count = 0; count <= maxval -1; count++)
-		{	
-			std::cout << ReqConstraint->values_array[count] << " ";
-		}
-		
-		std::cout << std::endl << "Number of recommended values is: " << RecConstraint -> values_count << std::endl;
-		std::cout << "Allowable values are: ";
-		count = 0;
-		for ( count = 0; count <= maxval -1; count++)
-		{	
-			std::cout << RecConstraint->values_array[count] << " ";
-		}
+////////////////////////////////////////////////////////////////////////////////
+// Frame Metadata
+// - with --metadata PICAM stamps each frame with its exposure start and end
+//   time and a frame tracking counter, in the bytes between frame_size and
+//   frame_stride
+// - those are collected into a table of CaptureFileFrame entries written
+//   right after the last readout (header.metadata_offset); the header also
+//   gets a summary of tracking counter gaps and trigger interval statistics
+////////////////////////////////////////////////////////////////////////////////
+#define METADATA_LONG_INTERVAL 1.5	/* x median interval: likely a missed trigger */
+#define METADATA_GAPS_SHOWN    10
 
-		std::cout << std::endl;
-		std::cout << "Destroying collection constraints: ";
-		error = Picam_DestroyCollectionConstraints(RecConstraint);
-		PrintError(error);
-		error = Picam_DestroyCollectionConstraints(ReqConstraint);
-		PrintError(error);
+// - one frame's entry in the metadata table
+struct CaptureFileFrame
+{
+	uint64_t index;                   /* frame number in the file      */
+	int64_t  exposure_start;          /* ticks, -1 if not stamped      */
+	int64_t  exposure_end;            /* ticks, -1 if not stamped      */
+	int64_t  tracking;                /* counter, -1 if not tracked    */
+};
+
+// - turns the time stamps and frame tracking on or off before a commit
+//   (parameters the camera does not have are left alone)
+PicamError SetMetadataParameters(PicamHandle camera, bool enabled)
+{
+	pibln exists = false;
+	PicamError err = Picam_DoesParameterExist( camera, PicamParameter_TimeStamps, &exists );
+	if( err == PicamError_None && exists )
+		err = Picam_SetParameterIntegerValue( camera, PicamParameter_TimeStamps,
+		                                      enabled ? PicamTimeStampsMask_ExposureStarted | PicamTimeStampsMask_ExposureEnded : PicamTimeStampsMask_None );
+	else if( enabled )
+		std::cout << "WARNING: this camera cannot time stamp frames" << std::endl;
+	if( err != PicamError_None )
+		return err;
+
+	exists = false;
+	err = Picam_DoesParameterExist( camera, PicamParameter_TrackFrames, &exists );
+	if( err == PicamError_None && exists )
+		err = Picam_SetParameterIntegerValue( camera, PicamParameter_TrackFrames, enabled );
+	else if( enabled )
+		std::cout << "WARNING: this camera cannot track frames" << std::endl;
+	return err;
+}
+
+// - collects the committed metadata of every frame of a run
+struct FrameMetadataTable
+{
+	piint	framesPerReadout;
+	piint	frameSize;
+	piint	frameStride;
+	piint	startBytes;			/* 0 when not stamped */
+	piint	endBytes;
+	piint	trackingBytes;		/* 0 when not tracked */
+	pi64s	resolution;			/* ticks per second   */
+	vector<CaptureFileFrame> frames;
+
+	// - reads the committed layout; returns false if frames carry no metadata
+	bool Load(PicamHandle camera)
+	{
+		piint stamps = PicamTimeStampsMask_None, track = 0, stampDepth = 0, trackDepth = 0;
+		resolution = 0;
+		Picam_GetParameterIntegerValue( camera, PicamParameter_FramesPerReadout, &framesPerReadout );
+		Picam_GetParameterIntegerValue( camera, PicamParameter_FrameSize, &frameSize );
+		Picam_GetParameterIntegerValue( camera, PicamParameter_FrameStride, &frameStride );
+		Picam_GetParameterIntegerValue( camera, PicamParameter_TimeStamps, &stamps );
+		Picam_GetParameterIntegerValue( camera, PicamParameter_TrackFrames, &track );
+		Picam_GetParameterIntegerValue( camera, PicamParameter_TimeStampBitDepth, &stampDepth );
+		Picam_GetParameterIntegerValue( camera, PicamParameter_FrameTrackingBitDepth, &trackDepth );
+		Picam_GetParameterLargeIntegerValue( camera, PicamParameter_TimeStampResolution, &resolution );
+		startBytes = ( stamps & PicamTimeStampsMask_ExposureStarted ) ? stampDepth / 8 : 0;
+		endBytes = ( stamps & PicamTimeStampsMask_ExposureEnded ) ? stampDepth / 8 : 0;
+		trackingBytes = track ? trackDepth / 8 : 0;
+		return startBytes + endBytes + trackingBytes > 0;
 	}
 
-	
-	// Check if settable
-	std::cout << "Checking if parameter is settable to value: ";
-	pibln settable;
-	error = Picam_CanSetParameterFloatingPointValue( camera, parameter, floatval, &settable);
-	PrintError(error);
-	std::cout << "Settability is: " << settable << std::endl;
-	
+	// - bytes the table takes for a run of readoutCount readouts
+	pi64s TableBytes(pi64s readoutCount) const
+	{
+		return readoutCount * framesPerReadout * (pi64s)sizeof(CaptureFileFrame);
+	}
 
-	// Set Val
-	std::cout << "Setting  ";
-	PrintEnumString(PicamEnumeratedType_Parameter, parameter);
-	std::cout << " to: " << floatval << std::endl;
-	//    std::cout << "Setting " << ExposureTime << " ms exposure time: ";
-    error = 
-        Picam_SetParameterFloatingPointValue(
-            camera,
-            parameter,
-            floatval );
-    PrintError( error );
+	// - pulls the metadata out of each frame of count readouts
+	void Parse(const pibyte* readouts, pi64s count, piint readoutstride)
+	{
+		for( pi64s r = 0; r < count; ++r )
+			for( piint f = 0; f < framesPerReadout; ++f )
+			{
+				const pibyte* meta = readouts + r * readoutstride + f * frameStride + frameSize;
+				CaptureFileFrame frame;
+				frame.index = frames.size();
+				frame.exposure_start = startBytes ? ReadCounter( meta, startBytes ) : -1;
+				meta += startBytes;
+				frame.exposure_end = endBytes ? ReadCounter( meta, endBytes ) : -1;
+				meta += endBytes;
+				frame.tracking = trackingBytes ? ReadCounter( meta, trackingBytes ) : -1;
+				frames.push_back( frame );
+			}
+	}
 
-    // - show that the modified parameters need to be applied to hardware
-    Picam_AreParametersCommitted( camera, &committed );
-    if( committed )
-        std::cout << "Parameters have not changed.  Not going to commit." << std::endl;
-    else
+	// - ms the first frame of a readout was exposed, from its time stamps,
+	//   or -1 if it is not stamped at both ends
+	double MeasuredExposure(const pibyte* readout) const
 	{
-        std::cout << "Parameters have been modified" << std::endl;
+		if( !startBytes || !endBytes || resolution <= 0 )
+			return -1;
+		const pibyte* meta = readout + frameSize;
+		int64_t start = ReadCounter( meta, startBytes );
+		int64_t end = ReadCounter( meta + startBytes, endBytes );
+		return 1000.0 * ( end - start ) / resolution;
+	}
 
-		// - apply the changes to hardware
-		std::cout << "Commit to hardware: ";
-		const PicamParameter* failed_parameters;
-		piint failed_parameters_count;
-		error =
-			Picam_CommitParameters(
-				camera,
-				&failed_parameters,
-				&failed_parameters_count );
-		PrintError( error );
-		if( failed_parameters_count > 0 )
+	// - prints the dropped frame gaps and trigger interval statistics and
+	//   records them in the header
+	void Summarize(CaptureFileHeader& header) const
+	{
+		header.metadata_count = frames.size();
+		header.time_stamp_resolution = resolution;
+		std::cout << "Frame metadata: " << frames.size() << " frames" << std::endl;
+
+		if( trackingBytes )
 		{
-			std::cout << "THE FOLLOWING PARAMETERS ARE INVALID: " << std::endl;
-			for( piint i = 0; i < failed_parameters_count; ++i )
+			pi64s shown = 0;
+			for( size_t i = 1; i < frames.size(); ++i )
 			{
-				std::cout << "FAILED TO COMMIT PARAMETER: ";
-				std::cout << "    ";
-				PrintEnumString(
-					PicamEnumeratedType_Parameter,
-					failed_parameters[i] );
-				std::cout << std::endl;
+				pi64s jump = frames[i].tracking - frames[i - 1].tracking;
+				if( jump <= 1 )
+					continue;
+				header.missing_frames += jump - 1;
+				if( shown++ < METADATA_GAPS_SHOWN )
+					std::cout << "    " << jump - 1 << " frame(s) missing after frame " << i - 1
+					          << " (tracking " << frames[i - 1].tracking << " -> " << frames[i].tracking << ")" << std::endl;
 			}
+			std::cout << "    Missing frames: " << header.missing_frames << std::endl;
 		}
 
-	// Read Val Again
-	std::cout << "Reading value of ";
-	PrintEnumString(PicamEnumeratedType_Parameter, parameter);
-	std::cout << ": ";
-	error = Picam_GetParameterFloatingPointValue(camera, parameter, &CurrentFltVal);
-	PrintError(error);
-	if(error == PicamError_None)
+		if( startBytes && resolution > 0 && frames.size() > 1 )
+		{
+			vector<double> intervals;
+			for( size_t i = 1; i < frames.size(); ++i )
+				intervals.push_back( 1000.0 * ( frames[i].exposure_start - frames[i - 1].exposure_start ) / resolution );
+			double sum = 0, squares = 0;
+			header.trigger_interval_min = header.trigger_interval_max = intervals[0];
+			for( size_t i = 0; i < intervals.size(); ++i )
+			{
+				sum += intervals[i];
+				squares += intervals[i] * intervals[i];
+				header.trigger_interval_min = std::min( header.trigger_interval_min, intervals[i] );
+				header.trigger_interval_max = std::max( header.trigger_interval_max, intervals[i] );
+			}
+			header.trigger_interval_mean = sum / intervals.size();
+			header.trigger_interval_std = sqrt( std::max( 0.0, squares / intervals.size() - header.trigger_interval_mean * header.trigger_interval_mean ) );
+
+			/* Much longer than usual means a trigger (or more) went by unused */
+			vector<double> sorted( intervals );
+			std::nth_element( sorted.begin(), sorted.begin() + sorted.size() / 2, sorted.end() );
+			double median = sorted[sorted.size() / 2];
+			for( size_t i = 0; i < intervals.size(); ++i )
+				if( intervals[i] > METADATA_LONG_INTERVAL * median )
+					header.long_intervals++;
+
+			std::cout << "    Exposure start interval: mean " << header.trigger_interval_mean << " ms, std "
+			          << header.trigger_interval_std << " ms, min " << header.trigger_interval_min << " ms, max "
+			          << header.trigger_interval_max << " ms" << std::endl;
+			std::cout << "    Intervals over " << METADATA_LONG_INTERVAL << "x the median (" << median << " ms): "
+			          << header.long_intervals << std::endl;
+		}
+	}
+
+private:
+	// - little-endian counter of the given width
+	static int64_t ReadCounter(const pibyte* bytes, piint count)
 	{
-		PrintEnumString(PicamEnumeratedType_Parameter, parameter);
-		std::cout << " is set to: " << CurrentFltVal << std::endl;
+		uint64_t value = 0;
+		for( piint i = count - 1; i >= 0; --i )
+			value = ( value << 8 ) | bytes[i];
+		return (int64_t)value;
 	}
+};
 
+// - atomically replaces the file at "to" with the finished file at "from"
+bool RenameIntoPlace(const string& from, const string& to)
+{
+#ifdef _WIN32
+	return MoveFileExA( from.c_str(), to.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH ) != 0;
+#else
+	if( rename( from.c_str(), to.c_str() ) != 0 )
+		return false;
+	/* Make the new directory entry itself durable */
+	size_t slash = to.find_last_of('/');
+	string directory = slash == string::npos ? "." : to.substr(0, slash + 1);
+	int handle = open( directory.c_str(), O_RDONLY );
+	if( handle >= 0 )
+	{
+		fsync( handle );
+		close( handle );
 	}
+	return true;
+#endif
+}
 
-	std::cout << std::endl;
+// - seeks past 2 GB on either platform
+int FileSeek(FILE* pFile, pi64s offset)
+{
+#ifdef _WIN32
+	return _fseeki64( pFile, offset, SEEK_SET );
+#else
+	return fseeko( pFile, (off_t)offset, SEEK_SET );
+#endif
 }
 
-void SetIntParameter(PicamHandle camera, PicamParameter parameter, piint intval)
+////////////////////////////////////////////////////////////////////////////////
+// Completion Notification
+// - the capture is written as <file>.partial and renamed to <file> only once
+//   it is complete and flushed, so a file under its final name is never torn
+// - <file>.status is rewritten (atomically) as the capture progresses:
+//     state=starting|running|done|failed
+//     readouts=<in file>
+//     total=<requested>
+//     result=<CaptureResult, once finished>
+//     message=<text>
+// - with --notify=PORT the same events go as lines to a listener on
+//   127.0.0.1:PORT: "PROGRESS readouts total", then "DONE <file>" or
+//   "FAILED <result> <message>"
+////////////////////////////////////////////////////////////////////////////////
+#define CAPTURE_PROGRESS_INTERVAL 250	/* ms between progress reports */
+
+// - describes how a capture ended
+string CaptureResultString(CaptureResult result)
 {
-	PicamError error;
-	pibln committed;
-	std::cout << "= = = = = = = = = " << std::endl;
-	// Display Current Val
-	piint CurrentIntVal;
-	std::cout << "Reading value of ";
-	PrintEnumString(PicamEnumeratedType_Parameter, parameter);
-	std::cout << ": ";
-	error = Picam_GetParameterIntegerValue(camera, parameter, &CurrentIntVal);
-	PrintError(error);
-	if(error == PicamError_None)
+	switch( result )
 	{
-		PrintEnumString(PicamEnumeratedType_Parameter, parameter);
-		std::cout << " is set to: " << CurrentIntVal << std::endl;
+	case CaptureResult_Saved:        return "saved";
+	case CaptureResult_BadArguments: return "invalid arguments";
+	case CaptureResult_InvalidRoi:   return "invalid ROI";
+	case CaptureResult_CameraError:  return "camera error";
+	case CaptureResult_FileError:    return "could not write file";
+	case CaptureResult_Incomplete:   return "acquisition incomplete";
+	case CaptureResult_TestFailed:   return "test failed";
+	case CaptureResult_BadCalibration: return "dark or flat frame does not fit the capture";
+	case CaptureResult_NotLocked:    return "sensor temperature did not lock";
+	case CaptureResult_Aborted:      return "stopped by the --abort-if rule";
+	case CaptureResult_TestSkipped:  return "test skipped, the host sets the limit";
 	}
+	return "unknown";
+}
 
-	// Display read value
-	pibln readable;
-	std::cout << "Checking if value is readable from hardware: ";
-	error = Picam_CanReadParameter( camera, parameter, &readable );
-	PrintError(error);
-	std::cout << "Readability is: " << readable << std::endl;
+// - holds every camera of a run back until all of them are armed, so they
+//   all start on the same trigger
+struct StartGate
+{
+	std::mutex				lock;
+	std::condition_variable	ready;
+	size_t					expected;
+	size_t					arrived;
+	std::chrono::steady_clock::time_point	released;
 
-	// Display Default Val
-	piint DefaultIntVal;
-	std::cout << "Reading Default Value: ";
-	error = Picam_GetParameterIntegerDefaultValue(camera, parameter, &DefaultIntVal);
-	PrintError(error);
-	if(error == PicamError_None)
+	StartGate(size_t cameras) : expected(cameras), arrived(0), released(std::chrono::steady_clock::now()) {}
+
+	// - waits until every camera still in the run has arrived
+	void Arrive()
 	{
-		PrintEnumString(PicamEnumeratedType_Parameter, parameter);
-		std::cout << " default value is: " << DefaultIntVal << std::endl;
+		std::unique_lock<std::mutex> guard( lock );
+		++arrived;
+		if( arrived >= expected )
+		{
+			released = std::chrono::steady_clock::now();
+			ready.notify_all();
+		}
+		else
+			ready.wait( guard, [this] { return arrived >= expected; } );
 	}
 
-	// Get Constraint Types
-	PicamConstraintType ConstraintType;
-	std::cout << "Getting Constraint Type: ";
-	error = Picam_GetParameterConstraintType(camera, parameter, &ConstraintType);
-	PrintError(error);
-	if(error == PicamError_None)
+	// - a camera that failed before arming stops the others waiting for it
+	void Withdraw()
 	{
-		std::cout << "Constraint Type is: ";\
-		PrintEnumString(PicamEnumeratedType_ConstraintType, ConstraintType);
-		std::cout << std::endl;
+		std::lock_guard<std::mutex> guard( lock );
+		--expected;
+		if( arrived > 0 && arrived >= expected )
+		{
+			released = std::chrono::steady_clock::now();
+			ready.notify_all();
+		}
 	}
-	if(ConstraintType == PicamConstraintType_Range)
+};
+
+// - reports a capture's progress and outcome to whoever is waiting on it
+struct CaptureProgress
+{
+	string	FilePath;
+	string	Detail;			/* first PICAM error, if any */
+	pi64s	Total;
+	std::atomic<pi64s>	Readouts;	/* in the file so far        */
+	StartGate*	Gate;		/* other cameras of the run  */
+	bool	Armed;
+	SOCKET	Notify;
+	std::chrono::steady_clock::time_point	lastReport;
+
+	CaptureProgress() : Total(0), Readouts(0), Gate(0), Armed(false), Notify(INVALID_SOCKET) {}
+	~CaptureProgress()
 	{
-		const PicamRangeConstraint* ReqConstraint;
-		const PicamRangeConstraint* RecConstraint;;
-		std::cout << "Getting Range Constraints: ";
-		// error = Picam_GetParameterRangeConstraint( camera, parameter, PicamConstraintCategory category, const PicamRangeConstraint** constraint );
-		error = Picam_GetParameterRangeConstraint( camera, parameter, PicamConstraintCategory_Required, &ReqConstraint );
-		PrintError(error);
-		error = Picam_GetParameterRangeConstraint( camera, parameter, PicamConstraintCategory_Recommended, &RecConstraint );
-		std::cout << "Max Allowable Val is: " << ReqConstraint-> maximum << std::endl;
-		std::cout << "Min Allowable val is: " << ReqConstraint-> minimum << std::endl;
-		std::cout << "Allowable Increment is: " << ReqConstraint -> increment << std::endl;
-		std::cout << "Max Recommended Val is: " << RecConstraint-> maximum << std::endl;
-		std::cout << "Min Recommended val is: " << RecConstraint-> minimum << std::endl;
-		std::cout << "Recommended Increment is: " << RecConstraint -> increment << std::endl;
+		if( Notify != INVALID_SOCKET )
+		{
+			closesocket( Notify );
+#ifdef _WIN32
+			WSACleanup();
+#endif
+		}
+	}
 
-		std::cout << "Destroying range constraints: ";
-		error = Picam_DestroyRangeConstraints(RecConstraint);
-		PrintError(error);
-		error = Picam_DestroyRangeConstraints(ReqConstraint);
-		PrintError(error);
+	// - connects to the listener on notifyPort (if not 0) and reports the start
+	void Begin(const string& path, pi64s total, piint notifyPort)
+	{
+		FilePath = path;
+		Total = total;
+		if( notifyPort > 0 )
+		{
+#ifdef _WIN32
+			WSADATA wsaData;
+			WSAStartup(MAKEWORD(2, 2), &wsaData);
+#endif
+			sockaddr_in address;
+			memset(&address, 0, sizeof(address));
+			address.sin_family = AF_INET;
+			address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+			address.sin_port = htons((unsigned short)notifyPort);
+			Notify = socket(AF_INET, SOCK_STREAM, 0);
+			if( Notify != INVALID_SOCKET && connect(Notify, (sockaddr*)&address, sizeof(address)) != 0 )
+			{
+				closesocket( Notify );
+				Notify = INVALID_SOCKET;
+			}
+			if( Notify == INVALID_SOCKET )
+			{
+				std::cout << "WARNING: nobody is listening on notify port " << notifyPort << std::endl;
+#ifdef _WIN32
+				WSACleanup();
+#endif
+			}
+		}
+		Report("starting", 0, -1, "");
 	}
-	if(ConstraintType == PicamConstraintType_Collection)
+
+	// - reports the readouts so far, at most every CAPTURE_PROGRESS_INTERVAL ms
+	//   unless forced
+	void Update(pi64s readouts, bool force = false)
 	{
-		const PicamCollectionConstraint* ReqConstraint;
-		const PicamCollectionConstraint* RecConstraint;
-		std::cout << "Getting Collection Constraints: ";
-		// error = Picam_GetParameterCollectionConstraint( camera, parameter, PicamConstraintCategory_Required, &constraint );
-		error = Picam_GetParameterCollectionConstraint( camera, parameter, PicamConstraintCategory_Required, &ReqConstraint );
-		PrintError(error);
-		error = Picam_GetParameterCollectionConstraint( camera, parameter, PicamConstraintCategory_Recommended, &RecConstraint );
-		PrintError(error);
-		std::cout << "Number of permissible values is: " << ReqConstraint -> values_count << std::endl;
-		std::cout << "Permissible values are: ";
-		piint maxval = ReqConstraint->values_count;
-		int count = 0;
-		for ( count = 0; count <= maxval -1; count++)
-		{	
-			std::cout << ReqConstraint->values_array[count] << " ";
+		Readouts = readouts;
+		std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+		if( !force && now - lastReport < std::chrono::milliseconds(CAPTURE_PROGRESS_INTERVAL) )
+			return;
+		lastReport = now;
+		Report("running", readouts, -1, "");
+		Send("PROGRESS " + std::to_string(readouts) + " " + std::to_string(Total));
+	}
+
+	// - called just before the acquisition starts; waits for the rest of a
+	//   multi-camera run
+	void Arm()
+	{
+		if( Gate && !Armed )
+			Gate->Arrive();
+		Armed = true;
+	}
+
+	// - reports the outcome
+	void Finish(CaptureResult result)
+	{
+		if( Gate && !Armed )
+			Gate->Withdraw();
+		Armed = true;
+
+		string message = CaptureResultString(result);
+		if( !Detail.empty() )
+			message += " (" + Detail + ")";
+		if( result == CaptureResult_Saved )
+		{
+			Report("done", Readouts, result, message);
+			Send("DONE " + FilePath);
 		}
-		std::cout << std::endl;
-		std::cout << "Number of recommended values is: " << RecConstraint -> values_count << std::endl;
-		std::cout << "Recommended values are: ";
-		maxval = RecConstraint -> values_count;
-		count = 0;
-		for ( count = 0; count <= maxval - 1; count++)
+		else
 		{
-			std::cout << RecConstraint -> values_array[count] << " ";
+			Report("failed", Readouts, result, message);
+			Send("FAILED " + std::to_string((int)result) + " " + message);
 		}
+	}
 
-		std::cout << std::endl;
-		std::cout << "Destroying collection constraints: ";
-		error = Picam_DestroyCollectionConstraints(RecConstraint);
-		PrintError(error);
-		error = Picam_DestroyCollectionConstraints(ReqConstraint);
-		PrintError(error);
+	// - records the first PICAM error for the final report
+	void Failed(const string& step, PicamError error)
+	{
+		if( !Detail.empty() || error == PicamError_None )
+			return;
+		const pichar* string;
+		Picam_GetEnumerationString( PicamEnumeratedType_Error, error, &string );
+		Detail = step + ": " + string;
+		Picam_DestroyString( string );
 	}
 
-	// Check if settable
-	std::cout << "Checking if parameter is settable to value: ";
-	pibln settable;
-	error = Picam_CanSetParameterIntegerValue( camera, parameter, intval, &settable);
-	PrintError(error);
-	std::cout << "Settability is: " << settable << std::endl;
+private:
+	void Send(const string& line)
+	{
+		if( Notify == INVALID_SOCKET )
+			return;
+		string text = line + "\n";
+		if( send(Notify, text.c_str(), (int)text.size(), 0) != (int)text.size() )
+		{
+			closesocket( Notify );
+			Notify = INVALID_SOCKET;
+		}
+	}
 
-	// Set Parameter
-	std::cout << "Setting Parameter: ";
-	PrintEnumString(PicamEnumeratedType_Parameter, parameter);
-	std::cout << " to: " << intval << std::endl;
-	//    std::cout << "Setting " << ExposureTime << " ms exposure time: ";
-    error = 
-		Picam_SetParameterIntegerValue(
-            camera,
-            parameter,
-            intval );
-    PrintError( error );
+	void Report(const char* state, pi64s readouts, int result, const string& message)
+	{
+		if( FilePath.empty() )
+			return;
+		string statusPath = FilePath + ".status";
+		string temporary = statusPath + ".tmp";
+		FILE* pFile = fopen( temporary.c_str(), "w" );
+		if( !pFile )
+			return;
+		fprintf( pFile, "state=%s\nreadouts=%lld\ntotal=%lld\n", state, (long long)readouts, (long long)Total );
+		if( result >= 0 )
+			fprintf( pFile, "result=%d\n", result );
+		fprintf( pFile, "message=%s\n", message.c_str() );
+		fclose( pFile );
+		RenameIntoPlace( temporary, statusPath );
+	}
+};
 
-    // - show that the modified parameters need to be applied to hardware
-    Picam_AreParametersCommitted( camera, &committed );
-    if( committed )
-        std::cout << "Parameters have not changed.  Not going to commit." << std::endl;
-    else
+////////////////////////////////////////////////////////////////////////////////
+// Temperature Telemetry
+// - --telemetry[=MS] reads the sensor temperature and its lock status every
+//   MS ms (default 1000) on a thread of its own for the whole acquisition;
+//   the acquisition thread never waits for it
+// - the readings go into a table of CaptureFileTemperature entries at the
+//   end of the file (header.telemetry_offset), each with the number of
+//   camera readouts acquired by then, and the header gets the range seen
+// - --wait-for-lock[=SECONDS] holds the acquisition back until the sensor
+//   reports Locked, for at most SECONDS (default 600), instead of the user
+//   waiting a fixed time before starting a run
+////////////////////////////////////////////////////////////////////////////////
+#define TELEMETRY_INTERVAL     1000		/* ms between readings             */
+#define TELEMETRY_MARGIN       60000	/* ms of readings kept past the estimated run */
+#define TELEMETRY_MAX_SAMPLES  (1 << 20)
+#define LOCK_WAIT_TIMEOUT      600		/* s for --wait-for-lock           */
+#define LOCK_WAIT_REPORT       5000		/* ms between reports while waiting */
+
+// - one reading in the telemetry table
+struct CaptureFileTemperature
+{
+	int64_t  time;                    /* microseconds since 1970 UTC   */
+	uint64_t readouts;                /* camera readouts acquired by then */
+	double   temperature;             /* degrees C                     */
+	uint32_t status;                  /* PicamSensorTemperatureStatus  */
+	uint32_t reserved;
+};
+
+// - reads the sensor temperature and status from the hardware
+bool ReadSensorTemperature(PicamHandle camera, CaptureFileTemperature& sample)
+{
+	piint status = PicamSensorTemperatureStatus_Unlocked;
+	memset( &sample, 0, sizeof(sample) );
+	sample.time = WallClockMicroseconds();
+	bool ok = Picam_ReadParameterFloatingPointValue( camera, PicamParameter_SensorTemperatureReading, &sample.temperature ) == PicamError_None &&
+	          Picam_ReadParameterIntegerValue( camera, PicamParameter_SensorTemperatureStatus, &status ) == PicamError_None;
+	sample.status = (uint32_t)status;
+	return ok;
+}
+
+// - holds the acquisition back until the sensor temperature locks
+// - returns false if it did not within timeout seconds
+bool WaitForTemperatureLock(PicamHandle camera, piint timeout, CaptureProgress& progress)
+{
+	std::chrono::steady_clock::time_point started = std::chrono::steady_clock::now();
+	std::chrono::steady_clock::time_point reported = started - std::chrono::milliseconds(LOCK_WAIT_REPORT);
+	piflt setPoint = 0;
+	Picam_GetParameterFloatingPointValue( camera, PicamParameter_SensorTemperatureSetPoint, &setPoint );
+	while( true )
 	{
-        std::cout << "Parameters have been modified." << std::endl;
+		CaptureFileTemperature sample;
+		if( !ReadSensorTemperature( camera, sample ) )
+		{
+			std::cout << "FAILED TO READ THE SENSOR TEMPERATURE" << std::endl;
+			progress.Detail = "could not read the sensor temperature";
+			return false;
+		}
+		std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+		double seconds = std::chrono::duration<double>( now - started ).count();
+		if( sample.status == PicamSensorTemperatureStatus_Locked )
+		{
+			std::cout << "Sensor temperature locked at " << sample.temperature << " degrees C after " << seconds << " s" << std::endl;
+			return true;
+		}
+		if( seconds >= timeout )
+		{
+			std::cout << "ERROR: the sensor temperature did not lock within " << timeout << " s (" << sample.temperature
+			          << " degrees C, set point " << setPoint << ")" << std::endl;
+			char detail[64];
+			snprintf( detail, sizeof(detail), "%.2f C against a set point of %.2f C", sample.temperature, setPoint );
+			progress.Detail = detail;
+			return false;
+		}
+		if( now - reported >= std::chrono::milliseconds(LOCK_WAIT_REPORT) )
+		{
+			std::cout << "Waiting for the sensor temperature to lock: " << sample.temperature << " degrees C, set point " << setPoint << std::endl;
+			reported = now;
+		}
+		progress.Update( 0 );
+		std::this_thread::sleep_for( std::chrono::milliseconds(100) );
+	}
+}
 
-		// - apply the changes to hardware
-		std::cout << "Commit to hardware: ";
-		const PicamParameter* failed_parameters;
-		piint failed_parameters_count;
-		error =
-			Picam_CommitParameters(
-				camera,
-				&failed_parameters,
-				&failed_parameters_count );
-		PrintError( error );
-		if( failed_parameters_count > 0 )
+// - the telemetry thread and the readings it took
+struct TemperatureMonitor
+{
+	PicamHandle		camera;
+	CaptureProgress*	progress;
+	piint			interval;	/* ms */
+	vector<CaptureFileTemperature>	samples;	/* reserved up front */
+	size_t			capacity;
+	pi64s			skipped;	/* readings that did not fit or failed */
+	std::thread		thread;
+	std::mutex		lock;
+	std::condition_variable	wake;
+	bool			stopping;
+
+	TemperatureMonitor() : camera(0), progress(0), interval(TELEMETRY_INTERVAL), capacity(0), skipped(0), stopping(false) {}
+	~TemperatureMonitor() { Stop(); }
+
+	// - room for the readings of a run expected to take milliseconds ms
+	static size_t Capacity(piint interval, double milliseconds)
+	{
+		double samples = ( 2 * milliseconds + TELEMETRY_MARGIN ) / std::max( interval, 1 ) + 1;
+		return (size_t)std::min( samples, (double)TELEMETRY_MAX_SAMPLES );
+	}
+
+	void Start(PicamHandle handle, piint ms, size_t room, CaptureProgress& report)
+	{
+		camera = handle;
+		interval = std::max( ms, 1 );
+		capacity = room;
+		progress = &report;
+		samples.reserve( capacity );
+		stopping = false;
+		thread = std::thread( &TemperatureMonitor::Run, this );
+		std::cout << "Reading the sensor temperature every " << interval << " ms" << std::endl;
+	}
+
+	void Stop()
+	{
+		if( !thread.joinable() )
+			return;
+		{
+			std::lock_guard<std::mutex> guard( lock );
+			stopping = true;
+		}
+		wake.notify_all();
+		thread.join();
+	}
+
+	// - the range of readings and how many were not Locked
+	void Summarize(CaptureFileHeader& header) const
+	{
+		header.telemetry_interval = interval;
+		header.unlocked_samples = 0;
+		for( size_t i = 0; i < samples.size(); ++i )
+		{
+			const CaptureFileTemperature& sample = samples[i];
+			header.sensor_temperature_min = i == 0 ? sample.temperature : std::min( header.sensor_temperature_min, sample.temperature );
+			header.sensor_temperature_max = i == 0 ? sample.temperature : std::max( header.sensor_temperature_max, sample.temperature );
+			if( sample.status != PicamSensorTemperatureStatus_Locked )
+				header.unlocked_samples++;
+		}
+	}
+
+	void PrintReport(const CaptureFileHeader& header) const
+	{
+		if( samples.empty() )
+			return;
+		std::cout << "Sensor temperature during the run: " << header.sensor_temperature_min << " to " << header.sensor_temperature_max
+		          << " degrees C over " << samples.size() << " readings" << std::endl;
+		if( header.unlocked_samples > 0 )
+			std::cout << "WARNING: the sensor temperature was not locked for " << header.unlocked_samples << " of " << samples.size() << " readings" << std::endl;
+		if( skipped > 0 )
+			std::cout << "WARNING: " << skipped << " temperature readings failed or did not fit the table" << std::endl;
+	}
+
+private:
+	void Run()
+	{
+		std::unique_lock<std::mutex> guard( lock );
+		while( !stopping )
+		{
+			guard.unlock();
+			CaptureFileTemperature sample;
+			bool ok = ReadSensorTemperature( camera, sample );
+			sample.readouts = (uint64_t)progress->Readouts.load();
+			/* samples never grows past what was reserved, so it never moves */
+			if( ok && samples.size() < capacity )
+				samples.push_back( sample );
+			else
+				skipped++;
+			guard.lock();
+			wake.wait_for( guard, std::chrono::milliseconds(interval), [this] { return stopping; } );
+		}
+	}
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// Exposure Sequences
+// - --sequence=ms:N,ms:N,... takes N readouts at each exposure time in turn,
+//   in one acquisition and one file, e.g. a bracketed HDR series
+// - where the camera takes ExposureTime online (Picam_CanSetParameterOnline)
+//   each step is set while the acquisition keeps running, once the readouts
+//   of the step before are all in; otherwise the acquisition stops after
+//   each step and is started again with the next exposure committed
+// - the camera is always a readout or so ahead of what has arrived, so after
+//   an online change a readout or two still arrive at the old exposure.
+//   They are recognised by their time stamps and left out, and the camera
+//   keeps acquiring until every step has its readouts
+// - every frame is tagged with the exposure it was measured to have (or, if
+//   the camera cannot stamp, the one it should have had) in a table of
+//   CaptureFileExposure entries (header.exposure_table_offset)
+// - --sequence-test runs the online bookkeeping against a made up camera
+////////////////////////////////////////////////////////////////////////////////
+#define SEQUENCE_LEAD_READOUTS 1	/* readouts a camera without time stamps is taken to be ahead of us */
+#define SEQUENCE_LATE_READOUTS 16	/* readouts a change may take to show before the run gives up */
+
+// - one frame's entry in the exposure table
+struct CaptureFileExposure
+{
+	uint64_t frame;                   /* frame number in the file      */
+	double   exposure;                /* ms the frame was exposed      */
+	double   requested;               /* ms of its step                */
+	uint32_t step;                    /* from 0                        */
+	uint32_t measured;                /* 1 from the time stamps, 0 assumed */
+};
+
+// - parses ms:N,ms:N,...
+bool ParseSequence(const string& text, vector<ExposureStep>& steps)
+{
+	steps.clear();
+	std::istringstream items(text);
+	string item;
+	while( std::getline(items, item, ',') )
+	{
+		ExposureStep step;
+		size_t colon = item.find(':');
+		if( colon == string::npos )
+			return false;
+		step.exposure = ::atof(item.substr(0, colon).c_str());
+		step.readouts = atoll(item.substr(colon + 1).c_str());
+		if( step.exposure < 0 || step.readouts <= 0 )
+			return false;
+		steps.push_back(step);
+	}
+	return !steps.empty();
+}
+
+// - a sequence sets the exposure and length of the run, and needs the frames
+//   time stamped to tell which exposure each got.  Returns false if the
+//   other options rule it out
+bool ApplySequence(CaptureOptions& options, piflt& dt, int& NFrames)
+{
+	if( options.Sequence.empty() )
+		return true;
+	if( !options.DarkFile.empty() || options.CoaddCount > 0 )
+	{
+		std::cout << "ERROR: --sequence changes the exposure, which --dark and --coadd need to stay the same" << std::endl;
+		return false;
+	}
+	pi64s total = 0;
+	for( size_t i = 0; i < options.Sequence.size(); ++i )
+		total += options.Sequence[i].readouts;
+	if( total != NFrames || dt != options.Sequence[0].exposure )
+		std::cout << "Exposure sequence of " << options.Sequence.size() << " steps: " << total << " readouts, starting at "
+		          << options.Sequence[0].exposure << " ms (in place of the " << NFrames << " readouts at " << dt << " ms given)" << std::endl;
+	dt = options.Sequence[0].exposure;
+	NFrames = (int)total;
+	options.Metadata = true;
+	return true;
+}
+
+// - steps through a sequence during AcquireToFile and tags the frames after
+struct ExposureSequencer
+{
+	vector<ExposureStep>	steps;
+	vector<pi64s>	first;		/* offline: readout each step starts at */
+	vector<pi64s>	applied;	/* readouts in when it was set          */
+	vector<pi64s>	kept;		/* online: readouts stored of each step */
+	vector<uint32_t>	stepOf;	/* online: step of each stored readout  */
+	size_t			next;		/* step to set next                     */
+	size_t			current;	/* online: step being stored            */
+	pi64s			received;	/* online: readouts the camera delivered */
+	pi64s			skipped;	/* online: of those, left out           */
+	bool			online;
+	vector<CaptureFileExposure>	tags;
+
+	ExposureSequencer() : next(0), current(0), received(0), skipped(0), online(false) {}
+
+	bool Active() const { return !steps.empty(); }
+
+	// - starts the bookkeeping of a sequence
+	void Begin(const vector<ExposureStep>& sequence, bool changeOnline)
+	{
+		steps = sequence;
+		online = changeOnline;
+		first.assign( steps.size(), 0 );
+		applied.assign( steps.size(), -1 );
+		kept.assign( steps.size(), 0 );
+		stepOf.clear();
+		for( size_t i = 1; i < steps.size(); ++i )
+			first[i] = first[i - 1] + steps[i - 1].readouts;
+		/* Online, the configured exposure is the first step */
+		next = online ? 1 : 0;
+		applied[0] = online ? 0 : -1;
+		current = 0;
+		received = skipped = 0;
+	}
+
+	// - finds out how the camera changes exposure; online it then acquires
+	//   until it is stopped, to make up for the readouts left out
+	PicamError Setup(PicamHandle camera, const CaptureOptions& options)
+	{
+		if( options.Sequence.empty() )
+			return PicamError_None;
+		pibln onlineable = false;
+		Begin( options.Sequence, Picam_CanSetParameterOnline( camera, PicamParameter_ExposureTime, &onlineable ) == PicamError_None && onlineable );
+		std::cout << "Exposure sequence of " << steps.size() << " steps, "
+		          << ( online ? "changed online while acquiring" : "the acquisition restarted for each (the camera cannot change exposure online)" ) << std::endl;
+		if( !online )
+			return PicamError_None;
+		PicamError err = Picam_SetParameterLargeIntegerValue( camera, PicamParameter_ReadoutCount, 0 );
+		if( err == PicamError_None )
+		{
+			const PicamParameter* failed;
+			piint failedCount;
+			err = Picam_CommitParameters( camera, &failed, &failedCount );
+			Picam_DestroyParameters( failed );
+		}
+		return err;
+	}
+
+	// - online: whether to store the readout that just arrived, given the
+	//   exposure measured from its time stamps (-1 if it has none)
+	bool Keep(double measured)
+	{
+		pi64s readout = received++;
+		if( next == current + 2 )	/* the step after this one is set */
+		{
+			double now = steps[current].exposure, after = steps[current + 1].exposure;
+			bool changed;
+			if( measured >= 0 && now != after )
+				changed = fabs( measured - after ) < fabs( measured - now );
+			else
+				changed = readout >= applied[current + 1] + SEQUENCE_LEAD_READOUTS;
+			if( changed )
+				current++;
+		}
+		if( kept[current] >= steps[current].readouts )
+		{
+			skipped++;
+			return false;
+		}
+		kept[current]++;
+		stepOf.push_back( (uint32_t)current );
+		return true;
+	}
+
+	// - online: whether the next step is to be set now
+	bool Ready() const
+	{
+		return online && next == current + 1 && next < steps.size() && kept[current] >= steps[current].readouts;
+	}
+
+	// - online: notes that the next step was set
+	void Applied()
+	{
+		applied[next++] = received;
+	}
+
+	// - online: sets the next step once the readouts of this one are all in
+	PicamError Advance(PicamHandle camera)
+	{
+		if( !Ready() )
+			return PicamError_None;
+		PicamError err = Picam_SetParameterFloatingPointValueOnline( camera, PicamParameter_ExposureTime, steps[next].exposure );
+		if( err == PicamError_None )
+			Applied();
+		return err;
+	}
+
+	// - online: whether every step has its readouts
+	bool Done() const
+	{
+		return current + 1 == steps.size() && kept[current] >= steps[current].readouts;
+	}
+
+	// - online: whether the last change has still not shown
+	bool Stalled() const
+	{
+		return next == current + 2 && received - applied[current + 1] > SEQUENCE_LATE_READOUTS;
+	}
+
+	// - offline: whether the next step is to be started now
+	bool Due(pi64s written) const
+	{
+		return !online && next < steps.size() && written == first[next];
+	}
+
+	// - offline: commits the next step's exposure and readout count
+	PicamError Commit(PicamHandle camera, pi64s written)
+	{
+		PicamError err = Picam_SetParameterFloatingPointValue( camera, PicamParameter_ExposureTime, steps[next].exposure );
+		if( err == PicamError_None )
+			err = Picam_SetParameterLargeIntegerValue( camera, PicamParameter_ReadoutCount, steps[next].readouts );
+		if( err == PicamError_None )
+		{
+			const PicamParameter* failed;
+			piint failedCount;
+			err = Picam_CommitParameters( camera, &failed, &failedCount );
+			Picam_DestroyParameters( failed );
+		}
+		if( err == PicamError_None )
+			applied[next++] = written;
+		return err;
+	}
+
+	// - the step stored readout r belongs to
+	size_t StepOf(pi64s r) const
+	{
+		if( online )
+			return r < (pi64s)stepOf.size() ? stepOf[r] : current;
+		size_t step = 0;
+		for( size_t s = 1; s < steps.size(); ++s )
+			if( applied[s] >= 0 && r >= applied[s] )
+				step = s;
+		return step;
+	}
+
+	// - tags every frame of the readouts taken with its step and the
+	//   exposure it got, from the time stamps where there are both
+	void Tag(const FrameMetadataTable& metadata, pi64s readouts, piint framesPerReadout)
+	{
+		tags.clear();
+		vector<pi64s> counts( steps.size(), 0 );
+		pi64s measured = 0;
+		for( pi64s i = 0; i < readouts * framesPerReadout; ++i )
+		{
+			CaptureFileExposure tag;
+			memset( &tag, 0, sizeof(tag) );
+			tag.frame = i;
+			size_t step = StepOf( i / framesPerReadout );
+			if( metadata.resolution > 0 && i < (pi64s)metadata.frames.size() &&
+			    metadata.frames[i].exposure_start >= 0 && metadata.frames[i].exposure_end >= 0 )
+			{
+				tag.exposure = 1000.0 * ( metadata.frames[i].exposure_end - metadata.frames[i].exposure_start ) / metadata.resolution;
+				tag.measured = 1;
+				measured++;
+			}
+			else
+				tag.exposure = steps[step].exposure;
+			tag.step = (uint32_t)step;
+			tag.requested = steps[step].exposure;
+			counts[step]++;
+			tags.push_back( tag );
+		}
+
+		std::cout << "Exposure sequence: " << ( measured == (pi64s)tags.size() ? "every frame's exposure measured from its time stamps" :
+		                                        measured > 0 ? "exposures partly measured from time stamps, partly assumed" :
+		                                                       "exposures assumed (the camera does not time stamp exposure start and end)" ) << std::endl;
+		for( size_t s = 0; s < steps.size(); ++s )
+			std::cout << "    Step " << s + 1 << ": " << steps[s].exposure << " ms, " << counts[s] << " frames (" << steps[s].readouts * framesPerReadout << " asked for)" << std::endl;
+		if( skipped > 0 )
+			std::cout << "    " << skipped << " readouts that arrived at the exposure of a finished step were left out" << std::endl;
+	}
+};
+
+// - runs the online bookkeeping against a made up camera that shows each
+//   change lag readouts after it was set, with and without time stamps, and
+//   checks that every step gets its readouts at its own exposure
+int SequenceTest()
+{
+	ExposureStep given[][3] = { { { 1, 5 }, { 10, 5 }, { 100, 5 } },
+	                            { { 20, 3 }, { 20, 2 }, { 5, 4 } } };
+	bool passed = true;
+	for( int g = 0; g < 2; ++g )
+	for( int stamped = 0; stamped < 2; ++stamped )
+	for( pi64s lag = 0; lag <= 3; ++lag )
+	for( pi64s burst = 1; burst <= 4; burst *= 4 )
+	{
+		/* Without time stamps only the lag it assumes comes out right */
+		if( !stamped && lag != SEQUENCE_LEAD_READOUTS )
+			continue;
+		vector<ExposureStep> steps( given[g], given[g] + 3 );
+		ExposureSequencer sequence;
+		sequence.Begin( steps, true );
+
+		/* The camera's exposure, and the one it changes to from readout pendingFrom */
+		double exposure = steps[0].exposure, pending = exposure;
+		pi64s pendingFrom = 0, taken = 0;
+		vector<double> stored;
+		while( !sequence.Done() && !sequence.Stalled() && taken < 1000 )
+		{
+			for( pi64s b = 0; b < burst; ++b, ++taken )
+			{
+				if( taken >= pendingFrom )
+					exposure = pending;
+				if( sequence.Keep( stamped ? exposure : -1 ) )
+					stored.push_back( exposure );
+			}
+			if( sequence.Ready() )
+			{
+				pending = steps[sequence.next].exposure;
+				pendingFrom = taken + lag;
+				sequence.Applied();
+			}
+		}
+
+		bool right = sequence.Done();
+		vector<pi64s> counts( steps.size(), 0 );
+		for( size_t r = 0; r < stored.size(); ++r )
+		{
+			size_t step = sequence.StepOf( (pi64s)r );
+			counts[step]++;
+			right = right && stored[r] == steps[step].exposure;
+		}
+		std::cout << "Steps ";
+		for( size_t s = 0; s < steps.size(); ++s )
+			std::cout << ( s ? "," : "" ) << steps[s].exposure << ":" << steps[s].readouts;
+		std::cout << ( stamped ? ", time stamped" : ", not stamped" ) << ", lag " << lag << ", " << burst << " readouts at a time: got ";
+		for( size_t s = 0; s < steps.size(); ++s )
+		{
+			std::cout << ( s ? "," : "" ) << counts[s];
+			right = right && counts[s] == steps[s].readouts;
+		}
+		std::cout << " with " << sequence.skipped << " left out: " << ( right ? "right" : "WRONG" ) << std::endl;
+		passed = passed && right;
+	}
+	std::cout << "Sequence test " << ( passed ? "PASSED" : "FAILED" ) << std::endl;
+	return passed ? 0 : CaptureResult_TestFailed;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Buffer Arena
+// - the large buffers of a capture, PICAM's circular acquisition buffer and
+//   the writer thread's blocks, come from a pool kept for the life of the
+//   process: a capture server or MEX session allocates them on its first
+//   shot and later shots of the same size or smaller reuse them, already
+//   faulted in, instead of allocating and touching fresh memory every time
+// - each buffer is a multiple of 2 MB backed by huge pages where the system
+//   grants them (Linux MAP_HUGETLB, else transparent huge pages; Windows
+//   large pages, which need the "Lock pages in memory" privilege), locked
+//   in memory where allowed, and otherwise touched page by page when it is
+//   allocated.  Buffers are at least page aligned, which suits SIMD loads
+//   and O_DIRECT alike
+// - at most ARENA_KEEP_BYTES of free buffers are kept; above that the ones
+//   given back longest ago go back to the system.  A free buffer is only
+//   reused for a request of at least 1 / ARENA_REUSE_SLACK of its size, so
+//   a small capture does not hold on to the buffer of a large one
+// - --no-arena allocates them from the heap per capture, as before
+////////////////////////////////////////////////////////////////////////////////
+#define ARENA_HUGE_PAGE   (2 * 1024 * 1024)
+#define ARENA_PAGE        4096
+#define ARENA_KEEP_BYTES  ((size_t)1024 * 1024 * 1024)	/* of free buffers kept for reuse */
+#define ARENA_REUSE_SLACK 2								/* largest free buffer : request  */
+
+// - one buffer of the arena
+struct ArenaBlock
+{
+	pibyte*	data;
+	size_t	size;
+	bool	huge;		/* backed by huge (large) pages  */
+	bool	locked;		/* page-locked                   */
+};
+
+struct BufferArena
+{
+	std::mutex			lock;
+	vector<ArenaBlock>	free;		/* oldest given back first */
+	size_t				kept;		/* bytes in free           */
+	pi64s				allocations;
+	pi64s				reuses;
+
+	BufferArena() : kept(0), allocations(0), reuses(0) {}
+	~BufferArena() { Trim(); }
+
+#ifdef _WIN32
+	// - large pages need SeLockMemoryPrivilege enabled in the process token,
+	//   granting "Lock pages in memory" to the user is not enough by itself
+	static bool EnableLargePages()
+	{
+		HANDLE token;
+		if( !OpenProcessToken( GetCurrentProcess(), TOKEN_ADJUST_PRIVILEGES | TOKEN_QUERY, &token ) )
+		{
+			std::cout << "Buffer arena: could not open the process token (error " << GetLastError() << "), so no large pages" << std::endl;
+			return false;
+		}
+		TOKEN_PRIVILEGES privileges;
+		privileges.PrivilegeCount = 1;
+		privileges.Privileges[0].Attributes = SE_PRIVILEGE_ENABLED;
+		/* AdjustTokenPrivileges succeeds with ERROR_NOT_ALL_ASSIGNED if the user does not hold it */
+		DWORD error = ERROR_SUCCESS;
+		if( !LookupPrivilegeValue( 0, SE_LOCK_MEMORY_NAME, &privileges.Privileges[0].Luid ) ||
+		    !AdjustTokenPrivileges( token, FALSE, &privileges, 0, 0, 0 ) || GetLastError() != ERROR_SUCCESS )
+			error = GetLastError();
+		CloseHandle( token );
+		if( error != ERROR_SUCCESS )
+			std::cout << "Buffer arena: could not enable SeLockMemoryPrivilege (error " << error
+			          << "), so no large pages; grant the user \"Lock pages in memory\" to have them" << std::endl;
+		return error == ERROR_SUCCESS;
+	}
+#endif
+
+	// - maps size bytes (a multiple of ARENA_HUGE_PAGE), faulted in
+	static ArenaBlock Allocate(size_t size)
+	{
+		ArenaBlock block = { 0, size, false, false };
+#ifdef _WIN32
+		static const bool privileged = EnableLargePages();		/* once, before the first allocation */
+		SIZE_T large = GetLargePageMinimum();
+		if( privileged && large > 0 && size % large == 0 )
+			block.data = static_cast<pibyte*>( VirtualAlloc( 0, size, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE ) );
+		block.huge = block.locked = block.data != 0;	/* large pages are never paged out */
+		if( !block.data )
+		{
+			block.data = static_cast<pibyte*>( VirtualAlloc( 0, size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE ) );
+			block.locked = block.data && VirtualLock( block.data, size ) != 0;
+		}
+#else
+		void* mapped = MAP_FAILED;
+#ifdef MAP_HUGETLB
+		mapped = mmap( 0, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0 );
+		block.huge = mapped != MAP_FAILED;
+#endif
+		if( mapped == MAP_FAILED )
+		{
+			mapped = mmap( 0, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0 );
+#ifdef MADV_HUGEPAGE
+			/* Transparent huge pages, if the kernel has them to spare */
+			if( mapped != MAP_FAILED )
+				madvise( mapped, size, MADV_HUGEPAGE );
+#endif
+		}
+		block.data = mapped == MAP_FAILED ? 0 : static_cast<pibyte*>( mapped );
+		block.locked = block.data && mlock( block.data, size ) == 0;
+#endif
+		/* Locking faults every page in; otherwise it is done here, once */
+		if( block.data && !block.locked )
+			for( size_t offset = 0; offset < size; offset += ARENA_PAGE )
+				block.data[offset] = 0;
+		return block;
+	}
+
+	static void Free(const ArenaBlock& block)
+	{
+		if( !block.data )
+			return;
+#ifdef _WIN32
+		VirtualFree( block.data, 0, MEM_RELEASE );
+#else
+		munmap( block.data, block.size );
+#endif
+	}
+
+	// - the smallest free buffer of at least bytes, unless it is more than
+	//   ARENA_REUSE_SLACK times too large, or a new one
+	ArenaBlock Acquire(size_t bytes)
+	{
+		size_t size = ( bytes + ARENA_HUGE_PAGE - 1 ) / ARENA_HUGE_PAGE * ARENA_HUGE_PAGE;
+		std::lock_guard<std::mutex> guard( lock );
+		size_t best = free.size();
+		for( size_t i = 0; i < free.size(); ++i )
+			if( free[i].size >= size && free[i].size <= size * ARENA_REUSE_SLACK && ( best == free.size() || free[i].size < free[best].size ) )
+				best = i;
+		if( best < free.size() )
+		{
+			ArenaBlock block = free[best];
+			free.erase( free.begin() + best );
+			kept -= block.size;
+			++reuses;
+			std::cout << "Buffer arena: reusing " << block.size / (1024 * 1024) << " MB" << std::endl;
+			return block;
+		}
+
+		std::chrono::steady_clock::time_point begun = std::chrono::steady_clock::now();
+		ArenaBlock block = Allocate( size );
+		if( !block.data )
+		{
+			std::cout << "Buffer arena: COULD NOT ALLOCATE " << size / (1024 * 1024) << " MB" << std::endl;
+			return block;
+		}
+		++allocations;
+		std::cout << "Buffer arena: allocated " << size / (1024 * 1024) << " MB (" << ( block.huge ? "huge pages" : "normal pages" )
+		          << ( block.locked ? ", locked" : ", not locked" ) << ") in "
+		          << std::chrono::duration<double, std::milli>( std::chrono::steady_clock::now() - begun ).count() << " ms" << std::endl;
+		return block;
+	}
+
+	// - keeps the buffer for the next capture, giving back the oldest free
+	//   ones while more than ARENA_KEEP_BYTES are kept
+	void Release(const ArenaBlock& block)
+	{
+		if( !block.data )
+			return;
+		std::lock_guard<std::mutex> guard( lock );
+		free.push_back( block );
+		kept += block.size;
+		while( kept > ARENA_KEEP_BYTES )
+		{
+			std::cout << "Buffer arena: giving back " << free.front().size / (1024 * 1024) << " MB (more than "
+			          << ARENA_KEEP_BYTES / (1024 * 1024) << " MB free)" << std::endl;
+			kept -= free.front().size;
+			Free( free.front() );
+			free.erase( free.begin() );
+		}
+	}
+
+	// - gives every free buffer back to the system
+	void Trim()
+	{
+		std::lock_guard<std::mutex> guard( lock );
+		for( size_t i = 0; i < free.size(); ++i )
+			Free( free[i] );
+		free.clear();
+		kept = 0;
+	}
+};
+
+static BufferArena Arena;
+
+// - a buffer from the arena (or the heap, for --no-arena) for as long as it
+//   is in scope
+struct ArenaBuffer
+{
+	ArenaBlock		block;
+	vector<pibyte>	heap;
+
+	ArenaBuffer() { block.data = 0; block.size = 0; }
+	~ArenaBuffer() { Arena.Release( block ); }
+
+	pibyte* Get(size_t bytes, bool arena)
+	{
+		Arena.Release( block );
+		block.data = 0;
+		if( !arena )
+		{
+			heap.resize( bytes );
+			return heap.empty() ? 0 : &heap[0];
+		}
+		block = Arena.Acquire( bytes );
+		return block.data;
+	}
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// Readout Sinks
+// - where AcquireToFile puts the readouts of a run: straight into the
+//   memory-mapped capture file, or through a background writer thread
+// - the writer thread (--writer-thread) takes readouts off the acquisition
+//   thread in large aligned blocks, passed through a lock-free single
+//   producer / single consumer queue, and writes them with direct I/O
+//   (O_DIRECT / FILE_FLAG_NO_BUFFERING) where the file system allows it
+// - when every block is waiting for the disk the acquisition thread stalls;
+//   stalls are counted and timed so a slow disk shows up in the report
+//   instead of as silently lost readouts
+////////////////////////////////////////////////////////////////////////////////
+#define WRITER_BLOCK_SIZE  (8 * 1024 * 1024)
+#define WRITER_BLOCKS      8
+#define WRITER_ALIGNMENT   4096
+#define WRITER_IDLE_US     100
+
+struct ReadoutSink
+{
+	virtual ~ReadoutSink() {}
+
+	// - memory PICAM may acquire the whole run into directly, or 0
+	virtual pibyte* RunBuffer() { return 0; }
+
+	// - takes the next count readouts; false if they could not be stored
+	virtual bool Store(const pibyte* readouts, pi64s count) = 0;
+
+	// - why the run should stop although everything was stored, or ""
+	virtual string StopReason() const { return ""; }
+};
+
+// - fills the frame area of a memory-mapped capture file
+struct MappedSink : ReadoutSink
+{
+	MappedFile&	file;
+	pi64s		dataOffset;
+	piint		readoutstride;
+	bool		zeroCopy;		/* PICAM writes into the mapping itself */
+	pi64s		stored;
+	pi64s		flushed;
+
+	MappedSink(MappedFile& file, pi64s dataOffset, piint readoutstride, bool zeroCopy)
+		: file(file), dataOffset(dataOffset), readoutstride(readoutstride), zeroCopy(zeroCopy), stored(0), flushed(dataOffset) {}
+
+	pibyte* RunBuffer() { return zeroCopy ? file.data + dataOffset : 0; }
+
+	bool Store(const pibyte* readouts, pi64s count)
+	{
+		/* Already in place unless it came through the circular buffer */
+		pibyte* target = file.data + dataOffset + stored * readoutstride;
+		if( readouts != target )
+			memcpy( target, readouts, (size_t)(count * readoutstride) );
+		stored += count;
+
+		/* Hand finished pages to the disk and out of memory */
+		pi64s end = ( dataOffset + stored * readoutstride ) / CAPTURE_FILE_PAGE_SIZE * CAPTURE_FILE_PAGE_SIZE;
+		if( end - flushed >= CAPTURE_FILE_FLUSH_BYTES )
+		{
+			file.Flush( flushed, end - flushed );
+			file.Release( flushed, end - flushed );
+			flushed = end;
+		}
+		return true;
+	}
+};
+
+// - lock-free queue of block numbers between exactly one producer thread and
+//   one consumer thread
+struct BlockQueue
+{
+	vector<size_t>		slots;
+	std::atomic<size_t>	head;		/* next to pop, owned by the consumer  */
+	std::atomic<size_t>	tail;		/* next to push, owned by the producer */
+
+	BlockQueue(size_t capacity) : slots(capacity + 1), head(0), tail(0) {}
+
+	bool Push(size_t block)
+	{
+		size_t t = tail.load( std::memory_order_relaxed );
+		size_t next = ( t + 1 ) % slots.size();
+		if( next == head.load( std::memory_order_acquire ) )
+			return false;
+		slots[t] = block;
+		tail.store( next, std::memory_order_release );
+		return true;
+	}
+
+	bool Pop(size_t& block)
+	{
+		size_t h = head.load( std::memory_order_relaxed );
+		if( h == tail.load( std::memory_order_acquire ) )
+			return false;
+		block = slots[h];
+		head.store( ( h + 1 ) % slots.size(), std::memory_order_release );
+		return true;
+	}
+
+	size_t Depth() const
+	{
+		return ( tail.load( std::memory_order_acquire ) + slots.size() - head.load( std::memory_order_acquire ) ) % slots.size();
+	}
+};
+
+// - copies readouts into aligned blocks on the acquisition thread and writes
+//   full blocks to disk on its own thread
+struct DirectWriter : ReadoutSink
+{
+	string				path;
+	pi64s				dataOffset;
+	piint				readoutstride;
+	ArenaBuffer			storage;
+	pibyte*				blocks;			/* WRITER_BLOCKS aligned blocks  */
+	size_t				lengths[WRITER_BLOCKS];
+	BlockQueue			filled;			/* acquisition -> writer         */
+	BlockQueue			empty;			/* writer -> acquisition         */
+	size_t				current;		/* block being filled            */
+	bool				haveCurrent;
+	std::atomic<bool>	closing;
+	std::atomic<bool>	failed;
+	std::thread			worker;
+	bool				direct;
+#ifdef _WIN32
+	HANDLE				file;
+#else
+	int					file;
+#endif
+
+	/* back-pressure and throughput accounting */
+	pi64s				bytesStored;
+	pi64s				stalls;
+	double				stallSeconds;
+	size_t				peakDepth;
+	double				writeSeconds;	/* writer thread only */
+	std::chrono::steady_clock::time_point	started;
+
+	DirectWriter()
+		: dataOffset(0), readoutstride(0), blocks(0), filled(WRITER_BLOCKS), empty(WRITER_BLOCKS), current(0), haveCurrent(false),
+		  closing(false), failed(false), direct(false), bytesStored(0), stalls(0), stallSeconds(0), peakDepth(0), writeSeconds(0)
+	{
+#ifdef _WIN32
+		file = INVALID_HANDLE_VALUE;
+#else
+		file = -1;
+#endif
+	}
+
+	~DirectWriter()
+	{
+		if( worker.joinable() )
+		{
+			closing = true;
+			worker.join();
+		}
+		CloseFile();
+	}
+
+	// - creates the file and starts the writer thread; readouts are written
+	//   from dataOffset (a multiple of WRITER_ALIGNMENT) on.  The blocks come
+	//   from the buffer arena unless arena is false
+	bool Open(const string& filePath, pi64s offset, piint stride, bool arena)
+	{
+		path = filePath;
+		dataOffset = offset;
+		readoutstride = stride;
+#ifdef _WIN32
+		file = CreateFileA( path.c_str(), GENERIC_WRITE, FILE_SHARE_READ, 0, CREATE_ALWAYS, FILE_FLAG_NO_BUFFERING | FILE_FLAG_WRITE_THROUGH, 0 );
+		direct = file != INVALID_HANDLE_VALUE;
+		if( !direct )
+			file = CreateFileA( path.c_str(), GENERIC_WRITE, FILE_SHARE_READ, 0, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, 0 );
+		if( file == INVALID_HANDLE_VALUE )
+			return false;
+#else
+		file = -1;
+#ifdef O_DIRECT
+		file = open( path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_DIRECT, 0644 );
+		direct = file >= 0;
+#endif
+		/* Some file systems (tmpfs, network shares) refuse direct I/O */
+		if( file < 0 )
+			file = open( path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644 );
+		if( file < 0 )
+			return false;
+#ifdef F_NOCACHE
+		direct = fcntl( file, F_NOCACHE, 1 ) == 0;
+#endif
+#endif
+		if( !direct )
+			std::cout << "Direct I/O is not available for this file; the writer thread uses buffered writes" << std::endl;
+
+		pibyte* memory = storage.Get( (size_t)WRITER_BLOCKS * WRITER_BLOCK_SIZE + WRITER_ALIGNMENT, arena );
+		if( !memory )
+			return false;
+		uintptr_t base = reinterpret_cast<uintptr_t>( memory );
+		blocks = memory + ( WRITER_ALIGNMENT - base % WRITER_ALIGNMENT ) % WRITER_ALIGNMENT;
+		for( size_t i = 0; i < WRITER_BLOCKS; ++i )
+			empty.Push( i );
+
+		started = std::chrono::steady_clock::now();
+		worker = std::thread( &DirectWriter::Run, this );
+		std::cout << "Writer thread started with " << WRITER_BLOCKS << " blocks of " << WRITER_BLOCK_SIZE / (1024 * 1024) << " MB" << std::endl;
+		return true;
+	}
+
+	bool Store(const pibyte* readouts, pi64s count)
+	{
+		return Append( readouts, (size_t)( count * readoutstride ) );
+	}
+
+	// - queues any number of bytes to follow what was stored before
+	bool Append(const pibyte* readouts, size_t bytes)
+	{
+		while( bytes > 0 )
+		{
+			if( failed )
+				return false;
+			if( !haveCurrent && !NextBlock() )
+				return false;
+			size_t room = WRITER_BLOCK_SIZE - lengths[current];
+			size_t chunk = bytes < room ? bytes : room;
+			memcpy( blocks + current * WRITER_BLOCK_SIZE + lengths[current], readouts, chunk );
+			lengths[current] += chunk;
+			readouts += chunk;
+			bytes -= chunk;
+			bytesStored += chunk;
+			if( lengths[current] == WRITER_BLOCK_SIZE )
+				QueueCurrent();
+		}
+		return true;
+	}
+
+	// - writes out what is left, stops the writer thread, then adds the
+	//   header (if any) at the start and the table behind the readouts at
+	//   dataEnd; returns true if everything reached the disk
+	bool Finish(const CaptureFileHeader* header, pi64s dataEnd, const void* table, pi64s tableBytes)
+	{
+		if( haveCurrent && lengths[current] > 0 )
+			QueueCurrent();
+		closing = true;
+		if( worker.joinable() )
+			worker.join();
+		CloseFile();
+		bool ok = !failed;
+
+		double seconds = std::chrono::duration<double>( std::chrono::steady_clock::now() - started ).count();
+		std::cout << "Writer thread: " << bytesStored / (1024.0 * 1024.0) << " MB";
+		if( writeSeconds > 0 )
+			std::cout << ", " << bytesStored / (1024.0 * 1024.0) / writeSeconds << " MB/s while writing";
+		if( seconds > 0 )
+			std::cout << ", " << bytesStored / (1024.0 * 1024.0) / seconds << " MB/s sustained";
+		std::cout << (direct ? " (direct I/O)" : " (buffered)") << std::endl;
+		std::cout << "    Peak queue depth " << peakDepth << " of " << WRITER_BLOCKS << " blocks; "
+		          << stalls << " stalls waiting for the disk, " << stallSeconds * 1000.0 << " ms in total" << std::endl;
+		if( stalls > 0 )
+			std::cout << "WARNING: the disk did not keep up with the camera.  Readouts waited in PICAM's circular buffer meanwhile." << std::endl;
+
+		/* The last block was padded to the alignment; trim it and add the rest */
+		FILE* pFile = fopen( path.c_str(), "r+b" );
+		if( !pFile )
+			return false;
+		if( header && fwrite( header, sizeof(*header), 1, pFile ) != 1 )
+			ok = false;
+		if( tableBytes > 0 && ( FileSeek( pFile, dataEnd ) != 0 || fwrite( table, (size_t)tableBytes, 1, pFile ) != 1 ) )
+			ok = false;
+		ok = fflush( pFile ) == 0 && ok;
+#ifdef _WIN32
+		ok = _chsize_s( _fileno( pFile ), dataEnd + tableBytes ) == 0 && ok;
+		ok = _commit( _fileno( pFile ) ) == 0 && ok;
+#else
+		ok = ftruncate( fileno( pFile ), dataEnd + tableBytes ) == 0 && ok;
+		ok = fsync( fileno( pFile ) ) == 0 && ok;
+#endif
+		fclose( pFile );
+		return ok;
+	}
+
+private:
+	// - takes an empty block, stalling while the writer has them all
+	bool NextBlock()
+	{
+		if( !empty.Pop( current ) )
+		{
+			std::chrono::steady_clock::time_point waited = std::chrono::steady_clock::now();
+			while( !empty.Pop( current ) )
+			{
+				if( failed )
+					return false;
+				std::this_thread::sleep_for( std::chrono::microseconds( WRITER_IDLE_US ) );
+			}
+			stalls++;
+			stallSeconds += std::chrono::duration<double>( std::chrono::steady_clock::now() - waited ).count();
+		}
+		lengths[current] = 0;
+		haveCurrent = true;
+		return true;
+	}
+
+	void QueueCurrent()
+	{
+		/* Always room: there are only WRITER_BLOCKS blocks */
+		filled.Push( current );
+		haveCurrent = false;
+		peakDepth = std::max( peakDepth, filled.Depth() );
+	}
+
+	// - the writer thread: writes full blocks in order until told to close
+	void Run()
+	{
+		pi64s offset = dataOffset;
+		while( true )
+		{
+			size_t block;
+			if( !filled.Pop( block ) )
+			{
+				if( !closing )
+				{
+					std::this_thread::sleep_for( std::chrono::microseconds( WRITER_IDLE_US ) );
+					continue;
+				}
+				/* closing is set after the last push, so one more look suffices */
+				if( !filled.Pop( block ) )
+					break;
+			}
+			/* Direct I/O writes whole aligned blocks; the tail is trimmed later */
+			size_t length = ( lengths[block] + WRITER_ALIGNMENT - 1 ) / WRITER_ALIGNMENT * WRITER_ALIGNMENT;
+			std::chrono::steady_clock::time_point begun = std::chrono::steady_clock::now();
+			bool ok = WriteAt( offset, blocks + block * WRITER_BLOCK_SIZE, length );
+			std::chrono::steady_clock::time_point ended = std::chrono::steady_clock::now();
+			writeSeconds += std::chrono::duration<double>( ended - begun ).count();
+			Logging.Span( "Write block", begun, ended );
+			offset += lengths[block];
+			empty.Push( block );
+			if( !ok )
+			{
+				failed = true;
+				break;
+			}
+		}
+	}
+
+	bool WriteAt(pi64s offset, const pibyte* data, size_t length)
+	{
+		while( length > 0 )
+		{
+#ifdef _WIN32
+			OVERLAPPED position;
+			memset( &position, 0, sizeof(position) );
+			position.Offset = (DWORD)( offset & 0xFFFFFFFF );
+			position.OffsetHigh = (DWORD)( offset >> 32 );
+			DWORD done = 0;
+			if( !WriteFile( file, data, (DWORD)length, &done, &position ) || done == 0 )
+				return false;
+#else
+			ssize_t done = pwrite( file, data, length, (off_t)offset );
+			if( done <= 0 )
+				return false;
+#endif
+			data += done;
+			offset += done;
+			length -= done;
+		}
+		return true;
+	}
+
+	void CloseFile()
+	{
+#ifdef _WIN32
+		if( file != INVALID_HANDLE_VALUE )
+			CloseHandle( file );
+		file = INVALID_HANDLE_VALUE;
+#else
+		if( file >= 0 )
+			close( file );
+		file = -1;
+#endif
+	}
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// Dark and Flat Correction
+// - --dark=FILE subtracts a master dark and --flat=FILE divides by a master
+//   flat, normalized to 1 over each ROI, before each readout is stored
+// - the masters are capture files; all their frames are averaged.  They must
+//   have the same ROIs and binning as the capture, and the dark the same
+//   exposure time.  If the flat was taken at that exposure too the dark is
+//   subtracted from it first
+// - --output-type=float32 stores the corrected pixels as floats instead of
+//   rounding them back to uint16 (clamped to 0..65535)
+// - the kernels use AVX2 where the processor has it, SSE2 otherwise and plain
+//   C++ on other processors.  --benchmark-correction times them all, and
+//   the frame statistics kernels, against the plain C++ results
+////////////////////////////////////////////////////////////////////////////////
+#define CORRECTION_DARK  1		/* header.corrections bits */
+#define CORRECTION_FLAT  2
+#define CORRECTION_BENCHMARK_FRAMES 200
+#define CORRECTION_BENCHMARK_BUDGET 0.1	/* of the full frame readout time */
+
+enum CorrectionKernel
+{
+	CorrectionKernel_Scalar,
+	CorrectionKernel_Sse2,
+	CorrectionKernel_Avx2
+};
+
+string CorrectionKernelName(CorrectionKernel kernel)
+{
+	switch( kernel )
+	{
+	case CorrectionKernel_Scalar: return "scalar";
+	case CorrectionKernel_Sse2:   return "SSE2";
+	case CorrectionKernel_Avx2:   return "AVX2";
+	}
+	return "unknown";
+}
+
+// - out = (raw - dark) * gain, rounded to nearest and clamped to uint16
+void CorrectScalar(const uint16_t* raw, const float* dark, const float* gain, uint16_t* out, size_t n)
+{
+	for( size_t i = 0; i < n; ++i )
+	{
+		float value = ( (float)raw[i] - dark[i] ) * gain[i];
+		value = std::min( std::max( value, 0.0f ), 65535.0f );
+		out[i] = (uint16_t)std::lrint( value );
+	}
+}
+
+// - out = (raw - dark) * gain as float
+void CorrectScalar(const uint16_t* raw, const float* dark, const float* gain, float* out, size_t n)
+{
+	for( size_t i = 0; i < n; ++i )
+		out[i] = ( (float)raw[i] - dark[i] ) * gain[i];
+}
+
+#ifdef CORRECTION_X86
+void CorrectSse2(const uint16_t* raw, const float* dark, const float* gain, uint16_t* out, size_t n)
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i bias = _mm_set1_epi32( 32768 );
+	const __m128i flip = _mm_set1_epi16( (short)0x8000 );
+	const __m128 lowest = _mm_setzero_ps();
+	const __m128 highest = _mm_set1_ps( 65535.0f );
+	size_t i = 0;
+	for( ; i + 8 <= n; i += 8 )
+	{
+		__m128i pixels = _mm_loadu_si128( (const __m128i*)( raw + i ) );
+		__m128 lo = _mm_cvtepi32_ps( _mm_unpacklo_epi16( pixels, zero ) );
+		__m128 hi = _mm_cvtepi32_ps( _mm_unpackhi_epi16( pixels, zero ) );
+		lo = _mm_mul_ps( _mm_sub_ps( lo, _mm_loadu_ps( dark + i ) ), _mm_loadu_ps( gain + i ) );
+		hi = _mm_mul_ps( _mm_sub_ps( hi, _mm_loadu_ps( dark + i + 4 ) ), _mm_loadu_ps( gain + i + 4 ) );
+		lo = _mm_min_ps( _mm_max_ps( lo, lowest ), highest );
+		hi = _mm_min_ps( _mm_max_ps( hi, lowest ), highest );
+		/* SSE2 has only a signed 32 -> 16 bit pack: shift into its range and back */
+		__m128i packed = _mm_packs_epi32( _mm_sub_epi32( _mm_cvtps_epi32( lo ), bias ), _mm_sub_epi32( _mm_cvtps_epi32( hi ), bias ) );
+		_mm_storeu_si128( (__m128i*)( out + i ), _mm_xor_si128( packed, flip ) );
+	}
+	CorrectScalar( raw + i, dark + i, gain + i, out + i, n - i );
+}
+
+void CorrectSse2(const uint16_t* raw, const float* dark, const float* gain, float* out, size_t n)
+{
+	const __m128i zero = _mm_setzero_si128();
+	size_t i = 0;
+	for( ; i + 8 <= n; i += 8 )
+	{
+		__m128i pixels = _mm_loadu_si128( (const __m128i*)( raw + i ) );
+		__m128 lo = _mm_cvtepi32_ps( _mm_unpacklo_epi16( pixels, zero ) );
+		__m128 hi = _mm_cvtepi32_ps( _mm_unpackhi_epi16( pixels, zero ) );
+		_mm_storeu_ps( out + i, _mm_mul_ps( _mm_sub_ps( lo, _mm_loadu_ps( dark + i ) ), _mm_loadu_ps( gain + i ) ) );
+		_mm_storeu_ps( out + i + 4, _mm_mul_ps( _mm_sub_ps( hi, _mm_loadu_ps( dark + i + 4 ) ), _mm_loadu_ps( gain + i + 4 ) ) );
+	}
+	CorrectScalar( raw + i, dark + i, gain + i, out + i, n - i );
+}
+
+CORRECTION_AVX2_TARGET
+void CorrectAvx2(const uint16_t* raw, const float* dark, const float* gain, uint16_t* out, size_t n)
+{
+	const __m256 lowest = _mm256_setzero_ps();
+	const __m256 highest = _mm256_set1_ps( 65535.0f );
+	size_t i = 0;
+	for( ; i + 16 <= n; i += 16 )
+	{
+		__m256i pixels = _mm256_loadu_si256( (const __m256i*)( raw + i ) );
+		__m256 lo = _mm256_cvtepi32_ps( _mm256_cvtepu16_epi32( _mm256_castsi256_si128( pixels ) ) );
+		__m256 hi = _mm256_cvtepi32_ps( _mm256_cvtepu16_epi32( _mm256_extracti128_si256( pixels, 1 ) ) );
+		lo = _mm256_mul_ps( _mm256_sub_ps( lo, _mm256_loadu_ps( dark + i ) ), _mm256_loadu_ps( gain + i ) );
+		hi = _mm256_mul_ps( _mm256_sub_ps( hi, _mm256_loadu_ps( dark + i + 8 ) ), _mm256_loadu_ps( gain + i + 8 ) );
+		lo = _mm256_min_ps( _mm256_max_ps( lo, lowest ), highest );
+		hi = _mm256_min_ps( _mm256_max_ps( hi, lowest ), highest );
+		/* The pack works within 128 bit lanes; put the quarters back in order */
+		__m256i packed = _mm256_packus_epi32( _mm256_cvtps_epi32( lo ), _mm256_cvtps_epi32( hi ) );
+		_mm256_storeu_si256( (__m256i*)( out + i ), _mm256_permute4x64_epi64( packed, 0xD8 ) );
+	}
+	CorrectSse2( raw + i, dark + i, gain + i, out + i, n - i );
+}
+
+CORRECTION_AVX2_TARGET
+void CorrectAvx2(const uint16_t* raw, const float* dark, const float* gain, float* out, size_t n)
+{
+	size_t i = 0;
+	for( ; i + 16 <= n; i += 16 )
+	{
+		__m256i pixels = _mm256_loadu_si256( (const __m256i*)( raw + i ) );
+		__m256 lo = _mm256_cvtepi32_ps( _mm256_cvtepu16_epi32( _mm256_castsi256_si128( pixels ) ) );
+		__m256 hi = _mm256_cvtepi32_ps( _mm256_cvtepu16_epi32( _mm256_extracti128_si256( pixels, 1 ) ) );
+		_mm256_storeu_ps( out + i, _mm256_mul_ps( _mm256_sub_ps( lo, _mm256_loadu_ps( dark + i ) ), _mm256_loadu_ps( gain + i ) ) );
+		_mm256_storeu_ps( out + i + 8, _mm256_mul_ps( _mm256_sub_ps( hi, _mm256_loadu_ps( dark + i + 8 ) ), _mm256_loadu_ps( gain + i + 8 ) ) );
+	}
+	CorrectSse2( raw + i, dark + i, gain + i, out + i, n - i );
+}
+#endif
+
+// - the fastest kernel this processor runs
+CorrectionKernel BestCorrectionKernel()
+{
+#ifdef CORRECTION_X86
+#ifdef _MSC_VER
+	int info[4];
+	__cpuid( info, 1 );
+	bool osSavesAvx = ( info[2] & (1 << 27) ) && ( info[2] & (1 << 28) ) && ( _xgetbv( 0 ) & 6 ) == 6;
+	__cpuidex( info, 7, 0 );
+	if( osSavesAvx && ( info[1] & (1 << 5) ) )
+		return CorrectionKernel_Avx2;
+#else
+	__builtin_cpu_init();
+	if( __builtin_cpu_supports( "avx2" ) )
+		return CorrectionKernel_Avx2;
+#endif
+	return CorrectionKernel_Sse2;
+#else
+	return CorrectionKernel_Scalar;
+#endif
+}
+
+template<typename Pixel>
+void Correct(CorrectionKernel kernel, const uint16_t* raw, const float* dark, const float* gain, Pixel* out, size_t n)
+{
+#ifdef CORRECTION_X86
+	if( kernel == CorrectionKernel_Avx2 )
+		return CorrectAvx2( raw, dark, gain, out, n );
+	if( kernel == CorrectionKernel_Sse2 )
+		return CorrectSse2( raw, dark, gain, out, n );
+#endif
+	CorrectScalar( raw, dark, gain, out, n );
+}
+
+// - averages every frame of a capture file that has the same ROIs as the
+//   capture described by header
+CaptureResult LoadMasterFrame(const string& path, const CaptureFileHeader& header, bool sameExposure, vector<float>& mean, CaptureFileHeader& master)
+{
+	FILE* pFile = fopen( path.c_str(), "rb" );
+	if( !pFile )
+	{
+		std::cout << "FAILED TO OPEN MASTER FRAME: " << path << std::endl;
+		return CaptureResult_FileError;
+	}
+	CaptureResult result = CaptureResult_Saved;
+	memset( &master, 0, sizeof(master) );
+	if( fread( &master, sizeof(master), 1, pFile ) != 1 || memcmp( master.magic, CAPTURE_FILE_MAGIC, sizeof(master.magic) ) != 0 )
+	{
+		std::cout << path << " is not a capture file" << std::endl;
+		result = CaptureResult_BadCalibration;
+	}
+	else if( master.bytes_per_pixel != 2 || master.frame_size != header.frame_size || master.roi_count != header.roi_count )
+	{
+		std::cout << path << " does not have the ROIs of this capture (or is already corrected)" << std::endl;
+		result = CaptureResult_BadCalibration;
+	}
+	else if( master.readout_count == 0 )
+	{
+		std::cout << path << " has no frames" << std::endl;
+		result = CaptureResult_BadCalibration;
+	}
+	for( uint32_t r = 0; result == CaptureResult_Saved && r < header.roi_count; ++r )
+	{
+		const CaptureFileRoi& a = master.rois[r];
+		const CaptureFileRoi& b = header.rois[r];
+		if( a.x != b.x || a.y != b.y || a.width != b.width || a.height != b.height || a.x_binning != b.x_binning || a.y_binning != b.y_binning )
+		{
+			std::cout << path << ": ROI " << r + 1 << " is " << a.width << "x" << a.height << " at " << a.x << "," << a.y << " binned " << a.x_binning << "x" << a.y_binning
+			          << ", the capture's is " << b.width << "x" << b.height << " at " << b.x << "," << b.y << " binned " << b.x_binning << "x" << b.y_binning << std::endl;
+			result = CaptureResult_BadCalibration;
+		}
+	}
+	if( result == CaptureResult_Saved && sameExposure && fabs( master.exposure_time - header.exposure_time ) > 1e-6 * std::max( 1.0, header.exposure_time ) )
+	{
+		std::cout << path << " was exposed for " << master.exposure_time << " ms, the capture is " << header.exposure_time << " ms" << std::endl;
+		result = CaptureResult_BadCalibration;
+	}
+
+	/* Sum every frame of every readout, one readout at a time */
+	size_t pixels = master.frame_size / 2;
+	vector<double> sum( result == CaptureResult_Saved ? pixels : 0, 0.0 );
+	vector<pibyte> readout( result == CaptureResult_Saved ? (size_t)master.readout_stride : 0 );
+	pi64s frames = 0;
+	if( result == CaptureResult_Saved && fseek( pFile, (long)master.data_offset, SEEK_SET ) != 0 )
+		result = CaptureResult_FileError;
+	for( uint64_t k = 0; result == CaptureResult_Saved && k < master.readout_count; ++k )
+	{
+		if( fread( &readout[0], readout.size(), 1, pFile ) != 1 )
+		{
+			std::cout << "FAILED TO READ MASTER FRAME: " << path << std::endl;
+			result = CaptureResult_FileError;
+			break;
+		}
+		for( uint32_t f = 0; f < master.frames_per_readout; ++f, ++frames )
+		{
+			const uint16_t* frame = reinterpret_cast<const uint16_t*>( &readout[f * master.frame_stride] );
+			for( size_t i = 0; i < pixels; ++i )
+				sum[i] += frame[i];
+		}
+	}
+	fclose( pFile );
+	if( result != CaptureResult_Saved )
+		return result;
+
+	mean.resize( pixels );
+	for( size_t i = 0; i < pixels; ++i )
+		mean[i] = (float)( sum[i] / frames );
+	std::cout << "Averaged " << frames << " frames of " << path << std::endl;
+	return CaptureResult_Saved;
+}
+
+// - the masters of one capture and what they do to its readouts
+struct CorrectionStage
+{
+	vector<float>		dark;			/* counts, per pixel of a frame    */
+	vector<float>		gain;			/* 1 / normalized flat             */
+	uint32_t			corrections;	/* CORRECTION_DARK | CORRECTION_FLAT */
+	bool				floatOutput;
+	CorrectionKernel	kernel;
+	size_t				pixels;			/* per frame                       */
+	uint32_t			framesPerReadout;
+	uint32_t			frameStride;	/* camera                          */
+	uint32_t			trailer;		/* metadata bytes after the pixels */
+	uint32_t			outFrameStride;
+	pi64s				frames;
+	double				seconds;
+
+	CorrectionStage() : corrections(0), floatOutput(false), kernel(BestCorrectionKernel()), pixels(0), framesPerReadout(1),
+	                    frameStride(0), trailer(0), outFrameStride(0), frames(0), seconds(0) {}
+
+	bool Active() const { return corrections != 0 || floatOutput; }
+
+	// - loads the masters the options ask for and changes header to describe
+	//   the corrected readouts
+	CaptureResult Load(const CaptureOptions& options, CaptureFileHeader& header)
+	{
+		floatOutput = options.FloatOutput;
+		pixels = header.frame_size / 2;
+		framesPerReadout = header.frames_per_readout;
+		frameStride = header.frame_stride;
+		trailer = header.frame_stride - header.frame_size;
+
+		CaptureFileHeader master;
+		CaptureResult result = CaptureResult_Saved;
+		if( !options.DarkFile.empty() )
+		{
+			result = LoadMasterFrame( options.DarkFile, header, true, dark, master );
+			corrections |= CORRECTION_DARK;
+		}
+		if( result == CaptureResult_Saved && !options.FlatFile.empty() )
+		{
+			vector<float> flat;
+			result = LoadMasterFrame( options.FlatFile, header, false, flat, master );
+			if( result == CaptureResult_Saved )
+				NormalizeFlat( header, flat, fabs( master.exposure_time - header.exposure_time ) <= 1e-6 * std::max( 1.0, header.exposure_time ) );
+			corrections |= CORRECTION_FLAT;
+		}
+		if( result != CaptureResult_Saved || !Active() )
+			return result;
+		if( dark.empty() )
+			dark.assign( pixels, 0.0f );
+		if( gain.empty() )
+			gain.assign( pixels, 1.0f );
+
+		/* Floats take twice the room; any metadata still follows the pixels */
+		uint32_t bytes = floatOutput ? 4 : 2;
+		outFrameStride = (uint32_t)( pixels * bytes ) + trailer;
+		header.bytes_per_pixel = bytes;
+		header.pixel_bit_depth = floatOutput ? 32 : header.pixel_bit_depth;
+		header.pixel_type = floatOutput ? CAPTURE_PIXEL_FLOAT32 : CAPTURE_PIXEL_UINT16;
+		header.frame_size = (uint32_t)( pixels * bytes );
+		header.frame_stride = outFrameStride;
+		header.readout_stride = (uint64_t)outFrameStride * framesPerReadout;
+		for( uint32_t r = 0; r < header.roi_count; ++r )
+			header.rois[r].offset = header.rois[r].offset / 2 * bytes;
+		header.corrections = corrections;
+		std::cout << "Correcting" << ( corrections & CORRECTION_DARK ? " dark" : "" ) << ( corrections & CORRECTION_FLAT ? " flat" : "" )
+		          << " to " << ( floatOutput ? "float32" : "uint16" ) << " with the " << CorrectionKernelName( kernel ) << " kernel" << std::endl;
+		return CaptureResult_Saved;
+	}
+
+	// - gain = mean / flat over each ROI; pixels with no signal are left alone
+	void NormalizeFlat(const CaptureFileHeader& header, vector<float>& flat, bool subtractDark)
+	{
+		if( subtractDark && !dark.empty() )
+			for( size_t i = 0; i < pixels; ++i )
+				flat[i] -= dark[i];
+		gain.assign( pixels, 1.0f );
+		pi64s dead = 0;
+		for( uint32_t r = 0; r < header.roi_count; ++r )
+		{
+			size_t first = (size_t)header.rois[r].offset / 2;
+			size_t count = (size_t)header.rois[r].columns * header.rois[r].rows;
+			double total = 0;
+			for( size_t i = first; i < first + count; ++i )
+				total += flat[i];
+			double level = total / count;
+			for( size_t i = first; i < first + count; ++i )
+			{
+				if( flat[i] > 0 && level > 0 )
+					gain[i] = (float)( level / flat[i] );
+				else
+					dead++;
+			}
+		}
+		if( dead > 0 )
+			std::cout << dead << " pixels of the flat have no signal and are not flat fielded" << std::endl;
+	}
+
+	// - corrects count readouts from the camera's layout into the file's
+	void Apply(const pibyte* readouts, pibyte* out, pi64s count)
+	{
+		std::chrono::steady_clock::time_point begun = std::chrono::steady_clock::now();
+		for( pi64s k = 0; k < count * framesPerReadout; ++k )
+		{
+			const pibyte* frame = readouts + k * frameStride;
+			pibyte* target = out + k * outFrameStride;
+			const uint16_t* raw = reinterpret_cast<const uint16_t*>( frame );
+			if( floatOutput )
+				Correct( kernel, raw, &dark[0], &gain[0], reinterpret_cast<float*>( target ), pixels );
+			else
+				Correct( kernel, raw, &dark[0], &gain[0], reinterpret_cast<uint16_t*>( target ), pixels );
+			if( trailer > 0 )
+				memcpy( target + outFrameStride - trailer, frame + frameStride - trailer, trailer );
+		}
+		frames += count * framesPerReadout;
+		seconds += std::chrono::duration<double>( std::chrono::steady_clock::now() - begun ).count();
+	}
+
+	void PrintReport() const
+	{
+		if( frames > 0 )
+			std::cout << "Correction (" << CorrectionKernelName( kernel ) << "): " << frames << " frames, "
+			          << seconds * 1000.0 / frames << " ms per frame" << std::endl;
+	}
+};
+
+// - corrects each readout on its way to another sink
+struct CorrectingSink : ReadoutSink
+{
+	ReadoutSink&		sink;
+	CorrectionStage&	correction;
+	piint				readoutstride;		/* camera */
+	vector<pibyte>		corrected;			/* one readout, as stored */
+
+	CorrectingSink(ReadoutSink& sink, CorrectionStage& correction, piint readoutstride)
+		: sink(sink), correction(correction), readoutstride(readoutstride),
+		  corrected( (size_t)correction.outFrameStride * correction.framesPerReadout ) {}
+
+	/* The camera's data is never what is stored, so PICAM gets a circular buffer */
+	pibyte* RunBuffer() { return 0; }
+
+	bool Store(const pibyte* readouts, pi64s count)
+	{
+		for( pi64s k = 0; k < count; ++k )
+		{
+			correction.Apply( readouts + k * readoutstride, &corrected[0], 1 );
+			if( !sink.Store( &corrected[0], 1 ) )
+				return false;
+		}
+		return true;
+	}
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// Co-adding
+// - --coadd=K combines every K consecutive readouts into one stored readout,
+//   so only NFrames / K readouts reach the disk
+// - --coadd-mode=sum keeps the sum (uint32 for raw counts), mean (default)
+//   stores the average as float32, sigma-clip the average of the values
+//   within --clip-sigma (default 3) robust standard deviations of the median
+// - --variance adds a per-pixel variance map (float32) of each group behind
+//   the frames of every stored readout, at header.variance_offset
+// - sums are kept in 32 bit integers for raw counts; the values of a group
+//   are held only for sigma-clip
+////////////////////////////////////////////////////////////////////////////////
+#define COADD_CLIP_SIGMA   3.0
+#define COADD_MAD_TO_SIGMA 1.4826	/* median absolute deviation to sigma */
+
+enum CoaddMode
+{
+	CoaddMode_None        = 0,
+	CoaddMode_Sum         = 1,
+	CoaddMode_Mean        = 2,
+	CoaddMode_ClippedMean = 3
+};
+
+string CoaddModeName(CoaddMode mode)
+{
+	switch( mode )
+	{
+	case CoaddMode_None:        return "none";
+	case CoaddMode_Sum:         return "sum";
+	case CoaddMode_Mean:        return "mean";
+	case CoaddMode_ClippedMean: return "sigma-clipped mean";
+	}
+	return "unknown";
+}
+
+// - the running sums of one group of readouts and how they are stored
+struct CoaddStage
+{
+	CoaddMode			mode;
+	piint				count;				/* readouts per group            */
+	bool				variance;
+	double				sigma;
+	bool				integer;			/* input is uint16               */
+	size_t				pixels;				/* per frame                     */
+	uint32_t			framesPerReadout;
+	uint32_t			inFrameStride;
+	piint				inReadoutStride;
+	uint32_t			outFrameSize;
+	uint32_t			varianceOffset;		/* in each stored readout, or 0  */
+	vector<uint32_t>	integerSums;		/* uint16 input                  */
+	vector<double>		sums;				/* float input                   */
+	vector<double>		squares;			/* --variance                    */
+	vector<float>		group;				/* sigma-clip: the whole group   */
+	vector<float>		values;				/* sigma-clip: one pixel         */
+	piint				added;
+	pi64s				stored;
+	pi64s				clipped;
+	double				seconds;
+
+	CoaddStage() : mode(CoaddMode_None), count(1), variance(false), sigma(COADD_CLIP_SIGMA), integer(true), pixels(0), framesPerReadout(1),
+	               inFrameStride(0), inReadoutStride(0), outFrameSize(0), varianceOffset(0), added(0), stored(0), clipped(0), seconds(0) {}
+
+	bool Active() const { return mode != CoaddMode_None; }
+
+	// - stored readouts for the given number of camera readouts
+	pi64s Stored(pi64s readouts) const { return Active() ? readouts / count : readouts; }
+
+	// - sets up for the readouts header describes and changes header to
+	//   describe the stored ones
+	CaptureResult Setup(const CaptureOptions& options, int NFrames, CaptureFileHeader& header)
+	{
+		mode = options.CoaddCount > 0 ? (CoaddMode)options.CoaddMethod : CoaddMode_None;
+		if( !Active() )
+			return CaptureResult_Saved;
+		count = options.CoaddCount;
+		variance = options.VarianceMaps;
+		sigma = options.ClipSigma;
+		if( NFrames % count != 0 )
+		{
+			std::cout << "ERROR: NFrames (" << NFrames << ") must be a multiple of --coadd (" << count << ")" << std::endl;
+			return CaptureResult_BadArguments;
+		}
+
+		integer = ( header.pixel_type == CAPTURE_PIXEL_UINT16 );
+		pixels = header.frame_size / header.bytes_per_pixel;
+		framesPerReadout = header.frames_per_readout;
+		inFrameStride = header.frame_stride;
+		inReadoutStride = (piint)header.readout_stride;
+		size_t total = pixels * framesPerReadout;
+		if( integer )
+			integerSums.assign( total, 0 );
+		else
+			sums.assign( total, 0.0 );
+		if( variance )
+			squares.assign( total, 0.0 );
+		if( mode == CoaddMode_ClippedMean )
+		{
+			group.resize( total * count );
+			values.resize( count );
+		}
+
+		/* Whole frames of 4 byte pixels, without the metadata bytes */
+		uint32_t inBytes = header.bytes_per_pixel;
+		outFrameSize = (uint32_t)( pixels * 4 );
+		varianceOffset = variance ? outFrameSize * framesPerReadout : 0;
+		header.pixel_type = ( mode == CoaddMode_Sum && integer ) ? CAPTURE_PIXEL_UINT32 : CAPTURE_PIXEL_FLOAT32;
+		header.bytes_per_pixel = 4;
+		header.pixel_bit_depth = 32;
+		header.frame_size = outFrameSize;
+		header.frame_stride = outFrameSize;
+		header.readout_stride = (uint64_t)outFrameSize * framesPerReadout * ( variance ? 2 : 1 );
+		for( uint32_t r = 0; r < header.roi_count; ++r )
+			header.rois[r].offset = header.rois[r].offset / inBytes * 4;
+		header.coadd_count = count;
+		header.coadd_mode = mode;
+		header.variance_offset = varianceOffset;
+		header.clip_sigma = mode == CoaddMode_ClippedMean ? sigma : 0;
+		std::cout << "Co-adding: " << CoaddModeName( mode ) << " of every " << count << " readouts" << ( variance ? " with variance maps" : "" );
+		if( mode == CoaddMode_ClippedMean )
+			std::cout << ", clipped at " << sigma << " sigma (" << group.size() * sizeof(float) / (1024.0 * 1024.0) << " MB held)";
+		std::cout << std::endl;
+		return CaptureResult_Saved;
+	}
+
+	void AddSums(const uint16_t* in, size_t base)
+	{
+		uint32_t* sum = &integerSums[base];
+		for( size_t i = 0; i < pixels; ++i )
+			sum[i] += in[i];
+	}
+
+	void AddSums(const float* in, size_t base)
+	{
+		double* sum = &sums[base];
+		for( size_t i = 0; i < pixels; ++i )
+			sum[i] += in[i];
+	}
+
+	template<typename Pixel>
+	void AddFrame(const Pixel* in, size_t base)
+	{
+		AddSums( in, base );
+		if( variance )
+		{
+			double* square = &squares[base];
+			for( size_t i = 0; i < pixels; ++i )
+				square[i] += (double)in[i] * in[i];
+		}
+		if( mode == CoaddMode_ClippedMean )
+		{
+			float* kept = &group[added * pixels * framesPerReadout + base];
+			for( size_t i = 0; i < pixels; ++i )
+				kept[i] = (float)in[i];
+		}
+	}
+
+	// - adds one readout to the group
+	void Add(const pibyte* readout)
+	{
+		std::chrono::steady_clock::time_point begun = std::chrono::steady_clock::now();
+		for( uint32_t f = 0; f < framesPerReadout; ++f )
+		{
+			const pibyte* frame = readout + f * inFrameStride;
+			if( integer )
+				AddFrame( reinterpret_cast<const uint16_t*>( frame ), f * pixels );
+			else
+				AddFrame( reinterpret_cast<const float*>( frame ), f * pixels );
+		}
+		added++;
+		seconds += std::chrono::duration<double>( std::chrono::steady_clock::now() - begun ).count();
+	}
+
+	bool Full() const { return added == count; }
+
+	// - mean and variance of the values of pixel j within sigma robust
+	//   standard deviations of their median
+	void ClipPixel(size_t j, float& mean, float& spread)
+	{
+		size_t total = pixels * framesPerReadout;
+		for( piint k = 0; k < count; ++k )
+			values[k] = group[k * total + j];
+		std::nth_element( values.begin(), values.begin() + count / 2, values.end() );
+		float median = values[count / 2];
+		for( piint k = 0; k < count; ++k )
+			values[k] = fabs( group[k * total + j] - median );
+		std::nth_element( values.begin(), values.begin() + count / 2, values.end() );
+		double scale = COADD_MAD_TO_SIGMA * values[count / 2];
+		if( scale == 0 )
+		{
+			/* Mostly identical values: fall back on the plain standard deviation */
+			double m = integer ? integerSums[j] / (double)count : sums[j] / count;
+			for( piint k = 0; k < count; ++k )
+				scale += ( group[k * total + j] - m ) * ( group[k * total + j] - m );
+			scale = sqrt( scale / count );
+		}
+
+		double sum = 0, square = 0;
+		piint kept = 0;
+		for( piint k = 0; k < count; ++k )
+		{
+			float v = group[k * total + j];
+			if( fabs( v - median ) <= sigma * scale )
+			{
+				sum += v;
+				square += (double)v * v;
+				kept++;
+			}
+		}
+		clipped += count - kept;
+		mean = (float)( sum / kept );
+		spread = kept > 1 ? (float)( ( square - sum * sum / kept ) / ( kept - 1 ) ) : 0.0f;
+	}
+
+	// - writes the group as one stored readout and starts the next group
+	void Reduce(pibyte* out)
+	{
+		std::chrono::steady_clock::time_point begun = std::chrono::steady_clock::now();
+		size_t total = pixels * framesPerReadout;
+		float* maps = reinterpret_cast<float*>( out + varianceOffset );
+		for( size_t j = 0; j < total; ++j )
+		{
+			double sum = integer ? integerSums[j] : sums[j];
+			float spread = 0;
+			if( mode == CoaddMode_ClippedMean )
+				ClipPixel( j, reinterpret_cast<float*>( out )[j], spread );
+			else
+			{
+				if( mode == CoaddMode_Sum && integer )
+					reinterpret_cast<uint32_t*>( out )[j] = integerSums[j];
+				else
+					reinterpret_cast<float*>( out )[j] = (float)( mode == CoaddMode_Sum ? sum : sum / count );
+				if( variance && count > 1 )
+					spread = (float)( ( squares[j] - sum * sum / count ) / ( count - 1 ) );
+			}
+			if( variance )
+				maps[j] = spread;
+		}
+		if( integer )
+			std::fill( integerSums.begin(), integerSums.end(), 0 );
+		else
+			std::fill( sums.begin(), sums.end(), 0.0 );
+		if( variance )
+			std::fill( squares.begin(), squares.end(), 0.0 );
+		added = 0;
+		stored++;
+		seconds += std::chrono::duration<double>( std::chrono::steady_clock::now() - begun ).count();
+	}
+
+	void PrintReport() const
+	{
+		if( !Active() )
+			return;
+		std::cout << "Co-adding: " << stored << " readouts stored from " << stored * count << ", "
+		          << ( stored > 0 ? seconds * 1000.0 / ( stored * count ) : 0 ) << " ms per readout";
+		if( mode == CoaddMode_ClippedMean )
+			std::cout << ", " << clipped << " pixel values clipped";
+		std::cout << std::endl;
+	}
+};
+
+// - adds each readout to the current group and passes on a stored readout
+//   once the group is full
+struct CoaddSink : ReadoutSink
+{
+	ReadoutSink&	sink;
+	CoaddStage&		coadd;
+	vector<pibyte>	reduced;		/* one stored readout */
+
+	CoaddSink(ReadoutSink& sink, CoaddStage& coadd, piint storedstride)
+		: sink(sink), coadd(coadd), reduced( coadd.Active() ? (size_t)storedstride : 0 ) {}
+
+	pibyte* RunBuffer() { return 0; }
+
+	bool Store(const pibyte* readouts, pi64s count)
+	{
+		for( pi64s k = 0; k < count; ++k )
+		{
+			coadd.Add( readouts + k * coadd.inReadoutStride );
+			if( coadd.Full() )
+			{
+				coadd.Reduce( &reduced[0] );
+				if( !sink.Store( &reduced[0], 1 ) )
+					return false;
+			}
+		}
+		return true;
+	}
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// Compression
+// - --compress[=THREADS] stores each readout losslessly compressed as one
+//   chunk; a chunk index (CaptureFileChunk per readout) after the data gives
+//   every chunk's offset and size, so any readout can still be read alone
+// - the codec predicts each pixel of an ROI from its neighbours (the JPEG-LS
+//   median edge predictor) and bit-packs the residuals in blocks of
+//   CODEC_BLOCK_PIXELS, each block taking only as many bits as its largest
+//   residual needs; metadata bytes after the pixels are stored as they are
+// - readouts are compressed on worker threads and written, in order, by the
+//   writer thread
+// - DecodeReadout is the reference decoder; --decompress=FILE uses it to
+//   write an uncompressed copy
+////////////////////////////////////////////////////////////////////////////////
+#define CODEC_BLOCK_PIXELS   32
+#define CODEC_JOBS_PER_THREAD 2
+
+// - where a compressed readout is in the file
+struct CaptureFileChunk
+{
+	uint64_t offset;                  /* bytes from the start of file  */
+	uint64_t size;                    /* compressed bytes              */
+};
+
+// - the JPEG-LS median edge predictor from the pixels left, above and above left
+inline uint16_t PredictPixel(const uint16_t* pixels, uint32_t x, uint32_t y, uint32_t columns)
+{
+	if( y == 0 )
+		return x == 0 ? 0 : pixels[x - 1];
+	const uint16_t* row = pixels + (size_t)y * columns;
+	if( x == 0 )
+		return row[(ptrdiff_t)x - (ptrdiff_t)columns];
+	int a = row[x - 1], b = row[(ptrdiff_t)x - (ptrdiff_t)columns], c = row[(ptrdiff_t)x - (ptrdiff_t)columns - 1];
+	if( c >= std::max( a, b ) )
+		return (uint16_t)std::min( a, b );
+	if( c <= std::min( a, b ) )
+		return (uint16_t)std::max( a, b );
+	return (uint16_t)( a + b - c );
+}
+
+// - writes a width byte and count values of that many bits, least significant first
+pibyte* PackBlock(const uint16_t* values, size_t count, pibyte* out)
+{
+	uint32_t all = 0;
+	for( size_t i = 0; i < count; ++i )
+		all |= values[i];
+	int bits = 0;
+	while( all >> bits )
+		bits++;
+	*out++ = (pibyte)bits;
+
+	uint64_t held = 0;
+	int heldBits = 0;
+	for( size_t i = 0; i < count; ++i )
+	{
+		held |= (uint64_t)values[i] << heldBits;
+		heldBits += bits;
+		while( heldBits >= 8 )
+		{
+			*out++ = (pibyte)held;
+			held >>= 8;
+			heldBits -= 8;
+		}
+	}
+	if( heldBits > 0 )
+		*out++ = (pibyte)held;
+	return out;
+}
+
+// - residuals of one ROI, wrapped to 16 bits and zigzagged so small
+//   differences of either sign give small values
+pibyte* EncodeRoi(const uint16_t* pixels, uint32_t columns, uint32_t rows, pibyte* out)
+{
+	uint16_t block[CODEC_BLOCK_PIXELS];
+	size_t filled = 0;
+	for( uint32_t y = 0; y < rows; ++y )
+	{
+		for( uint32_t x = 0; x < columns; ++x )
+		{
+			int16_t residual = (int16_t)(uint16_t)( pixels[(size_t)y * columns + x] - PredictPixel( pixels, x, y, columns ) );
+			block[filled++] = (uint16_t)( ( (uint32_t)(uint16_t)residual << 1 ) ^ (uint32_t)( residual >> 15 ) );
+			if( filled == CODEC_BLOCK_PIXELS )
+			{
+				out = PackBlock( block, filled, out );
+				filled = 0;
+			}
+		}
+	}
+	if( filled > 0 )
+		out = PackBlock( block, filled, out );
+	return out;
+}
+
+// - undoes EncodeRoi; false if the data runs out or is not valid
+bool DecodeRoi(const pibyte*& in, const pibyte* end, uint16_t* pixels, uint32_t columns, uint32_t rows)
+{
+	size_t total = (size_t)columns * rows;
+	uint16_t block[CODEC_BLOCK_PIXELS];
+	for( size_t first = 0; first < total; first += CODEC_BLOCK_PIXELS )
+	{
+		size_t count = std::min( (size_t)CODEC_BLOCK_PIXELS, total - first );
+		if( in >= end || *in > 16 )
+			return false;
+		int bits = *in++;
+		if( (size_t)( end - in ) < ( count * bits + 7 ) / 8 )
+			return false;
+		uint64_t held = 0;
+		int heldBits = 0;
+		for( size_t i = 0; i < count; ++i )
+		{
+			while( heldBits < bits )
+			{
+				held |= (uint64_t)*in++ << heldBits;
+				heldBits += 8;
+			}
+			block[i] = (uint16_t)( held & ( ( 1u << bits ) - 1 ) );
+			held >>= bits;
+			heldBits -= bits;
+		}
+		for( size_t i = 0; i < count; ++i )
+		{
+			uint32_t x = (uint32_t)( ( first + i ) % columns ), y = (uint32_t)( ( first + i ) / columns );
+			int16_t residual = (int16_t)( ( block[i] >> 1 ) ^ (uint16_t)( -(int)( block[i] & 1 ) ) );
+			pixels[first + i] = (uint16_t)( PredictPixel( pixels, x, y, columns ) + residual );
+		}
+	}
+	return true;
+}
+
+// - the largest a compressed readout can be
+size_t MaxChunkSize(const CaptureFileHeader& header)
+{
+	size_t pixels = header.frame_size / 2;
+	size_t blocks = pixels / CODEC_BLOCK_PIXELS + header.roi_count + 1;
+	return (size_t)header.readout_stride + blocks * header.frames_per_readout;
+}
+
+// - compresses one readout: every ROI of every frame, then any bytes after them
+void EncodeReadout(const CaptureFileHeader& header, const pibyte* readout, vector<pibyte>& chunk)
+{
+	chunk.resize( MaxChunkSize( header ) );
+	pibyte* out = &chunk[0];
+	for( uint32_t f = 0; f < header.frames_per_readout; ++f )
+	{
+		const pibyte* frame = readout + (size_t)f * header.frame_stride;
+		for( uint32_t r = 0; r < header.roi_count; ++r )
+			out = EncodeRoi( reinterpret_cast<const uint16_t*>( frame + header.rois[r].offset ), header.rois[r].columns, header.rois[r].rows, out );
+		size_t trailer = header.frame_stride - header.frame_size;
+		memcpy( out, frame + header.frame_size, trailer );
+		out += trailer;
+	}
+	size_t rest = (size_t)header.readout_stride - (size_t)header.frames_per_readout * header.frame_stride;
+	memcpy( out, readout + header.readout_stride - rest, rest );
+	out += rest;
+	chunk.resize( out - &chunk[0] );
+}
+
+// - the reference decoder: one chunk back into a readout of readout_stride bytes
+bool DecodeReadout(const CaptureFileHeader& header, const pibyte* chunk, size_t size, pibyte* readout)
+{
+	const pibyte* in = chunk;
+	const pibyte* end = chunk + size;
+	for( uint32_t f = 0; f < header.frames_per_readout; ++f )
+	{
+		pibyte* frame = readout + (size_t)f * header.frame_stride;
+		for( uint32_t r = 0; r < header.roi_count; ++r )
+			if( !DecodeRoi( in, end, reinterpret_cast<uint16_t*>( frame + header.rois[r].offset ), header.rois[r].columns, header.rois[r].rows ) )
+				return false;
+		size_t trailer = header.frame_stride - header.frame_size;
+		if( (size_t)( end - in ) < trailer )
+			return false;
+		memcpy( frame + header.frame_size, in, trailer );
+		in += trailer;
+	}
+	size_t rest = (size_t)header.readout_stride - (size_t)header.frames_per_readout * header.frame_stride;
+	if( (size_t)( end - in ) != rest )
+		return false;
+	memcpy( readout + header.readout_stride - rest, in, rest );
+	return true;
+}
+
+// - compresses readouts on worker threads and hands the chunks, in order,
+//   to the writer thread
+struct CompressingSink : ReadoutSink
+{
+	enum JobState { JobFree, JobQueued, JobWorking, JobDone };
+	struct Job
+	{
+		vector<pibyte>	raw;
+		vector<pibyte>	chunk;
+		JobState		state;
+		Job() : state(JobFree) {}
+	};
+
+	DirectWriter&				writer;
+	CaptureFileHeader			layout;
+	vector<Job>					jobs;
+	vector<std::thread>			workers;
+	std::mutex					lock;
+	std::condition_variable		changed;
+	bool						stopping;
+	size_t						submitted;
+	size_t						written;
+	vector<CaptureFileChunk>	chunks;
+	pi64s						dataOffset;
+	pi64s						packed;			/* compressed bytes written */
+	pi64s						stalls;			/* waits for a free job     */
+	double						busySeconds;	/* all workers together     */
+
+	CompressingSink(DirectWriter& writer, const CaptureFileHeader& header, pi64s dataOffset, piint threads)
+		: writer(writer), layout(header), jobs( (size_t)threads * CODEC_JOBS_PER_THREAD ), stopping(false), submitted(0), written(0),
+		  dataOffset(dataOffset), packed(0), stalls(0), busySeconds(0)
+	{
+		for( piint t = 0; t < threads; ++t )
+			workers.push_back( std::thread( &CompressingSink::Run, this ) );
+		if( threads > 0 )
+			std::cout << "Compressing on " << threads << " worker threads" << std::endl;
+	}
+
+	~CompressingSink() { Stop(); }
+
+	bool Store(const pibyte* readouts, pi64s count)
+	{
+		for( pi64s k = 0; k < count; ++k )
+		{
+			/* The oldest job must be written before its slot is reused */
+			if( !Drain( jobs.size() - 1 ) )
+				return false;
+			Job& job = jobs[submitted % jobs.size()];
+			job.raw.assign( readouts + k * layout.readout_stride, readouts + ( k + 1 ) * layout.readout_stride );
+			{
+				std::lock_guard<std::mutex> guard( lock );
+				job.state = JobQueued;
+				submitted++;
+			}
+			changed.notify_all();
+		}
+		return Drain( jobs.size() - 1 );
+	}
+
+	// - writes finished chunks in order, waiting for them while more than
+	//   pending are outstanding
+	bool Drain(size_t pending)
+	{
+		while( written < submitted )
+		{
+			Job& job = jobs[written % jobs.size()];
+			{
+				std::unique_lock<std::mutex> guard( lock );
+				if( job.state != JobDone )
+				{
+					if( submitted - written <= pending )
+						return true;
+					stalls++;
+					changed.wait( guard, [&job]{ return job.state == JobDone; } );
+				}
+			}
+			CaptureFileChunk entry = { (uint64_t)( dataOffset + packed ), job.chunk.size() };
+			if( !writer.Append( &job.chunk[0], job.chunk.size() ) )
+				return false;
+			chunks.push_back( entry );
+			packed += job.chunk.size();
+			{
+				std::lock_guard<std::mutex> guard( lock );
+				job.state = JobFree;
+			}
+			written++;
+		}
+		return true;
+	}
+
+	// - writes everything still outstanding and stops the workers
+	bool Finish()
+	{
+		bool ok = Drain( 0 );
+		Stop();
+		pi64s raw = (pi64s)chunks.size() * layout.readout_stride;
+		std::cout << "Compression: " << chunks.size() << " readouts, " << raw / (1024.0 * 1024.0) << " MB to " << packed / (1024.0 * 1024.0) << " MB";
+		if( packed > 0 )
+			std::cout << " (" << (double)raw / packed << ":1)";
+		if( busySeconds > 0 )
+			std::cout << ", " << raw / (1024.0 * 1024.0) / busySeconds << " MB/s per worker thread";
+		std::cout << std::endl;
+		if( stalls > 0 )
+			std::cout << "WARNING: " << stalls << " readouts waited for a compression worker; use more threads" << std::endl;
+		return ok;
+	}
+
+private:
+	void Stop()
+	{
+		{
+			std::lock_guard<std::mutex> guard( lock );
+			stopping = true;
+		}
+		changed.notify_all();
+		for( size_t t = 0; t < workers.size(); ++t )
+			if( workers[t].joinable() )
+				workers[t].join();
+	}
+
+	// - a worker thread: compresses queued jobs until stopped
+	void Run()
+	{
+		std::unique_lock<std::mutex> guard( lock );
+		while( true )
+		{
+			Job* job = 0;
+			for( size_t i = 0; i < jobs.size() && !job; ++i )
+				if( jobs[i].state == JobQueued )
+					job = &jobs[i];
+			if( !job )
+			{
+				if( stopping )
+					return;
+				changed.wait( guard );
+				continue;
+			}
+			job->state = JobWorking;
+			guard.unlock();
+			std::chrono::steady_clock::time_point begun = std::chrono::steady_clock::now();
+			EncodeReadout( layout, &job->raw[0], job->chunk );
+			std::chrono::steady_clock::time_point ended = std::chrono::steady_clock::now();
+			double seconds = std::chrono::duration<double>( ended - begun ).count();
+			Logging.Span( "Compress readout", begun, ended );
+			guard.lock();
+			busySeconds += seconds;
+			job->state = JobDone;
+			changed.notify_all();
+		}
+	}
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// Frame Statistics
+// - --stats[=THREADS] computes the minimum, maximum, mean, standard
+//   deviation, saturated pixel count and a STATS_HISTOGRAM_BINS bin
+//   histogram of every frame the camera delivers, before any correction or
+//   co-adding, and stores them as a table of CaptureFileFrameStats after the
+//   readouts, so a saturated, blank or corrupted frame shows up without
+//   loading the frames themselves
+// - each frame is gone over once: the kernels keep the minimum, maximum,
+//   sums and saturated count in vector registers and bin the same pixels
+//   while they are at hand, with AVX2, SSE2 or plain C++ as for correction
+// - readouts are copied to worker threads (default 1) and the results taken
+//   back in order on the acquisition thread, which also checks the rule
+// - --abort-if=METRIC>VALUE (or <) stops the run once --abort-frames=N
+//   frames in a row (default 1) meet it.  METRIC is saturated (the fraction
+//   of a frame's pixels at the saturation level), min, max, mean or std.
+//   The frames so far are kept as an incomplete file and the run ends with
+//   CaptureResult_Aborted
+////////////////////////////////////////////////////////////////////////////////
+#define STATS_HISTOGRAM_BINS  16
+#define STATS_JOBS_PER_THREAD 4
+
+// - one frame of the statistics table
+struct CaptureFileFrameStats
+{
+	uint64_t frame;                   /* from 0, over the whole run    */
+	uint16_t min;
+	uint16_t max;
+	uint32_t saturated;               /* pixels at stats_saturation    */
+	double   mean;
+	double   std;
+	uint32_t histogram[STATS_HISTOGRAM_BINS];	/* pixel >> stats_shift */
+};
+
+// - what the kernels add up over the pixels of a frame
+struct FrameSums
+{
+	uint64_t	sum;
+	uint64_t	squares;
+	uint64_t	saturated;
+	uint16_t	min;
+	uint16_t	max;
+	uint32_t	histogram[STATS_HISTOGRAM_BINS];
+
+	FrameSums() : sum(0), squares(0), saturated(0), min(65535), max(0) { memset( histogram, 0, sizeof(histogram) ); }
+};
+
+void StatsScalar(const uint16_t* pixels, size_t n, uint16_t saturation, int shift, FrameSums& sums)
+{
+	for( size_t i = 0; i < n; ++i )
+	{
+		uint32_t value = pixels[i];
+		sums.sum += value;
+		sums.squares += (uint64_t)value * value;
+		sums.saturated += value >= saturation;
+		sums.min = (uint16_t)std::min<uint32_t>( sums.min, value );
+		sums.max = (uint16_t)std::max<uint32_t>( sums.max, value );
+		sums.histogram[( value >> shift ) & ( STATS_HISTOGRAM_BINS - 1 )]++;
+	}
+}
+
+#ifdef CORRECTION_X86
+// - bins 8 pixels already shifted down, into 4 histograms so neighbouring
+//   pixels of the same bin do not wait for each other
+inline void BinPixels(const uint16_t* binned, uint32_t (*histograms)[STATS_HISTOGRAM_BINS])
+{
+	for( int k = 0; k < 8; ++k )
+		histograms[k & 3][binned[k] & ( STATS_HISTOGRAM_BINS - 1 )]++;
+}
+
+inline void MergeHistograms(const uint32_t (*histograms)[STATS_HISTOGRAM_BINS], uint32_t* histogram)
+{
+	for( int b = 0; b < STATS_HISTOGRAM_BINS; ++b )
+		histogram[b] += histograms[0][b] + histograms[1][b] + histograms[2][b] + histograms[3][b];
+}
+
+void StatsSse2(const uint16_t* pixels, size_t n, uint16_t saturation, int shift, FrameSums& sums)
+{
+	/* SSE2 compares and takes the minimum of signed 16-bit values only: flip the sign bit */
+	const __m128i flip = _mm_set1_epi16( (short)0x8000 );
+	const __m128i low = _mm_set1_epi16( 0x00FF );
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i ceiling = _mm_set1_epi16( (short)( saturation ^ 0x8000 ) );
+	__m128i lowest = _mm_set1_epi16( (short)0x7FFF ), highest = _mm_set1_epi16( (short)0x8000 );
+	const __m128i one = _mm_set1_epi16( 1 );
+	const __m128i count = _mm_cvtsi32_si128( shift );
+	__m128i sum = zero, squares = zero, saturated = zero;
+	uint16_t binned[8];
+	uint32_t histograms[4][STATS_HISTOGRAM_BINS] = {};
+	size_t i = 0, since = 0;
+	for( ; i + 8 <= n; i += 8 )
+	{
+		__m128i v = _mm_loadu_si128( (const __m128i*)( pixels + i ) );
+		__m128i s = _mm_xor_si128( v, flip );
+		lowest = _mm_min_epi16( lowest, s );
+		highest = _mm_max_epi16( highest, s );
+		/* at or above saturation: not below it */
+		saturated = _mm_add_epi16( saturated, _mm_andnot_si128( _mm_cmplt_epi16( s, ceiling ), one ) );
+		/* a byte-wise sum of absolute differences from 0 adds up the bytes */
+		sum = _mm_add_epi64( sum, _mm_add_epi64( _mm_sad_epu8( _mm_and_si128( v, low ), zero ), _mm_slli_epi64( _mm_sad_epu8( _mm_srli_epi16( v, 8 ), zero ), 8 ) ) );
+		__m128i lo = _mm_unpacklo_epi16( v, zero ), hi = _mm_unpackhi_epi16( v, zero );
+		squares = _mm_add_epi64( squares, _mm_add_epi64( _mm_mul_epu32( lo, lo ), _mm_mul_epu32( _mm_srli_epi64( lo, 32 ), _mm_srli_epi64( lo, 32 ) ) ) );
+		squares = _mm_add_epi64( squares, _mm_add_epi64( _mm_mul_epu32( hi, hi ), _mm_mul_epu32( _mm_srli_epi64( hi, 32 ), _mm_srli_epi64( hi, 32 ) ) ) );
+		_mm_storeu_si128( (__m128i*)binned, _mm_srl_epi16( v, count ) );
+		BinPixels( binned, histograms );
+		/* the 16-bit saturated counts are emptied before they can wrap */
+		if( ++since == 32768 )
+		{
+			uint16_t counts[8];
+			_mm_storeu_si128( (__m128i*)counts, saturated );
+			for( int k = 0; k < 8; ++k )
+				sums.saturated += counts[k];
+			saturated = zero;
+			since = 0;
+		}
+	}
+	uint16_t lanes[8];
+	uint64_t wide[2];
+	_mm_storeu_si128( (__m128i*)lanes, _mm_xor_si128( lowest, flip ) );
+	for( int k = 0; k < 8; ++k )
+		sums.min = std::min( sums.min, lanes[k] );
+	_mm_storeu_si128( (__m128i*)lanes, _mm_xor_si128( highest, flip ) );
+	for( int k = 0; k < 8; ++k )
+		sums.max = std::max( sums.max, lanes[k] );
+	_mm_storeu_si128( (__m128i*)lanes, saturated );
+	for( int k = 0; k < 8; ++k )
+		sums.saturated += lanes[k];
+	_mm_storeu_si128( (__m128i*)wide, sum );
+	sums.sum += wide[0] + wide[1];
+	_mm_storeu_si128( (__m128i*)wide, squares );
+	sums.squares += wide[0] + wide[1];
+	MergeHistograms( histograms, sums.histogram );
+	StatsScalar( pixels + i, n - i, saturation, shift, sums );
+}
+
+CORRECTION_AVX2_TARGET
+void StatsAvx2(const uint16_t* pixels, size_t n, uint16_t saturation, int shift, FrameSums& sums)
+{
+	const __m256i low = _mm256_set1_epi16( 0x00FF );
+	const __m256i zero = _mm256_setzero_si256();
+	const __m256i ceiling = _mm256_set1_epi16( (short)saturation );
+	const __m128i count = _mm_cvtsi32_si128( shift );
+	__m256i lowest = _mm256_set1_epi16( -1 ), highest = zero;
+	__m256i sum = zero, squares = zero, saturated = zero;
+	uint16_t binned[16];
+	uint32_t histograms[4][STATS_HISTOGRAM_BINS] = {};
+	size_t i = 0, since = 0;
+	for( ; i + 16 <= n; i += 16 )
+	{
+		__m256i v = _mm256_loadu_si256( (const __m256i*)( pixels + i ) );
+		lowest = _mm256_min_epu16( lowest, v );
+		highest = _mm256_max_epu16( highest, v );
+		/* v >= saturation exactly when max(v, saturation) == v; that is -1 */
+		saturated = _mm256_sub_epi16( saturated, _mm256_cmpeq_epi16( _mm256_max_epu16( v, ceiling ), v ) );
+		sum = _mm256_add_epi64( sum, _mm256_add_epi64( _mm256_sad_epu8( _mm256_and_si256( v, low ), zero ), _mm256_slli_epi64( _mm256_sad_epu8( _mm256_srli_epi16( v, 8 ), zero ), 8 ) ) );
+		__m256i lo = _mm256_cvtepu16_epi32( _mm256_castsi256_si128( v ) ), hi = _mm256_cvtepu16_epi32( _mm256_extracti128_si256( v, 1 ) );
+		squares = _mm256_add_epi64( squares, _mm256_add_epi64( _mm256_mul_epu32( lo, lo ), _mm256_mul_epu32( _mm256_srli_epi64( lo, 32 ), _mm256_srli_epi64( lo, 32 ) ) ) );
+		squares = _mm256_add_epi64( squares, _mm256_add_epi64( _mm256_mul_epu32( hi, hi ), _mm256_mul_epu32( _mm256_srli_epi64( hi, 32 ), _mm256_srli_epi64( hi, 32 ) ) ) );
+		_mm256_storeu_si256( (__m256i*)binned, _mm256_srl_epi16( v, count ) );
+		BinPixels( binned, histograms );
+		BinPixels( binned + 8, histograms );
+		if( ++since == 32768 )
+		{
+			uint16_t counts[16];
+			_mm256_storeu_si256( (__m256i*)counts, saturated );
+			for( int k = 0; k < 16; ++k )
+				sums.saturated += counts[k];
+			saturated = zero;
+			since = 0;
+		}
+	}
+	uint16_t lanes[16];
+	uint64_t wide[4];
+	_mm256_storeu_si256( (__m256i*)lanes, lowest );
+	for( int k = 0; k < 16; ++k )
+		sums.min = std::min( sums.min, lanes[k] );
+	_mm256_storeu_si256( (__m256i*)lanes, highest );
+	for( int k = 0; k < 16; ++k )
+		sums.max = std::max( sums.max, lanes[k] );
+	_mm256_storeu_si256( (__m256i*)lanes, saturated );
+	for( int k = 0; k < 16; ++k )
+		sums.saturated += lanes[k];
+	_mm256_storeu_si256( (__m256i*)wide, sum );
+	sums.sum += wide[0] + wide[1] + wide[2] + wide[3];
+	_mm256_storeu_si256( (__m256i*)wide, squares );
+	sums.squares += wide[0] + wide[1] + wide[2] + wide[3];
+	MergeHistograms( histograms, sums.histogram );
+	StatsScalar( pixels + i, n - i, saturation, shift, sums );
+}
+#endif
+
+void FrameStats(CorrectionKernel kernel, const uint16_t* pixels, size_t n, uint16_t saturation, int shift, FrameSums& sums)
+{
+#ifdef CORRECTION_X86
+	if( kernel == CorrectionKernel_Avx2 )
+		return StatsAvx2( pixels, n, saturation, shift, sums );
+	if( kernel == CorrectionKernel_Sse2 )
+		return StatsSse2( pixels, n, saturation, shift, sums );
+#endif
+	StatsScalar( pixels, n, saturation, shift, sums );
+}
+
+// - whether two kernels came to the same statistics
+bool SameSums(const FrameSums& a, const FrameSums& b)
+{
+	return a.sum == b.sum && a.squares == b.squares && a.saturated == b.saturated && a.min == b.min && a.max == b.max &&
+	       memcmp( a.histogram, b.histogram, sizeof(a.histogram) ) == 0;
+}
+
+// - the --abort-if rule
+struct AbortRule
+{
+	enum Metric { None, Saturated, Min, Max, Mean, Std };
+	Metric		metric;
+	bool		above;		/* > rather than <         */
+	double		limit;
+	piint		frames;		/* in a row to stop the run */
+
+	AbortRule() : metric(None), above(true), limit(0), frames(1) {}
+
+	bool Active() const { return metric != None; }
+
+	// - METRIC>VALUE or METRIC<VALUE
+	bool Parse(const string& text)
+	{
+		const char* names[] = { "", "saturated", "min", "max", "mean", "std" };
+		size_t op = text.find_first_of( "<>" );
+		if( op == string::npos || op + 1 >= text.size() )
+			return false;
+		char* end;
+		limit = strtod( text.c_str() + op + 1, &end );
+		if( *end != 0 )
+			return false;
+		above = text[op] == '>';
+		for( int m = Saturated; m <= Std; ++m )
+			if( text.compare( 0, op, names[m] ) == 0 )
+			{
+				metric = (Metric)m;
+				return true;
+			}
+		return false;
+	}
+
+	// - the metric of one frame of pixels pixels
+	double Value(const CaptureFileFrameStats& stats, size_t pixels) const
+	{
+		switch( metric )
+		{
+		case Saturated: return pixels > 0 ? (double)stats.saturated / pixels : 0;
+		case Min:       return stats.min;
+		case Max:       return stats.max;
+		case Mean:      return stats.mean;
+		case Std:       return stats.std;
+		default:        return 0;
+		}
+	}
+
+	bool Met(const CaptureFileFrameStats& stats, size_t pixels) const
+	{
+		double value = Value( stats, pixels );
+		return above ? value > limit : value < limit;
+	}
+
+	string Describe() const
+	{
+		const char* names[] = { "", "saturated", "min", "max", "mean", "std" };
+		std::ostringstream text;
+		text << names[metric] << ( above ? ">" : "<" ) << limit;
+		return text.str();
+	}
+};
+
+// - works out the statistics of each readout on worker threads on its way
+//   to another sink and keeps them, in order, for the file
+struct StatsSink : ReadoutSink
+{
+	enum JobState { JobFree, JobQueued, JobWorking, JobDone };
+	struct Job
+	{
+		vector<pibyte>			raw;
+		vector<CaptureFileFrameStats>	stats;
+		JobState				state;
+		Job() : state(JobFree) {}
+	};
+
+	ReadoutSink&				sink;
+	CaptureFileHeader			layout;			/* the camera's */
+	CorrectionKernel			kernel;
+	uint16_t					saturation;
+	int							shift;
+	size_t						pixels;			/* per frame */
+	AbortRule					rule;
+	vector<Job>					jobs;
+	vector<std::thread>			workers;
+	std::mutex					lock;
+	std::condition_variable		changed;
+	bool						stopping;
+	size_t						submitted;
+	size_t						collected;
+	vector<CaptureFileFrameStats>	frames;
+	piint						inARow;			/* frames meeting the rule */
+	string						abortReason;
+	pi64s						stalls;
+	double						busySeconds;
+
+	StatsSink(ReadoutSink& sink, const CaptureFileHeader& header, const CaptureOptions& options)
+		: sink(sink), layout(header), kernel(BestCorrectionKernel()), pixels(header.frame_size / 2),
+		  jobs( (size_t)options.StatsThreads * STATS_JOBS_PER_THREAD ), stopping(false), submitted(0), collected(0), inARow(0), stalls(0), busySeconds(0)
+	{
+		int depth = header.pixel_bit_depth > 0 && header.pixel_bit_depth <= 16 ? header.pixel_bit_depth : 16;
+		saturation = (uint16_t)( ( 1u << depth ) - 1 );
+		shift = std::max( 0, depth - 4 );
+		if( !options.AbortIf.empty() )
+			rule.Parse( options.AbortIf );
+		rule.frames = options.AbortFrames;
+		for( piint t = 0; t < options.StatsThreads; ++t )
+			workers.push_back( std::thread( &StatsSink::Run, this ) );
+		if( options.StatsThreads > 0 )
+			std::cout << "Frame statistics on " << options.StatsThreads << " worker thread(s) with the " << CorrectionKernelName( kernel ) << " kernel"
+			          << ( rule.Active() ? ", stopping on " + rule.Describe() : string() ) << std::endl;
+	}
+
+	~StatsSink() { Stop(); }
+
+	/* The statistics are of a copy, so PICAM can still use the file directly */
+	pibyte* RunBuffer() { return sink.RunBuffer(); }
+
+	bool Store(const pibyte* readouts, pi64s count)
+	{
+		for( pi64s k = 0; k < count; ++k )
+		{
+			if( !Collect( jobs.size() - 1 ) )
+				return false;
+			Job& job = jobs[submitted % jobs.size()];
+			job.raw.assign( readouts + k * layout.readout_stride, readouts + ( k + 1 ) * layout.readout_stride );
+			{
+				std::lock_guard<std::mutex> guard( lock );
+				job.state = JobQueued;
+				submitted++;
+			}
+			changed.notify_all();
+		}
+		return sink.Store( readouts, count ) && Collect( jobs.size() - 1 );
+	}
+
+	string StopReason() const
+	{
+		return abortReason.empty() ? sink.StopReason() : abortReason;
+	}
+
+	// - takes finished results in order, waiting for them while more than
+	//   pending are outstanding, and checks them against the rule
+	bool Collect(size_t pending)
+	{
+		while( collected < submitted )
+		{
+			Job& job = jobs[collected % jobs.size()];
+			{
+				std::unique_lock<std::mutex> guard( lock );
+				if( job.state != JobDone )
+				{
+					if( submitted - collected <= pending )
+						return true;
+					stalls++;
+					changed.wait( guard, [&job]{ return job.state == JobDone; } );
+				}
+			}
+			for( size_t f = 0; f < job.stats.size(); ++f )
+			{
+				job.stats[f].frame = frames.size();
+				frames.push_back( job.stats[f] );
+				if( !rule.Active() || !abortReason.empty() )
+					continue;
+				inARow = rule.Met( job.stats[f], pixels ) ? inARow + 1 : 0;
+				if( inARow >= rule.frames )
+				{
+					std::ostringstream reason;
+					reason << "frame " << frames.size() << " met --abort-if=" << rule.Describe() << " (" << rule.Value( job.stats[f], pixels ) << ")";
+					if( rule.frames > 1 )
+						reason << ", " << rule.frames << " frames in a row";
+					abortReason = reason.str();
+				}
+			}
+			{
+				std::lock_guard<std::mutex> guard( lock );
+				job.state = JobFree;
+			}
+			collected++;
+		}
+		return true;
+	}
+
+	// - takes everything still outstanding and stops the workers
+	void Finish()
+	{
+		Collect( 0 );
+		Stop();
+		PrintReport();
+	}
+
+	void PrintReport() const
+	{
+		if( frames.empty() )
+			return;
+		uint16_t lowest = 65535, highest = 0;
+		double means = 0, worst = 0;
+		pi64s saturatedFrames = 0;
+		for( size_t f = 0; f < frames.size(); ++f )
+		{
+			lowest = std::min( lowest, frames[f].min );
+			highest = std::max( highest, frames[f].max );
+			means += frames[f].mean;
+			worst = std::max( worst, pixels > 0 ? (double)frames[f].saturated / pixels : 0.0 );
+			saturatedFrames += frames[f].saturated > 0;
+		}
+		std::cout << "Frame statistics: " << frames.size() << " frames, values " << lowest << " to " << highest << ", mean " << means / frames.size()
+		          << ", " << saturatedFrames << " frames with saturated pixels (worst " << worst * 100 << "%)";
+		if( busySeconds > 0 )
+			std::cout << ", " << busySeconds * 1000.0 / frames.size() << " ms per frame";
+		std::cout << std::endl;
+		if( stalls > 0 )
+			std::cout << "WARNING: " << stalls << " readouts waited for a statistics worker; use more threads" << std::endl;
+		if( !abortReason.empty() )
+			std::cout << "WARNING: aborted, " << abortReason << std::endl;
+	}
+
+private:
+	void Stop()
+	{
+		{
+			std::lock_guard<std::mutex> guard( lock );
+			stopping = true;
+		}
+		changed.notify_all();
+		for( size_t t = 0; t < workers.size(); ++t )
+			if( workers[t].joinable() )
+				workers[t].join();
+	}
+
+	// - one readout's frames
+	void Measure(Job& job)
+	{
+		job.stats.resize( layout.frames_per_readout );
+		for( uint32_t f = 0; f < layout.frames_per_readout; ++f )
+		{
+			FrameSums sums;
+			FrameStats( kernel, reinterpret_cast<const uint16_t*>( &job.raw[(size_t)f * layout.frame_stride] ), pixels, saturation, shift, sums );
+			CaptureFileFrameStats& stats = job.stats[f];
+			memset( &stats, 0, sizeof(stats) );
+			stats.min = pixels > 0 ? sums.min : 0;
+			stats.max = sums.max;
+			stats.saturated = (uint32_t)sums.saturated;
+			stats.mean = pixels > 0 ? (double)sums.sum / pixels : 0;
+			stats.std = pixels > 0 ? sqrt( std::max( 0.0, (double)sums.squares / pixels - stats.mean * stats.mean ) ) : 0;
+			memcpy( stats.histogram, sums.histogram, sizeof(stats.histogram) );
+		}
+	}
+
+	// - a worker thread: measures queued readouts until stopped
+	void Run()
+	{
+		std::unique_lock<std::mutex> guard( lock );
+		while( true )
+		{
+			Job* job = 0;
+			for( size_t i = 0; i < jobs.size() && !job; ++i )
+				if( jobs[i].state == JobQueued )
+					job = &jobs[i];
+			if( !job )
+			{
+				if( stopping )
+					return;
+				changed.wait( guard );
+				continue;
+			}
+			job->state = JobWorking;
+			guard.unlock();
+			std::chrono::steady_clock::time_point begun = std::chrono::steady_clock::now();
+			Measure( *job );
+			std::chrono::steady_clock::time_point ended = std::chrono::steady_clock::now();
+			Logging.Span( "Frame statistics", begun, ended );
+			guard.lock();
+			busySeconds += std::chrono::duration<double>( ended - begun ).count();
+			job->state = JobDone;
+			changed.notify_all();
+		}
+	}
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// Spot Centroiding
+// - --centroid[=THREADS] finds the spots of every frame the camera delivers
+//   and stores them as a table of CaptureFileSpot after the readouts;
+//   --centroid-only stores the table instead of the frames, so a spot
+//   tracking run writes a few bytes per spot rather than megabytes per frame
+// - the background of each ROI is the median of each CENTROID_TILE pixel
+//   tile and the noise the median absolute deviation from it; pixels more
+//   than --spot-threshold=SIGMA (default CENTROID_THRESHOLD) noise above the
+//   background are joined into 8-connected spots of at least
+//   --spot-min-pixels=N, and each spot's position and FWHM are the
+//   intensity weighted mean and spread of its pixels above the background
+// - the --max-spots=N (default CENTROID_MAX_SPOTS) brightest spots of a frame
+//   are kept; --thumbnails=R also keeps the (2R+1) x (2R+1) pixels around the
+//   peak of each, in the order of the table
+// - frames are searched on worker threads (default half the cores) and the
+//   spots taken back in order on the acquisition thread
+////////////////////////////////////////////////////////////////////////////////
+#define CENTROID_TILE           32		/* pixels across a background tile */
+#define CENTROID_NOISE_STRIDE   7		/* every 7th pixel estimates the noise */
+#define CENTROID_JOBS_PER_THREAD 2
+#define FWHM_PER_SIGMA          2.35482	/* of a Gaussian */
+#define MAD_PER_SIGMA           1.4826
+
+// - one spot of the table
+struct CaptureFileSpot
+{
+	uint64_t frame;                   /* from 0, over the whole run    */
+	uint32_t spot;                    /* from 0 in a frame, brightest first */
+	uint32_t roi;                     /* from 0                        */
+	double   x;                       /* sensor pixels, intensity weighted */
+	double   y;
+	double   flux;                    /* counts above the background   */
+	double   fwhm;                    /* sensor pixels                 */
+	double   background;              /* counts per pixel under it     */
+	uint32_t pixels;                  /* above the threshold           */
+	uint16_t peak_column;             /* brightest pixel, in the ROI   */
+	uint16_t peak_row;
+};
+
+struct SpotSettings
+{
+	double		threshold;		/* noise sigma */
+	uint32_t	minPixels;
+	uint32_t	maxSpots;
+	uint32_t	thumbnailRadius;
+};
+
+// - buffers a worker reuses from frame to frame
+struct SpotScratch
+{
+	vector<uint16_t>	samples;
+	vector<float>		background;		/* per tile */
+	vector<float>		limit;			/* per tile */
+	vector<pibyte>		visited;
+	vector<uint32_t>	stack;
+};
+
+// - finds the spots of one ROI of a frame and adds them to spots
+void FindSpots(const uint16_t* pixels, const CaptureFileRoi& roi, uint32_t roiIndex, const SpotSettings& settings, SpotScratch& scratch, vector<CaptureFileSpot>& spots)
+{
+	uint32_t columns = roi.columns, rows = roi.rows;
+	size_t n = (size_t)columns * rows;
+	if( n == 0 )
+		return;
+	uint32_t tilesX = ( columns + CENTROID_TILE - 1 ) / CENTROID_TILE, tilesY = ( rows + CENTROID_TILE - 1 ) / CENTROID_TILE;
+	scratch.background.resize( (size_t)tilesX * tilesY );
+	scratch.limit.resize( scratch.background.size() );
+
+	/* The median of each tile (every other row is plenty) is its background */
+	for( uint32_t ty = 0; ty < tilesY; ++ty )
+		for( uint32_t tx = 0; tx < tilesX; ++tx )
+		{
+			scratch.samples.clear();
+			for( uint32_t y = ty * CENTROID_TILE; y < std::min( rows, ( ty + 1 ) * CENTROID_TILE ); y += 2 )
+				scratch.samples.insert( scratch.samples.end(), pixels + (size_t)y * columns + tx * CENTROID_TILE,
+				                        pixels + (size_t)y * columns + std::min( columns, ( tx + 1 ) * CENTROID_TILE ) );
+			std::nth_element( scratch.samples.begin(), scratch.samples.begin() + scratch.samples.size() / 2, scratch.samples.end() );
+			scratch.background[(size_t)ty * tilesX + tx] = scratch.samples[scratch.samples.size() / 2];
+		}
+
+	/* and the median deviation from it the noise */
+	scratch.samples.clear();
+	for( size_t i = 0; i < n; i += CENTROID_NOISE_STRIDE )
+	{
+		float level = scratch.background[( i / columns / CENTROID_TILE ) * tilesX + ( i % columns ) / CENTROID_TILE];
+		scratch.samples.push_back( (uint16_t)std::min( 65535.0f, fabsf( pixels[i] - level ) ) );
+	}
+	std::nth_element( scratch.samples.begin(), scratch.samples.begin() + scratch.samples.size() / 2, scratch.samples.end() );
+	double sigma = std::max( 1.0, MAD_PER_SIGMA * scratch.samples[scratch.samples.size() / 2] );
+	for( size_t t = 0; t < scratch.limit.size(); ++t )
+		scratch.limit[t] = (float)( scratch.background[t] + settings.threshold * sigma );
+
+	/* Every pixel over the limit not yet in a spot starts one */
+	scratch.visited.assign( n, 0 );
+	for( uint32_t y = 0; y < rows; ++y )
+	{
+		const float* limits = &scratch.limit[( y / CENTROID_TILE ) * tilesX];
+		for( uint32_t x = 0; x < columns; ++x )
+		{
+			size_t i = (size_t)y * columns + x;
+			if( pixels[i] <= limits[x / CENTROID_TILE] || scratch.visited[i] )
+				continue;
+			double weight = 0, sx = 0, sy = 0, sxx = 0, syy = 0, level = 0;
+			uint32_t count = 0, peak = (uint32_t)i;
+			scratch.stack.assign( 1, (uint32_t)i );
+			scratch.visited[i] = 1;
+			while( !scratch.stack.empty() )
+			{
+				uint32_t at = scratch.stack.back();
+				scratch.stack.pop_back();
+				uint32_t px = at % columns, py = at / columns;
+				size_t tile = ( py / CENTROID_TILE ) * tilesX + px / CENTROID_TILE;
+				double w = pixels[at] - scratch.background[tile];
+				weight += w;
+				sx += w * px;
+				sy += w * py;
+				sxx += w * px * px;
+				syy += w * py * py;
+				level += scratch.background[tile];
+				count++;
+				if( pixels[at] > pixels[peak] )
+					peak = at;
+				for( int dy = -1; dy <= 1; ++dy )
+					for( int dx = -1; dx <= 1; ++dx )
+					{
+						int nx = (int)px + dx, ny = (int)py + dy;
+						if( nx < 0 || ny < 0 || nx >= (int)columns || ny >= (int)rows )
+							continue;
+						size_t j = (size_t)ny * columns + nx;
+						if( !scratch.visited[j] && pixels[j] > scratch.limit[( ny / CENTROID_TILE ) * tilesX + nx / CENTROID_TILE] )
+						{
+							scratch.visited[j] = 1;
+							scratch.stack.push_back( (uint32_t)j );
+						}
+					}
+			}
+			if( count < settings.minPixels || weight <= 0 )
+				continue;
+
+			/* Binned ROI pixels to sensor pixels */
+			double cx = sx / weight, cy = sy / weight;
+			double vx = std::max( 0.0, sxx / weight - cx * cx ), vy = std::max( 0.0, syy / weight - cy * cy );
+			CaptureFileSpot spot;
+			memset( &spot, 0, sizeof(spot) );
+			spot.roi = roiIndex;
+			spot.x = roi.x + cx * roi.x_binning + ( roi.x_binning - 1 ) * 0.5;
+			spot.y = roi.y + cy * roi.y_binning + ( roi.y_binning - 1 ) * 0.5;
+			spot.flux = weight;
+			spot.fwhm = FWHM_PER_SIGMA * sqrt( ( vx * roi.x_binning * roi.x_binning + vy * roi.y_binning * roi.y_binning ) / 2 );
+			spot.background = level / count;
+			spot.pixels = count;
+			spot.peak_column = (uint16_t)( peak % columns );
+			spot.peak_row = (uint16_t)( peak / columns );
+			spots.push_back( spot );
+		}
+	}
+}
+
+// - the (2R+1) x (2R+1) pixels around the peak of a spot, 0 off the ROI
+void CutThumbnail(const uint16_t* pixels, const CaptureFileRoi& roi, const CaptureFileSpot& spot, uint32_t radius, uint16_t* out)
+{
+	int size = 2 * (int)radius + 1;
+	for( int dy = 0; dy < size; ++dy )
+		for( int dx = 0; dx < size; ++dx )
+		{
+			int x = spot.peak_column + dx - (int)radius, y = spot.peak_row + dy - (int)radius;
+			bool inside = x >= 0 && y >= 0 && x < (int)roi.columns && y < (int)roi.rows;
+			*out++ = inside ? pixels[(size_t)y * roi.columns + x] : 0;
+		}
+}
+
+// - takes readouts and keeps nothing, for --centroid-only
+struct DiscardSink : ReadoutSink
+{
+	bool Store(const pibyte*, pi64s) { return true; }
+};
+
+// - finds the spots of each readout on worker threads on its way to another
+//   sink and keeps them, in order, for the file
+struct CentroidSink : ReadoutSink
+{
+	enum JobState { JobFree, JobQueued, JobWorking, JobDone };
+	struct Job
+	{
+		vector<pibyte>			raw;
+		vector<CaptureFileSpot>	spots;			/* frame is within the readout */
+		vector<uint16_t>		thumbnails;
+		JobState				state;
+		Job() : state(JobFree) {}
+	};
+
+	ReadoutSink&				sink;
+	CaptureFileHeader			layout;			/* the camera's */
+	SpotSettings				settings;
+	vector<Job>					jobs;
+	vector<std::thread>			workers;
+	std::mutex					lock;
+	std::condition_variable		changed;
+	bool						stopping;
+	size_t						submitted;
+	size_t						collected;
+	vector<CaptureFileSpot>		spots;
+	vector<uint16_t>			thumbnails;
+	pi64s						frames;			/* searched */
+	pi64s						empty;			/* without a spot */
+	pi64s						stalls;
+	double						busySeconds;
+
+	CentroidSink(ReadoutSink& sink, const CaptureFileHeader& header, const CaptureOptions& options)
+		: sink(sink), layout(header), jobs( (size_t)options.CentroidThreads * CENTROID_JOBS_PER_THREAD ), stopping(false),
+		  submitted(0), collected(0), frames(0), empty(0), stalls(0), busySeconds(0)
+	{
+		settings.threshold = options.SpotThreshold;
+		settings.minPixels = options.SpotMinPixels;
+		settings.maxSpots = options.MaxSpots;
+		settings.thumbnailRadius = options.ThumbnailRadius;
+		for( piint t = 0; t < options.CentroidThreads; ++t )
+			workers.push_back( std::thread( &CentroidSink::Run, this ) );
+		if( options.CentroidThreads > 0 )
+			std::cout << "Finding spots " << settings.threshold << " sigma above the background on " << options.CentroidThreads << " worker thread(s)"
+			          << ( options.CentroidOnly ? "; the frames are not stored" : "" ) << std::endl;
+	}
+
+	~CentroidSink() { Stop(); }
+
+	pibyte* RunBuffer() { return sink.RunBuffer(); }
+
+	// - the room the spots of count frames can take at most
+	static pi64s MaxBytes(const CaptureOptions& options, pi64s count)
+	{
+		size_t side = 2 * (size_t)options.ThumbnailRadius + 1;
+		return count * options.MaxSpots * (pi64s)( sizeof(CaptureFileSpot) + ( options.ThumbnailRadius > 0 ? side * side * sizeof(uint16_t) : 0 ) );
+	}
+
+	bool Store(const pibyte* readouts, pi64s count)
+	{
+		for( pi64s k = 0; k < count; ++k )
+		{
+			Collect( jobs.size() - 1 );
+			Job& job = jobs[submitted % jobs.size()];
+			job.raw.assign( readouts + k * layout.readout_stride, readouts + ( k + 1 ) * layout.readout_stride );
+			{
+				std::lock_guard<std::mutex> guard( lock );
+				job.state = JobQueued;
+				submitted++;
+			}
+			changed.notify_all();
+		}
+		bool stored = sink.Store( readouts, count );
+		Collect( jobs.size() - 1 );
+		return stored;
+	}
+
+	string StopReason() const { return sink.StopReason(); }
+
+	// - takes finished spots in order, waiting for them while more than
+	//   pending are outstanding
+	void Collect(size_t pending)
+	{
+		while( collected < submitted )
+		{
+			Job& job = jobs[collected % jobs.size()];
+			{
+				std::unique_lock<std::mutex> guard( lock );
+				if( job.state != JobDone )
+				{
+					if( submitted - collected <= pending )
+						return;
+					stalls++;
+					changed.wait( guard, [&job]{ return job.state == JobDone; } );
+				}
+			}
+			for( size_t s = 0; s < job.spots.size(); ++s )
+			{
+				job.spots[s].frame += frames;
+				spots.push_back( job.spots[s] );
+			}
+			thumbnails.insert( thumbnails.end(), job.thumbnails.begin(), job.thumbnails.end() );
+			frames += layout.frames_per_readout;
+			{
+				std::lock_guard<std::mutex> guard( lock );
+				job.state = JobFree;
+			}
+			collected++;
+		}
+	}
+
+	// - takes everything still outstanding and stops the workers
+	void Finish()
+	{
+		Collect( 0 );
+		Stop();
+		if( frames == 0 )
+			return;
+		std::cout << "Spots: " << spots.size() << " in " << frames << " frames (" << (double)spots.size() / frames << " per frame, "
+		          << empty << " frames without any)";
+		if( busySeconds > 0 )
+			std::cout << ", " << busySeconds * 1000.0 / frames << " ms per frame";
+		std::cout << std::endl;
+		if( stalls > 0 )
+			std::cout << "WARNING: " << stalls << " readouts waited for a centroiding worker; use more threads" << std::endl;
+	}
+
+private:
+	void Stop()
+	{
+		{
+			std::lock_guard<std::mutex> guard( lock );
+			stopping = true;
+		}
+		changed.notify_all();
+		for( size_t t = 0; t < workers.size(); ++t )
+			if( workers[t].joinable() )
+				workers[t].join();
+	}
+
+	// - the spots of one readout's frames, brightest first in each
+	void Search(Job& job, SpotScratch& scratch)
+	{
+		job.spots.clear();
+		job.thumbnails.clear();
+		size_t side = 2 * (size_t)settings.thumbnailRadius + 1;
+		for( uint32_t f = 0; f < layout.frames_per_readout; ++f )
+		{
+			const pibyte* frame = &job.raw[(size_t)f * layout.frame_stride];
+			size_t first = job.spots.size();
+			for( uint32_t r = 0; r < layout.roi_count; ++r )
+				FindSpots( reinterpret_cast<const uint16_t*>( frame + layout.rois[r].offset ), layout.rois[r], r, settings, scratch, job.spots );
+			std::sort( job.spots.begin() + first, job.spots.end(), []( const CaptureFileSpot& a, const CaptureFileSpot& b ) { return a.flux > b.flux; } );
+			if( job.spots.size() - first > settings.maxSpots )
+				job.spots.resize( first + settings.maxSpots );
+			if( job.spots.size() == first )
+			{
+				std::lock_guard<std::mutex> guard( lock );
+				empty++;
+			}
+			for( size_t s = first; s < job.spots.size(); ++s )
+			{
+				job.spots[s].frame = f;
+				job.spots[s].spot = (uint32_t)( s - first );
+				if( settings.thumbnailRadius == 0 )
+					continue;
+				const CaptureFileRoi& roi = layout.rois[job.spots[s].roi];
+				job.thumbnails.resize( job.thumbnails.size() + side * side );
+				CutThumbnail( reinterpret_cast<const uint16_t*>( frame + roi.offset ), roi, job.spots[s], settings.thumbnailRadius, &job.thumbnails[job.thumbnails.size() - side * side] );
+			}
+		}
+	}
+
+	// - a worker thread: searches queued readouts until stopped
+	void Run()
+	{
+		SpotScratch scratch;
+		std::unique_lock<std::mutex> guard( lock );
+		while( true )
+		{
+			Job* job = 0;
+			for( size_t i = 0; i < jobs.size() && !job; ++i )
+				if( jobs[i].state == JobQueued )
+					job = &jobs[i];
+			if( !job )
+			{
+				if( stopping )
+					return;
+				changed.wait( guard );
+				continue;
+			}
+			job->state = JobWorking;
+			guard.unlock();
+			std::chrono::steady_clock::time_point begun = std::chrono::steady_clock::now();
+			Search( *job, scratch );
+			std::chrono::steady_clock::time_point ended = std::chrono::steady_clock::now();
+			Logging.Span( "Find spots", begun, ended );
+			guard.lock();
+			busySeconds += std::chrono::duration<double>( ended - begun ).count();
+			job->state = JobDone;
+			changed.notify_all();
+		}
+	}
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// TIFF Export
+// - --tiff[=FILE] also writes every stored frame as a page of a multi-page
+//   TIFF (FILE, default the capture file with .tif appended), one file per
+//   ROI (FILE_roi2.tif, ... for the extra ROIs)
+// - each page is its IFD, then the values too long for the IFD, then the
+//   pixels as one strip; the IFD's next-page offset points at where the
+//   following page will start, so pages are written one after the other and
+//   only the last is patched if the run ends early
+// - BigTIFF is used when the run could reach 4 GB
+////////////////////////////////////////////////////////////////////////////////
+#define TIFF_CLASSIC_LIMIT   0xFFFFFFFFull	/* largest classic TIFF offset */
+#define TIFF_BUFFER_SIZE     (4 * 1024 * 1024)
+
+#define TIFF_SHORT     3
+#define TIFF_LONG      4
+#define TIFF_RATIONAL  5
+#define TIFF_ASCII     2
+#define TIFF_LONG8     16
+
+// - the pages of one ROI
+struct TiffWriter
+{
+	struct Entry
+	{
+		uint16_t		tag;
+		uint16_t		type;
+		uint64_t		count;
+		vector<pibyte>	value;
+	};
+
+	string			path;
+	FILE*			file;
+	bool			big;			/* BigTIFF */
+	uint32_t		width, height;
+	uint16_t		bits, format;
+	pi64s			pageBytes;		/* pixels of a page     */
+	pi64s			position;		/* end of what is written */
+	pi64s			lastNext;		/* next-page field of the last page */
+	pi64s			pages;
+	pi64s			expected;
+	string			description;
+	vector<pibyte>	page;
+
+	TiffWriter() : file(0), big(false), width(0), height(0), bits(0), format(0), pageBytes(0), position(0), lastNext(0), pages(0), expected(0) {}
+	~TiffWriter() { if( file ) fclose( file ); }
+
+	// - creates the file for expectedPages pages of the given size
+	bool Open(const string& filePath, uint32_t columns, uint32_t rows, piint bytesPerPixel, bool floating, pi64s expectedPages, const string& text)
+	{
+		path = filePath;
+		width = columns;
+		height = rows;
+		bits = (uint16_t)( bytesPerPixel * 8 );
+		format = floating ? 3 : 1;
+		pageBytes = (pi64s)columns * rows * bytesPerPixel;
+		expected = expectedPages;
+		description = text;
+		big = ( PageOverhead( false ) + pageBytes ) * expectedPages + 8 > (pi64s)TIFF_CLASSIC_LIMIT;
+
+		file = fopen( ( path + ".partial" ).c_str(), "wb" );
+		if( !file )
+			return false;
+		setvbuf( file, 0, _IOFBF, TIFF_BUFFER_SIZE );
+
+		/* Little-endian header; the first page follows it */
+		pibyte head[16] = { 'I', 'I' };
+		if( big )
+		{
+			Put( head + 2, 43, 2 );
+			Put( head + 4, 8, 2 );
+			Put( head + 8, 16, 8 );
+			position = 16;
+		}
+		else
+		{
+			Put( head + 2, 42, 2 );
+			Put( head + 4, 8, 4 );
+			position = 8;
+		}
+		return fwrite( head, (size_t)position, 1, file ) == 1;
+	}
+
+	// - adds one page whose pixels are row after row at pixels
+	bool AddPage(const pibyte* pixels)
+	{
+		vector<Entry> entries;
+		AddEntry( entries, 256, TIFF_LONG, 1, width );
+		AddEntry( entries, 257, TIFF_LONG, 1, height );
+		AddEntry( entries, 258, TIFF_SHORT, 1, bits );
+		AddEntry( entries, 259, TIFF_SHORT, 1, 1 );				/* no compression */
+		AddEntry( entries, 262, TIFF_SHORT, 1, 1 );				/* black is zero  */
+		if( pages == 0 && !description.empty() )
+			AddText( entries, 270, description );
+		AddEntry( entries, 273, big ? TIFF_LONG8 : TIFF_LONG, 1, 0 );	/* filled below */
+		AddEntry( entries, 277, TIFF_SHORT, 1, 1 );
+		AddEntry( entries, 278, TIFF_LONG, 1, height );
+		AddEntry( entries, 279, big ? TIFF_LONG8 : TIFF_LONG, 1, (uint64_t)pageBytes );
+		AddEntry( entries, 282, TIFF_RATIONAL, 1, 1 | ( 1ull << 32 ) );
+		AddEntry( entries, 283, TIFF_RATIONAL, 1, 1 | ( 1ull << 32 ) );
+		AddEntry( entries, 284, TIFF_SHORT, 1, 1 );				/* contiguous     */
+		AddEntry( entries, 296, TIFF_SHORT, 1, 1 );				/* no unit        */
+		AddText( entries, 305, "ConfigAndCapture" );
+		AddEntry( entries, 339, TIFF_SHORT, 1, format );
+
+		/* IFD, then the values that do not fit in it, then the pixels */
+		size_t entrySize = big ? 20 : 12;
+		size_t countSize = big ? 8 : 2;
+		size_t inlineSize = big ? 8 : 4;
+		size_t ifdBytes = countSize + entries.size() * entrySize + inlineSize;
+		size_t extraBytes = 0;
+		for( size_t i = 0; i < entries.size(); ++i )
+			if( entries[i].value.size() > inlineSize )
+				extraBytes += ( entries[i].value.size() + 1 ) & ~(size_t)1;
+		pi64s pixelsAt = position + (pi64s)( ifdBytes + extraBytes );
+		for( size_t i = 0; i < entries.size(); ++i )
+			if( entries[i].tag == 273 )
+				Put( &entries[i].value[0], (uint64_t)pixelsAt, big ? 8 : 4 );
+
+		page.assign( ifdBytes + extraBytes, 0 );
+		Put( &page[0], entries.size(), countSize );
+		size_t at = countSize;
+		size_t extra = ifdBytes;
+		for( size_t i = 0; i < entries.size(); ++i, at += entrySize )
+		{
+			const Entry& entry = entries[i];
+			Put( &page[at], entry.tag, 2 );
+			Put( &page[at + 2], entry.type, 2 );
+			Put( &page[at + 4], entry.count, big ? 8 : 4 );
+			pibyte* value = &page[at + 4 + ( big ? 8 : 4 )];
+			if( entry.value.size() <= inlineSize )
+				memcpy( value, &entry.value[0], entry.value.size() );
+			else
+			{
+				Put( value, (uint64_t)( position + extra ), inlineSize );
+				memcpy( &page[extra], &entry.value[0], entry.value.size() );
+				extra += ( entry.value.size() + 1 ) & ~(size_t)1;
+			}
+		}
+
+		/* The next page starts right behind this one, if there is to be one */
+		pi64s end = pixelsAt + ( ( pageBytes + 1 ) & ~(pi64s)1 );
+		lastNext = position + (pi64s)( at );
+		Put( &page[at], pages + 1 < expected ? (uint64_t)end : 0, inlineSize );
+
+		bool ok = fwrite( &page[0], page.size(), 1, file ) == 1 && fwrite( pixels, (size_t)pageBytes, 1, file ) == 1;
+		if( ok && ( pageBytes & 1 ) )
+			ok = fputc( 0, file ) != EOF;
+		position = end;
+		pages++;
+		return ok;
+	}
+
+	// - ends the last page's chain and, if every page is in, puts the file
+	//   in place
+	bool Close(bool complete)
+	{
+		if( !file )
+			return false;
+		bool ok = true;
+		if( pages > 0 && pages < expected )
+		{
+			pibyte zero[8] = { 0 };
+			ok = FileSeek( file, lastNext ) == 0 && fwrite( zero, big ? 8 : 4, 1, file ) == 1;
+		}
+		ok = fclose( file ) == 0 && ok;
+		file = 0;
+		if( ok && complete )
+			ok = RenameIntoPlace( path + ".partial", path );
+		return ok;
+	}
+
+private:
+	// - bytes a page takes besides its pixels
+	pi64s PageOverhead(bool bigTiff) const
+	{
+		return ( bigTiff ? 8 + 17 * 20 + 8 : 2 + 17 * 12 + 4 ) + 16 + 18 + ( (pi64s)description.size() + 2 );
+	}
+
+	static void Put(pibyte* at, uint64_t value, size_t bytes)
+	{
+		for( size_t i = 0; i < bytes; ++i, value >>= 8 )
+			at[i] = (pibyte)( value & 0xFF );
+	}
+
+	static void AddEntry(vector<Entry>& entries, uint16_t tag, uint16_t type, uint64_t count, uint64_t value)
+	{
+		Entry entry;
+		entry.tag = tag;
+		entry.type = type;
+		entry.count = count;
+		size_t bytes = type == TIFF_SHORT ? 2 : type == TIFF_LONG ? 4 : 8;
+		entry.value.resize( bytes );
+		Put( &entry.value[0], value, bytes );
+		entries.push_back( entry );
+	}
+
+	static void AddText(vector<Entry>& entries, uint16_t tag, const string& text)
+	{
+		Entry entry;
+		entry.tag = tag;
+		entry.type = TIFF_ASCII;
+		entry.count = text.size() + 1;
+		entry.value.assign( text.begin(), text.end() );
+		entry.value.push_back( 0 );
+		entries.push_back( entry );
+	}
+};
+
+// - tees the stored readouts into one TiffWriter per ROI
+struct TiffSink : ReadoutSink
+{
+	ReadoutSink&			sink;
+	CaptureFileHeader		layout;
+	vector<TiffWriter>		writers;
+	double					seconds;
+
+	TiffSink(ReadoutSink& sink, const CaptureFileHeader& header) : sink(sink), layout(header), seconds(0) {}
+
+	// - the file of ROI index (0 for the first)
+	static string RoiPath(const string& path, piint index)
+	{
+		if( index == 0 )
+			return path;
+		std::ostringstream suffix;
+		suffix << "_roi" << index + 1;
+		size_t dot = path.find_last_of('.');
+		size_t slash = path.find_last_of("/\\");
+		if( dot == string::npos || ( slash != string::npos && dot < slash ) )
+			return path + suffix.str();
+		return path.substr( 0, dot ) + suffix.str() + path.substr( dot );
+	}
+
+	bool Open(const string& path, pi64s readouts)
+	{
+		writers.resize( layout.roi_count );
+		for( uint32_t r = 0; r < layout.roi_count; ++r )
+		{
+			const CaptureFileRoi& roi = layout.rois[r];
+			std::ostringstream text;
+			text << "ROI " << r + 1 << " of " << layout.roi_count << ": x " << roi.x << " y " << roi.y << " width " << roi.width
+			     << " height " << roi.height << " binning " << roi.x_binning << "x" << roi.y_binning << ", exposure "
+			     << layout.exposure_time << " ms";
+			if( !writers[r].Open( RoiPath( path, r ), roi.columns, roi.rows, layout.bytes_per_pixel,
+			                      layout.pixel_type == CAPTURE_PIXEL_FLOAT32, readouts * layout.frames_per_readout, text.str() ) )
+			{
+				std::cout << "FAILED TO OPEN TIFF FILE: " << RoiPath( path, r ) << std::endl;
+				return false;
+			}
+		}
+		std::cout << "Writing " << ( writers.empty() || !writers[0].big ? "TIFF" : "BigTIFF" ) << " pages to " << path << std::endl;
+		return true;
+	}
+
+	/* PICAM may still acquire straight into the capture file */
+	pibyte* RunBuffer() { return sink.RunBuffer(); }
+
+	bool Store(const pibyte* readouts, pi64s count)
+	{
+		std::chrono::steady_clock::time_point begun = std::chrono::steady_clock::now();
+		bool ok = true;
+		for( pi64s k = 0; k < count && ok; ++k )
+			for( uint32_t f = 0; f < layout.frames_per_readout && ok; ++f )
+			{
+				const pibyte* frame = readouts + k * layout.readout_stride + f * layout.frame_stride;
+				for( size_t r = 0; r < writers.size() && ok; ++r )
+					ok = writers[r].AddPage( frame + layout.rois[r].offset );
+			}
+		seconds += std::chrono::duration<double>( std::chrono::steady_clock::now() - begun ).count();
+		if( !ok )
+			std::cout << "FAILED TO WRITE TIFF PAGE" << std::endl;
+		return ok && sink.Store( readouts, count );
+	}
+
+	bool Close(bool complete)
+	{
+		bool ok = true;
+		for( size_t r = 0; r < writers.size(); ++r )
+			ok = writers[r].Close( complete ) && ok;
+		if( !writers.empty() )
+			std::cout << "TIFF: " << writers[0].pages << " pages per ROI in " << seconds * 1000.0 << " ms" << std::endl;
+		return ok;
+	}
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// Shared Ring
+// - --shared-ring=NAME publishes every readout, as the camera delivers it,
+//   into a named shared memory ring of --ring-slots=N (default 8) slots that
+//   any number of other processes can read while the run goes on
+// - the writer never waits for readers: each slot carries a sequence number
+//   that is odd while the slot is being written and 2 x (readout + 1) once
+//   it holds that readout, so a reader checks the number before and after
+//   looking at the pixels and knows when it was lapped
+// - the layout (CaptureFileHeader of the camera's readouts) sits in the ring
+//   header, so readers need nothing else to find the ROIs
+// - named "Local\NAME" on Windows and "/NAME" (/dev/shm/NAME) elsewhere; it
+//   goes away when the run ends and the last reader lets go
+// - --watch=NAME follows a ring from another process and prints the mean
+//   and peak of ROI 1 of every readout it sees
+////////////////////////////////////////////////////////////////////////////////
+#define SHARED_RING_MAGIC       "PIRING01"
+#define SHARED_RING_VERSION     1
+#define SHARED_RING_HEADER_SIZE 4096
+#define SHARED_RING_SLOT_HEADER 64
+#define SHARED_RING_WAIT_SECONDS 30		/* --watch waits this long for the ring */
+
+enum SharedRingState
+{
+	SharedRingState_Running = 1,
+	SharedRingState_Done = 2
+};
+
+// - at the start of the ring; all counts are in readouts
+struct SharedRingHeader
+{
+	char                  magic[8];       /* SHARED_RING_MAGIC             */
+	uint32_t              version;
+	uint32_t              header_size;    /* first slot                    */
+	uint32_t              slot_count;
+	std::atomic<uint32_t> state;          /* SharedRingState               */
+	uint64_t              slot_size;      /* bytes from slot to slot       */
+	uint64_t              readout_bytes;  /* after each slot's header      */
+	std::atomic<uint64_t> published;      /* readouts published so far     */
+	uint64_t              reserved[2];
+	CaptureFileHeader     layout;         /* at byte 64                    */
+};
+
+// - in front of every readout in the ring
+struct SharedRingSlot
+{
+	std::atomic<uint64_t> sequence;       /* odd while written, else 2 x (readout + 1) */
+	int64_t               timestamp;      /* wall clock, microseconds since 1970 */
+	uint64_t              reserved[6];
+};
+
+enum SharedRingRead
+{
+	SharedRingRead_Ok,
+	SharedRingRead_NotYet,
+	SharedRingRead_Lapped
+};
+
+// - a named shared memory region, created by the writer or opened by a reader
+struct SharedRegion
+{
+	string		name;
+	pibyte*		data;
+	size_t		size;
+	bool		owner;
+#ifdef _WIN32
+	HANDLE		mapping;
+#endif
+
+#ifdef _WIN32
+	SharedRegion() : data(0), size(0), owner(false), mapping(0) {}
+#else
+	SharedRegion() : data(0), size(0), owner(false) {}
+#endif
+	~SharedRegion() { Close(); }
+
+	bool Create(const string& ringName, size_t bytes)
+	{
+		name = ringName;
+		size = bytes;
+		owner = true;
+#ifdef _WIN32
+		mapping = CreateFileMappingA( INVALID_HANDLE_VALUE, 0, PAGE_READWRITE, (DWORD)( (uint64_t)bytes >> 32 ), (DWORD)bytes, ( "Local\\" + name ).c_str() );
+		if( !mapping )
+			return false;
+		data = static_cast<pibyte*>( MapViewOfFile( mapping, FILE_MAP_ALL_ACCESS, 0, 0, bytes ) );
+#else
+		int handle = shm_open( ( "/" + name ).c_str(), O_CREAT | O_RDWR | O_TRUNC, 0644 );
+		if( handle < 0 )
+			return false;
+		void* mapped = ftruncate( handle, (off_t)bytes ) == 0 ? mmap( 0, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, handle, 0 ) : MAP_FAILED;
+		close( handle );
+		data = mapped == MAP_FAILED ? 0 : static_cast<pibyte*>( mapped );
+#endif
+		return data != 0;
+	}
+
+	// - maps an existing region read-only; false if there is none yet
+	bool Open(const string& ringName)
+	{
+		name = ringName;
+		owner = false;
+#ifdef _WIN32
+		mapping = OpenFileMappingA( FILE_MAP_READ, FALSE, ( "Local\\" + name ).c_str() );
+		if( !mapping )
+			return false;
+		data = static_cast<pibyte*>( MapViewOfFile( mapping, FILE_MAP_READ, 0, 0, 0 ) );
+		MEMORY_BASIC_INFORMATION info;
+		size = data && VirtualQuery( data, &info, sizeof(info) ) ? info.RegionSize : 0;
+#else
+		int handle = shm_open( ( "/" + name ).c_str(), O_RDONLY, 0 );
+		if( handle < 0 )
+			return false;
+		off_t end = lseek( handle, 0, SEEK_END );
+		void* mapped = end > 0 ? mmap( 0, (size_t)end, PROT_READ, MAP_SHARED, handle, 0 ) : MAP_FAILED;
+		close( handle );
+		data = mapped == MAP_FAILED ? 0 : static_cast<pibyte*>( mapped );
+		size = data ? (size_t)end : 0;
+#endif
+		return data != 0;
+	}
+
+	void Close()
+	{
+#ifdef _WIN32
+		if( data )
+			UnmapViewOfFile( data );
+		if( mapping )
+			CloseHandle( mapping );
+		mapping = 0;
+#else
+		if( data )
+			munmap( data, size );
+		if( owner && !name.empty() )
+			shm_unlink( ( "/" + name ).c_str() );
+#endif
+		data = 0;
+		owner = false;
+		name.clear();
+	}
+};
+
+// - publishes the camera's readouts; a tee in front of the rest of the sinks
+struct SharedRingSink : ReadoutSink
+{
+	ReadoutSink&		sink;
+	SharedRegion		region;
+	SharedRingHeader*	ring;
+	pi64s				published;
+
+	SharedRingSink(ReadoutSink& sink) : sink(sink), ring(0), published(0) {}
+	~SharedRingSink()
+	{
+		if( ring )
+			ring->state = SharedRingState_Done;
+	}
+
+	bool Open(const string& name, const CaptureFileHeader& layout, piint slots)
+	{
+		uint64_t slotSize = ( SHARED_RING_SLOT_HEADER + layout.readout_stride + CAPTURE_FILE_PAGE_SIZE - 1 ) / CAPTURE_FILE_PAGE_SIZE * CAPTURE_FILE_PAGE_SIZE;
+		if( !region.Create( name, (size_t)( SHARED_RING_HEADER_SIZE + slots * slotSize ) ) )
+		{
+			std::cout << "FAILED TO CREATE SHARED RING: " << name << std::endl;
+			return false;
+		}
+		ring = new( region.data ) SharedRingHeader();
+		ring->version = SHARED_RING_VERSION;
+		ring->header_size = SHARED_RING_HEADER_SIZE;
+		ring->slot_count = slots;
+		ring->slot_size = slotSize;
+		ring->readout_bytes = layout.readout_stride;
+		ring->published = 0;
+		ring->layout = layout;
+		for( piint s = 0; s < slots; ++s )
+			new( Slot( s ) ) SharedRingSlot();
+		ring->state = SharedRingState_Running;
+
+		/* The magic goes in last, once the rest is there to be read */
+		std::atomic_thread_fence( std::memory_order_release );
+		memcpy( ring->magic, SHARED_RING_MAGIC, sizeof(ring->magic) );
+		std::cout << "Publishing readouts to shared ring " << name << " (" << slots << " slots of " << slotSize / 1024.0 << " KB)" << std::endl;
+		return true;
+	}
+
+	/* PICAM may still acquire straight into the capture file */
+	pibyte* RunBuffer() { return sink.RunBuffer(); }
+
+	bool Store(const pibyte* readouts, pi64s count)
+	{
+		int64_t now = WallClockMicroseconds();
+		for( pi64s k = 0; k < count; ++k, ++published )
+		{
+			SharedRingSlot* slot = Slot( (piint)( published % ring->slot_count ) );
+			slot->sequence.store( 2 * (uint64_t)published + 1, std::memory_order_relaxed );
+			std::atomic_thread_fence( std::memory_order_release );
+			slot->timestamp = now;
+			memcpy( reinterpret_cast<pibyte*>( slot ) + SHARED_RING_SLOT_HEADER, readouts + k * ring->readout_bytes, (size_t)ring->readout_bytes );
+			slot->sequence.store( 2 * (uint64_t)( published + 1 ), std::memory_order_release );
+			ring->published.store( published + 1, std::memory_order_release );
+		}
+		return sink.Store( readouts, count );
+	}
+
+private:
+	SharedRingSlot* Slot(piint s)
+	{
+		return reinterpret_cast<SharedRingSlot*>( region.data + SHARED_RING_HEADER_SIZE + s * ring->slot_size );
+	}
+};
+
+// - fills a FrameArray, frame after frame, on the readouts' way to another
+//   sink: a file captured as well, or nothing
+struct ArraySink : ReadoutSink
+{
+	ReadoutSink&		sink;
+	FrameArray&			array;
+	CaptureFileHeader	layout;
+	pi64s				stored;		/* frames */
+
+	ArraySink(ReadoutSink& sink, FrameArray& array, const CaptureFileHeader& header) : sink(sink), array(array), layout(header), stored(0) {}
+
+	/* PICAM may still acquire straight into the capture file */
+	pibyte* RunBuffer() { return sink.RunBuffer(); }
+
+	bool Store(const pibyte* readouts, pi64s count)
+	{
+		size_t pixels = (size_t)array.rows * array.columns;
+		for( pi64s k = 0; k < count; ++k )
+			for( uint32_t f = 0; f < layout.frames_per_readout && stored < array.frames; ++f, ++stored )
+			{
+				const pibyte* frame = readouts + k * layout.readout_stride + f * layout.frame_stride + layout.rois[0].offset;
+				TransposeFrame( reinterpret_cast<const uint16_t*>( frame ), array.rows, array.columns, array.data + stored * pixels );
+			}
+		return sink.Store( readouts, count );
+	}
+
+	string StopReason() const { return sink.StopReason(); }
+};
+
+// - allocates array for ROI 1 of NFrames readouts laid out as header says,
+//   if its owner asked for that; false if it is not there or does not fit
+bool FitFrameArray(FrameArray& array, const CaptureFileHeader& header, int NFrames)
+{
+	pi64s frames = (pi64s)NFrames * header.frames_per_readout;
+	if( array.allocate )
+	{
+		array.rows = (piint)header.rois[0].rows;
+		array.columns = (piint)header.rois[0].columns;
+		array.frames = frames;
+		array.data = array.allocate( array.rows, array.columns, array.frames, array.context );
+		if( !array.data )
+		{
+			std::cout << "ERROR: no memory for a " << array.rows << " x " << array.columns << " x " << array.frames << " array" << std::endl;
+			return false;
+		}
+	}
+	if( !array.data || array.rows != (piint)header.rois[0].rows || array.columns != (piint)header.rois[0].columns || array.frames != frames )
+	{
+		std::cout << "ERROR: the array is " << array.rows << " x " << array.columns << " x " << array.frames << ", the capture "
+		          << header.rois[0].rows << " x " << header.rois[0].columns << " x " << frames << std::endl;
+		return false;
+	}
+	return true;
+}
+
+// - reads a ring published by another process, in place
+struct SharedRingReader
+{
+	SharedRegion			region;
+	const SharedRingHeader*	ring;
+
+	SharedRingReader() : ring(0) {}
+
+	bool Attach(const string& name)
+	{
+		if( !region.Open( name ) )
+			return false;
+		ring = reinterpret_cast<const SharedRingHeader*>( region.data );
+		std::atomic_thread_fence( std::memory_order_acquire );
+		if( region.size < SHARED_RING_HEADER_SIZE || memcmp( ring->magic, SHARED_RING_MAGIC, sizeof(ring->magic) ) != 0 ||
+		    region.size < SHARED_RING_HEADER_SIZE + ring->slot_count * ring->slot_size )
+		{
+			region.Close();
+			ring = 0;
+			return false;
+		}
+		return true;
+	}
+
+	uint64_t Published() const { return ring->published.load( std::memory_order_acquire ); }
+	bool Done() const { return ring->state.load( std::memory_order_acquire ) == SharedRingState_Done; }
+
+	// - readout (from 0) in the ring, or 0 if it is not there; the pixels may
+	//   only be trusted if Check( readout ) still says so after use
+	const pibyte* Readout(uint64_t readout, int64_t* timestamp = 0) const
+	{
+		const SharedRingSlot* slot = Slot( readout );
+		if( slot->sequence.load( std::memory_order_acquire ) != 2 * ( readout + 1 ) )
+			return 0;
+		if( timestamp )
+			*timestamp = slot->timestamp;
+		return reinterpret_cast<const pibyte*>( slot ) + SHARED_RING_SLOT_HEADER;
+	}
+
+	// - whether readout is (still) in its slot
+	SharedRingRead Check(uint64_t readout) const
+	{
+		if( readout >= Published() )
+			return SharedRingRead_NotYet;
+		std::atomic_thread_fence( std::memory_order_acquire );
+		return Slot( readout )->sequence.load( std::memory_order_relaxed ) == 2 * ( readout + 1 ) ? SharedRingRead_Ok : SharedRingRead_Lapped;
+	}
+
+private:
+	const SharedRingSlot* Slot(uint64_t readout) const
+	{
+		return reinterpret_cast<const SharedRingSlot*>( region.data + ring->header_size + ( readout % ring->slot_count ) * ring->slot_size );
+	}
+};
+
+// - follows the ring NAME until its run is over, printing what it sees
+int WatchSharedRing(const string& name)
+{
+	SharedRingReader reader;
+	std::chrono::steady_clock::time_point begun = std::chrono::steady_clock::now();
+	while( !reader.Attach( name ) )
+	{
+		if( std::chrono::steady_clock::now() - begun > std::chrono::seconds( SHARED_RING_WAIT_SECONDS ) )
+		{
+			std::cout << "No shared ring " << name << " appeared within " << SHARED_RING_WAIT_SECONDS << " seconds" << std::endl;
+			return CaptureResult_FileError;
+		}
+		std::this_thread::sleep_for( std::chrono::milliseconds( 10 ) );
+	}
+	const CaptureFileRoi& roi = reader.ring->layout.rois[0];
+	std::cout << "Watching " << name << ": " << roi.columns << " x " << roi.rows << " ROI 1, " << reader.ring->slot_count << " slots" << std::endl;
+
+	uint64_t next = 0, seen = 0, lapped = 0;
+	while( true )
+	{
+		uint64_t published = reader.Published();
+		if( next >= published )
+		{
+			if( reader.Done() )
+				break;
+			std::this_thread::sleep_for( std::chrono::milliseconds( 1 ) );
+			continue;
+		}
+		/* Fell more than a ring behind: skip to the oldest still there */
+		if( published - next > reader.ring->slot_count )
+		{
+			lapped += published - reader.ring->slot_count - next;
+			next = published - reader.ring->slot_count;
+		}
+
+		int64_t timestamp = 0;
+		const pibyte* readout = reader.Readout( next, &timestamp );
+		double sum = 0;
+		uint16_t peak = 0;
+		if( readout )
+		{
+			const uint16_t* pixels = reinterpret_cast<const uint16_t*>( readout + roi.offset );
+			for( size_t i = 0; i < (size_t)roi.columns * roi.rows; ++i )
+			{
+				sum += pixels[i];
+				peak = std::max( peak, pixels[i] );
+			}
+		}
+		if( readout && reader.Check( next ) == SharedRingRead_Ok )
+		{
+			seen++;
+			std::cout << "Readout " << next + 1 << ": mean " << sum / ( (double)roi.columns * roi.rows ) << ", peak " << peak
+			          << ", " << ( WallClockMicroseconds() - timestamp ) / 1000.0 << " ms old" << std::endl;
+		}
+		else
+			lapped++;
+		next++;
+	}
+	std::cout << "Saw " << seen << " of " << reader.Published() << " readouts; lapped on " << lapped << std::endl;
+	return CaptureResult_Saved;
+}
+
+void SetFltParameter(PicamHandle camera, PicamParameter parameter, piflt floatval)
+{
+	PicamError error;
+	pibln committed;
+	piflt CurrentFltVal;
+	piflt DefaultFltVal;
+
+	std::cout << "= = = = = = = = = " << std::endl;
+
+	// Display Current Val
+	std::cout << "Getting value of ";
+	PrintEnumString(PicamEnumeratedType_Parameter, parameter);
+	std::cout << ": ";
+	error = Picam_GetParameterFloatingPointValue(camera, parameter, &CurrentFltVal);
+	PrintError(error);
+	if(error == PicamError_None)
+	{
+		PrintEnumString(PicamEnumeratedType_Parameter, parameter);
+		std::cout << " is set to: " << CurrentFltVal << std::endl;
+	}
+
+	// Display read value
+	pibln readable;
+	std::cout << "Checking if value is readable from hardware: ";
+	error = Picam_CanReadParameter( camera, parameter, &readable );
+	PrintError(error);
+	std::cout << "Readability is: " << readable << std::endl;
+
+	// Display Default Val
+	std::cout << "Reading Default Value: ";
+	error = Picam_GetParameterFloatingPointDefaultValue(camera, parameter, &DefaultFltVal);
+	PrintError(error);
+	if(error == PicamError_None)
+	{
+		PrintEnumString(PicamEnumeratedType_Parameter, parameter);
+		std::cout << " default value is: " << DefaultFltVal << std::endl;
+	}
+
+
+	// Get Constraint Types
+	PicamConstraintType ConstraintType;
+	std::cout << "Getting Constraint Type: ";
+	error = Picam_GetParameterConstraintType(camera, parameter, &ConstraintType);
+	PrintError(error);
+	if(error == PicamError_None)
+	{
+		std::cout << "Constraint Type is: ";\
+		PrintEnumString(PicamEnumeratedType_ConstraintType, ConstraintType);
+		std::cout << std::endl;
+	}
+	if(ConstraintType == PicamConstraintType_Range)
+	{
+		const PicamRangeConstraint* RecConstraint;
+		const PicamRangeConstraint* ReqConstraint;
+		std::cout << "Getting Range Constraints: ";
+		// error = Picam_GetParameterRangeConstraint( camera, parameter, PicamConstraintCategory category, const PicamRangeConstraint** constraint );
+		error = Picam_GetParameterRangeConstraint( camera, parameter, PicamConstraintCategory_Required, &ReqConstraint );
+		PrintError(error);
+		error = Picam_GetParameterRangeConstraint( camera, parameter, PicamConstraintCategory_Recommended, &RecConstraint );
+		PrintError(error);
+		std::cout << "Max Possible Val is: " << ReqConstraint-> maximum << std::endl;
+		std::cout << "Min Possible val is: " << ReqConstraint-> minimum << std::endl;
+		std::cout << "Possible Increment is: " << ReqConstraint -> increment << std::endl;
+
+		std::cout << "Max Recommended Val is: " << RecConstraint-> maximum << std::endl;
+		std::cout << "Min Recommended val is: " << RecConstraint-> minimum << std::endl;
+		std::cout << "Recommended Increment is: " << RecConstraint -> increment << std::endl;
+
+		std::cout << "Destroying range constraints: ";
+		error = Picam_DestroyRangeConstraints(RecConstraint);
+		PrintError(error);
+		error = Picam_DestroyRangeConstraints(ReqConstraint);
+		PrintError(error);
+	}
+	if(ConstraintType == PicamConstraintType_Collection)
+	{
+		const PicamCollectionConstraint* RecConstraint;
+		const PicamCollectionConstraint* ReqConstraint;
+		std::cout << "Getting Collection Constraints: ";
+		// error = Picam_GetParameterCollectionConstraint( camera, parameter, PicamConstraintCategory_Required, &constraint );
+		error = Picam_GetParameterCollectionConstraint( camera, parameter, PicamConstraintCategory_Required, &ReqConstraint );
+		PrintError(error);
+		error = Picam_GetParameterCollectionConstraint( camera, parameter, PicamConstraintCategory_Recommended, &RecConstraint );
+		PrintError(error);
+
+		std::cout << "Number of allowable values is: " << ReqConstraint -> values_count << std::endl;
+		std::cout << "Allowable values are: ";
+		piint maxval = ReqConstraint->values_count;
+		int count = 0;
+		for ( count = 0; count <= maxval -1; count++)
+		{	
+			std::cout << ReqConstraint->values_array[count] << " ";
+		}
+		
+		std::cout << std::endl << "Number of recommended values is: " << RecConstraint -> values_count << std::endl;
+		std::cout << "Allowable values are: ";
+		count = 0;
+		for ( count = 0; count <= maxval -1; count++)
+		{	
+			std::cout << RecConstraint->values_array[count] << " ";
+		}
+
+		std::cout << std::endl;
+		std::cout << "Destroying collection constraints: ";
+		error = Picam_DestroyCollectionConstraints(RecConstraint);
+		PrintError(error);
+		error = Picam_DestroyCollectionConstraints(ReqConstraint);
+		PrintError(error);
+	}
+
+	
+	// Check if settable
+	std::cout << "Checking if parameter is settable to value: ";
+	pibln settable;
+	error = Picam_CanSetParameterFloatingPointValue( camera, parameter, floatval, &settable);
+	PrintError(error);
+	std::cout << "Settability is: " << settable << std::endl;
+	
+
+	// Set Val
+	std::cout << "Setting  ";
+	PrintEnumString(PicamEnumeratedType_Parameter, parameter);
+	std::cout << " to: " << floatval << std::endl;
+	//    std::cout << "Setting " << ExposureTime << " ms exposure time: ";
+    error = 
+        Picam_SetParameterFloatingPointValue(
+            camera,
+            parameter,
+            floatval );
+    PrintError( error );
+
+    // - show that the modified parameters need to be applied to hardware
+    Picam_AreParametersCommitted( camera, &committed );
+    if( committed )
+        std::cout << "Parameters have not changed.  Not going to commit." << std::endl;
+    else
+	{
+        std::cout << "Parameters have been modified" << std::endl;
+
+		// - apply the changes to hardware
+		std::cout << "Commit to hardware: ";
+		const PicamParameter* failed_parameters;
+		piint failed_parameters_count;
+		error =
+			Picam_CommitParameters(
+				camera,
+				&failed_parameters,
+				&failed_parameters_count );
+		PrintError( error );
+		if( failed_parameters_count > 0 )
+		{
+			std::cout << "THE FOLLOWING PARAMETERS ARE INVALID: " << std::endl;
+			for( piint i = 0; i < failed_parameters_count; ++i )
+			{
+				std::cout << "FAILED TO COMMIT PARAMETER: ";
+				std::cout << "    ";
+				PrintEnumString(
+					PicamEnumeratedType_Parameter,
+					failed_parameters[i] );
+				std::cout << std::endl;
+			}
+		}
+
+	// Read Val Again
+	std::cout << "Reading value of ";
+	PrintEnumString(PicamEnumeratedType_Parameter, parameter);
+	std::cout << ": ";
+	error = Picam_GetParameterFloatingPointValue(camera, parameter, &CurrentFltVal);
+	PrintError(error);
+	if(error == PicamError_None)
+	{
+		PrintEnumString(PicamEnumeratedType_Parameter, parameter);
+		std::cout << " is set to: " << CurrentFltVal << std::endl;
+	}
+
+	}
+
+	std::cout << std::endl;
+}
+
+void SetIntParameter(PicamHandle camera, PicamParameter parameter, piint intval)
+{
+	PicamError error;
+	pibln committed;
+	std::cout << "= = = = = = = = = " << std::endl;
+	// Display Current Val
+	piint CurrentIntVal;
+	std::cout << "Reading value of ";
+	PrintEnumString(PicamEnumeratedType_Parameter, parameter);
+	std::cout << ": ";
+	error = Picam_GetParameterIntegerValue(camera, parameter, &CurrentIntVal);
+	PrintError(error);
+	if(error == PicamError_None)
+	{
+		PrintEnumString(PicamEnumeratedType_Parameter, parameter);
+		std::cout << " is set to: " << CurrentIntVal << std::endl;
+	}
+
+	// Display read value
+	pibln readable;
+	std::cout << "Checking if value is readable from hardware: ";
+	error = Picam_CanReadParameter( camera, parameter, &readable );
+	PrintError(error);
+	std::cout << "Readability is: " << readable << std::endl;
+
+	// Display Default Val
+	piint DefaultIntVal;
+	std::cout << "Reading Default Value: ";
+	error = Picam_GetParameterIntegerDefaultValue(camera, parameter, &DefaultIntVal);
+	PrintError(error);
+	if(error == PicamError_None)
+	{
+		PrintEnumString(PicamEnumeratedType_Parameter, parameter);
+		std::cout << " default value is: " << DefaultIntVal << std::endl;
+	}
+
+	// Get Constraint Types
+	PicamConstraintType ConstraintType;
+	std::cout << "Getting Constraint Type: ";
+	error = Picam_GetParameterConstraintType(camera, parameter, &ConstraintType);
+	PrintError(error);
+	if(error == PicamError_None)
+	{
+		std::cout << "Constraint Type is: ";\
+		PrintEnumString(PicamEnumeratedType_ConstraintType, ConstraintType);
+		std::cout << std::endl;
+	}
+	if(ConstraintType == PicamConstraintType_Range)
+	{
+		const PicamRangeConstraint* ReqConstraint;
+		const PicamRangeConstraint* RecConstraint;;
+		std::cout << "Getting Range Constraints: ";
+		// error = Picam_GetParameterRangeConstraint( camera, parameter, PicamConstraintCategory category, const PicamRangeConstraint** constraint );
+		error = Picam_GetParameterRangeConstraint( camera, parameter, PicamConstraintCategory_Required, &ReqConstraint );
+		PrintError(error);
+		error = Picam_GetParameterRangeConstraint( camera, parameter, PicamConstraintCategory_Recommended, &RecConstraint );
+		std::cout << "Max Allowable Val is: " << ReqConstraint-> maximum << std::endl;
+		std::cout << "Min Allowable val is: " << ReqConstraint-> minimum << std::endl;
+		std::cout << "Allowable Increment is: " << ReqConstraint -> increment << std::endl;
+		std::cout << "Max Recommended Val is: " << RecConstraint-> maximum << std::endl;
+		std::cout << "Min Recommended val is: " << RecConstraint-> minimum << std::endl;
+		std::cout << "Recommended Increment is: " << RecConstraint -> increment << std::endl;
+
+		std::cout << "Destroying range constraints: ";
+		error = Picam_DestroyRangeConstraints(RecConstraint);
+		PrintError(error);
+		error = Picam_DestroyRangeConstraints(ReqConstraint);
+		PrintError(error);
+	}
+	if(ConstraintType == PicamConstraintType_Collection)
+	{
+		const PicamCollectionConstraint* ReqConstraint;
+		const PicamCollectionConstraint* RecConstraint;
+		std::cout << "Getting Collection Constraints: ";
+		// error = Picam_GetParameterCollectionConstraint( camera, parameter, PicamConstraintCategory_Required, &constraint );
+		error = Picam_GetParameterCollectionConstraint( camera, parameter, PicamConstraintCategory_Required, &ReqConstraint );
+		PrintError(error);
+		error = Picam_GetParameterCollectionConstraint( camera, parameter, PicamConstraintCategory_Recommended, &RecConstraint );
+		PrintError(error);
+		std::cout << "Number of permissible values is: " << ReqConstraint -> values_count << std::endl;
+		std::cout << "Permissible values are: ";
+		piint maxval = ReqConstraint->values_count;
+		int count = 0;
+		for ( count = 0; count <= maxval -1; count++)
+		{	
+			std::cout << ReqConstraint->values_array[count] << " ";
+		}
+		std::cout << std::endl;
+		std::cout << "Number of recommended values is: " << RecConstraint -> values_count << std::endl;
+		std::cout << "Recommended values are: ";
+		maxval = RecConstraint -> values_count;
+		count = 0;
+		for ( count = 0; count <= maxval - 1; count++)
+		{
+			std::cout << RecConstraint -> values_array[count] << " ";
+		}
+
+		std::cout << std::endl;
+		std::cout << "Destroying collection constraints: ";
+		error = Picam_DestroyCollectionConstraints(RecConstraint);
+		PrintError(error);
+		error = Picam_DestroyCollectionConstraints(ReqConstraint);
+		PrintError(error);
+	}
+
+	// Check if settable
+	std::cout << "Checking if parameter is settable to value: ";
+	pibln settable;
+	error = Picam_CanSetParameterIntegerValue( camera, parameter, intval, &settable);
+	PrintError(error);
+	std::cout << "Settability is: " << settable << std::endl;
+
+	// Set Parameter
+	std::cout << "Setting Parameter: ";
+	PrintEnumString(PicamEnumeratedType_Parameter, parameter);
+	std::cout << " to: " << intval << std::endl;
+	//    std::cout << "Setting " << ExposureTime << " ms exposure time: ";
+    error = 
+		Picam_SetParameterIntegerValue(
+            camera,
+            parameter,
+            intval );
+    PrintError( error );
+
+    // - show that the modified parameters need to be applied to hardware
+    Picam_AreParametersCommitted( camera, &committed );
+    if( committed )
+        std::cout << "Parameters have not changed.  Not going to commit." << std::endl;
+    else
+	{
+        std::cout << "Parameters have been modified." << std::endl;
+
+		// - apply the changes to hardware
+		std::cout << "Commit to hardware: ";
+		const PicamParameter* failed_parameters;
+		piint failed_parameters_count;
+		error =
+			Picam_CommitParameters(
+				camera,
+				&failed_parameters,
+				&failed_parameters_count );
+		PrintError( error );
+		if( failed_parameters_count > 0 )
+		{
+			std::cout << "The following parameters are invalid:" << std::endl;
+			for( piint i = 0; i < failed_parameters_count; ++i )
+			{
+				std::cout << "FAILED TO COMMIT PARAMETER: ";
+				std::cout << "    ";
+				PrintEnumString(
+					PicamEnumeratedType_Parameter,
+					failed_parameters[i] );
+				std::cout << std::endl;
+			}
+		}
+	}
+
+	// Read Val AGain
+	std::cout << "Reading value of ";
+	PrintEnumString(PicamEnumeratedType_Parameter, parameter);
+	std::cout << ": ";
+	error = Picam_GetParameterIntegerValue(camera, parameter, &CurrentIntVal);
+	PrintError(error);
+	if(error == PicamError_None)
+	{
+		PrintEnumString(PicamEnumeratedType_Parameter, parameter);
+		std::cout << " is set to: " << CurrentIntVal << std::endl;
+	}
+	std::cout << std::endl;
+}
+////////////////////////////////////////////////////////////////////////////////
+// Parameter Staging
+// - values are staged first, checked against constraints cached once per
+//   parameter, then set and applied to hardware with a single commit
+// - every rejected parameter is reported together at the end
+////////////////////////////////////////////////////////////////////////////////
+
+// - a parameter value waiting to be committed
+struct StagedParameter
+{
+	PicamParameter	parameter;
+	PicamValueType	type;		/* Integer (also boolean/enum), FloatingPoint or LargeInteger */
+	piflt			value;
+};
+
+// - the required constraint of one parameter, queried from the camera once
+struct CachedConstraint
+{
+	PicamConstraintType	type;
+	piflt				minimum;	/* Range */
+	piflt				maximum;
+	piflt				increment;
+	vector<piflt>		values;		/* Collection */
+};
+
+// - what the ROIs may be, queried from the camera once
+struct CachedRoisConstraint
+{
+	bool				known;
+	piint				maximum_roi_count;
+	piint				width;		/* of the sensor */
+	piint				height;
+	PicamRoisConstraintRulesMask	rules;
+	vector<piint>		x_binning;	/* allowed binnings, if limited */
+	vector<piint>		y_binning;
+
+	CachedRoisConstraint() : known(false), maximum_roi_count(0), width(0), height(0), rules(PicamRoisConstraintRulesMask_None) {}
+};
+
+// - what a profile needs to know of a camera parameter, looked up once
+struct ProfileParameter
+{
+	PicamParameter	parameter;
+	PicamValueType	type;
+	bool			hasDefault;
+	piflt			defaultValue;
+};
+
+// - the constraints of one camera, also kept on disk (see Capability Cache)
+struct ConstraintCache
+{
+	std::map<PicamParameter, CachedConstraint>	parameters;
+	CachedRoisConstraint	rois;
+	string		path;		/* capability file, if any       */
+	string		key;		/* camera and firmware it is for */
+	bool		changed;	/* learned since it was read     */
+	piint		queries;	/* constraints asked of PICAM    */
+	vector<PicamParameter>	profiled;	/* set by the last profile */
+	bool		catalogued;	/* profileParameters filled      */
+	std::map<string, ProfileParameter>	profileParameters;	/* by squeezed name */
+	std::map<PicamEnumeratedType, std::map<string, piint> >	enumValues;	/* by squeezed name */
+
+	ConstraintCache() : changed(false), queries(0), catalogued(false) {}
+};
+
+// - returns the name of a parameter
+string ParameterName(PicamParameter parameter)
+{
+	const pichar* name;
+	if( Picam_GetEnumerationString(PicamEnumeratedType_Parameter, parameter, &name) != PicamError_None )
+		return "Parameter";
+	string text(name);
+	Picam_DestroyString(name);
+	return text;
+}
+
+// - stages a value, replacing any value already staged for the parameter
+void StageParameter(vector<StagedParameter>& stage, PicamParameter parameter, PicamValueType type, piflt value)
+{
+	for( size_t i = 0; i < stage.size(); ++i )
+	{
+		if( stage[i].parameter == parameter )
+		{
+			stage[i].value = value;
+			return;
+		}
+	}
+	StagedParameter staged = { parameter, type, value };
+	stage.push_back(staged);
+}
+
+void StageFltParameter(vector<StagedParameter>& stage, PicamParameter parameter, piflt floatval)
+{
+	StageParameter(stage, parameter, PicamValueType_FloatingPoint, floatval);
+}
+
+void StageIntParameter(vector<StagedParameter>& stage, PicamParameter parameter, piint intval)
+{
+	StageParameter(stage, parameter, PicamValueType_Integer, intval);
+}
+
+// - returns the cached constraint, querying the camera the first time
+const CachedConstraint& GetCachedConstraint(PicamHandle camera, ConstraintCache& cache, PicamParameter parameter)
+{
+	std::map<PicamParameter, CachedConstraint>::iterator found = cache.parameters.find(parameter);
+	if( found != cache.parameters.end() )
+		return found->second;
+	cache.queries++;
+	cache.changed = true;
+
+	CachedConstraint cached;
+	cached.type = PicamConstraintType_None;
+	cached.minimum = cached.maximum = cached.increment = 0;
+	Picam_GetParameterConstraintType(camera, parameter, &cached.type);
+	if( cached.type == PicamConstraintType_Range )
+	{
+		const PicamRangeConstraint* range;
+		if( Picam_GetParameterRangeConstraint(camera, parameter, PicamConstraintCategory_Required, &range) == PicamError_None )
+		{
+			cached.minimum = range->minimum;
+			cached.maximum = range->maximum;
+			cached.increment = range->increment;
+			Picam_DestroyRangeConstraints(range);
+		}
+		else
+			cached.type = PicamConstraintType_None;
+	}
+	else if( cached.type == PicamConstraintType_Collection )
+	{
+		const PicamCollectionConstraint* collection;
+		if( Picam_GetParameterCollectionConstraint(camera, parameter, PicamConstraintCategory_Required, &collection) == PicamError_None )
+		{
+			cached.values.assign(collection->values_array, collection->values_array + collection->values_count);
+			Picam_DestroyCollectionConstraints(collection);
+		}
+		else
+			cached.type = PicamConstraintType_None;
+	}
+	return cache.parameters[parameter] = cached;
+}
+
+// - returns the cached ROI constraint, querying the camera the first time
+const CachedRoisConstraint& GetCachedRoisConstraint(PicamHandle camera, ConstraintCache& cache, PicamError* error)
+{
+	*error = PicamError_None;
+	if( cache.rois.known )
+		return cache.rois;
+
+	const PicamRoisConstraint* constraint;
+	*error = Picam_GetParameterRoisConstraint( camera, PicamParameter_Rois, PicamConstraintCategory_Required, &constraint );
+	cache.queries++;
+	if( *error != PicamError_None )
+		return cache.rois;
+	CachedRoisConstraint& rois = cache.rois;
+	rois.maximum_roi_count = constraint->maximum_roi_count;
+	rois.width = (piint)constraint->width_constraint.maximum;
+	rois.height = (piint)constraint->height_constraint.maximum;
+	rois.rules = constraint->rules;
+	rois.x_binning.assign( constraint->x_binning_limits_array, constraint->x_binning_limits_array + constraint->x_binning_limits_count );
+	rois.y_binning.assign( constraint->y_binning_limits_array, constraint->y_binning_limits_array + constraint->y_binning_limits_count );
+	rois.known = true;
+	Picam_DestroyRoisConstraints( constraint );
+	cache.changed = true;
+	return rois;
+}
+
+// - checks a value against a cached constraint without asking the camera
+bool IsValueAllowed(const CachedConstraint& constraint, piflt value)
+{
+	if( constraint.type == PicamConstraintType_Range )
+	{
+		if( value < constraint.minimum || value > constraint.maximum )
+			return false;
+		if( constraint.increment > 0 )
+		{
+			piflt steps = (value - constraint.minimum) / constraint.increment;
+			return fabs(steps - floor(steps + 0.5)) < 1e-6;
+		}
+		return true;
+	}
+	if( constraint.type == PicamConstraintType_Collection )
+	{
+		for( size_t i = 0; i < constraint.values.size(); ++i )
+			if( fabs(constraint.values[i] - value) < 1e-9 )
+				return true;
+		return false;
+	}
+	return true;
+}
+
+// - checks a value against the cached constraint and, if that refuses it,
+//   against the camera's own: a constraint may follow other parameters
+//   (AdcSpeed the AdcQuality, ExposureTime and KineticsWindowHeight the
+//   readout mode), so the one cached may have been learned under others
+bool IsValueAllowedNow(PicamHandle camera, ConstraintCache& cache, PicamParameter parameter, piflt value)
+{
+	if( IsValueAllowed(GetCachedConstraint(camera, cache, parameter), value) )
+		return true;
+	cache.parameters.erase(parameter);
+	return IsValueAllowed(GetCachedConstraint(camera, cache, parameter), value);
+}
+
+// - describes the allowed values for an error message
+string DescribeConstraint(const CachedConstraint& constraint)
+{
+	ostringstream text;
+	if( constraint.type == PicamConstraintType_Range )
+		text << "range " << constraint.minimum << " to " << constraint.maximum << " in steps of " << constraint.increment;
+	else if( constraint.type == PicamConstraintType_Collection )
+	{
+		text << "one of";
+		for( size_t i = 0; i < constraint.values.size(); ++i )
+			text << " " << constraint.values[i];
+	}
+	return text.str();
+}
+
+// - reads the current value of a staged parameter; value is left alone if
+//   it cannot be read
+PicamError GetStagedValue(PicamHandle camera, const StagedParameter& staged, piflt* value)
+{
+	PicamError error;
+	if( staged.type == PicamValueType_FloatingPoint )
+		error = Picam_GetParameterFloatingPointValue(camera, staged.parameter, value);
+	else if( staged.type == PicamValueType_LargeInteger )
+	{
+		pi64s large = 0;
+		error = Picam_GetParameterLargeIntegerValue(camera, staged.parameter, &large);
+		if( error == PicamError_None )
+			*value = (piflt)large;
+	}
+	else
+	{
+		piint integer = 0;
+		error = Picam_GetParameterIntegerValue(camera, staged.parameter, &integer);
+		if( error == PicamError_None )
+			*value = integer;
+	}
+	return error;
+}
+
+PicamError SetStagedValue(PicamHandle camera, const StagedParameter& staged)
+{
+	if( staged.type == PicamValueType_FloatingPoint )
+		return Picam_SetParameterFloatingPointValue(camera, staged.parameter, staged.value);
+	if( staged.type == PicamValueType_LargeInteger )
+		return Picam_SetParameterLargeIntegerValue(camera, staged.parameter, (pi64s)staged.value);
+	return Picam_SetParameterIntegerValue(camera, staged.parameter, (piint)staged.value);
+}
+
+// - validates, sets and commits every staged value at once
+// - returns CaptureResult_Saved if every staged value is now committed,
+//   CaptureResult_BadArguments if a value is outside its constraint and
+//   CaptureResult_CameraError if the camera would not take or commit one
+CaptureResult CommitStagedParameters(PicamHandle camera, const vector<StagedParameter>& stage, ConstraintCache& cache)
+{
+	vector<string> problems;
+	piint changed = 0;
+	bool rejected = false;
+
+	for( size_t i = 0; i < stage.size(); ++i )
+	{
+		const StagedParameter& staged = stage[i];
+
+		std::cout << "    ";
+		PrintEnumString(PicamEnumeratedType_Parameter, staged.parameter);
+		std::cout << " = " << staged.value;
+
+		if( !IsValueAllowedNow(camera, cache, staged.parameter, staged.value) )
+		{
+			std::cout << "  REJECTED" << std::endl;
+			ostringstream problem;
+			problem << ParameterName(staged.parameter) << ": " << staged.value << " is outside the " << DescribeConstraint(GetCachedConstraint(camera, cache, staged.parameter));
+			problems.push_back(problem.str());
+			rejected = true;
+			continue;
+		}
+
+		piflt current = 0;
+		bool known = GetStagedValue(camera, staged, &current) == PicamError_None;
+		if( known && current == staged.value )
+		{
+			std::cout << "  (unchanged)" << std::endl;
+			continue;
+		}
+
+		PicamError error;
+		{
+			TraceSpan span( "Set", ParameterName(staged.parameter) );
+			error = SetStagedValue(camera, staged);
+		}
+		if( error != PicamError_None )
+		{
+			std::cout << "  FAILED" << std::endl;
+			const pichar* reason;
+			Picam_GetEnumerationString(PicamEnumeratedType_Error, error, &reason);
+			problems.push_back(ParameterName(staged.parameter) + ": could not be set (" + reason + ")");
+			Picam_DestroyString(reason);
+			continue;
+		}
+		if( known )
+			std::cout << "  (was " << current << ")" << std::endl;
+		else
+			std::cout << "  (was unknown)" << std::endl;
+		++changed;
+	}
+
+	/* One commit for everything */
+	pibln committed = true;
+	Picam_AreParametersCommitted(camera, &committed);
+	if( !committed )
+	{
+		std::cout << "Committing " << changed << " changed parameters to hardware: ";
+		const PicamParameter* failed_parameters;
+		piint failed_parameters_count;
+		PicamError error;
+		{
+			TraceSpan span( "Commit parameters" );
+			error = Picam_CommitParameters(camera, &failed_parameters, &failed_parameters_count);
+		}
+		PrintError(error);
+		for( piint i = 0; i < failed_parameters_count; ++i )
+		{
+			problems.push_back(ParameterName(failed_parameters[i]) + ": refused by the camera on commit");
+		}
+		Picam_DestroyParameters(failed_parameters);
+		if( error != PicamError_None && failed_parameters_count == 0 )
+			problems.push_back("commit failed");
+	}
+	else
+		std::cout << "Parameters have not changed.  Not going to commit." << std::endl;
+
+	if( !problems.empty() )
+	{
+		std::cout << "THE FOLLOWING PARAMETERS WERE NOT APPLIED: " << std::endl;
+		for( size_t i = 0; i < problems.size(); ++i )
+			std::cout << "    " << problems[i] << std::endl;
+	}
+	if( rejected )
+		return CaptureResult_BadArguments;
+	return problems.empty() ? CaptureResult_Saved : CaptureResult_CameraError;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Capability Cache
+// - the constraints of a camera only change with its model, serial number
+//   and firmware, so once learned they are kept in a file per camera,
+//   capabilities_<serial>.txt in --capability-dir (default the directory of
+//   the executeable), and read back on later runs instead of asking PICAM
+// - a file written for other firmware (or another camera) is ignored and
+//   rewritten; --refresh-capabilities asks the camera again regardless
+// - anything learned that is not in the file yet is added to it after
+//   configuration and after the ROIs are checked
+////////////////////////////////////////////////////////////////////////////////
+#define CAPABILITY_FILE_VERSION 1
+
+// - identifies the camera a capability file belongs to
+string CapabilityKey(PicamHandle camera)
+{
+	PicamCameraID id;
+	if( Picam_GetCameraID( camera, &id ) != PicamError_None )
+		return "";
+	ostringstream key;
+	key << "model " << (int)id.model << " serial " << id.serial_number << " sensor " << id.sensor_name;
+	const PicamFirmwareDetail* firmware;
+	piint count = 0;
+	if( Picam_GetFirmwareDetails( &id, &firmware, &count ) == PicamError_None )
+	{
+		for( piint i = 0; i < count; ++i )
+			key << " firmware " << firmware[i].name << "=" << firmware[i].detail;
+		Picam_DestroyFirmwareDetails( firmware );
+	}
+	return key.str();
+}
+
+// - fills cache from the camera's capability file, if it has an up to date
+//   one; either way the cache is saved to that file from now on
+void LoadCapabilities(PicamHandle camera, const CaptureOptions& options, ConstraintCache& cache)
+{
+	PicamCameraID id;
+	if( options.CapabilityDir == "none" || Picam_GetCameraID( camera, &id ) != PicamError_None )
+		return;
+	string directory = options.CapabilityDir;
+	if( !directory.empty() && directory[directory.size() - 1] != '/' && directory[directory.size() - 1] != '\\' )
+		directory += "/";
+	cache.path = directory + "capabilities_" + id.serial_number + ".txt";
+	cache.key = CapabilityKey( camera );
+	if( options.RefreshCapabilities )
+	{
+		std::cout << "Capabilities: asking the camera again (--refresh-capabilities)" << std::endl;
+		cache.changed = true;
+		return;
+	}
+
+	FILE* pFile = fopen( cache.path.c_str(), "r" );
+	if( !pFile )
+	{
+		std::cout << "Capabilities: none saved yet for this camera; learning them" << std::endl;
+		return;
+	}
+	ConstraintCache loaded;
+	bool current = false;
+	char line[4096];
+	while( fgets( line, sizeof(line), pFile ) )
+	{
+		string text( line );
+		text.erase( text.find_last_not_of( "\r\n" ) + 1 );
+		size_t equals = text.find('=');
+		if( equals == string::npos )
+			continue;
+		string name = text.substr( 0, equals );
+		std::istringstream value( text.substr( equals + 1 ) );
+		if( name == "version" )
+		{
+			int version = 0;
+			value >> version;
+			if( version != CAPABILITY_FILE_VERSION )
+				break;
+		}
+		else if( name == "camera" )
+			current = text.substr( equals + 1 ) == cache.key;
+		else if( name == "parameter" )
+		{
+			int parameter = 0, type = 0;
+			size_t count = 0;
+			CachedConstraint constraint;
+			value >> parameter >> type >> constraint.minimum >> constraint.maximum >> constraint.increment >> count;
+			constraint.type = (PicamConstraintType)type;
+			constraint.values.resize( count );
+			for( size_t i = 0; i < count; ++i )
+				value >> constraint.values[i];
+			if( value )
+				loaded.parameters[(PicamParameter)parameter] = constraint;
+		}
+		else if( name == "rois" )
+		{
+			CachedRoisConstraint& rois = loaded.rois;
+			int rules = 0;
+			size_t xCount = 0, yCount = 0;
+			value >> rois.maximum_roi_count >> rois.width >> rois.height >> rules >> xCount;
+			rois.x_binning.resize( xCount );
+			for( size_t i = 0; i < xCount; ++i )
+				value >> rois.x_binning[i];
+			value >> yCount;
+			rois.y_binning.resize( yCount );
+			for( size_t i = 0; i < yCount; ++i )
+				value >> rois.y_binning[i];
+			rois.rules = (PicamRoisConstraintRulesMask)rules;
+			rois.known = !value.fail();
+		}
+	}
+	fclose( pFile );
+
+	if( !current )
+	{
+		std::cout << "Capabilities: " << cache.path << " is for another camera or firmware; learning them again" << std::endl;
+		cache.changed = true;
+		return;
+	}
+	cache.parameters = loaded.parameters;
+	cache.rois = loaded.rois;
+	std::cout << "Capabilities: " << cache.parameters.size() << " parameters" << ( cache.rois.known ? " and the ROI limits" : "" )
+	          << " read from " << cache.path << std::endl;
+}
+
+// - writes the cache to its capability file if it learned anything new
+bool SaveCapabilities(ConstraintCache& cache)
+{
+	if( cache.path.empty() || !cache.changed )
+		return true;
+	string temporary = cache.path + ".tmp";
+	FILE* pFile = fopen( temporary.c_str(), "w" );
+	if( !pFile )
+	{
+		std::cout << "WARNING: could not save capabilities to " << cache.path << std::endl;
+		return false;
+	}
+	fprintf( pFile, "version=%d\ncamera=%s\n", CAPABILITY_FILE_VERSION, cache.key.c_str() );
+	for( std::map<PicamParameter, CachedConstraint>::const_iterator it = cache.parameters.begin(); it != cache.parameters.end(); ++it )
+	{
+		const CachedConstraint& constraint = it->second;
+		fprintf( pFile, "parameter=%d %d %.17g %.17g %.17g %d", (int)it->first, (int)constraint.type,
+		         constraint.minimum, constraint.maximum, constraint.increment, (int)constraint.values.size() );
+		for( size_t i = 0; i < constraint.values.size(); ++i )
+			fprintf( pFile, " %.17g", constraint.values[i] );
+		fprintf( pFile, "\n" );
+	}
+	if( cache.rois.known )
+	{
+		const CachedRoisConstraint& rois = cache.rois;
+		fprintf( pFile, "rois=%d %d %d %d %d", rois.maximum_roi_count, rois.width, rois.height, (int)rois.rules, (int)rois.x_binning.size() );
+		for( size_t i = 0; i < rois.x_binning.size(); ++i )
+			fprintf( pFile, " %d", rois.x_binning[i] );
+		fprintf( pFile, " %d", (int)rois.y_binning.size() );
+		for( size_t i = 0; i < rois.y_binning.size(); ++i )
+			fprintf( pFile, " %d", rois.y_binning[i] );
+		fprintf( pFile, "\n" );
+	}
+	bool ok = fclose( pFile ) == 0 && RenameIntoPlace( temporary, cache.path );
+	if( ok )
+		std::cout << "Capabilities: saved to " << cache.path << std::endl;
+	cache.changed = !ok;
+	return ok;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Readout Modes
+// - --readout-mode=full-frame (the default, as before), frame-transfer or
+//   kinetics.  Frame transfer shifts each frame into the masked storage
+//   area and exposes the next one while it is read out; kinetics exposes
+//   a window of --kinetics-window=ROWS rows (or sensor height / the
+//   --kinetics-frames=N wanted), shifts it under the mask and exposes the
+//   next, reading out all the windows of the sensor as one readout
+// - the mode and window are staged with the rest of the configuration and
+//   so checked against the camera's constraints; a run whose committed mode
+//   is not the one asked for is refused
+// - FillCaptureHeader slices each readout into FramesPerReadout frames of
+//   window-tall ROIs; the frame rate PICAM predicts is printed before the
+//   run and the one achieved after it
+////////////////////////////////////////////////////////////////////////////////
+
+string ReadoutModeName(piint mode)
+{
+	switch( mode )
+	{
+	case PicamReadoutControlMode_FullFrame:     return "full-frame";
+	case PicamReadoutControlMode_FrameTransfer: return "frame-transfer";
+	case PicamReadoutControlMode_Kinetics:      return "kinetics";
+	}
+	return std::to_string( mode );
+}
+
+bool ParseReadoutMode(const string& name, piint& mode)
+{
+	const piint modes[] = { PicamReadoutControlMode_FullFrame, PicamReadoutControlMode_FrameTransfer, PicamReadoutControlMode_Kinetics };
+	for( size_t i = 0; i < sizeof(modes) / sizeof(modes[0]); ++i )
+		if( name == ReadoutModeName( modes[i] ) )
+		{
+			mode = modes[i];
+			return true;
+		}
+	return false;
+}
+
+// - a comma separated list of modes, for --sweep-mode
+bool ParseReadoutModes(const string& value, vector<piint>& modes)
+{
+	modes.clear();
+	std::stringstream list( value );
+	string name;
+	while( std::getline( list, name, ',' ) )
+	{
+		piint mode;
+		if( !ParseReadoutMode( name, mode ) )
+			return false;
+		modes.push_back( mode );
+	}
+	return !modes.empty();
+}
+
+// - the kinetics window asked for, in rows; 0 to leave the camera's
+piint KineticsWindowRows(PicamHandle camera, const CaptureOptions& options)
+{
+	if( options.ReadoutMode != PicamReadoutControlMode_Kinetics )
+		return 0;
+	if( options.KineticsWindow > 0 )
+		return options.KineticsWindow;
+	piint height = 0;
+	if( options.KineticsFrames > 0 && Picam_GetParameterIntegerValue( camera, PicamParameter_SensorActiveHeight, &height ) == PicamError_None )
+		return std::max( 1, height / options.KineticsFrames );
+	return 0;
+}
+
+// - stages the readout mode and, for kinetics, the window height
+void StageReadoutMode(PicamHandle camera, const CaptureOptions& options, vector<StagedParameter>& stage)
+{
+	StageIntParameter(stage, PicamParameter_ReadoutControlMode, options.ReadoutMode);
+	piint window = KineticsWindowRows( camera, options );
+	if( window > 0 )
+		StageIntParameter(stage, PicamParameter_KineticsWindowHeight, window);
+}
+
+// - after the commit: whether the camera is in the mode asked for, and what
+//   it makes of it
+bool CheckReadoutMode(PicamHandle camera, const CaptureOptions& options)
+{
+	piint mode = 0, window = 0, framesPerReadout = 1;
+	piflt frameRate = 0;
+	Picam_GetParameterIntegerValue( camera, PicamParameter_ReadoutControlMode, &mode );
+	Picam_GetParameterIntegerValue( camera, PicamParameter_FramesPerReadout, &framesPerReadout );
+	Picam_GetParameterFloatingPointValue( camera, PicamParameter_FrameRateCalculation, &frameRate );
+	if( mode != options.ReadoutMode )
+	{
+		std::cout << "ERROR: the camera is in " << ReadoutModeName( mode ) << " readout mode, not " << ReadoutModeName( options.ReadoutMode ) << std::endl;
+		return false;
+	}
+	std::cout << "Readout mode: " << ReadoutModeName( mode );
+	if( mode == PicamReadoutControlMode_Kinetics )
+	{
+		Picam_GetParameterIntegerValue( camera, PicamParameter_KineticsWindowHeight, &window );
+		piint wanted = KineticsWindowRows( camera, options );
+		if( wanted > 0 && window != wanted )
+		{
+			std::cout << std::endl << "ERROR: the camera set a kinetics window of " << window << " rows, not " << wanted << std::endl;
+			return false;
+		}
+		std::cout << ", " << window << " row window";
+	}
+	std::cout << ", " << framesPerReadout << " frame(s) per readout, predicted " << frameRate << " frames/s" << std::endl;
+	return true;
+}
+
+// - the frame rate the run achieved, from the exposure time stamps if there
+//   are any, else from when the readouts arrived
+void ReportFrameRate(CaptureFileHeader& header, pi64s written, double arrivalMs)
+{
+	if( header.trigger_interval_mean > 0 )
+		header.frame_rate_achieved = 1000.0 / header.trigger_interval_mean;
+	else if( written > 1 && arrivalMs > 0 )
+		header.frame_rate_achieved = ( written - 1 ) * header.frames_per_readout * 1000.0 / arrivalMs;
+	std::cout << "Frame rate (" << ReadoutModeName( header.readout_mode ) << "): predicted " << header.frame_rate_predicted
+	          << " frames/s, achieved " << header.frame_rate_achieved << " frames/s" << std::endl;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Acquisition Profiles
+// - --profile=NAME takes the camera setup, the ROIs and the run from the
+//   [NAME] section of a profile file (profiles.txt next to the executeable,
+//   or --profiles=FILE); # starts a comment:
+//     [NAME]
+//     AdcAnalogGain=Low                 any PICAM parameter by name, with a
+//     TriggerDetermination=RisingEdge   number or the name of an enumeration
+//     roi=x,y,dx,dy[,xbin[,ybin]]       repeatable; used when x0 y0 dx dy are -
+//     exposure=ms                       used when dt is -
+//     frames=N                          used when NFrames is -
+// - the profile takes the place of the built-in settings of Configure; the
+//   command line still wins over it.  AdcSpeed, ReadoutControlMode and
+//   KineticsWindowHeight stand for --adc-speed, --readout-mode and
+//   --kinetics-window, and ExposureTime for exposure
+// - parameters the last profile set that the next one leaves out go back to
+//   the camera's defaults, and CommitStagedParameters only sets and commits
+//   values that differ, so switching profiles costs the changed parameters
+//   and no more
+////////////////////////////////////////////////////////////////////////////////
+#define PROFILE_ENUM_VALUES 64	/* enumeration values searched for a name */
+
+// - lower case without spaces, - or _, so RisingEdge matches "Rising Edge"
+string SqueezeName(const string& text)
+{
+	string squeezed;
+	for( size_t i = 0; i < text.size(); ++i )
+		if( text[i] != ' ' && text[i] != '-' && text[i] != '_' )
+			squeezed += (char)tolower( (unsigned char)text[i] );
+	return squeezed;
+}
+
+string TrimSpaces(const string& text)
+{
+	size_t first = text.find_first_not_of( " \t\r\n" );
+	if( first == string::npos )
+		return "";
+	return text.substr( first, text.find_last_not_of( " \t\r\n" ) - first + 1 );
+}
+
+// - a whole number and nothing else
+bool ParseWhole(const string& text, long& value)
+{
+	char* end = 0;
+	errno = 0;
+	value = strtol( text.c_str(), &end, 10 );
+	return !text.empty() && *end == 0 && errno == 0;
+}
+
+// - a finite number and nothing else
+bool ParseNumber(const string& text, piflt& value)
+{
+	char* end = 0;
+	value = strtod( text.c_str(), &end );
+	return !text.empty() && *end == 0 && std::isfinite( value );
+}
+
+// - the value of an enumeration from its name, as PICAM spells it or squeezed
+bool ParseEnumValue(PicamEnumeratedType type, const string& text, piint& value)
+{
+	for( piint candidate = 0; candidate < PROFILE_ENUM_VALUES; ++candidate )
+	{
+		const pichar* name;
+		if( Picam_GetEnumerationString( type, candidate, &name ) != PicamError_None )
+			continue;
+		bool match = SqueezeName( name ) == SqueezeName( text );
+		Picam_DestroyString( name );
+		if( match )
+		{
+			value = candidate;
+			return true;
+		}
+	}
+	return false;
+}
+
+// - the enumeration naming the values of a parameter, 0 for none
+PicamEnumeratedType ParameterEnumeration(PicamParameter parameter)
+{
+	switch( parameter )
+	{
+	case PicamParameter_AdcAnalogGain:        return PicamEnumeratedType_AdcAnalogGain;
+	case PicamParameter_AdcQuality:           return PicamEnumeratedType_AdcQuality;
+	case PicamParameter_PixelFormat:          return PicamEnumeratedType_PixelFormat;
+	case PicamParameter_ReadoutControlMode:   return PicamEnumeratedType_ReadoutControlMode;
+	case PicamParameter_TimeStamps:           return PicamEnumeratedType_TimeStampsMask;
+	case PicamParameter_TriggerDetermination: return PicamEnumeratedType_TriggerDetermination;
+	case PicamParameter_TriggerResponse:      return PicamEnumeratedType_TriggerResponse;
+	default:                                  return (PicamEnumeratedType)0;
+	}
+}
+
+bool IsParameterNamed(const string& name, PicamParameter parameter)
+{
+	return SqueezeName( name ) == SqueezeName( ParameterName( parameter ) );
+}
+
+// - the parameters of the camera with their types and defaults, asked of
+//   PICAM on the first profile and then kept in the cache
+const std::map<string, ProfileParameter>& GetProfileParameters(PicamHandle camera, ConstraintCache& cache)
+{
+	if( cache.catalogued )
+		return cache.profileParameters;
+	const PicamParameter* parameters = 0;
+	piint count = 0;
+	Picam_GetParameters( camera, &parameters, &count );
+	for( piint i = 0; i < count; ++i )
+	{
+		ProfileParameter known = { parameters[i], PicamValueType_Integer, false, 0 };
+		Picam_GetParameterValueType( camera, known.parameter, &known.type );
+		if( known.type == PicamValueType_FloatingPoint )
+			known.hasDefault = Picam_GetParameterFloatingPointDefaultValue( camera, known.parameter, &known.defaultValue ) == PicamError_None;
+		else if( known.type == PicamValueType_LargeInteger )
+		{
+			pi64s large = 0;
+			known.hasDefault = Picam_GetParameterLargeIntegerDefaultValue( camera, known.parameter, &large ) == PicamError_None;
+			known.defaultValue = (piflt)large;
+		}
+		else if( known.type == PicamValueType_Integer || known.type == PicamValueType_Boolean || known.type == PicamValueType_Enumeration )
+		{
+			piint integer = 0;
+			known.hasDefault = Picam_GetParameterIntegerDefaultValue( camera, known.parameter, &integer ) == PicamError_None;
+			known.defaultValue = integer;
+		}
+		cache.profileParameters[SqueezeName( ParameterName( known.parameter ) )] = known;
+	}
+	Picam_DestroyParameters( parameters );
+	cache.catalogued = true;
+	return cache.profileParameters;
+}
+
+// - ParseEnumValue, with the names of the enumeration read once into the cache
+bool LookupEnumValue(ConstraintCache& cache, PicamEnumeratedType type, const string& text, piint& value)
+{
+	std::map<PicamEnumeratedType, std::map<string, piint> >::iterator names = cache.enumValues.find( type );
+	if( names == cache.enumValues.end() )
+	{
+		names = cache.enumValues.insert( std::make_pair( type, std::map<string, piint>() ) ).first;
+		for( piint candidate = 0; candidate < PROFILE_ENUM_VALUES; ++candidate )
+		{
+			const pichar* name;
+			if( Picam_GetEnumerationString( type, candidate, &name ) != PicamError_None )
+				continue;
+			names->second[SqueezeName( name )] = candidate;
+			Picam_DestroyString( name );
+		}
+	}
+	std::map<string, piint>::const_iterator found = names->second.find( SqueezeName( text ) );
+	if( found == names->second.end() )
+		return false;
+	value = found->second;
+	return true;
+}
+
+bool ParseRoi(const string& text, PicamRoi& roi);
+
+// - reads the [options.Profile] section of options.ProfileFile into options
+bool LoadProfile(CaptureOptions& options)
+{
+	options.ProfileSettings.clear();
+	options.ProfileRois.clear();
+	options.ProfileExposure = -1;
+	options.ProfileFrames = 0;
+
+	FILE* pFile = fopen( options.ProfileFile.c_str(), "r" );
+	if( !pFile )
+	{
+		std::cout << "ERROR: could not read the profiles in " << options.ProfileFile << std::endl;
+		return false;
+	}
+	bool found = false, inside = false, valid = true;
+	char line[4096];
+	int number = 0;
+	while( fgets( line, sizeof(line), pFile ) )
+	{
+		++number;
+		string text = TrimSpaces( line );
+		if( text.empty() || text[0] == '#' )
+			continue;
+		if( text[0] == '[' )
+		{
+			inside = text == "[" + options.Profile + "]";
+			found = found || inside;
+			continue;
+		}
+		if( !inside )
+			continue;
+
+		size_t equals = text.find('=');
+		string name = TrimSpaces( text.substr( 0, equals ) );
+		string value = equals == string::npos ? "" : TrimSpaces( text.substr( equals + 1 ) );
+		long whole = 0;
+		piflt real = 0;
+		PicamRoi roi;
+		bool understood = equals != string::npos && !value.empty();
+		if( !understood )
+			;
+		else if( name == "roi" )
+		{
+			understood = ParseRoi( value, roi ) && roi.x >= 0 && roi.y >= 0 && roi.width > 0 && roi.height > 0;
+			if( understood )
+				options.ProfileRois.push_back( roi );
+		}
+		else if( name == "frames" )
+		{
+			understood = ParseWhole( value, whole ) && whole > 0 && whole <= INT_MAX;
+			options.ProfileFrames = (piint)whole;
+		}
+		else if( name == "exposure" || IsParameterNamed( name, PicamParameter_ExposureTime ) )
+		{
+			understood = ParseNumber( value, real ) && real >= 0;
+			options.ProfileExposure = real;
+		}
+		else if( IsParameterNamed( name, PicamParameter_AdcSpeed ) )
+		{
+			understood = ParseNumber( value, real ) && real > 0;
+			options.AdcSpeed = understood ? real : options.AdcSpeed;
+		}
+		else if( IsParameterNamed( name, PicamParameter_ReadoutControlMode ) )
+			understood = ParseReadoutMode( value, options.ReadoutMode ) || ParseEnumValue( PicamEnumeratedType_ReadoutControlMode, value, options.ReadoutMode );
+		else if( IsParameterNamed( name, PicamParameter_KineticsWindowHeight ) )
+		{
+			understood = ParseWhole( value, whole ) && whole > 0 && whole <= INT_MAX;
+			options.KineticsWindow = understood ? (piint)whole : options.KineticsWindow;
+		}
+		else
+		{
+			ProfileSetting setting = { name, value, number };
+			options.ProfileSettings.push_back( setting );
+		}
+		if( !understood )
+		{
+			std::cout << "ERROR: " << options.ProfileFile << " line " << number << ": " << text << std::endl;
+			valid = false;
+		}
+	}
+	fclose( pFile );
+
+	if( !found )
+	{
+		std::cout << "ERROR: there is no profile [" << options.Profile << "] in " << options.ProfileFile << std::endl;
+		return false;
+	}
+	if( valid )
+		std::cout << "Profile " << options.Profile << " from " << options.ProfileFile << ": " << options.ProfileSettings.size() << " parameters, "
+		          << options.ProfileRois.size() << " ROIs" << std::endl;
+	return valid;
+}
+
+// - stages the parameters of the profile on top of the built-in ones, and
+//   puts back to its default anything the previous profile set that this
+//   one does not.  Returns false, having staged nothing and kept the last
+//   profile's parameters, if a parameter or value is not understood
+bool StageProfile(PicamHandle camera, const CaptureOptions& options, ConstraintCache& cache, vector<StagedParameter>& stage)
+{
+	/* The whole profile is resolved before any of it is staged */
+	vector<string> problems;
+	vector<StagedParameter> profile;
+	vector<PicamParameter> profiled;
+	if( !options.ProfileSettings.empty() )
+	{
+		const std::map<string, ProfileParameter>& parameters = GetProfileParameters( camera, cache );
+		for( size_t i = 0; i < options.ProfileSettings.size(); ++i )
+		{
+			const ProfileSetting& setting = options.ProfileSettings[i];
+			string where = "line " + std::to_string( setting.line ) + ": " + setting.name + "=" + setting.value;
+			std::map<string, ProfileParameter>::const_iterator found = parameters.find( SqueezeName( setting.name ) );
+			if( found == parameters.end() )
+			{
+				problems.push_back( where + " (the camera has no such parameter)" );
+				continue;
+			}
+			PicamParameter parameter = found->second.parameter;
+			PicamValueType type = found->second.type;
+
+			piflt value = 0;
+			piint named = 0;
+			if( type == PicamValueType_Rois )
+			{
+				problems.push_back( where + " (give ROIs as roi= lines)" );
+				continue;
+			}
+			if( ParseNumber( setting.value, value ) )
+				;
+			else if( ParameterEnumeration( parameter ) != 0 && LookupEnumValue( cache, ParameterEnumeration( parameter ), setting.value, named ) )
+				value = named;
+			else if( type == PicamValueType_Boolean && ( setting.value == "true" || setting.value == "false" ) )
+				value = setting.value == "true";
+			else
+			{
+				problems.push_back( where + " (not a value of the parameter)" );
+				continue;
+			}
+			StageParameter( profile, parameter, type == PicamValueType_FloatingPoint || type == PicamValueType_LargeInteger ? type : PicamValueType_Integer, value );
+			profiled.push_back( parameter );
+		}
+	}
+
+	if( !problems.empty() )
+	{
+		std::cout << "THE FOLLOWING PROFILE SETTINGS OF " << options.ProfileFile << " WERE NOT UNDERSTOOD: " << std::endl;
+		for( size_t i = 0; i < problems.size(); ++i )
+			std::cout << "    " << problems[i] << std::endl;
+		return false;
+	}
+	for( size_t i = 0; i < profile.size(); ++i )
+		StageParameter( stage, profile[i].parameter, profile[i].type, profile[i].value );
+
+	/* Left over from the last profile: back to the camera's default */
+	for( size_t i = 0; i < cache.profiled.size(); ++i )
+	{
+		PicamParameter parameter = cache.profiled[i];
+		bool staged = false;
+		for( size_t s = 0; s < stage.size() && !staged; ++s )
+			staged = stage[s].parameter == parameter;
+		if( staged )
+			continue;
+		std::map<string, ProfileParameter>::const_iterator known = GetProfileParameters( camera, cache ).find( SqueezeName( ParameterName( parameter ) ) );
+		if( known == cache.profileParameters.end() || !known->second.hasDefault )
+			continue;
+		PicamValueType type = known->second.type;
+		std::cout << "    " << ParameterName( parameter ) << " back to its default " << known->second.defaultValue << " (not in this profile)" << std::endl;
+		StageParameter( stage, parameter, type == PicamValueType_FloatingPoint || type == PicamValueType_LargeInteger ? type : PicamValueType_Integer, known->second.defaultValue );
+	}
+	cache.profiled = profiled;
+	return true;
+}
+
+// - the eight arguments of a capture
+struct RunArguments
+{
+	string	FileDir;
+	string	FileName;
+	int		x0, y0, dx, dy;
+	piflt	dt;			/* ms */
+	int		NFrames;
+};
+
+// - checks and converts the eight arguments from args[first] on, where -
+//   takes the ROIs (all four), exposure or frames of the profile, or those
+//   of --sequence.  Returns what is wrong with them, or "" if nothing
+string ParseRunArguments(const vector<string>& args, size_t first, CaptureOptions& options, RunArguments& run)
+{
+	static const char* names[6] = { "x0", "y0", "dx", "dy", "dt", "NFrames" };
+	run.FileDir = args[first];
+	run.FileName = args[first + 1];
+	const string* fields = &args[first + 2];
+
+	bool profileRoi = fields[0] == "-";
+	for( int i = 1; i < 4; ++i )
+		if( ( fields[i] == "-" ) != profileRoi )
+			return "x0, y0, dx and dy: give all four, or - for all of them";
+	if( profileRoi )
+	{
+		if( options.ProfileRois.empty() )
+			return "x0, y0, dx and dy: - needs a --profile with roi= lines";
+		/* The first ROI of the profile stands for the arguments, binning and all */
+		const PicamRoi& roi = options.ProfileRois[0];
+		run.x0 = roi.x;
+		run.y0 = roi.y;
+		run.dx = roi.width;
+		run.dy = roi.height;
+		options.XBinning = roi.x_binning;
+		options.YBinning = roi.y_binning;
+		options.ExtraRois.insert( options.ExtraRois.begin(), options.ProfileRois.begin() + 1, options.ProfileRois.end() );
+	}
+	else
+	{
+		int* roi[4] = { &run.x0, &run.y0, &run.dx, &run.dy };
+		for( int i = 0; i < 4; ++i )
+		{
+			long value = 0;
+			if( !ParseWhole( fields[i], value ) || value < ( i < 2 ? 0 : 1 ) || value > INT_MAX )
+				return string( names[i] ) + ": " + fields[i] + " is not a" + ( i < 2 ? " pixel position" : " positive number of pixels" );
+			*roi[i] = (int)value;
+		}
+	}
+
+	bool sequence = !options.Sequence.empty();
+	if( fields[4] == "-" && ( options.ProfileExposure >= 0 || sequence ) )
+		run.dt = std::max( options.ProfileExposure, (piflt)0 );
+	else if( !ParseNumber( fields[4], run.dt ) || run.dt < 0 )
+		return string( names[4] ) + ": " + fields[4] + " is not an exposure time in ms" + ( fields[4] == "-" ? " (the profile has no exposure=)" : "" );
+
+	long frames = 0;
+	if( fields[5] == "-" && ( options.ProfileFrames > 0 || sequence ) )
+		run.NFrames = options.ProfileFrames;
+	else if( !ParseWhole( fields[5], frames ) || frames < 1 || frames > INT_MAX )
+		return string( names[5] ) + ": " + fields[5] + " is not a positive number of frames" + ( fields[5] == "-" ? " (the profile has no frames=)" : "" );
+	else
+		run.NFrames = (int)frames;
+	return "";
+}
+
+// - Set configuration.
+// - Need to mimic most (preferably all) settings from Winview.  Still learning how this all maps.
+// - Stages every value and commits once.  See ConfigureOneByOne for the original sequence.
+// - Returns CaptureResult_BadArguments for a profile it does not understand or a value
+//   outside its constraint, CaptureResult_CameraError if the camera refused the rest.
+CaptureResult Configure( PicamHandle camera, piflt ExposureTime, const CaptureOptions& options, ConstraintCache& cache )
+{
+	vector<StagedParameter> stage;
+
+	StageFltParameter(stage, PicamParameter_ExposureTime, ExposureTime);
+	StageFltParameter(stage, PicamParameter_AdcSpeed, options.AdcSpeed);
+	StageIntParameter(stage, PicamParameter_AdcAnalogGain, PicamAdcAnalogGain_High);
+	StageIntParameter(stage, PicamParameter_CleanUntilTrigger, 1);
+	StageIntParameter(stage, PicamParameter_TriggerResponse, PicamTriggerResponse_ReadoutPerTrigger);
+	StageIntParameter(stage, PicamParameter_TriggerDetermination, PicamTriggerDetermination_PositivePolarity);
+	StageIntParameter(stage, PicamParameter_CleanCycleCount, 1);
+	StageIntParameter(stage, PicamParameter_CleanSectionFinalHeight, 4);
+	StageIntParameter(stage, PicamParameter_CleanSectionFinalHeightCount, 250);
+	StageFltParameter(stage, PicamParameter_SensorTemperatureSetPoint, -70);
+	StageReadoutMode(camera, options, stage);
+	// In WinView we set this to 1 (assuming it corresponds to strips per clean, which is what I was told by Rob Alan).  When we set it to anything less than 8 it kills the PICAM.  So we're using 8.
+	StageIntParameter(stage, PicamParameter_CleanCycleHeight, 8);
+
+	// A profile replaces any of the above and adds its own; nothing is set unless all of it is understood
+	if( !StageProfile(camera, options, cache, stage) )
+		return CaptureResult_BadArguments;
+
+	std::cout << "Staged " << stage.size() << " parameters:" << std::endl;
+	piint queries = cache.queries;
+	CaptureResult committed = CommitStagedParameters(camera, stage, cache);
+	std::cout << "Constraint queries: " << cache.queries - queries << std::endl;
+	SaveCapabilities(cache);
+	return committed;
+}
+
+// - Original configuration sequence: queries, sets and commits each parameter on its own.
+// - Kept for comparison with --legacy-configure.
+// - Only what the options and the profile choose is checked: it returns
+//   CaptureResult_BadArguments if the profile is not understood or one of those values is
+//   outside its constraint, and CaptureResult_CameraError if a value the camera allows did not stick.
+// - cache carries the parameters of the last profile from one call to the next, as in Configure
+CaptureResult ConfigureOneByOne( PicamHandle camera, piflt ExposureTime, const CaptureOptions& options, ConstraintCache& cache )
+{
+	// The parameters of a profile, set one at a time like the rest below, but only if all of it is understood
+	vector<StagedParameter> profile;
+	if( !StageProfile(camera, options, cache, profile) )
+		return CaptureResult_BadArguments;
+
+	SetFltParameter(camera, PicamParameter_ExposureTime, ExposureTime);
+	
+	SetFltParameter(camera, PicamParameter_AdcSpeed, options.AdcSpeed);  
+	SetIntParameter(camera, PicamParameter_AdcAnalogGain, PicamAdcAnalogGain_High);
+	SetIntParameter(camera, PicamParameter_CleanUntilTrigger, 1);
+	
+	/*
+	typedef enum PicamTriggerResponse
+	{
+		PicamTriggerResponse_NoResponse               = 1,
+		PicamTriggerResponse_ReadoutPerTrigger        = 2,
+		PicamTriggerResponse_ShiftPerTrigger          = 3,
+		PicamTriggerResponse_ExposeDuringTriggerPulse = 4,
+		PicamTriggerResponse_StartOnSingleTrigger     = 5
+	} PicamTriggerResponse; 
+	*/
+	SetIntParameter(camera, PicamParameter_TriggerResponse, PicamTriggerResponse_ReadoutPerTrigger);
+
+	/*
+	typedef enum PicamTriggerDetermination
+	{
+		PicamTriggerDetermination_PositivePolarity = 1,
+		PicamTriggerDetermination_NegativePolarity = 2,
+		PicamTriggerDetermination_RisingEdge       = 3,
+		PicamTriggerDetermination_FallingEdge      = 4
+	} PicamTriggerDetermination;
+	*/
+	SetIntParameter(camera, PicamParameter_TriggerDetermination, PicamTriggerDetermination_PositivePolarity);
+
+	SetIntParameter(camera, PicamParameter_CleanCycleCount, 1);
+	SetIntParameter(camera, PicamParameter_CleanSectionFinalHeight, 4);
+	SetIntParameter(camera, PicamParameter_CleanSectionFinalHeightCount, 250);
+	SetFltParameter(camera, PicamParameter_SensorTemperatureSetPoint, -70);
+	SetIntParameter(camera, PicamParameter_ReadoutControlMode, options.ReadoutMode);
+	// In WinView we set this to 1 (assuming it corresponds to strips per clean, which is what I was told by Rob Alan).  When we set it to anything less than 8 it kills the PICAM.  So we're using 8.
+	SetIntParameter(camera, PicamParameter_CleanCycleHeight, 8);
+
+	/*
+	typedef enum PicamReadoutControlMode
+	{
+		PicamReadoutControlMode_FullFrame       = 1,  
+		PicamReadoutControlMode_FrameTransfer   = 2,
+		PicamReadoutControlMode_Interline       = 5,
+		PicamReadoutControlMode_Kinetics        = 3,
+		PicamReadoutControlMode_SpectraKinetics = 4,
+		PicamReadoutControlMode_Dif             = 6
+	} PicamReadoutControlMode;
+	*/
+	SetIntParameter(camera, PicamParameter_ReadoutControlMode, options.ReadoutMode);
+	if( KineticsWindowRows(camera, options) > 0 )
+		SetIntParameter(camera, PicamParameter_KineticsWindowHeight, KineticsWindowRows(camera, options));
+
+	vector<StagedParameter> chosen;
+	StageFltParameter(chosen, PicamParameter_AdcSpeed, options.AdcSpeed);
+	StageIntParameter(chosen, PicamParameter_ReadoutControlMode, options.ReadoutMode);
+	if( KineticsWindowRows(camera, options) > 0 )
+		StageIntParameter(chosen, PicamParameter_KineticsWindowHeight, KineticsWindowRows(camera, options));
+	for( size_t i = 0; i < profile.size(); ++i )
+	{
+		if( profile[i].type == PicamValueType_FloatingPoint )
+			SetFltParameter(camera, profile[i].parameter, profile[i].value);
+		else
+			SetIntParameter(camera, profile[i].parameter, (piint)profile[i].value);
+		chosen.push_back(profile[i]);
+	}
+
+	/* Read them back: the setters only print what went wrong */
+	CaptureResult result = CaptureResult_Saved;
+	for( size_t i = 0; i < chosen.size(); ++i )
+	{
+		piflt current = 0;
+		if( GetStagedValue(camera, chosen[i], &current) == PicamError_None && current == chosen[i].value )
+			continue;
+		std::cout << "NOT APPLIED: " << ParameterName(chosen[i].parameter) << " = " << chosen[i].value << std::endl;
+		if( !IsValueAllowedNow(camera, cache, chosen[i].parameter, chosen[i].value) )
+			result = CaptureResult_BadArguments;
+		else if( result == CaptureResult_Saved )
+			result = CaptureResult_CameraError;
+	}
+	return result;
+}
+
+// - configures the camera the way the options ask for
+CaptureResult ConfigureCamera( PicamHandle camera, piflt ExposureTime, const CaptureOptions& options, ConstraintCache& cache )
+{
+	if( options.LegacyConfigure )
+		return ConfigureOneByOne( camera, ExposureTime, options, cache );
+	return Configure( camera, ExposureTime, options, cache );
+}
+
+// - reads the temperature and temperature status directly from hardware
+void ReadTemperature( PicamHandle camera )
+{
+    PicamError error;
+
+    // - read temperature
+    std::cout << "Read sensor temperature: ";
+    piflt temperature;
+	
+    error =
+        Picam_ReadParameterFloatingPointValue(
+            camera,
+            PicamParameter_SensorTemperatureReading,
+            &temperature );
+    PrintError( error );
+    if( error == PicamError_None )
+    {
+        std::cout << "    " << "Temperature is "
+                  << temperature << " degrees C" << std::endl;
+    }
+
+    // - read temperature status
+    std::cout << "Read sensor temperature status: ";
+    PicamSensorTemperatureStatus status;
+    error =
+        Picam_ReadParameterIntegerValue(
+            camera,
+            PicamParameter_SensorTemperatureStatus,
+            reinterpret_cast<piint*>( &status ) );
+    PrintError( error );
+    if( error == PicamError_None )
+    {
+        std::cout << "    " << "Status is ";
+        PrintEnumString( PicamEnumeratedType_SensorTemperatureStatus, status );
+        std::cout << std::endl;
+    }
+}
+
+// - acquires the committed ReadoutCount and hands every readout to the sink
+// - if the sink offers a buffer for the whole run (the mapped file) it is
+//   PICAM's acquisition buffer, so the camera data lands there uncopied
+// - otherwise PICAM fills a BufferReadouts circular buffer and each readout
+//   is passed on as it arrives, so memory stays bounded no matter how long
+//   the run is
+// - metadata, if given, collects each frame's time stamps and tracking counter
+// - sequence, if given, changes the exposure time step by step
+// - returns the number of readouts stored
+pi64s AcquireToFile(PicamHandle camera, ReadoutSink& sink, piint readoutstride, int NFrames, const CaptureOptions& options, CaptureProgress& progress, FrameMetadataTable* metadata, ExposureSequencer* sequence = 0)
+{
+	PicamError				err;
+	PicamHandle				device;
+	PicamAcquisitionBuffer	buffer;
+	PicamAvailableData		available;
+	PicamAcquisitionStatus	status;
+	/* An online sequence leaves readouts out, so they cannot land in place */
+	pibyte*					frames = sequence && sequence->online ? 0 : sink.RunBuffer();
+
+	/* Circular buffer, never larger than the run itself, from the arena */
+	ArenaBuffer circular;
+	if( !frames )
+	{
+		pi64s bufferReadouts = options.BufferReadouts > 0 ? options.BufferReadouts : STREAM_BUFFER_READOUTS;
+		if( bufferReadouts > NFrames )
+			bufferReadouts = NFrames;
+		size_t bytes = (size_t)(bufferReadouts * readoutstride);
+		buffer.memory = circular.Get( bytes, options.UseArena );
+		buffer.memory_size = (pi64s)bytes;
+		if( !buffer.memory )
+		{
+			progress.Failed( "allocating the acquisition buffer", PicamError_InsufficientMemory );
+			return 0;
+		}
+		std::cout << "Attaching " << bufferReadouts << " readout circular buffer ("
+		          << bytes / (1024.0 * 1024.0) << " MB): ";
+	}
+	else
+	{
+		buffer.memory = frames;
+		buffer.memory_size = (pi64s)NFrames * readoutstride;
+		std::cout << "Attaching the mapped file as the acquisition buffer: ";
+	}
+
+	/* Without online changes the first step is an acquisition of its own */
+	if( sequence && sequence->Due( 0 ) )
+	{
+		err = sequence->Commit( camera, 0 );
+		if( err != PicamError_None )
+		{
+			std::cout << "Committing the first exposure step: ";
+			PrintError( err );
+			progress.Failed( "committing the first exposure step", err );
+			return 0;
+		}
+	}
+	err = PicamAdvanced_GetCameraDevice( camera, &device );
+	if( err == PicamError_None )
+		err = PicamAdvanced_SetAcquisitionBuffer( device, &buffer );
+	PrintError( err );
+	progress.Failed( "attaching acquisition buffer", err );
+	if( err != PicamError_None )
+		return 0;
+
+	progress.Arm();
+	Timing.Mark("File and buffer setup");
+	std::cout << "Starting acquisition of " << NFrames << " readouts: ";
+	err = Picam_StartAcquisition( camera );
+	PrintError( err );
+	progress.Failed( "starting acquisition", err );
+	progress.Update( 0, true );
+
+	pi64s written = 0;
+	pibln dataLost = false;
+	bool stopped = false;
+	std::chrono::steady_clock::time_point started = std::chrono::steady_clock::now();
+
+	/* Stores count readouts; false if the acquisition had to be stopped */
+	auto store = [&]( const pibyte* readouts, pi64s count ) -> bool
+	{
+		if( metadata )
+			metadata->Parse( readouts, count, readoutstride );
+		bool stored;
+		{
+			TraceSpan span( "Store readouts" );
+			stored = sink.Store( readouts, count );
+		}
+		if( !stored )
+		{
+			std::cout << "FAILED TO WRITE FILE.  Stopping acquisition. \n";
+			Picam_StopAcquisition( camera );
+			return false;
+		}
+		written += count;
+		progress.Update( written );
+
+		string reason = sink.StopReason();
+		if( !reason.empty() )
+		{
+			std::cout << "ABORTING: " << reason << ".  Stopping acquisition." << std::endl;
+			if( progress.Detail.empty() )
+				progress.Detail = reason;
+			Picam_StopAcquisition( camera );
+			return false;
+		}
+		return true;
+	};
+
+	status.running = ( err == PicamError_None );
+	while( status.running )
+	{
+		{
+			TraceSpan span( "Wait for readouts" );
+			err = Picam_WaitForAcquisitionUpdate( camera, TIMEOUT, &available, &status );
+		}
+		if( err == PicamError_TimeOutOccurred )
+		{
+			std::cout << "Still waiting for readouts (" << written << " of " << NFrames << " in file)" << std::endl;
+			progress.Update( written, true );
+			continue;
+		}
+		if( err != PicamError_None )
+		{
+			std::cout << "Acquisition update failed: ";
+			PrintError( err );
+			progress.Failed( "waiting for readouts", err );
+			Picam_StopAcquisition( camera );
+			break;
+		}
+
+		if( available.readout_count > 0 && written < NFrames )
+		{
+			if( written == 0 )
+				Timing.Mark("First readout");
+			pi64s count = available.readout_count;
+			const pibyte* readouts = static_cast<const pibyte*>( available.initial_readout );
+			bool going = true;
+			if( sequence && sequence->online )
+			{
+				/* Runs of readouts at the exposure of their step are stored,
+				   those still at the exposure of a finished step left out */
+				const pibyte* run = readouts;
+				pi64s length = 0;
+				for( pi64s r = 0; going && r < count; ++r )
+				{
+					const pibyte* readout = readouts + r * readoutstride;
+					if( sequence->Keep( metadata ? metadata->MeasuredExposure( readout ) : -1 ) )
+					{
+						++length;
+						continue;
+					}
+					if( length > 0 )
+						going = store( run, length );
+					run = readout + readoutstride;
+					length = 0;
+				}
+				if( going && length > 0 )
+					going = store( run, length );
+			}
+			else
+			{
+				if( count > NFrames - written )
+					count = NFrames - written;
+				going = store( readouts, count );
+			}
+			if( !going )
+				break;
+
+			if( sequence && ( err = sequence->Advance( camera ) ) != PicamError_None )
+			{
+				std::cout << "Changing the exposure online: ";
+				PrintError( err );
+				progress.Failed( "changing the exposure online", err );
+				Picam_StopAcquisition( camera );
+				break;
+			}
+			if( sequence && sequence->Stalled() )
+			{
+				std::cout << "The exposure change did not show in " << SEQUENCE_LATE_READOUTS << " readouts.  Stopping acquisition." << std::endl;
+				progress.Failed( "changing the exposure online", PicamError_InvalidOperation );
+				Picam_StopAcquisition( camera );
+				break;
+			}
+		}
+
+		/* An online sequence acquires until every step has its readouts */
+		if( sequence && sequence->online && sequence->Done() && !stopped && status.running )
+		{
+			Picam_StopAcquisition( camera );
+			stopped = true;
+		}
+		if( status.errors & PicamAcquisitionErrorsMask_DataLost )
+			dataLost = true;
+
+		/* or else the next one once the camera is done with this one */
+		if( !status.running && sequence && sequence->Due( written ) )
+		{
+			if( frames )
+			{
+				buffer.memory = frames + written * readoutstride;
+				buffer.memory_size = ( NFrames - written ) * (pi64s)readoutstride;
+			}
+			err = sequence->Commit( camera, written );
+			if( err == PicamError_None )
+				err = PicamAdvanced_SetAcquisitionBuffer( device, &buffer );
+			if( err == PicamError_None )
+				err = Picam_StartAcquisition( camera );
+			if( err != PicamError_None )
+			{
+				std::cout << "Starting the next exposure step: ";
+				PrintError( err );
+			}
+			progress.Failed( "starting the next exposure step", err );
+			status.running = ( err == PicamError_None );
+		}
+	}
+	Timing.Mark("Remaining readouts");
+
+	double seconds = std::chrono::duration<double>( std::chrono::steady_clock::now() - started ).count();
+	std::cout << "Acquired " << written << " of " << NFrames << " readouts";
+	if( seconds > 0 )
+		std::cout << " (" << written * (double)readoutstride / (1024.0 * 1024.0) / seconds << " MB/s)";
+	std::cout << std::endl;
+	if( dataLost )
+	{
+		std::cout << "WARNING: PICAM reported lost readouts.  If the disk cannot keep up, increase --buffer-readouts." << std::endl;
+		if( progress.Detail.empty() )
+			progress.Detail = "PICAM reported lost readouts";
+	}
+
+	/* Hand buffer management back to PICAM before our memory goes away */
+	buffer.memory = 0;
+	buffer.memory_size = 0;
+	PicamAdvanced_SetAcquisitionBuffer( device, &buffer );
+	return written;
+}
+
+// - acquires NFrames readouts into <FullFilePath>.partial, through the
+//   memory-mapped file or the writer thread, adds the header and metadata
+//   table and renames the file into place once it is complete
+CaptureResult CaptureToFile(PicamHandle camera, const PicamRois* region, piint readoutstride, const string& FullFilePath, int NFrames, const CaptureOptions& options, CaptureProgress& progress, FrameArray* array = 0)
+{
+	/* Nothing is captured before the sensor is at its temperature */
+	double lockWait = 0;
+	if( options.LockTimeout > 0 )
+	{
+		std::chrono::steady_clock::time_point waited = std::chrono::steady_clock::now();
+		if( !WaitForTemperatureLock( camera, options.LockTimeout, progress ) )
+			return CaptureResult_NotLocked;
+		lockWait = std::chrono::duration<double, std::milli>( std::chrono::steady_clock::now() - waited ).count();
+		Timing.Mark("Temperature lock");
+	}
+
+	/* Lay out the file: header, then the readouts on a page boundary */
+	CaptureFileHeader header;
+	FillCaptureHeader( camera, region, readoutstride, header );
+	header.lock_wait = lockWait;
+	pi64s dataOffset = options.RawFile ? 0 : CAPTURE_FILE_HEADER_SIZE;
+	header.start_time = WallClockMicroseconds();
+	CaptureFileHeader cameraLayout = header;
+	if( array && !FitFrameArray( *array, cameraLayout, NFrames ) )
+		return CaptureResult_BadArguments;
+
+	/* Dark and flat correction changes what is stored and perhaps its size */
+	CorrectionStage correction;
+	CaptureResult loaded = correction.Load( options, header );
+	if( loaded != CaptureResult_Saved )
+		return loaded;
+
+	/* as does co-adding, which also stores fewer readouts */
+	CoaddStage coadd;
+	loaded = coadd.Setup( options, NFrames, header );
+	if( loaded != CaptureResult_Saved )
+		return loaded;
+	piint filestride = (piint)header.readout_stride;
+
+	/* Compressed readouts go through the writer thread, which takes any size */
+	if( options.CompressThreads > 0 && ( options.RawFile || header.pixel_type != CAPTURE_PIXEL_UINT16 ) )
+	{
+		std::cout << "--compress needs 16-bit pixels in a capture file (not --raw, float32 or a sum)" << std::endl;
+		return CaptureResult_BadArguments;
+	}
+	if( options.CentroidOnly && ( options.CompressThreads > 0 || options.Tiff || coadd.Active() || correction.Active() || options.RawFile ) )
+	{
+		std::cout << "--centroid-only stores no frames to compress, export, co-add or correct, and needs the capture file header" << std::endl;
+		return CaptureResult_BadArguments;
+	}
+	pi64s storedReadouts = options.CentroidOnly ? 0 : coadd.Stored( NFrames );
+	bool writerThread = options.WriterThread || options.CompressThreads > 0;
+	if( options.CompressThreads > 0 )
+	{
+		header.codec = CAPTURE_CODEC_DELTA_PACK;
+		header.codec_block = CODEC_BLOCK_PIXELS;
+	}
+
+	/* The metadata table follows the last readout */
+	FrameMetadataTable metadata;
+	bool tracked = metadata.Load( camera );
+	pi64s tableBytes = tracked && !options.RawFile ? metadata.TableBytes( NFrames ) : 0;
+
+	/* and the temperature readings follow that */
+	TemperatureMonitor monitor;
+	size_t telemetryRoom = options.TelemetryInterval > 0 ?
+		TemperatureMonitor::Capacity( options.TelemetryInterval, NFrames * ( header.exposure_time + header.readout_time ) ) : 0;
+	pi64s telemetryBytes = options.RawFile ? 0 : telemetryRoom * sizeof(CaptureFileTemperature);
+
+	/* and the exposure of every frame of a sequence */
+	ExposureSequencer sequence;
+	PicamError sequenced = sequence.Setup( camera, options );
+	if( sequenced != PicamError_None )
+	{
+		std::cout << "Setting up the exposure sequence: ";
+		PrintError( sequenced );
+		progress.Failed( "setting up the exposure sequence", sequenced );
+		return CaptureResult_CameraError;
+	}
+	pi64s exposureBytes = sequence.Active() && !options.RawFile ? (pi64s)NFrames * header.frames_per_readout * sizeof(CaptureFileExposure) : 0;
+
+	/* and the statistics of every frame */
+	pi64s statsBytes = options.StatsThreads > 0 && !options.RawFile ? (pi64s)NFrames * header.frames_per_readout * sizeof(CaptureFileFrameStats) : 0;
+
+	/* and its spots */
+	pi64s spotBytes = options.CentroidThreads > 0 && !options.RawFile ? CentroidSink::MaxBytes( options, (pi64s)NFrames * header.frames_per_readout ) : 0;
+
+	/* Written under a temporary name until it is complete */
+	string PartialFilePath = FullFilePath + ".partial";
+	const char * FullFilePathChar  = PartialFilePath.c_str();
+	MappedFile file;
+	DirectWriter writer;
+	bool opened;
+	if( writerThread )
+		opened = writer.Open( PartialFilePath, dataOffset, filestride, options.UseArena );
+	else
+	{
+		opened = file.Create( PartialFilePath, dataOffset + storedReadouts * filestride + tableBytes + exposureBytes + statsBytes + spotBytes + telemetryBytes );
+		if( opened )
+			std::cout << "Opened file successfully.  Mapped " << file.size / (1024.0 * 1024.0) << " MB \n";
+	}
+	if( !opened )
+	{
+		std::cout << "FAILED TO OPEN FILE: " << FullFilePathChar << " \n";
+		return CaptureResult_FileError;
+	}
+
+	MappedSink mapped( file, dataOffset, filestride, !options.Streaming );
+	CompressingSink compressed( writer, header, dataOffset, options.CompressThreads );
+	DiscardSink discarded;
+	ReadoutSink& stored = options.CentroidOnly ? static_cast<ReadoutSink&>( discarded ) :
+	                      options.CompressThreads > 0 ? static_cast<ReadoutSink&>( compressed ) :
+	                      options.WriterThread ? static_cast<ReadoutSink&>( writer ) : mapped;
+	TiffSink tiffed( stored, header );
+	ReadoutSink& kept = options.Tiff ? static_cast<ReadoutSink&>( tiffed ) : stored;
+	if( options.Tiff && !tiffed.Open( options.TiffPath.empty() ? FullFilePath + ".tif" : options.TiffPath, coadd.Stored( NFrames ) ) )
+		return CaptureResult_FileError;
+	CoaddSink coadded( kept, coadd, filestride );
+	ReadoutSink& reduced = coadd.Active() ? static_cast<ReadoutSink&>( coadded ) : kept;
+	CorrectingSink corrected( reduced, correction, readoutstride );
+	ReadoutSink& processed = correction.Active() ? static_cast<ReadoutSink&>( corrected ) : reduced;
+
+	/* Other processes see the readouts as the camera delivers them */
+	SharedRingSink shared( processed );
+	ReadoutSink& published = options.SharedRing.empty() ? processed : static_cast<ReadoutSink&>( shared );
+	if( !options.SharedRing.empty() && !shared.Open( options.SharedRing, cameraLayout, options.RingSlots ) )
+		return CaptureResult_FileError;
+
+	/* and the library's caller gets them in its array as well */
+	FrameArray unused;
+	ArraySink arrayed( published, array ? *array : unused, cameraLayout );
+	ReadoutSink& sink = array ? static_cast<ReadoutSink&>( arrayed ) : published;
+
+	/* Spots and statistics are of the frames as the camera delivered them */
+	CentroidSink centroided( sink, cameraLayout, options );
+	ReadoutSink& searched = options.CentroidThreads > 0 ? static_cast<ReadoutSink&>( centroided ) : sink;
+	StatsSink measured( searched, cameraLayout, options );
+	ReadoutSink& source = options.StatsThreads > 0 ? static_cast<ReadoutSink&>( measured ) : searched;
+	if( telemetryRoom > 0 )
+		monitor.Start( camera, options.TelemetryInterval, telemetryRoom, progress );
+	pi64s written = AcquireToFile( camera, source, readoutstride, NFrames, options, progress, tracked ? &metadata : 0, sequence.Active() ? &sequence : 0 );
+	monitor.Stop();
+	if( options.StatsThreads > 0 )
+		measured.Finish();
+	if( options.CentroidThreads > 0 )
+		centroided.Finish();
+	correction.PrintReport();
+	coadd.PrintReport();
+	/* Side outputs are finished before the file itself */
+	bool finished = options.CompressThreads == 0 || compressed.Finish();
+	if( options.Tiff )
+		finished = tiffed.Close( written == NFrames ) && finished;
+
+	header.end_time = WallClockMicroseconds();
+	header.readout_count = options.CentroidOnly ? 0 : coadd.Stored( written );
+	header.complete = ( written == NFrames );
+	header.clipped_values = coadd.clipped;
+	pi64s dataEnd = dataOffset + (pi64s)header.readout_count * filestride;
+	const void* table = 0;
+	if( tracked )
+	{
+		metadata.Summarize( header );
+		/* Readouts a sequence left out between its steps are not missing */
+		uint64_t between = std::min<uint64_t>( header.missing_frames, (uint64_t)sequence.skipped * header.frames_per_readout );
+		if( between > 0 )
+		{
+			header.missing_frames -= between;
+			std::cout << "    " << between << " of the missing frames were left out between exposure steps (not counted as missing)" << std::endl;
+		}
+		if( tableBytes > 0 && !metadata.frames.empty() )
+		{
+			header.metadata_offset = dataEnd;
+			table = &metadata.frames[0];
+			tableBytes = metadata.frames.size() * sizeof(CaptureFileFrame);
+		}
+	}
+	if( !table )
+		tableBytes = 0;
+
+	/* Compressed data ends early and is followed by the chunk index */
+	vector<pibyte> tail;
+	if( options.CompressThreads > 0 )
+	{
+		dataEnd = dataOffset + compressed.packed;
+		header.compressed_bytes = compressed.packed;
+		header.chunk_index_offset = dataEnd;
+		tail.assign( (const pibyte*)compressed.chunks.data(), (const pibyte*)( compressed.chunks.data() + compressed.chunks.size() ) );
+		if( table )
+		{
+			header.metadata_offset = dataEnd + tail.size();
+			tail.insert( tail.end(), (const pibyte*)table, (const pibyte*)table + tableBytes );
+		}
+		table = tail.empty() ? 0 : &tail[0];
+		tableBytes = tail.size();
+	}
+
+	/* Further tables go after whatever is there */
+	auto append = [&]( const void* data, size_t bytes ) -> uint64_t
+	{
+		if( tail.empty() && table )
+			tail.assign( (const pibyte*)table, (const pibyte*)table + tableBytes );
+		uint64_t offset = dataEnd + tail.size();
+		tail.insert( tail.end(), (const pibyte*)data, (const pibyte*)data + bytes );
+		table = &tail[0];
+		tableBytes = tail.size();
+		return offset;
+	};
+
+	/* The exposure each frame of a sequence got */
+	if( sequence.Active() )
+	{
+		sequence.Tag( metadata, written, header.frames_per_readout );
+		header.sequence_steps = (uint32_t)sequence.steps.size();
+		header.sequence_online = sequence.online;
+		if( exposureBytes > 0 && !sequence.tags.empty() )
+		{
+			header.exposure_table_offset = append( sequence.tags.data(), sequence.tags.size() * sizeof(CaptureFileExposure) );
+			header.exposure_table_count = sequence.tags.size();
+		}
+	}
+
+	/* then the statistics of every frame */
+	if( options.StatsThreads > 0 )
+	{
+		header.stats_saturation = measured.saturation;
+		header.stats_shift = measured.shift;
+		header.aborted = !measured.abortReason.empty();
+		if( statsBytes > 0 && !measured.frames.empty() )
+		{
+			header.stats_offset = append( measured.frames.data(), measured.frames.size() * sizeof(CaptureFileFrameStats) );
+			header.stats_count = measured.frames.size();
+		}
+	}
+
+	/* and the spots, then their thumbnails */
+	if( options.CentroidThreads > 0 )
+	{
+		header.spot_frames = centroided.frames;
+		header.spot_threshold = options.SpotThreshold;
+		header.spots_only = options.CentroidOnly;
+		header.thumbnail_size = options.ThumbnailRadius > 0 ? 2 * options.ThumbnailRadius + 1 : 0;
+		if( spotBytes > 0 && !centroided.spots.empty() )
+		{
+			header.spot_table_offset = append( centroided.spots.data(), centroided.spots.size() * sizeof(CaptureFileSpot) );
+			header.spot_table_count = centroided.spots.size();
+			if( !centroided.thumbnails.empty() )
+				header.thumbnail_offset = append( centroided.thumbnails.data(), centroided.thumbnails.size() * sizeof(uint16_t) );
+		}
+	}
+
+	/* The temperature readings come last */
+	monitor.Summarize( header );
+	monitor.PrintReport( header );
+	ReportFrameRate( header, written, Timing.Stage("Remaining readouts") );
+	if( telemetryBytes > 0 && !monitor.samples.empty() )
+	{
+		header.telemetry_offset = append( monitor.samples.data(), monitor.samples.size() * sizeof(CaptureFileTemperature) );
+		header.telemetry_count = monitor.samples.size();
+	}
+
+	bool closed;
+	if( writerThread )
+		closed = writer.Finish( options.RawFile ? 0 : &header, dataEnd, table, tableBytes );
+	else
+	{
+		if( table )
+			memcpy( file.data + dataEnd, table, (size_t)tableBytes );
+		if( !options.RawFile )
+			memcpy( file.data, &header, sizeof(header) );
+		closed = file.Close( dataEnd + tableBytes );
+	}
+	closed = closed && finished;
+	progress.Update( written, true );
+	Timing.Mark("File flush");
+
+	if( !closed )
+	{
+		std::cout << "FAILED TO WRITE FILE: " << FullFilePathChar << " \n";
+		return CaptureResult_FileError;
+	}
+	if( written != NFrames )
+	{
+		std::cout << "INCOMPLETE FILE LEFT AT: " << FullFilePathChar << " \n";
+		return header.aborted ? CaptureResult_Aborted : CaptureResult_Incomplete;
+	}
+	if( !RenameIntoPlace( PartialFilePath, FullFilePath ) )
+	{
+		std::cout << "FAILED TO RENAME FILE TO: " << FullFilePath << " \n";
+		return CaptureResult_FileError;
+	}
+	return CaptureResult_Saved;
+}
+
+// - writes an uncompressed copy of a compressed capture file
+int DecompressCapture(const string& from, const string& to)
+{
+	FILE* in = fopen( from.c_str(), "rb" );
+	if( !in )
+	{
+		std::cout << "FAILED TO OPEN FILE: " << from << std::endl;
+		return CaptureResult_FileError;
+	}
+	CaptureFileHeader header;
+	if( fread( &header, sizeof(header), 1, in ) != 1 || memcmp( header.magic, CAPTURE_FILE_MAGIC, sizeof(header.magic) ) != 0 ||
+	    header.version < 5 || header.codec != CAPTURE_CODEC_DELTA_PACK )
+	{
+		std::cout << from << " is not a compressed capture file" << std::endl;
+		fclose( in );
+		return CaptureResult_BadArguments;
+	}
+
+	/* Chunk index, then the metadata table, if any */
+	vector<CaptureFileChunk> chunks( (size_t)header.readout_count );
+	vector<CaptureFileFrame> frames( (size_t)header.metadata_count );
+	bool ok = FileSeek( in, header.chunk_index_offset ) == 0 &&
+	          ( chunks.empty() || fread( &chunks[0], sizeof(CaptureFileChunk), chunks.size(), in ) == chunks.size() );
+	if( ok && !frames.empty() )
+		ok = FileSeek( in, header.metadata_offset ) == 0 && fread( &frames[0], sizeof(CaptureFileFrame), frames.size(), in ) == frames.size();
+	vector<CaptureFileExposure> exposures( header.version >= 7 ? (size_t)header.exposure_table_count : 0 );
+	if( ok && !exposures.empty() )
+		ok = FileSeek( in, header.exposure_table_offset ) == 0 && fread( &exposures[0], sizeof(CaptureFileExposure), exposures.size(), in ) == exposures.size();
+	vector<CaptureFileFrameStats> stats( header.version >= 9 ? (size_t)header.stats_count : 0 );
+	if( ok && !stats.empty() )
+		ok = FileSeek( in, header.stats_offset ) == 0 && fread( &stats[0], sizeof(CaptureFileFrameStats), stats.size(), in ) == stats.size();
+	vector<CaptureFileSpot> spots( header.version >= 10 ? (size_t)header.spot_table_count : 0 );
+	if( ok && !spots.empty() )
+		ok = FileSeek( in, header.spot_table_offset ) == 0 && fread( &spots[0], sizeof(CaptureFileSpot), spots.size(), in ) == spots.size();
+	vector<uint16_t> thumbnails( header.version >= 10 && header.thumbnail_offset > 0 ? spots.size() * header.thumbnail_size * header.thumbnail_size : 0 );
+	if( ok && !thumbnails.empty() )
+		ok = FileSeek( in, header.thumbnail_offset ) == 0 && fread( &thumbnails[0], sizeof(uint16_t), thumbnails.size(), in ) == thumbnails.size();
+	vector<CaptureFileTemperature> readings( header.version >= 6 ? (size_t)header.telemetry_count : 0 );
+	if( ok && !readings.empty() )
+		ok = FileSeek( in, header.telemetry_offset ) == 0 && fread( &readings[0], sizeof(CaptureFileTemperature), readings.size(), in ) == readings.size();
+
+	FILE* out = ok ? fopen( ( to + ".partial" ).c_str(), "wb" ) : 0;
+	CaptureFileHeader plain = header;
+	plain.codec = CAPTURE_CODEC_NONE;
+	plain.codec_block = 0;
+	plain.chunk_index_offset = 0;
+	plain.compressed_bytes = 0;
+	plain.metadata_offset = frames.empty() ? 0 : header.data_offset + header.readout_count * header.readout_stride;
+	uint64_t tables = header.data_offset + header.readout_count * header.readout_stride + frames.size() * sizeof(CaptureFileFrame);
+	plain.exposure_table_offset = exposures.empty() ? 0 : tables;
+	tables += exposures.size() * sizeof(CaptureFileExposure);
+	plain.stats_offset = stats.empty() ? 0 : tables;
+	tables += stats.size() * sizeof(CaptureFileFrameStats);
+	plain.spot_table_offset = spots.empty() ? 0 : tables;
+	tables += spots.size() * sizeof(CaptureFileSpot);
+	plain.thumbnail_offset = thumbnails.empty() ? 0 : tables;
+	tables += thumbnails.size() * sizeof(uint16_t);
+	plain.telemetry_offset = readings.empty() ? 0 : tables;
+	ok = out && fwrite( &plain, sizeof(plain), 1, out ) == 1 && FileSeek( out, header.data_offset ) == 0;
+
+	vector<pibyte> chunk, readout( (size_t)header.readout_stride );
+	for( size_t k = 0; ok && k < chunks.size(); ++k )
+	{
+		chunk.resize( (size_t)chunks[k].size );
+		ok = FileSeek( in, chunks[k].offset ) == 0 && ( chunk.empty() || fread( &chunk[0], chunk.size(), 1, in ) == 1 );
+		if( ok && !DecodeReadout( header, chunk.empty() ? 0 : &chunk[0], chunk.size(), &readout[0] ) )
+		{
+			std::cout << "Readout " << k + 1 << " of " << from << " does not decode" << std::endl;
+			ok = false;
+		}
+		ok = ok && fwrite( &readout[0], readout.size(), 1, out ) == 1;
+	}
+	if( ok && !frames.empty() )
+		ok = fwrite( &frames[0], sizeof(CaptureFileFrame), frames.size(), out ) == frames.size();
+	if( ok && !exposures.empty() )
+		ok = fwrite( &exposures[0], sizeof(CaptureFileExposure), exposures.size(), out ) == exposures.size();
+	if( ok && !stats.empty() )
+		ok = fwrite( &stats[0], sizeof(CaptureFileFrameStats), stats.size(), out ) == stats.size();
+	if( ok && !spots.empty() )
+		ok = fwrite( &spots[0], sizeof(CaptureFileSpot), spots.size(), out ) == spots.size();
+	if( ok && !thumbnails.empty() )
+		ok = fwrite( &thumbnails[0], sizeof(uint16_t), thumbnails.size(), out ) == thumbnails.size();
+	if( ok && !readings.empty() )
+		ok = fwrite( &readings[0], sizeof(CaptureFileTemperature), readings.size(), out ) == readings.size();
+	fclose( in );
+	if( out )
+		ok = fclose( out ) == 0 && ok;
+	if( !ok || !RenameIntoPlace( to + ".partial", to ) )
+	{
+		std::cout << "FAILED TO DECOMPRESS " << from << " TO " << to << std::endl;
+		return CaptureResult_FileError;
+	}
+	std::cout << "Decompressed " << chunks.size() << " readouts of " << from << " to " << to << std::endl;
+	return CaptureResult_Saved;
+}
+
+// - checks the requested ROIs against the camera's ROI constraint and explains
+//   every problem found.  Returns true if the camera should accept them.
+bool ValidateRois(const CachedRoisConstraint& constraint, const vector<PicamRoi>& rois)
+{
+	bool valid = true;
+	piint totalWidth = constraint.width;
+	piint totalHeight = constraint.height;
+
+	if( rois.empty() || (piint)rois.size() > constraint.maximum_roi_count )
+	{
+		std::cout << "Number of ROIs (" << rois.size() << ") is invalid.  The camera takes between 1 and " << constraint.maximum_roi_count << " ROIs" << std::endl;
+		valid = false;
+	}
+	for( size_t i = 0; i < rois.size(); ++i )
+	{
+		const PicamRoi& roi = rois[i];
+		std::ostringstream label;
+		if( rois.size() > 1 )
+			label << "ROI " << i + 1 << ": ";
+		string which = label.str();
+
+		if( roi.x < 0 || roi.x > totalWidth - 1 )
+		{
+			std::cout << which << "Choice of x0 (" << roi.x << ") is invalid.  x0 must be between the values of 0 and " << totalWidth - 1 << std::endl;
+			valid = false;
+		}
+		if( roi.y < 0 || roi.y > totalHeight - 1 )
+		{
+			std::cout << which << "Choice of y0 (" << roi.y << ") is invalid.  y0 must be between the values of 0 and " << totalHeight - 1 << std::endl;
+			valid = false;
+		}
+		if( roi.width < 1 )
+		{
+			std::cout << which << "Choice of dx (" << roi.width << ") is invalid.  dx must be between the values of 1 and " << totalWidth << std::endl;
+			valid = false;
+		}
+		if( roi.height < 1 )
+		{
+			std::cout << which << "Choice of dy (" << roi.height << ") is invalid.  dy must be between the values of 1 and " << totalHeight << std::endl;
+			valid = false;
+		}
+		if( roi.x + roi.width > totalWidth )
+		{
+			std::cout << which << "Invalid x-parameters.  x0 + dx (" << roi.x + roi.width << ") must be less than or equal to sensor width (" << totalWidth << ")" << std::endl;
+			valid = false;
+		}
+		if( roi.y + roi.height > totalHeight )
+		{
+			std::cout << which << "Invalid y-parameters.  y0 + dy (" << roi.y + roi.height << ") must be less than or equal to sensor height (" << totalHeight << ")" << std::endl;
+			valid = false;
+		}
+
+		/* Binning must be one of the camera's limits */
+		bool xAllowed = false, yAllowed = false;
+		std::ostringstream xLimits, yLimits;
+		for( size_t b = 0; b < constraint.x_binning.size(); ++b )
+		{
+			xAllowed = xAllowed || constraint.x_binning[b] == roi.x_binning;
+			xLimits << " " << constraint.x_binning[b];
+		}
+		for( size_t b = 0; b < constraint.y_binning.size(); ++b )
+		{
+			yAllowed = yAllowed || constraint.y_binning[b] == roi.y_binning;
+			yLimits << " " << constraint.y_binning[b];
+		}
+		if( !constraint.x_binning.empty() && !xAllowed )
+		{
+			std::cout << which << "x binning (" << roi.x_binning << ") is invalid.  Allowed values:" << xLimits.str() << std::endl;
+			valid = false;
+		}
+		if( !constraint.y_binning.empty() && !yAllowed )
+		{
+			std::cout << which << "y binning (" << roi.y_binning << ") is invalid.  Allowed values:" << yLimits.str() << std::endl;
+			valid = false;
+		}
+		if( roi.x_binning < 1 || roi.y_binning < 1 )
+			continue;
+
+		if( (constraint.rules & PicamRoisConstraintRulesMask_XBinningAlignment) &&
+		    (roi.x % roi.x_binning || roi.width % roi.x_binning) )
+		{
+			std::cout << which << "x0 (" << roi.x << ") and dx (" << roi.width << ") must be multiples of the x binning (" << roi.x_binning << ")" << std::endl;
+			valid = false;
+		}
+		if( (constraint.rules & PicamRoisConstraintRulesMask_YBinningAlignment) &&
+		    (roi.y % roi.y_binning || roi.height % roi.y_binning) )
+		{
+			std::cout << which << "y0 (" << roi.y << ") and dy (" << roi.height << ") must be multiples of the y binning (" << roi.y_binning << ")" << std::endl;
+			valid = false;
+		}
+
+		/* ROIs may not share pixels */
+		for( size_t j = 0; j < i; ++j )
+		{
+			const PicamRoi& other = rois[j];
+			if( roi.x < other.x + other.width && other.x < roi.x + roi.width &&
+			    roi.y < other.y + other.height && other.y < roi.y + roi.height )
+			{
+				std::cout << which << "overlaps ROI " << j + 1 << std::endl;
+				valid = false;
+			}
+		}
+	}
+	if( constraint.rules & (PicamRoisConstraintRulesMask_HorizontalSymmetry | PicamRoisConstraintRulesMask_VerticalSymmetry) )
+		std::cout << "Note: this camera also requires symmetric ROIs, which is checked when they are committed." << std::endl;
+	return valid;
+}
+
+// - the ROI given by the positional arguments followed by any --roi options
+vector<PicamRoi> CaptureRois(int x0, int y0, int dx, int dy, const CaptureOptions& options)
+{
+	PicamRoi roi;
+	roi.x = x0;
+	roi.y = y0;
+	roi.width = dx;
+	roi.height = dy;
+	roi.x_binning = options.XBinning;
+	roi.y_binning = options.YBinning;
+
+	vector<PicamRoi> rois(1, roi);
+	rois.insert(rois.end(), options.ExtraRois.begin(), options.ExtraRois.end());
+	return rois;
+}
+
+CaptureResult CaptureToArray(PicamHandle camera, const PicamRois* region, piint readoutstride, int NFrames, const CaptureOptions& options, CaptureProgress& progress, FrameArray& array);
+
+// - writes <FullFilePath>.partial and renames it to FullFilePath once all
+//   NFrames are safely on disk, or fills array instead if one is given
+CaptureResult AcquireROI(PicamHandle camera, string FullFilePath, const vector<PicamRoi>& rois, int NFrames, const CaptureOptions& options, ConstraintCache& cache, CaptureProgress& progress, FrameArray* array = 0)
+{
+	CaptureResult				result = CaptureResult_CameraError;
+	PicamError					err;			 /* Error Code			*/
+	PicamRois					region;			 /* Regions of interest */
+	const PicamParameter		*paramsFailed;	 /* Failed to commit    */
+	piint						failCount;		 /* Count of failed	    */
+
+	/* Get dimensional constraints, from the capability cache once known */
+	const CachedRoisConstraint& constraint = GetCachedRoisConstraint( camera, cache, &err );
+	SaveCapabilities( cache );
+	/* Error check */
+	if (err == PicamError_None)
+	{		
+		if( ValidateRois( constraint, rois ) )
+			std::cout << "Valid ROI choice. " << std::endl;
+		else
+		{
+			std::cout << "ERROR: Invalid ROI choice. " << std::endl;
+			result = CaptureResult_InvalidRoi;
+		}
+
+		/* Every ROI is read out, one after another, in each frame */
+		region.roi_array = const_cast<PicamRoi*>( &rois[0] );
+		region.roi_count = (piint)rois.size();
+		if( result != CaptureResult_InvalidRoi )
+		{
+			// Print our ROI settings
+			for( size_t i = 0; i < rois.size(); ++i )
+			{
+				if( rois.size() > 1 )
+					std::cout << "ROI " << i + 1 << ":" << std::endl;
+				std::cout << "x0 = : " << rois[i].x << std::endl;
+				std::cout << "y0 = : " << rois[i].y << std::endl;
+				std::cout << "dx = : " << rois[i].width << std::endl;
+				std::cout << "dy = : " << rois[i].height << std::endl;
+				std::cout << "xbin = : " << rois[i].x_binning << std::endl;
+				std::cout << "ybin = : " << rois[i].y_binning << std::endl;
+			}
+			std::cout << "NFrames = : " << NFrames << std::endl;
+
+			std::cout << "Setting ROIs: ";
+			/* Set the region of interest */
+			err = Picam_SetParameterRoisValue(	camera, 
+												PicamParameter_Rois, 
+												&region);
+			/* Error check */
+			/* Tell the camera how many readouts to take */
+			if (err == PicamError_None)
+				err = Picam_SetParameterLargeIntegerValue(	camera, 
+															PicamParameter_ReadoutCount, 
+															NFrames);
+			/* Time stamps and frame tracking ride along behind each frame */
+			if (err == PicamError_None)
+				err = SetMetadataParameters( camera, options.Metadata );
+			if (err == PicamError_None)
+			{
+				/* Commit ROI to hardware */
+				err = Picam_CommitParameters(	camera, 
+												&paramsFailed, 
+												&failCount);
+                Picam_DestroyParameters(paramsFailed);
+				PrintError(err);
+
+				/* Error check */
+				if (err == PicamError_None)
+				{
+					piint readoutstride = 0;
+					Picam_GetParameterIntegerValue( camera, PicamParameter_ReadoutStride, &readoutstride );
+
+					std::cout << "ReadoutStride is: " << readoutstride << "\n";
+					Timing.Mark("ROI setup and commit");
+
+					piflt readoutTime = 0;
+					err = Picam_GetParameterFloatingPointValue( camera, PicamParameter_ReadoutTimeCalculation, &readoutTime );
+					if(err == PicamError_None)
+						std::cout << "Readout time is: " << readoutTime << "msec" << std::endl;
+					else
+						std::cout << "Error getting readoutTime." << std::endl;
+
+					/* The mode is only known to have taken once committed */
+					if( !CheckReadoutMode( camera, options ) )
+					{
+						err = PicamError_InvalidParameterValue;
+						result = CaptureResult_CameraError;
+					}
+					else if( array && FullFilePath.empty() )
+						result = CaptureToArray( camera, &region, readoutstride, NFrames, options, progress, *array );
+					else
+						result = CaptureToFile( camera, &region, readoutstride, FullFilePath, NFrames, options, progress, array );
+				}				
+			}	
+		}
+	} 	
+	if( result == CaptureResult_CameraError )
+		progress.Failed( "ROI setup", err );
+	return result;
+}
+
+// - lists the optional arguments
+void PrintOptions()
+{
+	cout << "Options (after the 8 arguments):\n";
+	cout << "  --stream               write each readout to disk as it arrives instead of after the run\n";
+	cout << "  --buffer-readouts=N    readouts held in the streaming circular buffer (default " << STREAM_BUFFER_READOUTS << ")\n";
+	cout << "  --notify=PORT          report progress and completion to a listener on 127.0.0.1:PORT\n";
+	cout << "  --bin=X[,Y]            on-chip binning of the ROI given by the arguments (default 1)\n";
+	cout << "  --roi=x,y,dx,dy[,xbin[,ybin]]  read out another ROI as well; may be repeated\n";
+	cout << "  --writer-thread        copy readouts to a background thread that writes with direct I/O\n";
+	cout << "  --metadata             time stamp and track every frame; adds a per-frame table to the file\n";
+	cout << "  --dark=FILE            subtract the averaged frames of this capture file (same ROIs and exposure)\n";
+	cout << "  --flat=FILE            divide by the averaged frames of this capture file, normalized over each ROI\n";
+	cout << "  --output-type=T        uint16 (default) or float32 pixels after --dark/--flat\n";
+	cout << "  --coadd=K              store one readout per K: their sum, mean or sigma-clipped mean\n";
+	cout << "  --coadd-mode=M         sum, mean (default) or sigma-clip\n";
+	cout << "  --clip-sigma=S         sigma-clip keeps values within S robust sigma of the median (default 3)\n";
+	cout << "  --variance             with --coadd: store a per-pixel variance map of each group as well\n";
+	cout << "  --compress[=THREADS]   compress each readout losslessly on worker threads (default half the cores)\n";
+	cout << "  --tiff[=FILE]          also write the frames as a multi-page TIFF (default FILE.tif; BigTIFF past 4 GB)\n";
+	cout << "  --shared-ring=NAME     publish every readout into the shared memory ring NAME for other processes\n";
+	cout << "    --ring-slots=N           readouts the ring holds (default " << SHARED_RING_SLOTS << ")\n";
+	cout << "  --capability-dir=DIR   where camera capabilities are kept between runs (default next to the executeable; none to turn off)\n";
+	cout << "  --refresh-capabilities ask the camera for its capabilities again and save them\n";
+	cout << "  --log=FILE             also write everything printed, one JSON object per line, to FILE\n";
+	cout << "    --log-level=L            debug, info (default), warning or error: what still reaches the console\n";
+	cout << "  --telemetry[=MS]       read the sensor temperature every MS ms (default 1000) during the run, into the file\n";
+	cout << "  --wait-for-lock[=S]    start acquiring as soon as the sensor temperature locks; give up after S s (default 600)\n";
+	cout << "  --sequence=ms:N,...    N readouts at each exposure in turn, in one run (replaces dt and NFrames); changed online if possible\n";
+	cout << "  --stats[=THREADS]      min, max, mean, std, saturated pixels and a histogram of every frame, into the file\n";
+	cout << "  --abort-if=METRIC>V    stop the run when a frame's saturated (fraction), min, max, mean or std is > (or <) V\n";
+	cout << "    --abort-frames=N         only after N frames in a row (default 1)\n";
+	cout << "  --centroid[=THREADS]   find the spots of every frame on THREADS threads (default half the cores), into the file\n";
+	cout << "  --centroid-only[=T]    the same, storing only the spots and not the frames\n";
+	cout << "    --spot-threshold=S       noise sigma above the local background (default " << CENTROID_THRESHOLD << ")\n";
+	cout << "    --spot-min-pixels=N      pixels over the threshold a spot needs (default " << CENTROID_MIN_PIXELS << ")\n";
+	cout << "    --max-spots=N            brightest spots kept per frame (default " << CENTROID_MAX_SPOTS << ")\n";
+	cout << "    --thumbnails=R           also keep the (2R+1) x (2R+1) pixels around each spot\n";
+	cout << "  --readout-mode=M       full-frame (default), frame-transfer or kinetics\n";
+	cout << "    --kinetics-window=ROWS   rows exposed per kinetics frame\n";
+	cout << "    --kinetics-frames=N      or N kinetics frames per readout (window = sensor height / N)\n";
+	cout << "  --profile=NAME         camera parameters, ROIs and run of the profile [NAME]; - for x0 y0 dx dy, dt or NFrames takes its own\n";
+	cout << "    --profiles=FILE          the profiles (default " << PROFILE_FILE << " next to the executeable)\n";
+	cout << "  --no-arena             allocate the acquisition buffers per capture instead of reusing huge-page, locked ones\n";
+	cout << "  --trace                time library init, parameters, ROI setup, waits, stores and writes; print a breakdown\n";
+	cout << "  --raw                  write the readouts only, without the capture file header\n";
+	cout << "  --adc-speed=MHz        ADC speed (default 2)\n";
+	cout << "  --legacy-configure     set and commit each camera parameter separately (for timing comparison)\n";
+	cout << "  --cameras=SN1,SN2,...  capture from these cameras at once (or --cameras=all); files get _<serial>\n";
+	cout << "  --demo-cameras=N       connect N demo cameras first (they are used if --cameras is not given)\n";
+	cout << "  --scaling-test         with several cameras: check the total throughput scales with their number\n";
+	cout << "Other modes (instead of the 8 arguments):\n";
+	cout << "  --list-cameras         list the available cameras\n";
+	cout << "  --decompress=FILE      write an uncompressed copy of a compressed capture file\n";
+	cout << "    --decompress-to=FILE     where to write it (default FILE.decompressed)\n";
+	cout << "  --watch=NAME           follow the shared ring NAME of a running capture\n";
+	cout << "  --library-test         capture into memory through the library the MEX function uses\n";
+	cout << "  --sequence-test        check that online exposure sequences give every step its readouts\n";
+	cout << "  --benchmark-correction time the dark/flat correction and statistics kernels on a full frame; check them against plain C++\n";
+	cout << "  --benchmark=FILE       sweep the settings below and write the results to FILE (.csv or .json)\n";
+	cout << "    --sweep-size=N,...       square ROI sizes (default 64,256,1024)\n";
+	cout << "    --sweep-bin=N,...        binning (default 1,2,4)\n";
+	cout << "    --sweep-adc=MHz,...      ADC speeds (default all the camera offers)\n";
+	cout << "    --sweep-exposure=ms,...  exposure times (default 1)\n";
+	cout << "    --sweep-frames=N,...     readouts per point (default 100)\n";
+	cout << "    --sweep-mode=M,...       readout modes (default --readout-mode)\n";
+	cout << "  --server[=port]        keep the camera open and take CAPTURE commands on 127.0.0.1 (default port " << CAPTURE_SERVER_PORT << ")\n";
+}
+
+// - parses x,y,width,height[,x binning[,y binning]]
+bool ParseRoi(const string& text, PicamRoi& roi)
+{
+	roi.x_binning = roi.y_binning = 1;
+	int count = sscanf(text.c_str(), "%d,%d,%d,%d,%d,%d", &roi.x, &roi.y, &roi.width, &roi.height, &roi.x_binning, &roi.y_binning);
+	if( count == 5 )
+		roi.y_binning = roi.x_binning;
+	return count >= 4;
+}
+
+// - parses a comma separated list of positive numbers
+bool ParseList(const string& text, vector<piflt>& values)
+{
+	values.clear();
+	std::istringstream items(text);
+	string item;
+	while( std::getline(items, item, ',') )
+	{
+		piflt value = ::atof(item.c_str());
+		if( value <= 0 )
+			return false;
+		values.push_back(value);
+	}
+	return !values.empty();
+}
+
+// - parses the optional arguments.  Returns false on anything unrecognized,
+//   and names it in invalid if given
+bool ParseOptions(const vector<string>& args, size_t first, CaptureOptions& options, string* invalid = 0)
+{
+	// The profile is read first so that the options can override it
+	for( size_t i = first; i < args.size(); ++i )
+	{
+		if( args[i].compare(0, 11, "--profiles=") == 0 )
+			options.ProfileFile = args[i].substr(11);
+		else if( args[i].compare(0, 10, "--profile=") == 0 )
+			options.Profile = args[i].substr(10);
+	}
+	if( !options.Profile.empty() && !LoadProfile(options) )
+	{
+		if( invalid )
+			*invalid = "--profile=" + options.Profile;
+		return false;
+	}
+
+	PicamRoi roi;
+	for( size_t i = first; i < args.size(); ++i )
+	{
+		const string& arg = args[i];
+		string name = arg.substr(0, arg.find('='));
+		string value = arg.find('=') == string::npos ? "" : arg.substr(arg.find('=') + 1);
+
+		if( name == "--stream" )
+			options.Streaming = true;
+		else if( name == "--buffer-readouts" && atoi(value.c_str()) > 0 )
+			options.BufferReadouts = atoi(value.c_str());
+		else if( name == "--notify" && atoi(value.c_str()) > 0 )
+			options.NotifyPort = atoi(value.c_str());
+		else if( name == "--bin" && sscanf(value.c_str(), "%d,%d", &options.XBinning, &options.YBinning) >= 1 )
+		{
+			if( value.find(',') == string::npos )
+				options.YBinning = options.XBinning;
+		}
+		else if( name == "--roi" && ParseRoi(value, roi) )
+			options.ExtraRois.push_back(roi);
+		else if( name == "--cameras" && !value.empty() )
+		{
+			options.Cameras.clear();
+			std::istringstream serials(value);
+			string serial;
+			while( std::getline(serials, serial, ',') )
+				if( !serial.empty() )
+					options.Cameras.push_back(serial);
+		}
+		else if( name == "--demo-cameras" && atoi(value.c_str()) > 0 )
+			options.DemoCameras = atoi(value.c_str());
+		else if( name == "--scaling-test" )
+			options.ScalingTest = true;
+		else if( name == "--list-cameras" )
+			options.ListCameras = true;
+		else if( name == "--adc-speed" && ::atof(value.c_str()) > 0 )
+			options.AdcSpeed = ::atof(value.c_str());
+		else if( name == "--benchmark" && !value.empty() )
+			options.Benchmark = value;
+		else if( ( name == "--sweep-size" && ParseList(value, options.SweepSizes) ) ||
+		         ( name == "--sweep-bin" && ParseList(value, options.SweepBinning) ) ||
+		         ( name == "--sweep-adc" && ParseList(value, options.SweepAdcSpeeds) ) ||
+		         ( name == "--sweep-exposure" && ParseList(value, options.SweepExposures) ) ||
+		         ( name == "--sweep-frames" && ParseList(value, options.SweepFrames) ) )
+			continue;	/* the list is parsed in the test */
+		else if( name == "--dark" && !value.empty() )
+			options.DarkFile = value;
+		else if( name == "--flat" && !value.empty() )
+			options.FlatFile = value;
+		else if( name == "--output-type" && ( value == "uint16" || value == "float32" ) )
+			options.FloatOutput = ( value == "float32" );
+		else if( name == "--benchmark-correction" )
+			options.CorrectionBenchmark = true;
+		else if( name == "--coadd" && atoi(value.c_str()) > 0 )
+			options.CoaddCount = atoi(value.c_str());
+		else if( name == "--coadd-mode" && ( value == "sum" || value == "mean" || value == "sigma-clip" ) )
+			options.CoaddMethod = value == "sum" ? CoaddMode_Sum : value == "mean" ? CoaddMode_Mean : CoaddMode_ClippedMean;
+		else if( name == "--clip-sigma" && ::atof(value.c_str()) > 0 )
+			options.ClipSigma = ::atof(value.c_str());
+		else if( name == "--variance" )
+			options.VarianceMaps = true;
+		else if( name == "--compress" && ( value.empty() || atoi(value.c_str()) > 0 ) )
+			options.CompressThreads = value.empty() ? std::max( 1, (int)std::thread::hardware_concurrency() / 2 ) : atoi(value.c_str());
+		else if( name == "--tiff" )
+		{
+			options.Tiff = true;
+			options.TiffPath = value;
+		}
+		else if( name == "--shared-ring" && !value.empty() )
+			options.SharedRing = value;
+		else if( name == "--ring-slots" && atoi(value.c_str()) > 0 )
+			options.RingSlots = atoi(value.c_str());
+		else if( name == "--watch" && !value.empty() )
+			options.WatchRing = value;
+		else if( name == "--capability-dir" && !value.empty() )
+			options.CapabilityDir = value;
+		else if( name == "--refresh-capabilities" )
+			options.RefreshCapabilities = true;
+		else if( name == "--log" && !value.empty() )
+			options.LogPath = value;
+		else if( name == "--log-level" && ( value == "debug" || value == "info" || value == "warning" || value == "error" ) )
+			options.ConsoleLevel = value == "debug" ? LogLevel_Debug : value == "info" ? LogLevel_Info : value == "warning" ? LogLevel_Warning : LogLevel_Error;
+		else if( name == "--trace" )
+			options.Trace = true;
+		else if( name == "--telemetry" )
+			options.TelemetryInterval = value.empty() ? TELEMETRY_INTERVAL : atoi(value.c_str());
+		else if( name == "--sequence" && ParseSequence(value, options.Sequence) )
+			continue;	/* ParseSequence filled in the steps */
+		else if( name == "--readout-mode" && ParseReadoutMode(value, options.ReadoutMode) )
+			continue;	/* ParseReadoutMode set the mode */
+		else if( name == "--kinetics-window" && atoi(value.c_str()) > 0 )
+			options.KineticsWindow = atoi(value.c_str());
+		else if( name == "--kinetics-frames" && atoi(value.c_str()) > 0 )
+			options.KineticsFrames = atoi(value.c_str());
+		else if( name == "--sweep-mode" && ParseReadoutModes(value, options.SweepModes) )
+			continue;	/* ParseReadoutModes filled in the modes */
+		else if( name == "--stats" && ( value.empty() || atoi(value.c_str()) > 0 ) )
+			options.StatsThreads = value.empty() ? 1 : atoi(value.c_str());
+		else if( name == "--abort-if" && AbortRule().Parse(value) )
+		{
+			options.AbortIf = value;
+			options.StatsThreads = std::max( options.StatsThreads, 1 );
+		}
+		else if( name == "--abort-frames" && atoi(value.c_str()) > 0 )
+			options.AbortFrames = atoi(value.c_str());
+		else if( ( name == "--centroid" || name == "--centroid-only" ) && ( value.empty() || atoi(value.c_str()) > 0 ) )
+		{
+			options.CentroidThreads = value.empty() ? std::max( 1, (int)std::thread::hardware_concurrency() / 2 ) : atoi(value.c_str());
+			options.CentroidOnly = options.CentroidOnly || name == "--centroid-only";
+		}
+		else if( name == "--spot-threshold" && ::atof(value.c_str()) > 0 )
+			options.SpotThreshold = ::atof(value.c_str());
+		else if( name == "--spot-min-pixels" && atoi(value.c_str()) > 0 )
+			options.SpotMinPixels = atoi(value.c_str());
+		else if( name == "--max-spots" && atoi(value.c_str()) > 0 )
+			options.MaxSpots = atoi(value.c_str());
+		else if( name == "--thumbnails" && atoi(value.c_str()) > 0 )
+			options.ThumbnailRadius = atoi(value.c_str());
+		else if( name == "--wait-for-lock" )
+			options.LockTimeout = value.empty() ? LOCK_WAIT_TIMEOUT : atoi(value.c_str());
+		else if( name == "--library-test" )
+			options.LibraryTest = true;
+		else if( name == "--sequence-test" )
+			options.SequenceTest = true;
+		else if( name == "--decompress" && !value.empty() )
+			options.DecompressFrom = value;
+		else if( name == "--decompress-to" && !value.empty() )
+			options.DecompressTo = value;
+		else if( name == "--writer-thread" )
+			options.WriterThread = true;
+		else if( name == "--metadata" )
+			options.Metadata = true;
+		else if( name == "--raw" )
+			options.RawFile = true;
+		else if( name == "--legacy-configure" )
+			options.LegacyConfigure = true;
+		else if( name == "--no-arena" )
+			options.UseArena = false;
+		else if( ( name == "--profile" || name == "--profiles" ) && !value.empty() )
+			continue;	/* read before the other options */
+		else if( name == "--server" )
+			options.ServerPort = value.empty() ? CAPTURE_SERVER_PORT : atoi(value.c_str());
+		else
+		{
+			cout << "Invalid option: " << arg << "\n";
+			PrintOptions();
+			if( invalid )
+				*invalid = arg;
+			return false;
+		}
+	}
+	return true;
+}
+
+// - opens the first camera if any or creates a demo camera
+void OpenCamera( PicamHandle& camera, PicamCameraID& id )
+{
+    if( Picam_OpenFirstCamera( &camera ) == PicamError_None )
+        Picam_GetCameraID( camera, &id );
+    else
+    {
+		
+        Picam_ConnectDemoCamera(
+            PicamModel_Pixis1024BR,
+            "12345",
+            &id );
+		
+		Picam_OpenCamera( &id, &camera );
+		
+		
+    }
+    PrintCameraID( id );
+    std::cout << std::endl;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Capture Server
+// - keeps the camera open and configured between captures so a shot costs
+//   only its exposure and readout time
+// - one command per line on a local TCP socket, one reply line per command:
+//     CAPTURE FileDir FileName x0 y0 dx dy dt NFrames [options]
+//         replies "OK <file>" once the file is flushed to disk,
+//         or "ERROR <reason>"
+//     PING      replies "OK"
+//     SHUTDOWN  replies "OK", then closes the camera and exits
+// - arguments containing spaces may be "double quoted"
+////////////////////////////////////////////////////////////////////////////////
+
+// - splits a command line into words
+vector<string> SplitCommand(const string& line)
+{
+	vector<string> words;
+	size_t i = 0;
+	while( i < line.size() )
+	{
+		while( i < line.size() && isspace((unsigned char)line[i]) )
+			++i;
+		if( i == line.size() )
+			break;
+		string word;
+		if( line[i] == '"' )
+		{
+			size_t close = line.find('"', i + 1);
+			if( close == string::npos )
+				close = line.size();
+			word = line.substr(i + 1, close - i - 1);
+			i = close + 1;
+		}
+		else
+		{
+			while( i < line.size() && !isspace((unsigned char)line[i]) )
+				word += line[i++];
+		}
+		words.push_back(word);
+	}
+	return words;
+}
+
+// - the reply to a CAPTURE whose arguments are wrong, in the form of any
+//   other failure so that the client can go by the code
+string InvalidArguments(const string& detail)
+{
+	return "ERROR " + std::to_string((int)CaptureResult_BadArguments) + " " + CaptureResultString(CaptureResult_BadArguments) + " (" + detail + ")";
+}
+
+// - runs one CAPTURE command and returns the reply.  Its options are added
+//   to those the server was started with (defaults), and the camera is
+//   configured from them, which changes only the parameters that differ
+string HandleCapture(PicamHandle camera, const vector<string>& words, const vector<string>& defaults, ConstraintCache& constraints)
+{
+	if( words.size() < 9 )
+		return InvalidArguments("expecting CAPTURE FileDir FileName x0 y0 dx dy dt NFrames [options]");
+
+	CaptureOptions options;
+	vector<string> arguments(defaults);
+	arguments.insert(arguments.end(), words.begin() + 9, words.end());
+	string invalid;
+	if( !ParseOptions(arguments, 0, options, &invalid) )
+		return InvalidArguments(invalid);
+	if( options.ServerPort != 0 )
+		return InvalidArguments("--server is not an option of a CAPTURE");
+
+	RunArguments run;
+	string problem = ParseRunArguments(words, 1, options, run);
+	if( !problem.empty() )
+		return InvalidArguments(problem);
+	string FullFilePath = run.FileDir + run.FileName;
+	piflt dt = run.dt;
+	int NFrames = run.NFrames;
+	if( !ApplySequence(options, dt, NFrames) )
+		return InvalidArguments("--sequence cannot be combined with --dark or --coadd");
+
+	std::cout << "Capture of " << FullFilePath << std::endl
+	          << "=============" << std::endl;
+	Timing.Reset();
+	CaptureProgress progress;
+	progress.Begin(FullFilePath, NFrames, options.NotifyPort);
+
+	CaptureResult result = ConfigureCamera(camera, dt, options, constraints);
+	if( result != CaptureResult_Saved )
+		progress.Detail = "configuring the camera";
+	else
+	{
+		Timing.Mark("Configuration");
+		result = AcquireROI(camera, FullFilePath, CaptureRois(run.x0, run.y0, run.dx, run.dy, options), NFrames, options, constraints, progress);
+	}
+	progress.Finish(result);
+	std::cout << std::endl;
+	Timing.Print();
+	if( result == CaptureResult_Saved )
+		return "OK " + FullFilePath;
+	return "ERROR " + std::to_string((int)result) + " " + CaptureResultString(result) + ( progress.Detail.empty() ? "" : " (" + progress.Detail + ")" );
+}
+
+bool SendLine(SOCKET client, const string& line)
+{
+	string text = line + "\n";
+	size_t sent = 0;
+	while( sent < text.size() )
+	{
+		int n = send(client, text.c_str() + sent, (int)(text.size() - sent), 0);
+		if( n <= 0 )
+			return false;
+		sent += n;
+	}
+	return true;
+}
+
+// - accepts clients one at a time until a SHUTDOWN command arrives
+int RunServer(PicamHandle camera, piint port, const vector<string>& defaults, ConstraintCache& constraints)
+{
+#ifdef _WIN32
+	WSADATA wsaData;
+	WSAStartup(MAKEWORD(2, 2), &wsaData);
+#endif
+	SOCKET listener = socket(AF_INET, SOCK_STREAM, 0);
+	int reuse = 1;
+	setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, (const char*)&reuse, sizeof(reuse));
+
+	sockaddr_in address;
+	memset(&address, 0, sizeof(address));
+	address.sin_family = AF_INET;
+	address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	address.sin_port = htons((unsigned short)port);
+	if( listener == INVALID_SOCKET ||
+	    bind(listener, (sockaddr*)&address, sizeof(address)) != 0 ||
+	    listen(listener, 4) != 0 )
+	{
+		std::cout << "FAILED TO LISTEN ON PORT " << port << std::endl;
+		return 1;
+	}
+	std::cout << "Capture server listening on 127.0.0.1:" << port << std::endl << std::endl;
+
+	bool running = true;
+	while( running )
+	{
+		SOCKET client = accept(listener, 0, 0);
+		if( client == INVALID_SOCKET )
+			continue;
+
+		string pending;
+		char chunk[4096];
+		int n;
+		while( running && (n = recv(client, chunk, sizeof(chunk), 0)) > 0 )
+		{
+			pending.append(chunk, n);
+			size_t eol;
+			while( running && (eol = pending.find('\n')) != string::npos )
+			{
+				vector<string> words = SplitCommand(pending.substr(0, eol));
+				pending.erase(0, eol + 1);
+				if( words.empty() )
+					continue;
+
+				string command = words[0];
+				for( size_t i = 0; i < command.size(); ++i )
+					command[i] = (char)toupper((unsigned char)command[i]);
+
+				string reply;
+				if( command == "CAPTURE" )
+					reply = HandleCapture(camera, words, defaults, constraints);
+				else if( command == "PING" )
+					reply = "OK";
+				else if( command == "SHUTDOWN" )
+				{
+					reply = "OK";
+					running = false;
+				}
+				else
+					reply = "ERROR unknown command " + words[0];
+				SendLine(client, reply);
+			}
+		}
+		closesocket(client);
+	}
+
+	closesocket(listener);
+#ifdef _WIN32
+	WSACleanup();
+#endif
+	return 0;
+}
+
+// - opens and configures the camera once, then serves captures; args are
+//   the server's own, the defaults of every capture
+int ServeCaptures(const vector<string>& args, const CaptureOptions& options)
+{
+	vector<string> defaults(1, "--profiles=" + options.ProfileFile);
+	for( size_t i = 1; i < args.size(); ++i )
+		if( args[i].compare(0, 8, "--server") != 0 )
+			defaults.push_back(args[i]);
+
+    std::cout << std::boolalpha;
+    Picam_InitializeLibrary();
+	Timing.Mark("Library initialization");
+
+    PicamHandle camera;
+    PicamCameraID id;
+    OpenCamera( camera, id );
+	Timing.Mark("Camera open");
+
+	// Configure with whatever exposure the camera has; each CAPTURE sets its own
+	piflt dt = 0;
+	Picam_GetParameterFloatingPointValue( camera, PicamParameter_ExposureTime, &dt );
+
+    std::cout << "Configuration" << std::endl
+              << "=============" << std::endl;
+	ConstraintCache constraints;
+	LoadCapabilities( camera, options, constraints );
+	CaptureResult configured = ConfigureCamera( camera, dt, options, constraints );
+	std::cout << std::endl;
+	if( configured != CaptureResult_Saved )
+	{
+		std::cout << "ERROR: the camera could not be configured; not serving captures" << std::endl;
+		Picam_CloseCamera( camera );
+		Picam_UninitializeLibrary();
+		return configured;
+	}
+	Timing.Mark("Configuration");
+
+    std::cout << "Temperature" << std::endl
+              << "===========" << std::endl;
+    ReadTemperature( camera );
+    std::cout << std::endl;
+	Timing.Mark("Temperature read");
+	Timing.Print();
+
+	int status = RunServer( camera, options.ServerPort, defaults, constraints );
+
+    Picam_CloseCamera( camera );
+    Picam_UninitializeLibrary();
+	return status;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Multiple Cameras
+// - --cameras=SN1,SN2,... (or --cameras=all) captures from several cameras in
+//   one run; each camera is configured and acquired on its own thread and
+//   writes <name>_<serial><ext>
+// - all cameras are armed before any acquisition starts, so an external
+//   trigger reaches them all
+// - <name>.manifest lists every camera's file and outcome once the run is over
+// - --demo-cameras=N connects N demo cameras first; with --scaling-test the
+//   run is made with one camera and then with all of them, and fails unless
+//   together they reach the throughput their frame rates allow.  A host that
+//   cannot keep up with one camera, or has fewer cores than cameras, skips
+//   the verdict instead: it would only measure the host
+////////////////////////////////////////////////////////////////////////////////
+#define SCALING_TEST_EFFICIENCY 0.8	/* of the throughput the cameras should reach together */
+
+// - one camera's part in a run
+struct CameraRun
+{
+	PicamCameraID	id;
+	PicamHandle		camera;
+	string			FilePath;
+	CaptureResult	result;
+	string			message;
+	pi64s			readouts;
+	pi64s			bytes;
+	double			seconds;		/* from the common start to file closed */
+	double			predicted;		/* MB/s its frame rate allows           */
+};
+
+// - <FileDir><FileName> with _<serial> ahead of the extension
+string CameraFilePath(const string& FileDir, const string& FileName, const string& serial)
+{
+	size_t dot = FileName.find_last_of('.');
+	if( dot == string::npos )
+		return FileDir + FileName + "_" + serial;
+	return FileDir + FileName.substr(0, dot) + "_" + serial + FileName.substr(dot);
+}
+
+// - prints every camera PICAM can see
+void ListCameras()
+{
+	const PicamCameraID* ids;
+	piint count = 0;
+	if( Picam_GetAvailableCameraIDs( &ids, &count ) != PicamError_None )
+		return;
+	std::cout << count << " camera(s) available" << std::endl;
+	for( piint i = 0; i < count; ++i )
+	{
+		std::cout << "    ";
+		PrintCameraID( ids[i] );
+	}
+	Picam_DestroyCameraIDs( ids );
+}
+
+// - connects the demo cameras asked for and picks the cameras for the run by
+//   serial number.  Returns false if one of them is missing.
+bool SelectCameras(const CaptureOptions& options, vector<PicamCameraID>& selected)
+{
+	for( piint i = 1; i <= options.DemoCameras; ++i )
+	{
+		PicamCameraID id;
+		string serial = "DEMO" + std::to_string(i);
+		PicamError err = Picam_ConnectDemoCamera( PicamModel_Pixis1024BR, serial.c_str(), &id );
+		if( err != PicamError_None && err != PicamError_DemoAlreadyConnected )
+		{
+			std::cout << "Connecting demo camera " << serial << ": ";
+			PrintError( err );
+			return false;
+		}
+	}
+
+	const PicamCameraID* ids;
+	piint count = 0;
+	if( Picam_GetAvailableCameraIDs( &ids, &count ) != PicamError_None )
+		return false;
+	bool all = options.Cameras.empty() || ( options.Cameras.size() == 1 && options.Cameras[0] == "all" );
+	bool found = true;
+	if( all )
+		selected.assign( ids, ids + count );
+	else
+	{
+		for( size_t s = 0; s < options.Cameras.size(); ++s )
+		{
+			piint i = 0;
+			while( i < count && options.Cameras[s] != ids[i].serial_number )
+				++i;
+			if( i < count )
+				selected.push_back( ids[i] );
+			else
+			{
+				std::cout << "ERROR: no camera with serial number " << options.Cameras[s] << std::endl;
+				found = false;
+			}
+		}
+	}
+	Picam_DestroyCameraIDs( ids );
+	if( found && selected.empty() )
+		std::cout << "ERROR: no cameras available" << std::endl;
+	return found && !selected.empty();
+}
+
+// - configures one camera and captures from it; runs on its own thread
+void RunCamera(CameraRun& run, const vector<PicamRoi>& rois, piflt dt, int NFrames, const CaptureOptions& options, StartGate& gate)
+{
+	Timing.Reset();
+	ConstraintCache constraints;
+	LoadCapabilities( run.camera, options, constraints );
+	CaptureResult configured = ConfigureCamera( run.camera, dt, options, constraints );
+	Timing.Mark("Configuration");
+
+	CaptureProgress progress;
+	progress.Gate = &gate;
+	progress.Begin( run.FilePath, NFrames, 0 );
+	if( configured != CaptureResult_Saved )
+	{
+		/* Finish withdraws from the gate so the other cameras are not held up */
+		progress.Detail = "configuring the camera";
+		run.result = configured;
+	}
+	else
+		run.result = AcquireROI( run.camera, run.FilePath, rois, NFrames, options, constraints, progress );
+	progress.Finish( run.result );
+
+	piint readoutstride = 0;
+	Picam_GetParameterIntegerValue( run.camera, PicamParameter_ReadoutStride, &readoutstride );
+	run.readouts = progress.Readouts;
+	run.bytes = progress.Readouts * readoutstride;
+	run.seconds = std::chrono::duration<double>( std::chrono::steady_clock::now() - gate.released ).count();
+	piint framesPerReadout = 1;
+	piflt framesPerSecond = 0;
+	Picam_GetParameterIntegerValue( run.camera, PicamParameter_FramesPerReadout, &framesPerReadout );
+	Picam_GetParameterFloatingPointValue( run.camera, PicamParameter_FrameRateCalculation, &framesPerSecond );
+	run.predicted = framesPerReadout > 0 ? framesPerSecond / framesPerReadout * readoutstride / (1024.0 * 1024.0) : 0;
+	run.message = CaptureResultString( run.result ) + ( progress.Detail.empty() ? "" : " (" + progress.Detail + ")" );
+}
+
+// - writes the run manifest (atomically, like the status files)
+bool WriteManifest(const string& path, const vector<CameraRun>& runs, piflt dt, int NFrames, double seconds)
+{
+	string temporary = path + ".tmp";
+	FILE* pFile = fopen( temporary.c_str(), "w" );
+	if( !pFile )
+		return false;
+	pi64s bytes = 0;
+	for( size_t i = 0; i < runs.size(); ++i )
+		bytes += runs[i].bytes;
+	fprintf( pFile, "cameras=%d\nframes=%d\nexposure=%g\nseconds=%.3f\nmbps=%.1f\n",
+	         (int)runs.size(), NFrames, dt, seconds, seconds > 0 ? bytes / (1024.0 * 1024.0) / seconds : 0.0 );
+	for( size_t i = 0; i < runs.size(); ++i )
+	{
+		const CameraRun& run = runs[i];
+		const pichar* model;
+		Picam_GetEnumerationString( PicamEnumeratedType_Model, run.id.model, &model );
+		fprintf( pFile, "camera.%d.serial=%s\ncamera.%d.model=%s\ncamera.%d.file=%s\ncamera.%d.result=%d\ncamera.%d.message=%s\n"
+		                "camera.%d.readouts=%lld\ncamera.%d.mbps=%.1f\n",
+		         (int)i + 1, run.id.serial_number, (int)i + 1, model, (int)i + 1, run.FilePath.c_str(),
+		         (int)i + 1, (int)run.result, (int)i + 1, run.message.c_str(), (int)i + 1, (long long)run.readouts,
+		         (int)i + 1, run.seconds > 0 ? run.bytes / (1024.0 * 1024.0) / run.seconds : 0.0 );
+		Picam_DestroyString( model );
+	}
+	bool ok = fclose( pFile ) == 0;
+	return ok && RenameIntoPlace( temporary, path );
+}
+
+// - captures from all the given cameras at once; returns the first failure,
+//   if any, the combined throughput in MB/s and what their frame rates allow
+CaptureResult CaptureFromCameras(const vector<PicamCameraID>& ids, const string& FileDir, const string& FileName, const vector<PicamRoi>& rois,
+                                 piflt dt, int NFrames, const CaptureOptions& options, double& mbps, double& predicted)
+{
+	vector<CameraRun> runs( ids.size() );
+	CaptureResult result = CaptureResult_Saved;
+	for( size_t i = 0; i < ids.size(); ++i )
+	{
+		runs[i].id = ids[i];
+		runs[i].FilePath = CameraFilePath( FileDir, FileName, ids[i].serial_number );
+		runs[i].result = CaptureResult_CameraError;
+		runs[i].readouts = runs[i].bytes = 0;
+		runs[i].seconds = runs[i].predicted = 0;
+		std::cout << "Opening ";
+		PrintCameraID( ids[i] );
+		PicamError err = Picam_OpenCamera( &ids[i], &runs[i].camera );
+		if( err != PicamError_None )
+		{
+			PrintError( err );
+			runs[i].camera = 0;
+			runs[i].message = "could not open camera";
+			result = CaptureResult_CameraError;
+		}
+	}
+
+	/* Every camera that opened gets its own thread */
+	StartGate gate( 0 );
+	vector<std::thread> threads;
+	for( size_t i = 0; i < runs.size(); ++i )
+		if( runs[i].camera )
+			gate.expected++;
+	for( size_t i = 0; i < runs.size(); ++i )
+		if( runs[i].camera )
+			threads.push_back( std::thread( RunCamera, std::ref( runs[i] ), std::cref( rois ), dt, NFrames, std::cref( options ), std::ref( gate ) ) );
+	for( size_t i = 0; i < threads.size(); ++i )
+		threads[i].join();
+
+	double seconds = 0;
+	pi64s bytes = 0;
+	predicted = 0;
+	std::cout << std::endl << "Run summary" << std::endl
+	          << "===========" << std::endl;
+	for( size_t i = 0; i < runs.size(); ++i )
+	{
+		const CameraRun& run = runs[i];
+		seconds = std::max( seconds, run.seconds );
+		bytes += run.bytes;
+		predicted += run.predicted;
+		std::cout << "    " << run.id.serial_number << ": " << run.message << ", " << run.readouts << " readouts";
+		if( run.seconds > 0 )
+			std::cout << " at " << run.bytes / (1024.0 * 1024.0) / run.seconds << " MB/s";
+		std::cout << " -> " << run.FilePath << std::endl;
+		if( result == CaptureResult_Saved )
+			result = run.result;
+		if( run.camera )
+			Picam_CloseCamera( run.camera );
+	}
+	mbps = seconds > 0 ? bytes / (1024.0 * 1024.0) / seconds : 0;
+	std::cout << "    Total: " << mbps << " MB/s from " << runs.size() << " camera(s), whose frame rates allow " << predicted << " MB/s" << std::endl << std::endl;
+
+	string manifest = FileDir + FileName + ".manifest";
+	if( !WriteManifest( manifest, runs, dt, NFrames, seconds ) )
+	{
+		std::cout << "FAILED TO WRITE MANIFEST: " << manifest << std::endl;
+		if( result == CaptureResult_Saved )
+			result = CaptureResult_FileError;
+	}
+	return result;
+}
+
+// - the multi-camera run, reported as a whole through the manifest
+int CaptureWithCameras(const string& FileDir, const string& FileName, const vector<PicamRoi>& rois, piflt dt, int NFrames, const CaptureOptions& options)
+{
+	CaptureProgress progress;
+	progress.Begin( FileDir + FileName + ".manifest", NFrames, options.NotifyPort );
+
+	std::cout << std::boolalpha;
+	Picam_InitializeLibrary();
+	CaptureResult result = CaptureResult_CameraError;
+	vector<PicamCameraID> ids;
+	if( SelectCameras( options, ids ) )
+	{
+		double mbps = 0, predicted = 0;
+		if( options.ScalingTest && ids.size() > 1 )
+		{
+			/* One camera alone first, to see whether this host keeps up with one */
+			double single = 0, singlePredicted = 0;
+			std::cout << "Scaling test: 1 camera" << std::endl
+			          << "======================" << std::endl;
+			result = CaptureFromCameras( vector<PicamCameraID>( 1, ids[0] ), FileDir, FileName, rois, dt, NFrames, options, single, singlePredicted );
+			std::cout << "Scaling test: " << ids.size() << " cameras" << std::endl
+			          << "=======================" << std::endl;
+			if( result == CaptureResult_Saved )
+				result = CaptureFromCameras( ids, FileDir, FileName, rois, dt, NFrames, options, mbps, predicted );
+
+			/* Measured against what the cameras deliver, unless one camera alone
+			   already goes faster than its frame rate allows (a simulated camera
+			   running unthrottled): then only N x the single camera is a yardstick */
+			bool rated = predicted > 0 && single <= singlePredicted;
+			double expected = rated ? predicted : single * ids.size();
+			double efficiency = expected > 0 ? mbps / expected : 0;
+			unsigned cores = std::thread::hardware_concurrency();
+			bool keepsUp = singlePredicted <= 0 || single >= SCALING_TEST_EFFICIENCY * singlePredicted;
+			std::cout << "Scaling: 1 camera " << single << " MB/s (its frame rate allows " << singlePredicted << "), "
+			          << ids.size() << " cameras " << mbps << " MB/s (" << efficiency * 100.0 << "% of the " << expected << " MB/s "
+			          << ( rated ? "their frame rates allow" : "of linear scaling" ) << ", at least " << SCALING_TEST_EFFICIENCY * 100.0 << "% required): ";
+			CaptureResult verdict = CaptureResult_Saved;
+			if( efficiency >= SCALING_TEST_EFFICIENCY )
+				std::cout << "PASS" << std::endl;
+			else if( !keepsUp )
+			{
+				std::cout << "SKIPPED, this host does not keep up with even one camera, so the cameras' scaling cannot be told from its own limits" << std::endl;
+				verdict = CaptureResult_TestSkipped;
+			}
+			else if( cores > 0 && cores < ids.size() )
+			{
+				std::cout << "SKIPPED, " << ids.size() << " cameras on " << cores << " processor core(s): the host, not the cameras, sets the limit" << std::endl;
+				verdict = CaptureResult_TestSkipped;
+			}
+			else
+			{
+				std::cout << "FAIL" << std::endl;
+				verdict = CaptureResult_TestFailed;
+			}
+			if( result == CaptureResult_Saved )
+				result = verdict;
+		}
+		else
+			result = CaptureFromCameras( ids, FileDir, FileName, rois, dt, NFrames, options, mbps, predicted );
+	}
+	Picam_UninitializeLibrary();
+	progress.Finish( result );
+	return result;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Benchmark
+// - --benchmark=FILE sweeps readout mode, square ROI size, binning, ADC speed,
+//   exposure time and readout count, capturing once at every combination,
+//   and writes one result per capture to FILE as CSV, or as JSON if FILE
+//   ends in .json
+// - each capture goes through the same path as a normal run (Configure,
+//   AcquireROI), so --stream, --writer-thread and --metadata apply, and the
+//   timing comes from the stages of the TimingReport
+// - works with the demo camera, so it runs on a machine without hardware
+////////////////////////////////////////////////////////////////////////////////
+
+// - one capture of the sweep and how it went
+struct BenchmarkPoint
+{
+	piint			size;				/* dx = dy              */
+	piint			binning;			/* x and y              */
+	piflt			adcSpeed;			/* MHz                  */
+	piflt			exposure;			/* ms                   */
+	int				frames;				/* readouts requested   */
+	piint			readoutMode;		/* PicamReadoutControlMode */
+	CaptureResult	result;
+	pi64s			readouts;			/* readouts captured    */
+	piint			readoutStride;
+	piflt			readoutTime;		/* ReadoutTimeCalculation, ms */
+	double			configureMs;		/* staged configuration commit */
+	double			commitMs;			/* ROI and readout count commit */
+	double			setupMs;			/* file creation and acquisition buffer */
+	double			firstReadoutMs;		/* start of acquisition to first readout in hand */
+	double			acquireMs;			/* start of acquisition to last readout */
+	double			flushMs;			/* file flushed, closed and renamed */
+	double			totalMs;			/* configuration to file in place */
+	double			framesPerSecond;
+	double			predictedFramesPerSecond;	/* FrameRateCalculation */
+	double			mbPerSecond;		/* to disk, acquisition and flush */
+};
+
+// - the sweep values, or defaults if none were given
+vector<piflt> SweepValues(const vector<piflt>& given, piflt v1, piflt v2 = 0, piflt v3 = 0)
+{
+	if( !given.empty() )
+		return given;
+	vector<piflt> values(1, v1);
+	if( v2 > 0 )
+		values.push_back(v2);
+	if( v3 > 0 )
+		values.push_back(v3);
+	return values;
+}
+
+// - configures the camera for one point of the sweep and captures to path
+void RunBenchmarkPoint(PicamHandle camera, const string& path, const CaptureOptions& sweep, ConstraintCache& constraints, BenchmarkPoint& point)
+{
+	CaptureOptions options = sweep;
+	options.AdcSpeed = point.adcSpeed;
+	options.XBinning = options.YBinning = point.binning;
+	options.ReadoutMode = point.readoutMode;
+
+	Timing.Reset();
+	CaptureResult configured = ConfigureCamera( camera, point.exposure, options, constraints );
+	Timing.Mark("Configuration");
+
+	CaptureProgress progress;
+	progress.Begin( path, point.frames, 0 );
+	if( configured != CaptureResult_Saved )
+	{
+		progress.Detail = "configuring the camera";
+		point.result = configured;
+	}
+	else
+		point.result = AcquireROI( camera, path, CaptureRois(0, 0, point.size, point.size, options), point.frames, options, constraints, progress );
+	progress.Finish( point.result );
+
+	point.readouts = progress.Readouts;
+	point.readoutStride = 0;
+	point.readoutTime = 0;
+	point.predictedFramesPerSecond = 0;
+	piint framesPerReadout = 1;
+	if( configured == CaptureResult_Saved && point.result != CaptureResult_InvalidRoi )	/* otherwise these describe the previous point */
+	{
+		Picam_GetParameterIntegerValue( camera, PicamParameter_ReadoutStride, &point.readoutStride );
+		Picam_GetParameterFloatingPointValue( camera, PicamParameter_ReadoutTimeCalculation, &point.readoutTime );
+		Picam_GetParameterIntegerValue( camera, PicamParameter_FramesPerReadout, &framesPerReadout );
+		Picam_GetParameterFloatingPointValue( camera, PicamParameter_FrameRateCalculation, &point.predictedFramesPerSecond );
+	}
+
+	point.configureMs = Timing.Stage("Configuration");
+	point.commitMs = Timing.Stage("ROI setup and commit");
+	point.setupMs = Timing.Stage("File and buffer setup");
+	point.firstReadoutMs = Timing.Stage("First readout");
+	point.acquireMs = point.firstReadoutMs + Timing.Stage("Remaining readouts");
+	point.flushMs = Timing.Stage("File flush");
+	point.totalMs = std::chrono::duration<double, std::milli>( std::chrono::steady_clock::now() - Timing.start ).count();
+	point.framesPerSecond = point.acquireMs > 0 ? point.readouts * framesPerReadout * 1000.0 / point.acquireMs : 0;
+	double diskMs = point.acquireMs + point.flushMs;
+	point.mbPerSecond = diskMs > 0 ? point.readouts * (double)point.readoutStride / (1024.0 * 1024.0) * 1000.0 / diskMs : 0;
+
+	/* Only the numbers are kept */
+	remove( path.c_str() );
+	remove( ( path + ".partial" ).c_str() );
+	remove( ( path + ".status" ).c_str() );
+}
+
+// - writes the results as CSV, or JSON if the path ends in .json
+bool WriteBenchmark(const string& path, const PicamCameraID& id, const CaptureOptions& options, const vector<BenchmarkPoint>& points)
+{
+	bool json = path.size() >= 5 && path.compare(path.size() - 5, 5, ".json") == 0;
+	string temporary = path + ".tmp";
+	FILE* pFile = fopen( temporary.c_str(), "w" );
+	if( !pFile )
+		return false;
+
+	const pichar* name;
+	Picam_GetEnumerationString( PicamEnumeratedType_Model, id.model, &name );
+	string model( name );
+	Picam_DestroyString( name );
+	const char* mode = options.WriterThread ? "writer-thread" : options.Streaming ? "stream" : "mapped";
+	if( json )
+		fprintf( pFile, "{\n  \"camera\": \"%s\",\n  \"serial\": \"%s\",\n  \"mode\": \"%s\",\n  \"metadata\": %s,\n  \"points\": [\n",
+		         model.c_str(), id.serial_number, mode, options.Metadata ? "true" : "false" );
+	else
+		fprintf( pFile, "camera,serial,mode,readout_mode,size,binning,adc_mhz,exposure_ms,frames,result,readouts,readout_stride,readout_time_ms,"
+		                "configure_ms,commit_ms,setup_ms,first_readout_ms,acquire_ms,flush_ms,total_ms,frames_per_s,predicted_frames_per_s,mb_per_s\n" );
+
+	for( size_t i = 0; i < points.size(); ++i )
+	{
+		const BenchmarkPoint& p = points[i];
+		if( json )
+			fprintf( pFile, "    {\"readout_mode\": \"%s\", \"size\": %d, \"binning\": %d, \"adc_mhz\": %g, \"exposure_ms\": %g, \"frames\": %d, \"result\": \"%s\", "
+			                "\"readouts\": %lld, \"readout_stride\": %d, \"readout_time_ms\": %.3f, \"configure_ms\": %.3f, \"commit_ms\": %.3f, \"setup_ms\": %.3f, "
+			                "\"first_readout_ms\": %.3f, \"acquire_ms\": %.3f, \"flush_ms\": %.3f, \"total_ms\": %.3f, \"frames_per_s\": %.2f, \"predicted_frames_per_s\": %.2f, \"mb_per_s\": %.2f}%s\n",
+			         ReadoutModeName( p.readoutMode ).c_str(), p.size, p.binning, p.adcSpeed, p.exposure, p.frames, CaptureResultString( p.result ).c_str(),
+			         (long long)p.readouts, p.readoutStride, p.readoutTime, p.configureMs, p.commitMs, p.setupMs,
+			         p.firstReadoutMs, p.acquireMs, p.flushMs, p.totalMs, p.framesPerSecond, p.predictedFramesPerSecond, p.mbPerSecond,
+			         i + 1 < points.size() ? "," : "" );
+		else
+			fprintf( pFile, "%s,%s,%s,%s,%d,%d,%g,%g,%d,%s,%lld,%d,%.3f,%.3f,%.3f,%.3f,%.3f,%.3f,%.3f,%.3f,%.2f,%.2f,%.2f\n",
+			         model.c_str(), id.serial_number, mode, ReadoutModeName( p.readoutMode ).c_str(),
+			         p.size, p.binning, p.adcSpeed, p.exposure, p.frames, CaptureResultString( p.result ).c_str(),
+			         (long long)p.readouts, p.readoutStride, p.readoutTime, p.configureMs, p.commitMs, p.setupMs,
+			         p.firstReadoutMs, p.acquireMs, p.flushMs, p.totalMs, p.framesPerSecond, p.predictedFramesPerSecond, p.mbPerSecond );
+	}
+	if( json )
+		fprintf( pFile, "  ]\n}\n" );
+	bool ok = fclose( pFile ) == 0;
+	return ok && RenameIntoPlace( temporary, path );
+}
+
+// - opens the camera and runs the whole sweep
+int RunBenchmark(const CaptureOptions& options)
+{
+	std::cout << std::boolalpha;
+	Picam_InitializeLibrary();
+	PicamHandle camera;
+	PicamCameraID id;
+	OpenCamera( camera, id );
+
+	ConstraintCache constraints;
+	LoadCapabilities( camera, options, constraints );
+	vector<piflt> adcSpeeds = options.SweepAdcSpeeds;
+	if( adcSpeeds.empty() )
+	{
+		const CachedConstraint& adc = GetCachedConstraint( camera, constraints, PicamParameter_AdcSpeed );
+		adcSpeeds = adc.values.empty() ? vector<piflt>( 1, options.AdcSpeed ) : adc.values;
+	}
+	vector<piflt> sizes = SweepValues( options.SweepSizes, 64, 256, 1024 );
+	vector<piflt> binnings = SweepValues( options.SweepBinning, 1, 2, 4 );
+	vector<piflt> exposures = SweepValues( options.SweepExposures, 1 );
+	vector<piflt> frames = SweepValues( options.SweepFrames, 100 );
+	vector<piint> modes = options.SweepModes.empty() ? vector<piint>( 1, options.ReadoutMode ) : options.SweepModes;
+
+	/* Captures land next to the results and are removed after each point */
+	string path = options.Benchmark + ".capture";
+	vector<BenchmarkPoint> points;
+	for( size_t m = 0; m < modes.size(); ++m )
+	for( size_t a = 0; a < adcSpeeds.size(); ++a )
+	for( size_t e = 0; e < exposures.size(); ++e )
+	for( size_t s = 0; s < sizes.size(); ++s )
+	for( size_t b = 0; b < binnings.size(); ++b )
+	for( size_t f = 0; f < frames.size(); ++f )
+	{
+		BenchmarkPoint point;
+		memset( &point, 0, sizeof(point) );
+		point.size = (piint)sizes[s];
+		point.binning = (piint)binnings[b];
+		point.adcSpeed = adcSpeeds[a];
+		point.exposure = exposures[e];
+		point.frames = (int)frames[f];
+		point.readoutMode = modes[m];
+
+		std::cout << "Benchmark " << points.size() + 1 << ": " << point.size << "x" << point.size << " bin " << point.binning
+		          << ", ADC " << point.adcSpeed << " MHz, " << point.exposure << " ms, " << point.frames << " readouts, "
+		          << ReadoutModeName( point.readoutMode ) << std::endl
+		          << "=============" << std::endl;
+		RunBenchmarkPoint( camera, path, options, constraints, point );
+		std::cout << "Result: " << CaptureResultString( point.result ) << ", " << point.framesPerSecond << " frames/s (predicted "
+		          << point.predictedFramesPerSecond << "), "
+		          << point.mbPerSecond << " MB/s, commit " << point.commitMs << " ms, first readout " << point.firstReadoutMs << " ms" << std::endl << std::endl;
+		points.push_back( point );
+	}
+
+	Picam_CloseCamera( camera );
+	Picam_UninitializeLibrary();
+
+	if( !WriteBenchmark( options.Benchmark, id, options, points ) )
+	{
+		std::cout << "FAILED TO WRITE BENCHMARK RESULTS: " << options.Benchmark << std::endl;
+		return CaptureResult_FileError;
+	}
+	std::cout << points.size() << " benchmark results written to " << options.Benchmark << std::endl;
+	return CaptureResult_Saved;
+}
+
+// - times every kernel on a full frame of the camera against its readout time
+int BenchmarkCorrection()
+{
+	std::cout << std::boolalpha;
+	Picam_InitializeLibrary();
+	PicamHandle camera;
+	PicamCameraID id;
+	OpenCamera( camera, id );
+	piint width = 0, height = 0;
+	piflt readoutTime = 0;
+	Picam_GetParameterIntegerValue( camera, PicamParameter_SensorActiveWidth, &width );
+	Picam_GetParameterIntegerValue( camera, PicamParameter_SensorActiveHeight, &height );
+	Picam_GetParameterFloatingPointValue( camera, PicamParameter_ReadoutTimeCalculation, &readoutTime );
+	Picam_CloseCamera( camera );
+	Picam_UninitializeLibrary();
+
+	/* A made up frame and masters of the same size */
+	size_t pixels = (size_t)width * height;
+	vector<uint16_t> raw( pixels );
+	vector<float> dark( pixels ), gain( pixels );
+	unsigned seed = 12345;
+	for( size_t i = 0; i < pixels; ++i )
+	{
+		seed = seed * 1103515245 + 12345;
+		raw[i] = (uint16_t)( 500 + ( seed >> 16 ) % 4000 );
+		dark[i] = 600.0f + ( seed >> 8 ) % 100 * 0.5f;
+		gain[i] = 0.95f + ( seed >> 4 ) % 100 * 0.001f;
+	}
+	vector<uint16_t> expected16( pixels ), out16( pixels );
+	vector<float> expectedFloat( pixels ), outFloat( pixels );
+	CorrectScalar( &raw[0], &dark[0], &gain[0], &expected16[0], pixels );
+	CorrectScalar( &raw[0], &dark[0], &gain[0], &expectedFloat[0], pixels );
+
+	std::cout << "Correction benchmark: " << width << " x " << height << " frame, readout time " << readoutTime << " ms" << std::endl
+	          << "=============" << std::endl;
+	CorrectionKernel best = BestCorrectionKernel();
+	bool agree = true;
+	double bestMs = 0;
+	for( int k = CorrectionKernel_Scalar; k <= best; ++k )
+	{
+		CorrectionKernel kernel = (CorrectionKernel)k;
+		for( int asFloat = 0; asFloat < 2; ++asFloat )
 		{
-			std::cout << "The following parameters are invalid:" << std::endl;
-			for( piint i = 0; i < failed_parameters_count; ++i )
+			std::chrono::steady_clock::time_point begun = std::chrono::steady_clock::now();
+			for( int f = 0; f < CORRECTION_BENCHMARK_FRAMES; ++f )
 			{
-				std::cout << "FAILED TO COMMIT PARAMETER: ";
-				std::cout << "    ";
-				PrintEnumString(
-					PicamEnumeratedType_Parameter,
-					failed_parameters[i] );
-				std::cout << std::endl;
+				if( asFloat )
+					Correct( kernel, &raw[0], &dark[0], &gain[0], &outFloat[0], pixels );
+				else
+					Correct( kernel, &raw[0], &dark[0], &gain[0], &out16[0], pixels );
 			}
+			double ms = std::chrono::duration<double, std::milli>( std::chrono::steady_clock::now() - begun ).count() / CORRECTION_BENCHMARK_FRAMES;
+			bool same = asFloat ? outFloat == expectedFloat : out16 == expected16;
+			agree = agree && same;
+			std::cout << "    " << CorrectionKernelName( kernel ) << ( asFloat ? " float32: " : " uint16:  " ) << ms << " ms per frame ("
+			          << pixels / ms / 1000.0 << " Mpixel/s, " << ( readoutTime > 0 ? ms / readoutTime * 100.0 : 0 ) << "% of the readout time)"
+			          << ( same ? "" : " DIFFERS FROM SCALAR" ) << std::endl;
+			if( kernel == best )
+				bestMs = std::max( bestMs, ms );
 		}
 	}
 
-	// Read Val AGain
-	std::cout << "Reading value of ";
-	PrintEnumString(PicamEnumeratedType_Parameter, parameter);
-	std::cout << ": ";
-	error = Picam_GetParameterIntegerValue(camera, parameter, &CurrentIntVal);
-	PrintError(error);
-	if(error == PicamError_None)
+	/* The statistics kernels, on pixels over the whole range (the SSE2 ones
+	   only compare signed words) and on lengths and starts that leave tails */
+	vector<uint16_t> spread( pixels );
+	for( size_t i = 0; i < pixels; ++i )
 	{
-		PrintEnumString(PicamEnumeratedType_Parameter, parameter);
-		std::cout << " is set to: " << CurrentIntVal << std::endl;
+		seed = seed * 1103515245 + 12345;
+		spread[i] = i % 97 == 0 ? 65535 : i % 89 == 0 ? 0 : (uint16_t)( seed >> 16 );
 	}
-	std::cout << std::endl;
+	size_t lengths[] = { pixels, pixels - 1, 33, 7, 1 };
+	int shifts[] = { 0, 4, 12 };
+	uint16_t saturations[] = { 65535, 30000 };
+	for( int k = CorrectionKernel_Scalar; k <= best; ++k )
+	{
+		CorrectionKernel kernel = (CorrectionKernel)k;
+		bool same = true;
+		for( int l = 0; l < 5; ++l )
+			for( int s = 0; s < 3; ++s )
+				for( int t = 0; t < 2; ++t )
+				{
+					size_t start = lengths[l] < pixels ? 1 : 0;
+					FrameSums expected, sums;
+					StatsScalar( &spread[start], lengths[l], saturations[t], shifts[s], expected );
+					FrameStats( kernel, &spread[start], lengths[l], saturations[t], shifts[s], sums );
+					same = same && SameSums( expected, sums );
+				}
+
+		std::chrono::steady_clock::time_point begun = std::chrono::steady_clock::now();
+		for( int f = 0; f < CORRECTION_BENCHMARK_FRAMES; ++f )
+		{
+			FrameSums sums;
+			FrameStats( kernel, &spread[0], pixels, 65535, 12, sums );
+		}
+		double ms = std::chrono::duration<double, std::milli>( std::chrono::steady_clock::now() - begun ).count() / CORRECTION_BENCHMARK_FRAMES;
+		agree = agree && same;
+		std::cout << "    " << CorrectionKernelName( kernel ) << " statistics: " << ms << " ms per frame (" << pixels / ms / 1000.0 << " Mpixel/s)"
+		          << ( same ? "" : " DIFFERS FROM SCALAR" ) << std::endl;
+	}
+
+	bool fast = readoutTime <= 0 || bestMs < CORRECTION_BENCHMARK_BUDGET * readoutTime;
+	std::cout << CorrectionKernelName( best ) << " kernels " << ( agree ? "agree with" : "DO NOT AGREE WITH" ) << " the scalar code and take "
+	          << bestMs << " ms per frame, " << ( fast ? "under " : "OVER " ) << CORRECTION_BENCHMARK_BUDGET * 100.0 << "% of the readout time: "
+	          << ( agree && fast ? "PASS" : "FAIL" ) << std::endl;
+	return agree && fast ? CaptureResult_Saved : CaptureResult_TestFailed;
 }
-// - Set configuration.
-// - Need to mimic most (preferably all) settings from Winview.  Still learning how this all maps.
-//void Configure( PicamHandle camera, piint ExposureTime )
-void Configure( PicamHandle camera, piflt ExposureTime )
+
+////////////////////////////////////////////////////////////////////////////////
+// Capture Library
+// - CaptureSession, declared in CaptureLibrary.h with what it needs, keeps
+//   the camera open and configured between captures and acquires straight
+//   into memory the caller owns, laid out as a MATLAB array: rows x columns
+//   x frames, column-major, uint16
+// - PicamCapture.cpp links this file, built without main
+//   (CONFIG_AND_CAPTURE_LIBRARY), into a MEX function; --library-test drives
+//   the same calls from here
+// - only the first ROI is returned; options that change what is stored
+//   (correction, co-adding, files) or that need a file or the executeable
+//   (statistics, spots, the shared ring, telemetry, the lock wait, the log)
+//   are for captures to disk
+////////////////////////////////////////////////////////////////////////////////
+#define ARRAY_TILE 32	/* pixels per side of a transpose tile */
+#define LATEST_ATTEMPTS 3	/* reads of a ring slot before giving up on it */
+
+// - copies a row-major frame into column-major order, a tile at a time so
+//   both sides stay in cache
+void TransposeFrame(const uint16_t* frame, piint rows, piint columns, uint16_t* out)
 {
-	SetFltParameter(camera, PicamParameter_ExposureTime, ExposureTime);
-	
-	SetFltParameter(camera, PicamParameter_AdcSpeed, 2);  
-	SetIntParameter(camera, PicamParameter_AdcAnalogGain, PicamAdcAnalogGain_High);
-	SetIntParameter(camera, PicamParameter_CleanUntilTrigger, 1);
-	
-	/*
-	typedef enum PicamTriggerResponse
+	for( piint r0 = 0; r0 < rows; r0 += ARRAY_TILE )
+		for( piint c0 = 0; c0 < columns; c0 += ARRAY_TILE )
+		{
+			piint r1 = std::min( rows, r0 + ARRAY_TILE );
+			piint c1 = std::min( columns, c0 + ARRAY_TILE );
+			for( piint c = c0; c < c1; ++c )
+				for( piint r = r0; r < r1; ++r )
+					out[(size_t)c * rows + r] = frame[(size_t)r * columns + c];
+		}
+}
+
+// - acquires NFrames readouts into array, which must have room for them or
+//   be allocated once their frames are known
+CaptureResult CaptureToArray(PicamHandle camera, const PicamRois* region, piint readoutstride, int NFrames, const CaptureOptions& options, CaptureProgress& progress, FrameArray& array)
+{
+	CaptureFileHeader header;
+	FillCaptureHeader( camera, region, readoutstride, header );
+	if( !FitFrameArray( array, header, NFrames ) )
+		return CaptureResult_BadArguments;
+
+	DiscardSink discarded;
+	ArraySink sink( discarded, array, header );
+	pi64s written = AcquireToFile( camera, sink, readoutstride, NFrames, options, progress, 0 );
+	progress.Update( written, true );
+	return written == NFrames ? CaptureResult_Saved : CaptureResult_Incomplete;
+}
+
+CaptureSession::CaptureSession() : camera(0), open(false), configured(false), constraints(new ConstraintCache()) {}
+
+CaptureSession::~CaptureSession()
+{
+	Close();
+	delete constraints;
+}
+
+CaptureResult CaptureSession::Open(const string& serial)
+{
+	if( open )
+		return CaptureResult_Saved;
+	pibln initialized = false;
+	Picam_IsLibraryInitialized( &initialized );
+	if( !initialized )
+		Picam_InitializeLibrary();
+	if( serial.empty() )
+		OpenCamera( camera, id );
+	else
 	{
-		PicamTriggerResponse_NoResponse               = 1,
-		PicamTriggerResponse_ReadoutPerTrigger        = 2,
-		PicamTriggerResponse_ShiftPerTrigger          = 3,
-		PicamTriggerResponse_ExposeDuringTriggerPulse = 4,
-		PicamTriggerResponse_StartOnSingleTrigger     = 5
-	} PicamTriggerResponse; 
-	*/
-	SetIntParameter(camera, PicamParameter_TriggerResponse, PicamTriggerResponse_ReadoutPerTrigger);
+		CaptureOptions wanted;
+		wanted.Cameras.push_back( serial );
+		vector<PicamCameraID> selected;
+		if( !SelectCameras( wanted, selected ) || Picam_OpenCamera( &selected[0], &camera ) != PicamError_None )
+			return CaptureResult_CameraError;
+		id = selected[0];
+		PrintCameraID( id );
+	}
+	open = true;
+	configured = false;
+	*constraints = ConstraintCache();
+	return CaptureResult_Saved;
+}
 
-	/*
-	typedef enum PicamTriggerDetermination
+CaptureResult CaptureSession::Capture(int x0, int y0, int dx, int dy, piflt dt, int NFrames, const CaptureOptions& options, FrameArray& array, const string& FullFilePath)
+{
+	Timing.Reset();
+	if( !open )
+		return CaptureResult_CameraError;
+	if( !options.DarkFile.empty() || !options.FlatFile.empty() || options.CoaddCount > 0 || options.Tiff || options.CompressThreads > 0 || !options.Sequence.empty() )
 	{
-		PicamTriggerDetermination_PositivePolarity = 1,
-		PicamTriggerDetermination_NegativePolarity = 2,
-		PicamTriggerDetermination_RisingEdge       = 3,
-		PicamTriggerDetermination_FallingEdge      = 4
-	} PicamTriggerDetermination;
-	*/
-	SetIntParameter(camera, PicamParameter_TriggerDetermination, PicamTriggerDetermination_PositivePolarity);
+		std::cout << "ERROR: correction, co-adding, sequences and file options are only for captures to disk" << std::endl;
+		return CaptureResult_BadArguments;
+	}
+	if( options.StatsThreads > 0 || !options.AbortIf.empty() || options.CentroidThreads > 0 || options.CentroidOnly || !options.SharedRing.empty() ||
+	    options.TelemetryInterval > 0 || options.LockTimeout > 0 || !options.LogPath.empty() )
+	{
+		std::cout << "ERROR: --stats, --abort-if, --centroid, --shared-ring, --telemetry, --wait-for-lock and --log are only for captures to disk" << std::endl;
+		return CaptureResult_BadArguments;
+	}
+	if( !options.ExtraRois.empty() )
+	{
+		std::cout << "ERROR: the array holds one ROI; --roi is only for captures to disk" << std::endl;
+		return CaptureResult_BadArguments;
+	}
 
-	SetIntParameter(camera, PicamParameter_CleanCycleCount, 1);
-	SetIntParameter(camera, PicamParameter_CleanSectionFinalHeight, 4);
-	SetIntParameter(camera, PicamParameter_CleanSectionFinalHeightCount, 250);
-	SetFltParameter(camera, PicamParameter_SensorTemperatureSetPoint, -70);
-	SetIntParameter(camera, PicamParameter_ReadoutControlMode, PicamReadoutControlMode_FullFrame);
-	// In WinView we set this to 1 (assuming it corresponds to strips per clean, which is what I was told by Rob Alan).  When we set it to anything less than 8 it kills the PICAM.  So we're using 8.
-	SetIntParameter(camera, PicamParameter_CleanCycleHeight, 8);
+	CaptureProgress progress;
+	progress.Begin( FullFilePath, NFrames, 0 );
 
-	/*
-	typedef enum PicamReadoutControlMode
+	/* What was learned of the camera is forgotten when asked to */
+	if( configured && options.RefreshCapabilities )
 	{
-		PicamReadoutControlMode_FullFrame       = 1,  
-		PicamReadoutControlMode_FrameTransfer   = 2,
-		PicamReadoutControlMode_Interline       = 5,
-		PicamReadoutControlMode_Kinetics        = 3,
-		PicamReadoutControlMode_SpectraKinetics = 4,
-		PicamReadoutControlMode_Dif             = 6
-	} PicamReadoutControlMode;
-	*/
-	SetIntParameter(camera, PicamParameter_ReadoutControlMode, PicamReadoutControlMode_FullFrame);
+		constraints->parameters.clear();
+		constraints->rois = CachedRoisConstraint();
+	}
+	if( !configured || options.RefreshCapabilities )
+		LoadCapabilities( camera, options, *constraints );
+	CaptureResult result = ConfigureCamera( camera, dt, options, *constraints );
+	if( result != CaptureResult_Saved )
+		return result;
+	Timing.Mark( configured ? "Reconfiguration" : "Configuration" );
+	configured = true;
+	return AcquireROI( camera, FullFilePath, CaptureRois( x0, y0, dx, dy, options ), NFrames, options, *constraints, progress, &array );
 }
 
-// - reads the temperature and temperature status directly from hardware
-void ReadTemperature( PicamHandle camera )
+CaptureResult CaptureSession::Capture(int x0, int y0, int dx, int dy, piflt dt, int NFrames, const string& options, FrameArray& array)
 {
-    PicamError error;
+	CaptureOptions parsed;
+	if( !ParseOptions( SplitCommand( options ), 0, parsed ) )
+		return CaptureResult_BadArguments;
+	if( parsed.XBinning < 1 || parsed.YBinning < 1 )
+	{
+		std::cout << "ERROR: binning must be at least 1" << std::endl;
+		return CaptureResult_BadArguments;
+	}
+	return Capture( x0, y0, dx, dy, dt, NFrames, parsed, array );
+}
 
-    // - read temperature
-    std::cout << "Read sensor temperature: ";
-    piflt temperature;
-	
-    error =
-        Picam_ReadParameterFloatingPointValue(
-            camera,
-            PicamParameter_SensorTemperatureReading,
-            &temperature );
-    PrintError( error );
-    if( error == PicamError_None )
-    {
-        std::cout << "    " << "Temperature is "
-                  << temperature << " degrees C" << std::endl;
-    }
+void CaptureSession::Close()
+{
+	if( !open )
+		return;
+	Picam_CloseCamera( camera );
+	Picam_UninitializeLibrary();
+	open = false;
 
-    // - read temperature status
-    std::cout << "Read sensor temperature status: ";
-    PicamSensorTemperatureStatus status;
-    error =
-        Picam_ReadParameterIntegerValue(
-            camera,
-            PicamParameter_SensorTemperatureStatus,
-            reinterpret_cast<piint*>( &status ) );
-    PrintError( error );
-    if( error == PicamError_None )
-    {
-        std::cout << "    " << "Status is ";
-        PrintEnumString( PicamEnumeratedType_SensorTemperatureStatus, status );
-        std::cout << std::endl;
-    }
+	/* The buffers were kept for the next capture; there is none */
+	Arena.Trim();
 }
 
-void AcquireROI(PicamHandle camera, string FullFilePath, int x0, int y0, int dx, int dy, int NFrames)
-{
-	PicamError					err;			 /* Error Code			*/
-	PicamAvailableData			dataFrame;		 /* Data Struct			*/
-	PicamAcquisitionErrorsMask	acqErrors;		 /* Errors				*/
-	const PicamRois				*region;		 /* Region of interest  */
-	const PicamParameter		*paramsFailed;	 /* Failed to commit    */
-	piint						failCount;		 /* Count of failed	    */
-	const PicamRoisConstraint  *constraint;		 /* Constraints			*/
-	
-	/* Variables to compute central region in image */
-	//	piint halfHeight, halfWidth, totalWidth, totalHeight;
-	piint totalWidth, totalHeight;
-
-	/* Get dimensional constraints */
-	err = Picam_GetParameterRoisConstraint(	camera, 
-											PicamParameter_Rois, 
-											PicamConstraintCategory_Required, 
-											&constraint);	
-	/* Error check */
-	if (err == PicamError_None)
-	{		
-		/* Get width and height from constraints */
-		totalWidth = (piint)constraint->width_constraint.maximum;
-		totalHeight= (piint)constraint->height_constraint.maximum;
+/* The ring LatestRingReadout follows, from one call to the next */
+static SharedRingReader LatestRing;
 
-		if( x0 > -1 && x0 < totalWidth && dx > 0 && x0 + dx < totalWidth +1 && y0 > -1 && y0 < totalHeight && dy > 0 && y0 + dy < totalHeight + 1)
-			std::cout << "Valid ROI choice. " << std::endl;
-		else
-		{
-			std::cout << "ERROR: Invalid ROI choice. " << std::endl;
-			if( x0 <0 )
-				std::cout << "Choice of x0 (" << x0 << ") is invalid.  x0 must be between the values of 0 and " << totalWidth - 1<< std::endl;
-			if( y0 < 0 )
-				std::cout << "Choice of y0 (" << y0 << ") is invalid.  y0 must be between the values of 0 and " << totalHeight - 1 << std::endl;
-			if( x0 > totalWidth -1 )
-				std::cout << "Choice of x0 (" << x0 << ") is invalid.  x0 must be between the values of 0 and " << totalWidth - 1 << std::endl;
-			if( y0 > totalHeight - 1)
-				std::cout << "Choice of y0 (" << y0 << ") is invalid.  y0 must be between the values of 0 and " << totalHeight - 1 << std::endl;
-			if( dx < 1)
-				std::cout << "Choice of dx (" << dx << ") is invalid.  dx must be between the values of 1 and " << totalWidth << std::endl;
-			if( dy < 1)
-				std::cout << "Choice of dy (" << dy << ") is invalid.  dy must be between the values of 1 and " << totalHeight << std::endl;
-			if(x0+dx > totalWidth)
-				std::cout << "Invalid x-parameters.  x0 + dx (" << x0 + dx << ") must be less than or equal to sensor width (" << totalWidth  << ")" <<  std::endl;
-			if(y0 + dy > totalHeight)
-				std::cout << "Invalid y-parameters.  y0 + dy (" << y0 + dy << ") must be less than or equal to sensor height (" << totalHeight << ")" << std::endl;
-		}
-
-		/* Clean up constraints after using constraints */
-		Picam_DestroyRoisConstraints(constraint);
-
-
-		/* Get the orinal ROI */
-		err = Picam_GetParameterRoisValue(	camera, 
-											PicamParameter_Rois, 
-											&region);
-		/* Error check */
-		if (err == PicamError_None)
-		{
-			/* Modify the region */
-			if (region->roi_count == 1) 
-			{
-				/* The absolute size of the ROI */
-				// region->roi_array[0].height		= halfHeight;
-				// region->roi_array[0].width		= halfWidth;
-				region->roi_array[0].height		= dy;
-				region->roi_array[0].width		= dx;
-
-				/* The offset into the chip of the ROI (1/4th) */
-				// region->roi_array[0].x			= halfWidth  / 2;
-				// region->roi_array[0].y			= halfHeight / 2;
-				region->roi_array[0].x			= x0;
-				region->roi_array[0].y			= y0;
-
-				/* The vertical and horizontal binning */
-				// region->roi_array[0].x_binning	= 1;
-				// region->roi_array[0].y_binning	= 1;
-				region->roi_array[0].x_binning	= 1;
-				region->roi_array[0].y_binning	= 1;
-
-				// Print our ROI settings
-				std::cout << "x0 = : " << region->roi_array[0].x << std::endl;
-				std::cout << "y0 = : " << region->roi_array[0].y << std::endl;
-				std::cout << "dx = : " << region->roi_array[0].width << std::endl;
-				std::cout << "dy = : " << region->roi_array[0].height << std::endl;
-				std::cout << "xbin = : " << region->roi_array[0].x_binning << std::endl;
-				std::cout << "ybin = : " << region->roi_array[0].y_binning << std::endl;
-				std::cout << "NFrames = : " << NFrames << std::endl;
-			}
+double LatestRingReadout(const string& name, FrameArray& frame)
+{
+	/* A finished run lets go of its ring; the next one under the name is new */
+	if( LatestRing.ring && ( LatestRing.region.name != name || LatestRing.Done() ) )
+		CloseLatestRing();
+	if( !LatestRing.ring && !LatestRing.Attach( name ) )
+		return 0;
 
-			std::cout << "Setting ROIs: ";
-			/* Set the region of interest */
-			err = Picam_SetParameterRoisValue(	camera, 
-												PicamParameter_Rois, 
-												region);
-			/* Error check */
-			if (err == PicamError_None)
-			{
-				/* Commit ROI to hardware */
-				err = Picam_CommitParameters(	camera, 
-												&paramsFailed, 
-												&failCount);
-                Picam_DestroyParameters(paramsFailed);
-				PrintError(err);
+	const CaptureFileRoi& roi = LatestRing.ring->layout.rois[0];
+	frame.rows = (piint)roi.rows;
+	frame.columns = (piint)roi.columns;
+	frame.frames = 1;
+	frame.data = frame.allocate ? frame.allocate( frame.rows, frame.columns, 1, frame.context ) : 0;
+	if( !frame.data )
+		return 0;
+	for( int attempt = 0; attempt < LATEST_ATTEMPTS; ++attempt )
+	{
+		uint64_t published = LatestRing.Published();
+		if( published == 0 )
+			break;
+		const pibyte* pixels = LatestRing.Readout( published - 1 );
+		if( !pixels )
+			continue;
+		TransposeFrame( reinterpret_cast<const uint16_t*>( pixels + roi.offset ), frame.rows, frame.columns, frame.data );
+		if( LatestRing.Check( published - 1 ) == SharedRingRead_Ok )
+			return (double)published;
+	}
+	return 0;
+}
 
-				/* Error check */
-				if (err == PicamError_None)
-				{
-					piint readoutstride = 0;
-					Picam_GetParameterIntegerValue( camera, PicamParameter_ReadoutStride, &readoutstride );
+void CloseLatestRing()
+{
+	LatestRing.region.Close();
+	LatestRing.ring = 0;
+}
 
-					std::cout << "ReadoutStride is: " << readoutstride << "\n";
+void PrintCaptureTiming()
+{
+	Timing.Print();
+}
 
-					piflt readoutTime = 0;
-					err = Picam_GetParameterFloatingPointValue( camera, PicamParameter_ReadoutTimeCalculation, &readoutTime );
-					if(err == PicamError_None)
-						std::cout << "Readout time is: " << readoutTime << "msec" << std::endl;
-					else
-						std::cout << "Error getting readoutTime." << std::endl;
+// - exercises CaptureSession the way the MEX function does: one open, then
+//   captures of different shapes into preallocated arrays, and kinetics
+//   ones into arrays allocated for them; each also goes to a capture file,
+//   which must hold the same frames
+#define LIBRARY_TEST_FILE "library_test.tmp"	/* in the working directory */
 
-					/* Acquire 1 frame of data with a timeout */
-					err = Picam_Acquire(camera, NFrames, NO_TIMEOUT, &dataFrame, &acqErrors);
-					if (err  == PicamError_None) 
-					{
-						/* Get the bit depth */
-						piint depth;
-						Picam_GetParameterIntegerValue(	camera, 
-														PicamParameter_PixelBitDepth,  
-														&depth);	
+static uint16_t* AllocateTestArray(piint rows, piint columns, pi64s frames, void* context)
+{
+	vector<uint16_t>* memory = static_cast<vector<uint16_t>*>( context );
+	memory->resize( (size_t)rows * columns * frames );
+	return memory->empty() ? 0 : &(*memory)[0];
+}
 
+// - whether the capture file at path holds the frames of array, transposed
+bool MatchesCaptureFile(const string& path, const FrameArray& array)
+{
+	FILE* pFile = fopen( path.c_str(), "rb" );
+	if( !pFile )
+	{
+		std::cout << "FAILED TO OPEN CAPTURE FILE: " << path << std::endl;
+		return false;
+	}
+	CaptureFileHeader header;
+	memset( &header, 0, sizeof(header) );
+	bool same = fread( &header, sizeof(header), 1, pFile ) == 1 && memcmp( header.magic, CAPTURE_FILE_MAGIC, sizeof(header.magic) ) == 0 &&
+	            (pi64s)header.readout_count * header.frames_per_readout == array.frames &&
+	            (piint)header.rois[0].rows == array.rows && (piint)header.rois[0].columns == array.columns &&
+	            fseek( pFile, (long)header.data_offset, SEEK_SET ) == 0;
+	size_t pixels = (size_t)array.rows * array.columns;
+	vector<pibyte> readout( same ? (size_t)header.readout_stride : 0 );
+	vector<uint16_t> transposed( pixels );
+	pi64s frame = 0;
+	for( uint64_t k = 0; same && k < header.readout_count; ++k )
+	{
+		same = fread( &readout[0], readout.size(), 1, pFile ) == 1;
+		for( uint32_t f = 0; same && f < header.frames_per_readout; ++f, ++frame )
+		{
+			TransposeFrame( reinterpret_cast<const uint16_t*>( &readout[f * header.frame_stride + header.rois[0].offset] ), array.rows, array.columns, &transposed[0] );
+			same = memcmp( &transposed[0], array.data + frame * pixels, pixels * sizeof(uint16_t) ) == 0;
+			if( !same )
+				std::cout << "    frame " << frame + 1 << " differs from the capture file" << std::endl;
+		}
+	}
+	fclose( pFile );
+	return same;
+}
 
+int LibraryTest(const CaptureOptions& options)
+{
+	/* The transpose against a known pattern */
+	piint rows = 37, columns = 53;
+	vector<uint16_t> frame( (size_t)rows * columns ), transposed( frame.size() );
+	for( size_t i = 0; i < frame.size(); ++i )
+		frame[i] = (uint16_t)i;
+	TransposeFrame( &frame[0], rows, columns, &transposed[0] );
+	bool passed = true;
+	for( piint r = 0; r < rows; ++r )
+		for( piint c = 0; c < columns; ++c )
+			passed = passed && transposed[(size_t)c * rows + r] == frame[(size_t)r * columns + c];
+	std::cout << "Transpose of a " << rows << " x " << columns << " frame: " << ( passed ? "correct" : "WRONG" ) << std::endl;
 
-						const char * FullFilePathChar  = FullFilePath.c_str();
-						FILE *pFile;
-						pFile = fopen( FullFilePathChar, "wb");
+	CaptureSession session;
+	if( session.Open( options.Cameras.empty() ? "" : options.Cameras[0] ) != CaptureResult_Saved )
+		return CaptureResult_CameraError;
 
-						if( pFile )
-						{
-							std::cout << "Opened file successfully.  Preparing to write \n";
-							fwrite( dataFrame.initial_readout, 1, NFrames * (readoutstride), pFile );
-							fclose( pFile );
-						}
-						else
-						{
-							std::cout << "FAILED TO OPEN FILE: " << FullFilePathChar << " \n";
-						}
-					}
-					PrintError(err);
-				}				
-			}	
-			/* Free the regions */
-			Picam_DestroyRois(region);
+	int shapes[4][4] = { { 0, 0, 1024, 1024 }, { 100, 200, 64, 32 }, { 100, 200, 64, 32 }, { 0, 0, 64, 32 } };
+	piint frames[4] = { 3, 10, 10, 5 };
+	piint kinetics[4] = { 0, 0, 0, 4 };		/* frames per readout */
+	for( int s = 0; s < 4 && passed; ++s )
+	{
+		CaptureOptions shot( options );
+		FrameArray array;
+		vector<uint16_t> memory;
+		if( kinetics[s] > 0 )
+		{
+			shot.ReadoutMode = PicamReadoutControlMode_Kinetics;
+			shot.KineticsFrames = kinetics[s];
+			array.allocate = AllocateTestArray;
+			array.context = &memory;
 		}
-	} 	
+		else
+		{
+			memory.resize( (size_t)shapes[s][2] * shapes[s][3] * frames[s] );
+			array.data = &memory[0];
+			array.rows = shapes[s][3];
+			array.columns = shapes[s][2];
+			array.frames = frames[s];
+		}
+
+		std::chrono::steady_clock::time_point begun = std::chrono::steady_clock::now();
+		CaptureResult result = session.Capture( shapes[s][0], shapes[s][1], shapes[s][2], shapes[s][3], 1, frames[s], shot, array, LIBRARY_TEST_FILE );
+		double ms = std::chrono::duration<double, std::milli>( std::chrono::steady_clock::now() - begun ).count();
+		bool same = result == CaptureResult_Saved && MatchesCaptureFile( LIBRARY_TEST_FILE, array );
+		remove( LIBRARY_TEST_FILE );
+		remove( LIBRARY_TEST_FILE ".status" );
+		std::cout << "Capture " << s + 1 << ": " << array.rows << " x " << array.columns << " x " << array.frames << " in " << ms << " ms: "
+		          << CaptureResultString( result ) << ( result != CaptureResult_Saved ? "" : same ? ", same as the capture file" : ", NOT the capture file's frames" ) << std::endl;
+		passed = same;
+	}
+	session.Close();
+	std::cout << "Library test " << ( passed ? "PASSED" : "FAILED" ) << std::endl;
+	return passed ? 0 : CaptureResult_TestFailed;
 }
 
+#ifndef CONFIG_AND_CAPTURE_LIBRARY
 int main(int argc, char *argv[])
 {
-	
-	// Handle arguments.  Convert string types to int types.
-	string FileDir = string(argv[1]);
-	string FileName = string(argv[2]);
-
-	string x0Str = string(argv[3]);
-	int x0 = atoi(x0Str.c_str());
+	vector<string> args(argv, argv + argc);
+	CaptureOptions options;
+	LogSession logging;
 
-	string y0Str = string(argv[4]);
-	int y0 = atoi(y0Str.c_str());
+	// Camera capabilities and profiles are kept next to the executeable unless told otherwise
+	size_t slash = args[0].find_last_of("/\\");
+	if( slash != string::npos )
+		options.CapabilityDir = args[0].substr(0, slash + 1);
+	options.ProfileFile = options.CapabilityDir + PROFILE_FILE;
 
-	string dxStr = string(argv[5]);
-	int dx = atoi(dxStr.c_str());
+	// Server mode takes options only
+	if( argc > 1 && args[1].compare(0, 2, "--") == 0 )
+	{
+		if( !ParseOptions(args, 1, options) || !logging.Start(options) )
+			return 1;
+		if( options.ServerPort > 0 )
+			return ServeCaptures(args, options);
+		if( !options.Benchmark.empty() )
+			return RunBenchmark(options);
+		if( options.CorrectionBenchmark )
+			return BenchmarkCorrection();
+		if( options.LibraryTest )
+			return LibraryTest(options);
+		if( options.SequenceTest )
+			return SequenceTest();
+		if( !options.WatchRing.empty() )
+			return WatchSharedRing(options.WatchRing);
+		if( !options.DecompressFrom.empty() )
+			return DecompressCapture( options.DecompressFrom, options.DecompressTo.empty() ? options.DecompressFrom + ".decompressed" : options.DecompressTo );
+		if( options.ListCameras )
+		{
+			Picam_InitializeLibrary();
+			ListCameras();
+			Picam_UninitializeLibrary();
+			return 0;
+		}
+	}
 
-	string dyStr = string(argv[6]);
-	int dy = atoi(dyStr.c_str());
+	if(argc < 9)
+	{
+		cout << "Incorrect Number of Arguments.  Expecting 8 arguments: Save Directory, Save Name, x-pixel start, y-pixel start, Nx, Ny, exposure time (msec), NFrames\n";
+		PrintOptions();
+		return 1;
+	}
 
-	string dtStr = string(argv[7]);
-	// int dt = atoi(dtStr.c_str());
-	piflt dt = ::atof(dtStr.c_str());
+	if( !ParseOptions(args, 9, options) || !logging.Start(options) )
+		return 1;
+	
+	// Handle arguments.  Check and convert the string types to int types.
+	RunArguments run;
+	string problem = ParseRunArguments(args, 1, options, run);
+	if( !problem.empty() )
+	{
+		cout << "Invalid argument " << problem << "\n";
+		return CaptureResult_BadArguments;
+	}
+	string FileDir = run.FileDir;
+	string FileName = run.FileName;
+	int x0 = run.x0;
+	int y0 = run.y0;
+	int dx = run.dx;
+	int dy = run.dy;
+	piflt dt = run.dt;
+	int NFrames = run.NFrames;
 
-	string NFramesStr = string(argv[8]);
-	int NFrames = atoi(NFramesStr.c_str());
+	// An exposure sequence sets both
+	if( !ApplySequence(options, dt, NFrames) )
+		return CaptureResult_BadArguments;
 
-	if(argc == 9)
 	{
 		std::cout << "============" << std::endl;
 		std::cout << "Inputs: " << std::endl;
@@ -688,6 +8925,7 @@ int main(int argc, char *argv[])
 		cout << "dx: " << dx << "\n";
 		cout << "dy: " << dy << "\n";
 		cout << "dt: " << dt << "\n";
+		cout << "Mode: " << (options.Streaming ? "streaming" : "single acquire") << "\n";
 
 		// Echo all of the arguments so compiler doesn't whine about unused arguments
 //		cout << FileDir << FileName << x0 << y0 << dx << dy << dt << NFrames << "\n";
@@ -695,49 +8933,54 @@ int main(int argc, char *argv[])
 		std::string FullFilePath = FileDir + FileName;
 		cout << "Full File Path: " << FullFilePath << "\n";
 	}
-	else
-	{
-		cout << "Incorrect Number of Arguments.  Expecting 8 arguments: Save Directory, Save Name, x-pixel start, y-pixel start, Nx, Ny, exposure time (msec), NFrames\n";
-	}
 
 	// Construct full file path.
 	std::string FullFilePath = FileDir + FileName;
 
+	// Several cameras are a run of their own
+	if( !options.Cameras.empty() || options.DemoCameras > 0 )
+		return CaptureWithCameras( FileDir, FileName, CaptureRois(x0, y0, dx, dy, options), dt, NFrames, options );
+
+	// Let whoever waits on the file know we are under way
+	CaptureProgress progress;
+	progress.Begin( FullFilePath, NFrames, options.NotifyPort );
+
     // - set formatting options.  Not sure what this does.
     std::cout << std::boolalpha;
 
+    Timing.Reset();
     Picam_InitializeLibrary();
+	Timing.Mark("Library initialization");
 
     // - open the first camera if any or create a demo camera
     PicamHandle camera;
     PicamCameraID id;
-    if( Picam_OpenFirstCamera( &camera ) == PicamError_None )
-        Picam_GetCameraID( camera, &id );
-    else
-    {
-		
-        Picam_ConnectDemoCamera(
-            PicamModel_Pixis1024BR,
-            "12345",
-            &id );
-		
-		Picam_OpenCamera( &id, &camera );
-		
-		
-    }
-    PrintCameraID( id );
-    std::cout << std::endl;
+    OpenCamera( camera, id );
+	Timing.Mark("Camera open");
 
 
     std::cout << "Configuration" << std::endl
               << "=============" << std::endl;
-    Configure( camera, dt);
+	ConstraintCache constraints;
+	LoadCapabilities( camera, options, constraints );
+	CaptureResult configured = ConfigureCamera( camera, dt, options, constraints );
 	std::cout << std::endl;
+	if( configured != CaptureResult_Saved )
+	{
+		std::cout << "ERROR: the camera could not be configured; nothing was captured" << std::endl;
+		Picam_CloseCamera( camera );
+		Picam_UninitializeLibrary();
+		progress.Detail = "configuring the camera";
+		progress.Finish( configured );
+		return configured;
+	}
+	Timing.Mark("Configuration");
 
     std::cout << "Temperature" << std::endl
               << "===========" << std::endl;
     ReadTemperature( camera );
     std::cout << std::endl;
+	Timing.Mark("Temperature read");
 
 	// std::cout << "Acquisition" << std::endl
     //          << "=============" << std::endl;
@@ -746,15 +8989,13 @@ int main(int argc, char *argv[])
 
 	std::cout << "ROI Acquisition" << std::endl
 			  << "=============" << std::endl;
-	AcquireROI(camera, FullFilePath, x0, y0, dx, dy, NFrames);
+	CaptureResult result = AcquireROI(camera, FullFilePath, CaptureRois(x0, y0, dx, dy, options), NFrames, options, constraints, progress);
 	std::cout << std::endl;
-
+	Timing.Print();
 
     Picam_CloseCamera( camera );
     Picam_UninitializeLibrary();
+	progress.Finish( result );
+	return result;
 }
-
-
-
-
-
+#endif
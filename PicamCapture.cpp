@@ -0,0 +1,153 @@
+////////////////////////////////////////////////////////////////////////////////
+// PicamCapture MEX Function
+// - captures from the camera straight into a MATLAB array, without the
+//   executeable, a file on disk or a process per capture
+// - the camera is opened once and stays open and configured between calls
+//   until 'close' (or clear mex / exit)
+// - linked with the capture code of ConfigAndCapture.exe (CaptureLibrary.h):
+//     mex -DCONFIG_AND_CAPTURE_LIBRARY PicamCapture.cpp ConfigAndCapture.cpp
+//         -I<PICAM Includes> <PICAM Library>\Picam.lib
+//
+//   PicamCapture('open')                 opens the first camera (or a demo)
+//   PicamCapture('open', Serial)         opens the camera with that serial
+//   Frames = PicamCapture('capture', x0, y0, dx, dy, dt, NFrames)
+//   Frames = PicamCapture('capture', x0, y0, dx, dy, dt, NFrames, Options)
+//                                        dy x dx x NFrames uint16 (binned
+//                                        size with --bin, NFrames times the
+//                                        frames per readout in kinetics);
+//                                        Options holds the usual --options,
+//                                        e.g. '--bin=2'
+//   PicamCapture('close')
+//   [Frame, Readout] = PicamCapture('latest', Name)
+//                                        ROI 1 of the newest readout in the
+//                                        shared ring of a capture run with
+//                                        --shared-ring=Name (rows x columns
+//                                        uint16, [] if there is none) and its
+//                                        number, counting from 1
+////////////////////////////////////////////////////////////////////////////////
+#include <iostream>
+#include "CaptureLibrary.h"
+#include "mex.h"
+
+using std::string;
+
+// - sends std::cout to the MATLAB command window
+struct MexOutput : std::streambuf
+{
+	int overflow(int c)
+	{
+		if( c != EOF )
+			mexPrintf( "%c", c );
+		return c;
+	}
+
+	std::streamsize xsputn(const char* text, std::streamsize count)
+	{
+		mexPrintf( "%.*s", (int)count, text );
+		return count;
+	}
+};
+
+static CaptureSession Session;
+static MexOutput Output;
+
+static void CloseSession()
+{
+	Session.Close();
+	CloseLatestRing();
+}
+
+// - creates the output array once the library knows its size; context is
+//   where it goes
+static uint16_t* AllocateOutput(piint rows, piint columns, pi64s frames, void* context)
+{
+	mxArray** output = static_cast<mxArray**>( context );
+	mwSize dims[3] = { (mwSize)rows, (mwSize)columns, (mwSize)frames };
+	*output = mxCreateUninitNumericArray( 3, dims, mxUINT16_CLASS, mxREAL );
+	return (uint16_t*)mxGetData( *output );
+}
+
+// - copies ROI 1 of the newest readout of the ring into a new array
+static mxArray* LatestReadout(const string& name, double& readout)
+{
+	mxArray* frame = 0;
+	FrameArray array;
+	array.allocate = AllocateOutput;
+	array.context = &frame;
+	readout = LatestRingReadout( name, array );
+	if( readout > 0 )
+		return frame;
+	if( frame )
+		mxDestroyArray( frame );
+	return mxCreateNumericMatrix( 0, 0, mxUINT16_CLASS, mxREAL );
+}
+
+static string StringArgument(const mxArray* argument, const char* what)
+{
+	if( !mxIsChar( argument ) )
+		mexErrMsgIdAndTxt( "PicamCapture:arguments", "%s must be a string", what );
+	char* text = mxArrayToString( argument );
+	string value( text );
+	mxFree( text );
+	return value;
+}
+
+void mexFunction(int nlhs, mxArray* plhs[], int nrhs, const mxArray* prhs[])
+{
+	if( nrhs < 1 )
+		mexErrMsgIdAndTxt( "PicamCapture:arguments", "Expecting 'open', 'capture', 'close' or 'latest'" );
+	string command = StringArgument( prhs[0], "The command" );
+
+	std::streambuf* console = std::cout.rdbuf( &Output );
+	mexAtExit( CloseSession );
+	CaptureResult result = CaptureResult_Saved;
+
+	if( command == "latest" )
+	{
+		std::cout.rdbuf( console );
+		if( nrhs < 2 )
+			mexErrMsgIdAndTxt( "PicamCapture:arguments", "Expecting 'latest', Name" );
+		double readout = 0;
+		plhs[0] = LatestReadout( StringArgument( prhs[1], "The ring name" ), readout );
+		if( nlhs > 1 )
+			plhs[1] = mxCreateDoubleScalar( readout );
+		return;
+	}
+	if( command == "open" )
+		result = Session.Open( nrhs > 1 ? StringArgument( prhs[1], "The serial number" ) : "" );
+	else if( command == "close" )
+		Session.Close();
+	else if( command == "capture" )
+	{
+		if( nrhs < 7 )
+		{
+			std::cout.rdbuf( console );
+			mexErrMsgIdAndTxt( "PicamCapture:arguments", "Expecting 'capture', x0, y0, dx, dy, dt, NFrames[, Options]" );
+		}
+		int x0 = (int)mxGetScalar( prhs[1] );
+		int y0 = (int)mxGetScalar( prhs[2] );
+		int dx = (int)mxGetScalar( prhs[3] );
+		int dy = (int)mxGetScalar( prhs[4] );
+		piflt dt = mxGetScalar( prhs[5] );
+		int NFrames = (int)mxGetScalar( prhs[6] );
+
+		string options = nrhs > 7 ? StringArgument( prhs[7], "Options" ) : "";
+
+		/* Allocated once its size is known, in the orientation MATLAB uses, and filled in place */
+		result = Session.Open( "" );
+		FrameArray array;
+		array.allocate = AllocateOutput;
+		array.context = &plhs[0];
+		if( result == CaptureResult_Saved )
+			result = Session.Capture( x0, y0, dx, dy, dt, NFrames, options, array );
+		std::cout << std::endl;
+		PrintCaptureTiming();
+	}
+	else
+		result = CaptureResult_BadArguments;
+
+	std::cout.flush();
+	std::cout.rdbuf( console );
+	if( result != CaptureResult_Saved )
+		mexErrMsgIdAndTxt( "PicamCapture:failed", "PicamCapture %s: %s", command.c_str(), CaptureResultString( result ).c_str() );
+}
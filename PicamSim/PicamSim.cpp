@@ -0,0 +1,1866 @@
+////////////////////////////////////////////////////////////////////////////////
+// PICAM Stand-in
+// - a synthetic PIXIS-like camera behind the PICAM API declared in picam.h
+// - supports demo cameras, parameter constraints and commits, ROIs with
+//   binning, frame metadata, Picam_Acquire and the start/wait/stop
+//   acquisition calls with a library-owned or user-supplied circular buffer
+// - frames contain bias, noise and a few gaussian spots so downstream code
+//   has something to measure
+//
+// Environment knobs (all optional):
+//   PICAMSIM_CAMERAS        number of "hardware" cameras, or a comma separated
+//                           list of serial numbers (default: none, so the tool
+//                           falls back to a demo camera like on a bare PC)
+//   PICAMSIM_TIME_SCALE     wall-clock seconds per simulated second
+//                           (default 1, 0 runs as fast as possible)
+//   PICAMSIM_TRIGGER_HZ     external trigger rate when a trigger response is
+//                           configured (default 0, free running)
+//   PICAMSIM_TRIGGER_JITTER trigger jitter in microseconds (default 0)
+//   PICAMSIM_MISS_EVERY     miss every Nth trigger (default 0, never)
+//   PICAMSIM_DROP_EVERY     lose every Nth readout in transfer (default 0)
+//   PICAMSIM_SPOTS          number of gaussian spots per frame (default 6)
+////////////////////////////////////////////////////////////////////////////////
+
+#include "picam_advanced.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace
+{
+
+typedef std::chrono::steady_clock SimClock;
+
+////////////////////////////////////////////////////////////////////////////////
+// Settings from the environment
+////////////////////////////////////////////////////////////////////////////////
+double EnvFlt( const char* name, double defaultValue )
+{
+	const char* text = std::getenv( name );
+	return text && *text ? std::atof( text ) : defaultValue;
+}
+
+struct SimSettings
+{
+	double TimeScale;
+	double TriggerHz;
+	double TriggerJitterUs;
+	int    MissEvery;
+	int    DropEvery;
+	int    Spots;
+};
+
+SimSettings LoadSettings()
+{
+	SimSettings s;
+	s.TimeScale       = std::max( 0.0, EnvFlt( "PICAMSIM_TIME_SCALE", 1.0 ) );
+	s.TriggerHz       = std::max( 0.0, EnvFlt( "PICAMSIM_TRIGGER_HZ", 0.0 ) );
+	s.TriggerJitterUs = std::max( 0.0, EnvFlt( "PICAMSIM_TRIGGER_JITTER", 0.0 ) );
+	s.MissEvery       = (int)EnvFlt( "PICAMSIM_MISS_EVERY", 0 );
+	s.DropEvery       = (int)EnvFlt( "PICAMSIM_DROP_EVERY", 0 );
+	s.Spots           = (int)EnvFlt( "PICAMSIM_SPOTS", 6 );
+	return s;
+}
+
+SimSettings Settings;
+
+////////////////////////////////////////////////////////////////////////////////
+// Parameter table
+////////////////////////////////////////////////////////////////////////////////
+const piint SensorWidth  = 1024;
+const piint SensorHeight = 1024;
+const piflt RowShiftMs   = 0.01;   /* vertical shift time per sensor row */
+const piflt BiasCounts   = 600;
+
+struct ParamInfo
+{
+	PicamParameter      parameter;
+	const char*         name;
+	bool                readOnly;
+	bool                readable;     /* readable directly from hardware */
+	bool                onlineable;
+	piflt               defaultValue;
+	piflt               minimum;      /* range constraints */
+	piflt               maximum;
+	piflt               increment;
+	std::vector<piflt>  collection;   /* collection constraints */
+};
+
+std::vector<piflt> Values( piflt a )                            { return std::vector<piflt>( 1, a ); }
+std::vector<piflt> Values( piflt a, piflt b )                   { std::vector<piflt> v; v.push_back( a ); v.push_back( b ); return v; }
+std::vector<piflt> Values( piflt a, piflt b, piflt c )          { std::vector<piflt> v = Values( a, b ); v.push_back( c ); return v; }
+std::vector<piflt> Values( piflt a, piflt b, piflt c, piflt d ) { std::vector<piflt> v = Values( a, b, c ); v.push_back( d ); return v; }
+
+ParamInfo Range( PicamParameter p, const char* name, piflt def, piflt min, piflt max, piflt inc, bool onlineable = false )
+{
+	ParamInfo info = { p, name, false, false, onlineable, def, min, max, inc, std::vector<piflt>() };
+	return info;
+}
+
+ParamInfo Collection( PicamParameter p, const char* name, piflt def, const std::vector<piflt>& values )
+{
+	ParamInfo info = { p, name, false, false, false, def, 0, 0, 0, values };
+	return info;
+}
+
+ParamInfo ReadOnly( PicamParameter p, const char* name, bool readable = false )
+{
+	ParamInfo info = { p, name, true, readable, false, 0, 0, 0, 0, std::vector<piflt>() };
+	return info;
+}
+
+const std::vector<ParamInfo>& ParamTable()
+{
+	static std::vector<ParamInfo> table;
+	if( table.empty() )
+	{
+		std::vector<piflt> gains = Values( PicamAdcAnalogGain_Low, PicamAdcAnalogGain_Medium, PicamAdcAnalogGain_High );
+		std::vector<piflt> responses = Values( PicamTriggerResponse_NoResponse, PicamTriggerResponse_ReadoutPerTrigger,
+		                                       PicamTriggerResponse_ShiftPerTrigger, PicamTriggerResponse_ExposeDuringTriggerPulse );
+		responses.push_back( PicamTriggerResponse_StartOnSingleTrigger );
+
+		table.push_back( Range( PicamParameter_ExposureTime, "ExposureTime", 50, 0, 10000000, 0.001, true ) );
+		table.push_back( Range( PicamParameter_CleanSectionFinalHeight, "CleanSectionFinalHeight", 8, 1, SensorHeight, 1 ) );
+		table.push_back( Range( PicamParameter_CleanSectionFinalHeightCount, "CleanSectionFinalHeightCount", 1, 1, SensorHeight, 1 ) );
+		table.push_back( Range( PicamParameter_CleanCycleCount, "CleanCycleCount", 1, 0, 10000, 1 ) );
+		table.push_back( Range( PicamParameter_CleanCycleHeight, "CleanCycleHeight", SensorHeight, 1, SensorHeight, 1 ) );
+		table.push_back( Collection( PicamParameter_CleanUntilTrigger, "CleanUntilTrigger", 1, Values( 0, 1 ) ) );
+		table.push_back( Range( PicamParameter_SensorTemperatureSetPoint, "SensorTemperatureSetPoint", -70, -80, 25, 1 ) );
+		table.push_back( ReadOnly( PicamParameter_SensorTemperatureReading, "SensorTemperatureReading", true ) );
+		table.push_back( ReadOnly( PicamParameter_SensorTemperatureStatus, "SensorTemperatureStatus", true ) );
+		table.push_back( Collection( PicamParameter_ReadoutControlMode, "ReadoutControlMode", PicamReadoutControlMode_FullFrame,
+		                             Values( PicamReadoutControlMode_FullFrame, PicamReadoutControlMode_FrameTransfer, PicamReadoutControlMode_Kinetics ) ) );
+		table.push_back( ReadOnly( PicamParameter_ReadoutTimeCalculation, "ReadoutTimeCalculation" ) );
+		table.push_back( Collection( PicamParameter_TriggerResponse, "TriggerResponse", PicamTriggerResponse_NoResponse, responses ) );
+		table.push_back( Collection( PicamParameter_TriggerDetermination, "TriggerDetermination", PicamTriggerDetermination_PositivePolarity,
+		                             Values( 1, 2, 3, 4 ) ) );
+		table.push_back( Collection( PicamParameter_AdcSpeed, "AdcSpeed", 2, Values( 0.1, 2 ) ) );
+		table.push_back( Collection( PicamParameter_AdcBitDepth, "AdcBitDepth", 16, Values( 16 ) ) );
+		table.push_back( Collection( PicamParameter_AdcAnalogGain, "AdcAnalogGain", PicamAdcAnalogGain_Medium, gains ) );
+		table.push_back( Collection( PicamParameter_AdcQuality, "AdcQuality", PicamAdcQuality_LowNoise, Values( PicamAdcQuality_LowNoise ) ) );
+		table.push_back( Range( PicamParameter_ReadoutCount, "ReadoutCount", 1, 0, 2147483647.0 * 1024, 1 ) );
+		table.push_back( Collection( PicamParameter_PixelFormat, "PixelFormat", PicamPixelFormat_Monochrome16Bit, Values( PicamPixelFormat_Monochrome16Bit ) ) );
+		table.push_back( ReadOnly( PicamParameter_FrameSize, "FrameSize" ) );
+		table.push_back( ReadOnly( PicamParameter_FrameStride, "FrameStride" ) );
+		table.push_back( ReadOnly( PicamParameter_FramesPerReadout, "FramesPerReadout" ) );
+		table.push_back( ReadOnly( PicamParameter_ReadoutStride, "ReadoutStride" ) );
+		table.push_back( ReadOnly( PicamParameter_PixelBitDepth, "PixelBitDepth" ) );
+		table.push_back( ReadOnly( PicamParameter_ReadoutRateCalculation, "ReadoutRateCalculation" ) );
+		table.push_back( ReadOnly( PicamParameter_FrameRateCalculation, "FrameRateCalculation" ) );
+		table.push_back( Range( PicamParameter_KineticsWindowHeight, "KineticsWindowHeight", 64, 1, SensorHeight, 1 ) );
+		table.push_back( ReadOnly( PicamParameter_SensorActiveWidth, "SensorActiveWidth" ) );
+		table.push_back( ReadOnly( PicamParameter_SensorActiveHeight, "SensorActiveHeight" ) );
+		table.push_back( Collection( PicamParameter_TimeStamps, "TimeStamps", PicamTimeStampsMask_None, Values( 0, 1, 2, 3 ) ) );
+		table.push_back( Collection( PicamParameter_TimeStampResolution, "TimeStampResolution", 1000000, Values( 1000000 ) ) );
+		table.push_back( Collection( PicamParameter_TimeStampBitDepth, "TimeStampBitDepth", 64, Values( 64 ) ) );
+		table.push_back( Collection( PicamParameter_TrackFrames, "TrackFrames", 0, Values( 0, 1 ) ) );
+		table.push_back( Collection( PicamParameter_FrameTrackingBitDepth, "FrameTrackingBitDepth", 64, Values( 64 ) ) );
+	}
+	return table;
+}
+
+const ParamInfo* FindParam( PicamParameter parameter )
+{
+	const std::vector<ParamInfo>& table = ParamTable();
+	for( size_t i = 0; i < table.size(); ++i )
+		if( table[i].parameter == parameter )
+			return &table[i];
+	return 0;
+}
+
+PicamValueType ValueTypeOf( PicamParameter parameter )
+{
+	return (PicamValueType)( ( parameter >> 16 ) & 0xff );
+}
+
+PicamConstraintType ConstraintTypeOf( PicamParameter parameter )
+{
+	return (PicamConstraintType)( ( parameter >> 24 ) & 0xff );
+}
+
+bool InRange( const ParamInfo& info, piflt value )
+{
+	if( value < info.minimum - 1e-9 || value > info.maximum + 1e-9 )
+		return false;
+	if( info.increment > 0 )
+	{
+		piflt steps = ( value - info.minimum ) / info.increment;
+		if( std::fabs( steps - std::floor( steps + 0.5 ) ) > 1e-6 )
+			return false;
+	}
+	return true;
+}
+
+bool IsAllowed( const ParamInfo& info, piflt value )
+{
+	if( ConstraintTypeOf( info.parameter ) == PicamConstraintType_Range )
+		return InRange( info, value );
+	if( ConstraintTypeOf( info.parameter ) == PicamConstraintType_Collection )
+	{
+		for( size_t i = 0; i < info.collection.size(); ++i )
+			if( std::fabs( info.collection[i] - value ) < 1e-9 )
+				return true;
+		return false;
+	}
+	return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Camera state
+////////////////////////////////////////////////////////////////////////////////
+typedef std::map<PicamParameter, piflt> ValueMap;
+
+struct Layout
+{
+	piint framePixels;
+	piint frameSize;
+	piint metadataBytes;
+	piint frameStride;
+	piint framesPerReadout;
+	piint readoutStride;
+	piflt readoutMs;
+	piflt frameRate;
+	piflt readoutRate;
+};
+
+struct SimCamera
+{
+	PicamCameraID              id;
+	std::mutex                 lock;
+	ValueMap                   values;
+	ValueMap                   committed;
+	std::vector<PicamRoi>      rois;
+	std::vector<PicamRoi>      committedRois;
+
+	/* cooling */
+	piflt                      temperature;
+	SimClock::time_point       temperatureTime;
+
+	/* acquisition */
+	std::thread                worker;
+	bool                       running;
+	bool                       stopRequested;
+	std::condition_variable    updated;
+	std::vector<pibyte>        internalBuffer;
+	PicamAcquisitionBuffer     userBuffer;
+	pibyte*                    buffer;
+	pi64s                      capacity;     /* readouts in the circular buffer */
+	pi64s                      produced;     /* readouts written by the camera */
+	pi64s                      consumed;     /* readouts handed to the caller */
+	pi64s                      released;     /* readouts the caller is done with */
+	int                        errors;
+	SimClock::time_point       startTime;
+	Layout                     layout;
+	unsigned long long         rng;
+	std::vector<piflt>         spotX;
+	std::vector<piflt>         spotY;
+};
+
+struct SimLibrary
+{
+	std::mutex                  lock;
+	bool                        initialized;
+	std::vector<PicamCameraID>  connected;
+	std::vector<bool>           demo;
+	std::vector<SimCamera*>     open;
+};
+
+SimLibrary Library;
+
+piflt Get( const ValueMap& values, PicamParameter parameter )
+{
+	ValueMap::const_iterator it = values.find( parameter );
+	return it == values.end() ? 0 : it->second;
+}
+
+Layout ComputeLayout( const ValueMap& values, const std::vector<PicamRoi>& rois )
+{
+	Layout layout;
+	piint mode = (piint)Get( values, PicamParameter_ReadoutControlMode );
+	piint window = (piint)Get( values, PicamParameter_KineticsWindowHeight );
+	piint stamps = (piint)Get( values, PicamParameter_TimeStamps );
+
+	layout.framePixels = 0;
+	layout.framesPerReadout = 1;
+	for( size_t i = 0; i < rois.size(); ++i )
+	{
+		piint rows = rois[i].height;
+		if( mode == PicamReadoutControlMode_Kinetics )
+			rows = std::min( rows, window );
+		layout.framePixels += ( rois[i].width / rois[i].x_binning ) * std::max( 1, rows / rois[i].y_binning );
+	}
+	if( mode == PicamReadoutControlMode_Kinetics && window > 0 )
+		layout.framesPerReadout = std::max( 1, SensorHeight / window );
+
+	layout.metadataBytes = 0;
+	if( stamps & PicamTimeStampsMask_ExposureStarted )
+		layout.metadataBytes += 8;
+	if( stamps & PicamTimeStampsMask_ExposureEnded )
+		layout.metadataBytes += 8;
+	if( Get( values, PicamParameter_TrackFrames ) != 0 )
+		layout.metadataBytes += 8;
+
+	layout.frameSize = layout.framePixels * 2;
+	layout.frameStride = layout.frameSize + layout.metadataBytes;
+	layout.readoutStride = layout.frameStride * layout.framesPerReadout;
+
+	/* pixels are digitized at the ADC speed (MHz), every row is shifted */
+	piflt adc = std::max( 0.001, Get( values, PicamParameter_AdcSpeed ) );
+	piflt exposure = Get( values, PicamParameter_ExposureTime );
+	layout.readoutMs = layout.framePixels * layout.framesPerReadout / ( adc * 1000.0 ) + SensorHeight * RowShiftMs;
+
+	piflt readoutPeriod;
+	if( mode == PicamReadoutControlMode_FrameTransfer )
+		readoutPeriod = std::max( exposure, layout.readoutMs );
+	else if( mode == PicamReadoutControlMode_Kinetics )
+		readoutPeriod = layout.framesPerReadout * ( exposure + window * RowShiftMs ) + layout.readoutMs;
+	else
+		readoutPeriod = exposure + layout.readoutMs;
+	layout.readoutRate = 1000.0 / std::max( 1e-6, readoutPeriod );
+	layout.frameRate = layout.readoutRate * layout.framesPerReadout;
+	return layout;
+}
+
+/* - moves the simulated sensor toward its set point at 4 degrees per second */
+void UpdateTemperature( SimCamera* cam )
+{
+	SimClock::time_point now = SimClock::now();
+	piflt elapsed = std::chrono::duration<piflt>( now - cam->temperatureTime ).count();
+	piflt target = Get( cam->committed, PicamParameter_SensorTemperatureSetPoint );
+	piflt step = Settings.TimeScale > 0 ? 4.0 * elapsed / Settings.TimeScale : 1e9;
+	if( cam->temperature > target )
+		cam->temperature = std::max( target, cam->temperature - step );
+	else
+		cam->temperature = std::min( target, cam->temperature + step );
+	cam->temperatureTime = now;
+}
+
+SimCamera* FindCamera( PicamHandle handle )
+{
+	std::lock_guard<std::mutex> guard( Library.lock );
+	for( size_t i = 0; i < Library.open.size(); ++i )
+		if( Library.open[i] == handle )
+			return Library.open[i];
+	return 0;
+}
+
+unsigned long long NextRandom( unsigned long long& state )
+{
+	state ^= state << 13;
+	state ^= state >> 7;
+	state ^= state << 17;
+	return state;
+}
+
+SimCamera* CreateCamera( const PicamCameraID& id )
+{
+	SimCamera* cam = new SimCamera();
+	cam->id = id;
+	const std::vector<ParamInfo>& table = ParamTable();
+	for( size_t i = 0; i < table.size(); ++i )
+		if( !table[i].readOnly )
+			cam->values[table[i].parameter] = table[i].defaultValue;
+	cam->committed = cam->values;
+	PicamRoi full = { 0, SensorWidth, 1, 0, SensorHeight, 1 };
+	cam->rois.push_back( full );
+	cam->committedRois = cam->rois;
+	cam->temperature = 25;
+	cam->temperatureTime = SimClock::now();
+	cam->running = false;
+	cam->stopRequested = false;
+	cam->userBuffer.memory = 0;
+	cam->userBuffer.memory_size = 0;
+	cam->buffer = 0;
+	cam->capacity = cam->produced = cam->consumed = cam->released = 0;
+	cam->errors = 0;
+
+	/* spot positions depend on the serial number so cameras differ */
+	cam->rng = 88172645463325252ULL;
+	for( const char* c = id.serial_number; *c; ++c )
+		cam->rng = cam->rng * 31 + (unsigned char)*c;
+	for( int i = 0; i < Settings.Spots; ++i )
+	{
+		cam->spotX.push_back( 64 + (piflt)( NextRandom( cam->rng ) % ( SensorWidth - 128 ) ) );
+		cam->spotY.push_back( 64 + (piflt)( NextRandom( cam->rng ) % ( SensorHeight - 128 ) ) );
+	}
+	return cam;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Validation
+////////////////////////////////////////////////////////////////////////////////
+const piint BinningLimits[] = { 1, 2, 4, 8, 16, 32, 64, 128, 256, 512, 1024 };
+const piint BinningLimitCount = sizeof( BinningLimits ) / sizeof( BinningLimits[0] );
+const piint MaximumRoiCount = 16;
+
+bool IsBinningAllowed( piint binning )
+{
+	for( piint i = 0; i < BinningLimitCount; ++i )
+		if( BinningLimits[i] == binning )
+			return true;
+	return false;
+}
+
+bool SameRois( const std::vector<PicamRoi>& a, const std::vector<PicamRoi>& b )
+{
+	if( a.size() != b.size() )
+		return false;
+	for( size_t i = 0; i < a.size(); ++i )
+		if( std::memcmp( &a[i], &b[i], sizeof( PicamRoi ) ) != 0 )
+			return false;
+	return true;
+}
+
+bool AreRoisValid( const PicamRoi* rois, piint count )
+{
+	if( count < 1 || count > MaximumRoiCount )
+		return false;
+	for( piint i = 0; i < count; ++i )
+	{
+		const PicamRoi& r = rois[i];
+		if( r.x < 0 || r.y < 0 || r.width < 1 || r.height < 1 )
+			return false;
+		if( r.x + r.width > SensorWidth || r.y + r.height > SensorHeight )
+			return false;
+		if( !IsBinningAllowed( r.x_binning ) || !IsBinningAllowed( r.y_binning ) )
+			return false;
+		/* binning alignment rules */
+		if( r.x % r.x_binning || r.width % r.x_binning || r.y % r.y_binning || r.height % r.y_binning )
+			return false;
+		for( piint j = 0; j < i; ++j )
+		{
+			const PicamRoi& o = rois[j];
+			bool apart = r.x >= o.x + o.width || o.x >= r.x + r.width ||
+			             r.y >= o.y + o.height || o.y >= r.y + r.height;
+			if( !apart )
+				return false;
+		}
+	}
+	return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Frame synthesis
+////////////////////////////////////////////////////////////////////////////////
+void RenderFrame( SimCamera* cam, const std::vector<PicamRoi>& rois, piint rows, piflt exposure, pi64s frame, pibyte* out )
+{
+	unsigned short* pixels = reinterpret_cast<unsigned short*>( out );
+	piflt peak = std::min( 60000.0, 300.0 * exposure );
+	piflt sigma = 1.5;
+
+	for( size_t r = 0; r < rois.size(); ++r )
+	{
+		const PicamRoi& roi = rois[r];
+		piint w = roi.width / roi.x_binning;
+		piint roiRows = rows > 0 ? std::min( rows, roi.height ) : roi.height;
+		piint h = std::max( 1, roiRows / roi.y_binning );
+		piint n = w * h;
+
+		/* bias and a cheap triangular read noise */
+		piint i = 0;
+		while( i < n )
+		{
+			unsigned long long bits = NextRandom( cam->rng );
+			for( int k = 0; k < 4 && i < n; ++k, ++i, bits >>= 16 )
+				pixels[i] = (unsigned short)( BiasCounts + ( bits & 31 ) + ( ( bits >> 5 ) & 31 ) - 32 );
+		}
+
+		/* spots drift slowly so centroids move frame to frame */
+		for( size_t s = 0; s < cam->spotX.size(); ++s )
+		{
+			piflt cx = cam->spotX[s] + 3.0 * std::sin( 0.01 * frame + s );
+			piflt cy = cam->spotY[s] + 3.0 * std::cos( 0.013 * frame + s );
+			for( piint sy = (piint)( cy - 5 ); sy <= (piint)( cy + 5 ); ++sy )
+			{
+				piint by = ( sy - roi.y );
+				if( by < 0 || by >= roiRows )
+					continue;
+				by /= roi.y_binning;
+				for( piint sx = (piint)( cx - 5 ); sx <= (piint)( cx + 5 ); ++sx )
+				{
+					piint bx = sx - roi.x;
+					if( bx < 0 || bx >= roi.width )
+						continue;
+					bx /= roi.x_binning;
+					piflt d2 = ( sx - cx ) * ( sx - cx ) + ( sy - cy ) * ( sy - cy );
+					piflt v = pixels[by * w + bx] + peak * std::exp( -d2 / ( 2 * sigma * sigma ) );
+					pixels[by * w + bx] = (unsigned short)std::min( 65535.0, v );
+				}
+			}
+		}
+		pixels += n;
+	}
+}
+
+void WriteCounter( pibyte* out, unsigned long long value )
+{
+	for( int i = 0; i < 8; ++i )
+		out[i] = (pibyte)( value >> ( 8 * i ) );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Acquisition
+////////////////////////////////////////////////////////////////////////////////
+
+/* - returns false if the acquisition was stopped while waiting */
+bool WaitUntil( SimCamera* cam, piflt cameraMs )
+{
+	std::unique_lock<std::mutex> guard( cam->lock );
+	if( Settings.TimeScale > 0 )
+	{
+		SimClock::time_point due = cam->startTime +
+			std::chrono::duration_cast<SimClock::duration>( std::chrono::duration<piflt, std::milli>( cameraMs * Settings.TimeScale ) );
+		while( !cam->stopRequested && SimClock::now() < due )
+			cam->updated.wait_until( guard, due );
+	}
+	return !cam->stopRequested;
+}
+
+void AcquisitionLoop( SimCamera* cam, pi64s readoutCount )
+{
+	std::vector<PicamRoi> rois;
+	ValueMap values;
+	{
+		std::lock_guard<std::mutex> guard( cam->lock );
+		rois = cam->committedRois;
+		values = cam->committed;
+	}
+	const Layout layout = ComputeLayout( values, rois );
+	piint mode = (piint)values[PicamParameter_ReadoutControlMode];
+	piint response = (piint)values[PicamParameter_TriggerResponse];
+	piint stamps = (piint)values[PicamParameter_TimeStamps];
+	bool track = values[PicamParameter_TrackFrames] != 0;
+	piflt resolution = values[PicamParameter_TimeStampResolution];
+	piint window = mode == PicamReadoutControlMode_Kinetics ? (piint)values[PicamParameter_KineticsWindowHeight] : 0;
+	bool triggered = response != PicamTriggerResponse_NoResponse && Settings.TriggerHz > 0;
+
+	std::vector<pibyte> dropped( layout.readoutStride );
+	piflt ready = 0;           /* camera time (ms) the sensor can start exposing */
+	piflt readoutDone = 0;     /* camera time (ms) the last readout finished */
+	pi64s trigger = 0;
+	unsigned long long tracking = 0;
+
+	for( pi64s r = 0; readoutCount == 0 || r < readoutCount; ++r )
+	{
+		/* pick the destination slot, or lose the readout if the buffer is full */
+		pibyte* slot;
+		bool lose = Settings.DropEvery > 0 && ( r + 1 ) % Settings.DropEvery == 0;
+		{
+			std::lock_guard<std::mutex> guard( cam->lock );
+			if( cam->stopRequested )
+				break;
+			if( cam->produced - cam->released >= cam->capacity )
+				lose = true;
+			slot = lose ? &dropped[0] : cam->buffer + ( cam->produced % cam->capacity ) * layout.readoutStride;
+		}
+
+		piflt readoutStart = 0;
+		piflt exposure = 0;
+		for( piint f = 0; f < layout.framesPerReadout; ++f )
+		{
+			{
+				std::lock_guard<std::mutex> guard( cam->lock );
+				exposure = cam->committed[PicamParameter_ExposureTime];
+			}
+
+			piflt start = ready;
+			if( triggered && ( f == 0 || response == PicamTriggerResponse_ShiftPerTrigger ) &&
+			    !( response == PicamTriggerResponse_StartOnSingleTrigger && r > 0 ) )
+			{
+				piflt t;
+				do
+				{
+					t = 1000.0 * trigger / Settings.TriggerHz;
+					if( Settings.TriggerJitterUs > 0 )
+						t += ( (piflt)( NextRandom( cam->rng ) % 2001 ) / 1000.0 - 1.0 ) * Settings.TriggerJitterUs / 1000.0;
+					++trigger;
+				}
+				while( t < start || ( Settings.MissEvery > 0 && trigger % Settings.MissEvery == 0 ) );
+				start = t;
+			}
+			piflt end = start + exposure;
+
+			pibyte* frame = slot + f * layout.frameStride;
+			RenderFrame( cam, rois, window, exposure, (pi64s)tracking, frame );
+			pibyte* meta = frame + layout.frameSize;
+			if( stamps & PicamTimeStampsMask_ExposureStarted )
+			{
+				WriteCounter( meta, (unsigned long long)( start * resolution / 1000.0 ) );
+				meta += 8;
+			}
+			if( stamps & PicamTimeStampsMask_ExposureEnded )
+			{
+				WriteCounter( meta, (unsigned long long)( end * resolution / 1000.0 ) );
+				meta += 8;
+			}
+			if( track )
+				WriteCounter( meta, ++tracking );
+			else
+				++tracking;
+
+			if( mode == PicamReadoutControlMode_Kinetics )
+				ready = end + window * RowShiftMs;
+			else
+				ready = end;
+			readoutStart = ready;
+		}
+
+		/* the readout itself; frame transfer exposes the next frame while
+		   the storage area is read out */
+		if( mode == PicamReadoutControlMode_FrameTransfer )
+		{
+			readoutDone = std::max( readoutStart, readoutDone ) + layout.readoutMs;
+			ready = std::max( readoutStart, readoutDone - exposure );
+		}
+		else
+		{
+			readoutDone = readoutStart + layout.readoutMs;
+			ready = readoutDone;
+		}
+		if( !WaitUntil( cam, readoutDone ) )
+			break;
+
+		std::lock_guard<std::mutex> guard( cam->lock );
+		if( lose )
+			cam->errors |= PicamAcquisitionErrorsMask_DataLost;
+		else
+			++cam->produced;
+		cam->updated.notify_all();
+	}
+
+	std::lock_guard<std::mutex> guard( cam->lock );
+	cam->running = false;
+	cam->updated.notify_all();
+}
+
+void JoinWorker( SimCamera* cam )
+{
+	if( cam->worker.joinable() )
+		cam->worker.join();
+}
+
+PicamError StartLocked( SimCamera* cam, pi64s readoutCount, bool ownBuffer, std::unique_lock<std::mutex>& guard )
+{
+	if( cam->running )
+		return PicamError_AcquisitionInProgress;
+	if( cam->values != cam->committed || !SameRois( cam->rois, cam->committedRois ) )
+		return PicamError_ParametersNotCommitted;
+
+	guard.unlock();
+	JoinWorker( cam );
+	guard.lock();
+
+	cam->layout = ComputeLayout( cam->committed, cam->committedRois );
+	pi64s stride = cam->layout.readoutStride;
+	if( !ownBuffer && cam->userBuffer.memory )
+	{
+		cam->buffer = static_cast<pibyte*>( cam->userBuffer.memory );
+		cam->capacity = cam->userBuffer.memory_size / stride;
+		if( cam->capacity < 1 )
+			return PicamError_InvalidAcquisitionBuffer;
+	}
+	else
+	{
+		pi64s capacity = ownBuffer ? readoutCount : std::max<pi64s>( 2, ( 256LL << 20 ) / stride );
+		if( readoutCount > 0 )
+			capacity = std::min( capacity, readoutCount );
+		try
+		{
+			cam->internalBuffer.assign( (size_t)( capacity * stride ), 0 );
+		}
+		catch( ... )
+		{
+			return PicamError_InsufficientMemory;
+		}
+		cam->buffer = &cam->internalBuffer[0];
+		cam->capacity = capacity;
+	}
+
+	cam->produced = cam->consumed = cam->released = 0;
+	cam->errors = 0;
+	cam->running = true;
+	cam->stopRequested = false;
+	cam->startTime = SimClock::now();
+	cam->worker = std::thread( AcquisitionLoop, cam, readoutCount );
+	return PicamError_None;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Returned allocations
+////////////////////////////////////////////////////////////////////////////////
+const pichar* CopyString( const std::string& text )
+{
+	pichar* s = new pichar[text.size() + 1];
+	std::memcpy( s, text.c_str(), text.size() + 1 );
+	return s;
+}
+
+PicamRangeConstraint MakeRange( piflt min, piflt max, piflt inc )
+{
+	PicamRangeConstraint c;
+	std::memset( &c, 0, sizeof( c ) );
+	c.scope = PicamConstraintScope_Independent;
+	c.severity = PicamConstraintSeverity_Error;
+	c.empty_set = false;
+	c.minimum = min;
+	c.maximum = max;
+	c.increment = inc;
+	return c;
+}
+
+const PicamRois* CopyRois( const std::vector<PicamRoi>& rois )
+{
+	PicamRois* copy = new PicamRois;
+	copy->roi_count = (piint)rois.size();
+	copy->roi_array = new PicamRoi[rois.size()];
+	std::copy( rois.begin(), rois.end(), copy->roi_array );
+	return copy;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Enumeration strings
+////////////////////////////////////////////////////////////////////////////////
+struct EnumName
+{
+	PicamEnumeratedType type;
+	piint               value;
+	const char*         name;
+};
+
+const EnumName EnumNames[] =
+{
+	{ PicamEnumeratedType_Error, PicamError_None, "None" },
+	{ PicamEnumeratedType_Error, PicamError_UnexpectedError, "Unexpected Error" },
+	{ PicamEnumeratedType_Error, PicamError_UnexpectedNullPointer, "Unexpected Null Pointer" },
+	{ PicamEnumeratedType_Error, PicamError_InvalidPointer, "Invalid Pointer" },
+	{ PicamEnumeratedType_Error, PicamError_InvalidCount, "Invalid Count" },
+	{ PicamEnumeratedType_Error, PicamError_InvalidOperation, "Invalid Operation" },
+	{ PicamEnumeratedType_Error, PicamError_LibraryNotInitialized, "Library Not Initialized" },
+	{ PicamEnumeratedType_Error, PicamError_LibraryAlreadyInitialized, "Library Already Initialized" },
+	{ PicamEnumeratedType_Error, PicamError_EnumerationValueNotDefined, "Enumeration Value Not Defined" },
+	{ PicamEnumeratedType_Error, PicamError_NoCamerasAvailable, "No Cameras Available" },
+	{ PicamEnumeratedType_Error, PicamError_CameraAlreadyOpened, "Camera Already Opened" },
+	{ PicamEnumeratedType_Error, PicamError_InvalidCameraID, "Invalid Camera ID" },
+	{ PicamEnumeratedType_Error, PicamError_InvalidHandle, "Invalid Handle" },
+	{ PicamEnumeratedType_Error, PicamError_DemoAlreadyConnected, "Demo Already Connected" },
+	{ PicamEnumeratedType_Error, PicamError_InvalidDemoSerialNumber, "Invalid Demo Serial Number" },
+	{ PicamEnumeratedType_Error, PicamError_ParameterHasInvalidValueType, "Parameter Has Invalid Value Type" },
+	{ PicamEnumeratedType_Error, PicamError_ParameterHasInvalidConstraintType, "Parameter Has Invalid Constraint Type" },
+	{ PicamEnumeratedType_Error, PicamError_ParameterDoesNotExist, "Parameter Does Not Exist" },
+	{ PicamEnumeratedType_Error, PicamError_ParameterValueIsReadOnly, "Parameter Value Is Read Only" },
+	{ PicamEnumeratedType_Error, PicamError_InvalidParameterValue, "Invalid Parameter Value" },
+	{ PicamEnumeratedType_Error, PicamError_ParameterIsNotOnlineable, "Parameter Is Not Onlineable" },
+	{ PicamEnumeratedType_Error, PicamError_ParameterIsNotReadable, "Parameter Is Not Readable" },
+	{ PicamEnumeratedType_Error, PicamError_InvalidParameterValues, "Invalid Parameter Values" },
+	{ PicamEnumeratedType_Error, PicamError_ParametersNotCommitted, "Parameters Not Committed" },
+	{ PicamEnumeratedType_Error, PicamError_InvalidAcquisitionBuffer, "Invalid Acquisition Buffer" },
+	{ PicamEnumeratedType_Error, PicamError_InvalidReadoutCount, "Invalid Readout Count" },
+	{ PicamEnumeratedType_Error, PicamError_InsufficientMemory, "Insufficient Memory" },
+	{ PicamEnumeratedType_Error, PicamError_AcquisitionInProgress, "Acquisition In Progress" },
+	{ PicamEnumeratedType_Error, PicamError_AcquisitionNotInProgress, "Acquisition Not In Progress" },
+	{ PicamEnumeratedType_Error, PicamError_TimeOutOccurred, "Time Out Occurred" },
+	{ PicamEnumeratedType_Model, PicamModel_Pixis1024F, "PIXIS: 1024F" },
+	{ PicamEnumeratedType_Model, PicamModel_Pixis1024B, "PIXIS: 1024B" },
+	{ PicamEnumeratedType_Model, PicamModel_Pixis1024BR, "PIXIS: 1024BR" },
+	{ PicamEnumeratedType_Model, PicamModel_Pixis1024BUV, "PIXIS: 1024BUV" },
+	{ PicamEnumeratedType_ComputerInterface, PicamComputerInterface_Usb2, "USB 2.0" },
+	{ PicamEnumeratedType_ComputerInterface, PicamComputerInterface_1394A, "IEEE 1394A" },
+	{ PicamEnumeratedType_ComputerInterface, PicamComputerInterface_GigabitEthernet, "Gigabit Ethernet" },
+	{ PicamEnumeratedType_ValueType, PicamValueType_Integer, "Integer" },
+	{ PicamEnumeratedType_ValueType, PicamValueType_FloatingPoint, "Floating Point" },
+	{ PicamEnumeratedType_ValueType, PicamValueType_Boolean, "Boolean" },
+	{ PicamEnumeratedType_ValueType, PicamValueType_Enumeration, "Enumeration" },
+	{ PicamEnumeratedType_ValueType, PicamValueType_Rois, "Regions of Interest" },
+	{ PicamEnumeratedType_ValueType, PicamValueType_LargeInteger, "Large Integer" },
+	{ PicamEnumeratedType_ConstraintType, PicamConstraintType_None, "None" },
+	{ PicamEnumeratedType_ConstraintType, PicamConstraintType_Range, "Range" },
+	{ PicamEnumeratedType_ConstraintType, PicamConstraintType_Collection, "Collection" },
+	{ PicamEnumeratedType_ConstraintType, PicamConstraintType_Rois, "Regions of Interest" },
+	{ PicamEnumeratedType_AdcAnalogGain, PicamAdcAnalogGain_Low, "Low" },
+	{ PicamEnumeratedType_AdcAnalogGain, PicamAdcAnalogGain_Medium, "Medium" },
+	{ PicamEnumeratedType_AdcAnalogGain, PicamAdcAnalogGain_High, "High" },
+	{ PicamEnumeratedType_AdcQuality, PicamAdcQuality_LowNoise, "Low Noise" },
+	{ PicamEnumeratedType_AdcQuality, PicamAdcQuality_HighCapacity, "High Capacity" },
+	{ PicamEnumeratedType_PixelFormat, PicamPixelFormat_Monochrome16Bit, "Monochrome 16-bit" },
+	{ PicamEnumeratedType_ReadoutControlMode, PicamReadoutControlMode_FullFrame, "Full Frame" },
+	{ PicamEnumeratedType_ReadoutControlMode, PicamReadoutControlMode_FrameTransfer, "Frame Transfer" },
+	{ PicamEnumeratedType_ReadoutControlMode, PicamReadoutControlMode_Interline, "Interline" },
+	{ PicamEnumeratedType_ReadoutControlMode, PicamReadoutControlMode_Kinetics, "Kinetics" },
+	{ PicamEnumeratedType_ReadoutControlMode, PicamReadoutControlMode_SpectraKinetics, "Spectra Kinetics" },
+	{ PicamEnumeratedType_ReadoutControlMode, PicamReadoutControlMode_Dif, "DIF" },
+	{ PicamEnumeratedType_SensorTemperatureStatus, PicamSensorTemperatureStatus_Unlocked, "Unlocked" },
+	{ PicamEnumeratedType_SensorTemperatureStatus, PicamSensorTemperatureStatus_Locked, "Locked" },
+	{ PicamEnumeratedType_TimeStampsMask, PicamTimeStampsMask_None, "None" },
+	{ PicamEnumeratedType_TimeStampsMask, PicamTimeStampsMask_ExposureStarted, "Exposure Started" },
+	{ PicamEnumeratedType_TimeStampsMask, PicamTimeStampsMask_ExposureEnded, "Exposure Ended" },
+	{ PicamEnumeratedType_TriggerDetermination, PicamTriggerDetermination_PositivePolarity, "Positive Polarity" },
+	{ PicamEnumeratedType_TriggerDetermination, PicamTriggerDetermination_NegativePolarity, "Negative Polarity" },
+	{ PicamEnumeratedType_TriggerDetermination, PicamTriggerDetermination_RisingEdge, "Rising Edge" },
+	{ PicamEnumeratedType_TriggerDetermination, PicamTriggerDetermination_FallingEdge, "Falling Edge" },
+	{ PicamEnumeratedType_TriggerResponse, PicamTriggerResponse_NoResponse, "No Response" },
+	{ PicamEnumeratedType_TriggerResponse, PicamTriggerResponse_ReadoutPerTrigger, "Readout Per Trigger" },
+	{ PicamEnumeratedType_TriggerResponse, PicamTriggerResponse_ShiftPerTrigger, "Shift Per Trigger" },
+	{ PicamEnumeratedType_TriggerResponse, PicamTriggerResponse_ExposeDuringTriggerPulse, "Expose During Trigger Pulse" },
+	{ PicamEnumeratedType_TriggerResponse, PicamTriggerResponse_StartOnSingleTrigger, "Start On Single Trigger" },
+	{ PicamEnumeratedType_ValueAccess, PicamValueAccess_ReadOnly, "Read Only" },
+	{ PicamEnumeratedType_ValueAccess, PicamValueAccess_ReadWrite, "Read/Write" },
+	{ PicamEnumeratedType_ValueAccess, PicamValueAccess_ReadWriteTrivial, "Read/Write Trivial" },
+	{ PicamEnumeratedType_ConstraintCategory, PicamConstraintCategory_Capable, "Capable" },
+	{ PicamEnumeratedType_ConstraintCategory, PicamConstraintCategory_Required, "Required" },
+	{ PicamEnumeratedType_ConstraintCategory, PicamConstraintCategory_Recommended, "Recommended" },
+	{ PicamEnumeratedType_AcquisitionErrorsMask, PicamAcquisitionErrorsMask_None, "None" },
+	{ PicamEnumeratedType_AcquisitionErrorsMask, PicamAcquisitionErrorsMask_DataLost, "Data Lost" },
+	{ PicamEnumeratedType_AcquisitionErrorsMask, PicamAcquisitionErrorsMask_ConnectionLost, "Connection Lost" }
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// Shared parameter plumbing
+////////////////////////////////////////////////////////////////////////////////
+PicamError CheckParameter( SimCamera* cam, PicamParameter parameter, const ParamInfo** info )
+{
+	if( !cam )
+		return PicamError_InvalidHandle;
+	*info = FindParam( parameter );
+	if( !*info )
+		return PicamError_ParameterDoesNotExist;
+	return PicamError_None;
+}
+
+bool IsIntegerType( PicamParameter parameter )
+{
+	PicamValueType type = ValueTypeOf( parameter );
+	return type == PicamValueType_Integer || type == PicamValueType_Boolean || type == PicamValueType_Enumeration;
+}
+
+/* - current value of any numeric parameter, including calculated ones */
+piflt CurrentValue( SimCamera* cam, PicamParameter parameter )
+{
+	Layout layout = ComputeLayout( cam->values, cam->rois );
+	switch( parameter )
+	{
+	case PicamParameter_ReadoutTimeCalculation: return layout.readoutMs;
+	case PicamParameter_FrameSize:              return layout.frameSize;
+	case PicamParameter_FrameStride:            return layout.frameStride;
+	case PicamParameter_FramesPerReadout:       return layout.framesPerReadout;
+	case PicamParameter_ReadoutStride:          return layout.readoutStride;
+	case PicamParameter_PixelBitDepth:          return 16;
+	case PicamParameter_ReadoutRateCalculation: return layout.readoutRate;
+	case PicamParameter_FrameRateCalculation:   return layout.frameRate;
+	case PicamParameter_SensorActiveWidth:      return SensorWidth;
+	case PicamParameter_SensorActiveHeight:     return SensorHeight;
+	case PicamParameter_SensorTemperatureReading:
+		UpdateTemperature( cam );
+		return std::floor( cam->temperature * 100 + 0.5 ) / 100;
+	case PicamParameter_SensorTemperatureStatus:
+		UpdateTemperature( cam );
+		return cam->temperature == Get( cam->committed, PicamParameter_SensorTemperatureSetPoint )
+			? PicamSensorTemperatureStatus_Locked : PicamSensorTemperatureStatus_Unlocked;
+	default:
+		return Get( cam->values, parameter );
+	}
+}
+
+PicamError GetValue( PicamHandle camera, PicamParameter parameter, PicamValueType type, piflt* value )
+{
+	SimCamera* cam = FindCamera( camera );
+	const ParamInfo* info;
+	PicamError error = CheckParameter( cam, parameter, &info );
+	if( error != PicamError_None )
+		return error;
+	if( !value )
+		return PicamError_InvalidPointer;
+	bool matches = type == PicamValueType_Integer ? IsIntegerType( parameter ) : ValueTypeOf( parameter ) == type;
+	if( !matches )
+		return PicamError_ParameterHasInvalidValueType;
+	std::lock_guard<std::mutex> guard( cam->lock );
+	*value = CurrentValue( cam, parameter );
+	return PicamError_None;
+}
+
+PicamError CanSetValue( PicamHandle camera, PicamParameter parameter, PicamValueType type, piflt value, pibln* settable )
+{
+	SimCamera* cam = FindCamera( camera );
+	const ParamInfo* info;
+	PicamError error = CheckParameter( cam, parameter, &info );
+	if( error != PicamError_None )
+		return error;
+	if( !settable )
+		return PicamError_InvalidPointer;
+	bool matches = type == PicamValueType_Integer ? IsIntegerType( parameter ) : ValueTypeOf( parameter ) == type;
+	if( !matches )
+		return PicamError_ParameterHasInvalidValueType;
+	if( info->readOnly )
+		return PicamError_ParameterValueIsReadOnly;
+	*settable = IsAllowed( *info, value );
+	return PicamError_None;
+}
+
+PicamError SetValue( PicamHandle camera, PicamParameter parameter, PicamValueType type, piflt value, bool online )
+{
+	pibln settable;
+	PicamError error = CanSetValue( camera, parameter, type, value, &settable );
+	if( error != PicamError_None )
+		return error;
+	if( !settable )
+		return PicamError_InvalidParameterValue;
+	SimCamera* cam = FindCamera( camera );
+	const ParamInfo* info = FindParam( parameter );
+	std::lock_guard<std::mutex> guard( cam->lock );
+	if( online )
+	{
+		if( !info->onlineable )
+			return PicamError_ParameterIsNotOnlineable;
+		cam->committed[parameter] = value;
+	}
+	cam->values[parameter] = value;
+	return PicamError_None;
+}
+
+PicamError GetDefault( PicamHandle camera, PicamParameter parameter, PicamValueType type, piflt* value )
+{
+	SimCamera* cam = FindCamera( camera );
+	const ParamInfo* info;
+	PicamError error = CheckParameter( cam, parameter, &info );
+	if( error != PicamError_None )
+		return error;
+	if( !value )
+		return PicamError_InvalidPointer;
+	bool matches = type == PicamValueType_Integer ? IsIntegerType( parameter ) : ValueTypeOf( parameter ) == type;
+	if( !matches )
+		return PicamError_ParameterHasInvalidValueType;
+	if( info->readOnly )
+	{
+		std::lock_guard<std::mutex> guard( cam->lock );
+		*value = CurrentValue( cam, parameter );
+	}
+	else
+		*value = info->defaultValue;
+	return PicamError_None;
+}
+
+PicamError ReadValue( PicamHandle camera, PicamParameter parameter, PicamValueType type, piflt* value )
+{
+	SimCamera* cam = FindCamera( camera );
+	const ParamInfo* info;
+	PicamError error = CheckParameter( cam, parameter, &info );
+	if( error != PicamError_None )
+		return error;
+	if( !info->readable )
+		return PicamError_ParameterIsNotReadable;
+	return GetValue( camera, parameter, type, value );
+}
+
+} // namespace
+
+////////////////////////////////////////////////////////////////////////////////
+// Library
+////////////////////////////////////////////////////////////////////////////////
+PicamError PIL_CALL Picam_IsLibraryInitialized( pibln* inited )
+{
+	if( !inited )
+		return PicamError_InvalidPointer;
+	std::lock_guard<std::mutex> guard( Library.lock );
+	*inited = Library.initialized;
+	return PicamError_None;
+}
+
+PicamError PIL_CALL Picam_InitializeLibrary( void )
+{
+	std::lock_guard<std::mutex> guard( Library.lock );
+	if( Library.initialized )
+		return PicamError_LibraryAlreadyInitialized;
+	Settings = LoadSettings();
+	Library.initialized = true;
+
+	/* simulated hardware */
+	const char* cameras = std::getenv( "PICAMSIM_CAMERAS" );
+	std::vector<std::string> serials;
+	if( cameras && *cameras )
+	{
+		std::string list( cameras );
+		if( list.find_first_not_of( "0123456789" ) == std::string::npos )
+		{
+			for( int i = 0; i < std::atoi( cameras ); ++i )
+			{
+				char serial[32];
+				std::sprintf( serial, "SIM%04d", i + 1 );
+				serials.push_back( serial );
+			}
+		}
+		else
+		{
+			size_t start = 0;
+			while( start <= list.size() )
+			{
+				size_t comma = list.find( ',', start );
+				if( comma == std::string::npos )
+					comma = list.size();
+				if( comma > start )
+					serials.push_back( list.substr( start, comma - start ) );
+				start = comma + 1;
+			}
+		}
+	}
+	for( size_t i = 0; i < serials.size(); ++i )
+	{
+		PicamCameraID id;
+		std::memset( &id, 0, sizeof( id ) );
+		id.model = PicamModel_Pixis1024BR;
+		id.computer_interface = PicamComputerInterface_Usb2;
+		std::strncpy( id.sensor_name, "E2V 1024 x 1024 (CCD 47-10)(B)", PicamStringSize_SensorName - 1 );
+		std::strncpy( id.serial_number, serials[i].c_str(), PicamStringSize_SerialNumber - 1 );
+		Library.connected.push_back( id );
+		Library.demo.push_back( false );
+	}
+	return PicamError_None;
+}
+
+PicamError PIL_CALL Picam_UninitializeLibrary( void )
+{
+	std::vector<SimCamera*> open;
+	{
+		std::lock_guard<std::mutex> guard( Library.lock );
+		if( !Library.initialized )
+			return PicamError_LibraryNotInitialized;
+		open = Library.open;
+	}
+	for( size_t i = 0; i < open.size(); ++i )
+		Picam_CloseCamera( open[i] );
+	std::lock_guard<std::mutex> guard( Library.lock );
+	Library.connected.clear();
+	Library.demo.clear();
+	Library.initialized = false;
+	return PicamError_None;
+}
+
+PicamError PIL_CALL Picam_DestroyString( const pichar* s )
+{
+	delete[] s;
+	return PicamError_None;
+}
+
+PicamError PIL_CALL Picam_GetEnumerationString( PicamEnumeratedType type, piint value, const pichar** s )
+{
+	if( !s )
+		return PicamError_InvalidPointer;
+	if( type == PicamEnumeratedType_Parameter )
+	{
+		const ParamInfo* info = FindParam( (PicamParameter)value );
+		if( info )
+		{
+			*s = CopyString( info->name );
+			return PicamError_None;
+		}
+	}
+	for( size_t i = 0; i < sizeof( EnumNames ) / sizeof( EnumNames[0] ); ++i )
+	{
+		if( EnumNames[i].type == type && EnumNames[i].value == value )
+		{
+			*s = CopyString( EnumNames[i].name );
+			return PicamError_None;
+		}
+	}
+	/* masks and anything else the table lacks print as numbers */
+	char text[32];
+	std::sprintf( text, "%d", value );
+	*s = CopyString( text );
+	return PicamError_None;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Cameras
+////////////////////////////////////////////////////////////////////////////////
+PicamError PIL_CALL Picam_DestroyCameraIDs( const PicamCameraID* id_array )
+{
+	delete[] id_array;
+	return PicamError_None;
+}
+
+PicamError PIL_CALL Picam_GetAvailableCameraIDs( const PicamCameraID** id_array, piint* id_count )
+{
+	if( !id_array || !id_count )
+		return PicamError_InvalidPointer;
+	std::lock_guard<std::mutex> guard( Library.lock );
+	if( !Library.initialized )
+		return PicamError_LibraryNotInitialized;
+	PicamCameraID* ids = new PicamCameraID[Library.connected.size() + 1];
+	std::copy( Library.connected.begin(), Library.connected.end(), ids );
+	*id_array = ids;
+	*id_count = (piint)Library.connected.size();
+	return PicamError_None;
+}
+
+PicamError PIL_CALL Picam_GetUnavailableCameraIDs( const PicamCameraID** id_array, piint* id_count )
+{
+	if( !id_array || !id_count )
+		return PicamError_InvalidPointer;
+	*id_array = new PicamCameraID[1];
+	*id_count = 0;
+	return PicamError_None;
+}
+
+PicamError PIL_CALL Picam_DestroyFirmwareDetails( const PicamFirmwareDetail* firmware_array )
+{
+	delete[] firmware_array;
+	return PicamError_None;
+}
+
+PicamError PIL_CALL Picam_GetFirmwareDetails( const PicamCameraID* id, const PicamFirmwareDetail** firmware_array, piint* firmware_count )
+{
+	if( !id || !firmware_array || !firmware_count )
+		return PicamError_InvalidPointer;
+	PicamFirmwareDetail* details = new PicamFirmwareDetail[2];
+	std::memset( details, 0, 2 * sizeof( PicamFirmwareDetail ) );
+	std::strcpy( details[0].name, "Firmware" );
+	std::strcpy( details[0].detail, "PicamSim 1.0" );
+	std::strcpy( details[1].name, "FPGA" );
+	std::strcpy( details[1].detail, "PicamSim 1.0" );
+	*firmware_array = details;
+	*firmware_count = 2;
+	return PicamError_None;
+}
+
+PicamError PIL_CALL Picam_ConnectDemoCamera( PicamModel model, const pichar* serial_number, PicamCameraID* id )
+{
+	if( !serial_number )
+		return PicamError_InvalidDemoSerialNumber;
+	if( model < PicamModel_Pixis1024F || model > PicamModel_Pixis1024BUV )
+		return PicamError_InvalidDemoModel;
+	std::lock_guard<std::mutex> guard( Library.lock );
+	if( !Library.initialized )
+		return PicamError_LibraryNotInitialized;
+	for( size_t i = 0; i < Library.connected.size(); ++i )
+		if( std::strcmp( Library.connected[i].serial_number, serial_number ) == 0 )
+			return PicamError_DemoAlreadyConnected;
+
+	PicamCameraID demo;
+	std::memset( &demo, 0, sizeof( demo ) );
+	demo.model = model;
+	demo.computer_interface = PicamComputerInterface_Usb2;
+	std::strncpy( demo.sensor_name, "Demo 1024 x 1024", PicamStringSize_SensorName - 1 );
+	std::strncpy( demo.serial_number, serial_number, PicamStringSize_SerialNumber - 1 );
+	Library.connected.push_back( demo );
+	Library.demo.push_back( true );
+	if( id )
+		*id = demo;
+	return PicamError_None;
+}
+
+PicamError PIL_CALL Picam_DisconnectDemoCamera( const PicamCameraID* id )
+{
+	if( !id )
+		return PicamError_InvalidPointer;
+	std::lock_guard<std::mutex> guard( Library.lock );
+	for( size_t i = 0; i < Library.connected.size(); ++i )
+	{
+		if( Library.demo[i] && std::strcmp( Library.connected[i].serial_number, id->serial_number ) == 0 )
+		{
+			Library.connected.erase( Library.connected.begin() + i );
+			Library.demo.erase( Library.demo.begin() + i );
+			return PicamError_None;
+		}
+	}
+	return PicamError_InvalidCameraID;
+}
+
+PicamError PIL_CALL Picam_IsDemoCamera( const PicamCameraID* id, pibln* demo )
+{
+	if( !id || !demo )
+		return PicamError_InvalidPointer;
+	std::lock_guard<std::mutex> guard( Library.lock );
+	for( size_t i = 0; i < Library.connected.size(); ++i )
+	{
+		if( std::strcmp( Library.connected[i].serial_number, id->serial_number ) == 0 )
+		{
+			*demo = Library.demo[i];
+			return PicamError_None;
+		}
+	}
+	return PicamError_InvalidCameraID;
+}
+
+PicamError PIL_CALL Picam_OpenCamera( const PicamCameraID* id, PicamHandle* camera )
+{
+	if( !id || !camera )
+		return PicamError_InvalidPointer;
+	std::lock_guard<std::mutex> guard( Library.lock );
+	if( !Library.initialized )
+		return PicamError_LibraryNotInitialized;
+	for( size_t i = 0; i < Library.open.size(); ++i )
+		if( std::strcmp( Library.open[i]->id.serial_number, id->serial_number ) == 0 )
+			return PicamError_CameraAlreadyOpened;
+	for( size_t i = 0; i < Library.connected.size(); ++i )
+	{
+		if( std::strcmp( Library.connected[i].serial_number, id->serial_number ) == 0 )
+		{
+			SimCamera* cam = CreateCamera( Library.connected[i] );
+			Library.open.push_back( cam );
+			*camera = cam;
+			return PicamError_None;
+		}
+	}
+	return PicamError_InvalidCameraID;
+}
+
+PicamError PIL_CALL Picam_OpenFirstCamera( PicamHandle* camera )
+{
+	if( !camera )
+		return PicamError_InvalidPointer;
+	std::vector<PicamCameraID> candidates;
+	{
+		std::lock_guard<std::mutex> guard( Library.lock );
+		if( !Library.initialized )
+			return PicamError_LibraryNotInitialized;
+		candidates = Library.connected;
+	}
+	for( size_t i = 0; i < candidates.size(); ++i )
+		if( Picam_OpenCamera( &candidates[i], camera ) == PicamError_None )
+			return PicamError_None;
+	return PicamError_NoCamerasAvailable;
+}
+
+PicamError PIL_CALL Picam_CloseCamera( PicamHandle camera )
+{
+	SimCamera* cam = FindCamera( camera );
+	if( !cam )
+		return PicamError_InvalidHandle;
+	{
+		std::lock_guard<std::mutex> guard( cam->lock );
+		cam->stopRequested = true;
+		cam->updated.notify_all();
+	}
+	JoinWorker( cam );
+	{
+		std::lock_guard<std::mutex> guard( Library.lock );
+		Library.open.erase( std::find( Library.open.begin(), Library.open.end(), cam ) );
+	}
+	delete cam;
+	return PicamError_None;
+}
+
+PicamError PIL_CALL Picam_GetCameraID( PicamHandle camera, PicamCameraID* id )
+{
+	SimCamera* cam = FindCamera( camera );
+	if( !cam )
+		return PicamError_InvalidHandle;
+	if( !id )
+		return PicamError_InvalidPointer;
+	*id = cam->id;
+	return PicamError_None;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Parameter values
+////////////////////////////////////////////////////////////////////////////////
+PicamError PIL_CALL Picam_GetParameterIntegerValue( PicamHandle camera, PicamParameter parameter, piint* value )
+{
+	piflt v;
+	PicamError error = GetValue( camera, parameter, PicamValueType_Integer, &v );
+	if( error == PicamError_None && value )
+		*value = (piint)v;
+	return error;
+}
+
+PicamError PIL_CALL Picam_SetParameterIntegerValue( PicamHandle camera, PicamParameter parameter, piint value )
+{
+	return SetValue( camera, parameter, PicamValueType_Integer, value, false );
+}
+
+PicamError PIL_CALL Picam_CanSetParameterIntegerValue( PicamHandle camera, PicamParameter parameter, piint value, pibln* settable )
+{
+	return CanSetValue( camera, parameter, PicamValueType_Integer, value, settable );
+}
+
+PicamError PIL_CALL Picam_GetParameterLargeIntegerValue( PicamHandle camera, PicamParameter parameter, pi64s* value )
+{
+	piflt v;
+	PicamError error = GetValue( camera, parameter, PicamValueType_LargeInteger, &v );
+	if( error == PicamError_None && value )
+		*value = (pi64s)v;
+	return error;
+}
+
+PicamError PIL_CALL Picam_SetParameterLargeIntegerValue( PicamHandle camera, PicamParameter parameter, pi64s value )
+{
+	return SetValue( camera, parameter, PicamValueType_LargeInteger, (piflt)value, false );
+}
+
+PicamError PIL_CALL Picam_CanSetParameterLargeIntegerValue( PicamHandle camera, PicamParameter parameter, pi64s value, pibln* settable )
+{
+	return CanSetValue( camera, parameter, PicamValueType_LargeInteger, (piflt)value, settable );
+}
+
+PicamError PIL_CALL Picam_GetParameterFloatingPointValue( PicamHandle camera, PicamParameter parameter, piflt* value )
+{
+	return GetValue( camera, parameter, PicamValueType_FloatingPoint, value );
+}
+
+PicamError PIL_CALL Picam_SetParameterFloatingPointValue( PicamHandle camera, PicamParameter parameter, piflt value )
+{
+	return SetValue( camera, parameter, PicamValueType_FloatingPoint, value, false );
+}
+
+PicamError PIL_CALL Picam_CanSetParameterFloatingPointValue( PicamHandle camera, PicamParameter parameter, piflt value, pibln* settable )
+{
+	return CanSetValue( camera, parameter, PicamValueType_FloatingPoint, value, settable );
+}
+
+PicamError PIL_CALL Picam_DestroyRois( const PicamRois* rois )
+{
+	if( rois )
+	{
+		delete[] rois->roi_array;
+		delete rois;
+	}
+	return PicamError_None;
+}
+
+PicamError PIL_CALL Picam_GetParameterRoisValue( PicamHandle camera, PicamParameter parameter, const PicamRois** value )
+{
+	SimCamera* cam = FindCamera( camera );
+	if( !cam )
+		return PicamError_InvalidHandle;
+	if( parameter != PicamParameter_Rois )
+		return PicamError_ParameterHasInvalidValueType;
+	if( !value )
+		return PicamError_InvalidPointer;
+	std::lock_guard<std::mutex> guard( cam->lock );
+	*value = CopyRois( cam->rois );
+	return PicamError_None;
+}
+
+PicamError PIL_CALL Picam_CanSetParameterRoisValue( PicamHandle camera, PicamParameter parameter, const PicamRois* value, pibln* settable )
+{
+	SimCamera* cam = FindCamera( camera );
+	if( !cam )
+		return PicamError_InvalidHandle;
+	if( parameter != PicamParameter_Rois )
+		return PicamError_ParameterHasInvalidValueType;
+	if( !value || !settable )
+		return PicamError_InvalidPointer;
+	*settable = AreRoisValid( value->roi_array, value->roi_count );
+	return PicamError_None;
+}
+
+PicamError PIL_CALL Picam_SetParameterRoisValue( PicamHandle camera, PicamParameter parameter, const PicamRois* value )
+{
+	pibln settable;
+	PicamError error = Picam_CanSetParameterRoisValue( camera, parameter, value, &settable );
+	if( error != PicamError_None )
+		return error;
+	if( !settable )
+		return PicamError_InvalidParameterValue;
+	SimCamera* cam = FindCamera( camera );
+	std::lock_guard<std::mutex> guard( cam->lock );
+	cam->rois.assign( value->roi_array, value->roi_array + value->roi_count );
+	return PicamError_None;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Parameter defaults
+////////////////////////////////////////////////////////////////////////////////
+PicamError PIL_CALL Picam_GetParameterIntegerDefaultValue( PicamHandle camera, PicamParameter parameter, piint* value )
+{
+	piflt v;
+	PicamError error = GetDefault( camera, parameter, PicamValueType_Integer, &v );
+	if( error == PicamError_None && value )
+		*value = (piint)v;
+	return error;
+}
+
+PicamError PIL_CALL Picam_GetParameterLargeIntegerDefaultValue( PicamHandle camera, PicamParameter parameter, pi64s* value )
+{
+	piflt v;
+	PicamError error = GetDefault( camera, parameter, PicamValueType_LargeInteger, &v );
+	if( error == PicamError_None && value )
+		*value = (pi64s)v;
+	return error;
+}
+
+PicamError PIL_CALL Picam_GetParameterFloatingPointDefaultValue( PicamHandle camera, PicamParameter parameter, piflt* value )
+{
+	return GetDefault( camera, parameter, PicamValueType_FloatingPoint, value );
+}
+
+PicamError PIL_CALL Picam_GetParameterRoisDefaultValue( PicamHandle camera, PicamParameter parameter, const PicamRois** value )
+{
+	if( !FindCamera( camera ) )
+		return PicamError_InvalidHandle;
+	if( parameter != PicamParameter_Rois )
+		return PicamError_ParameterHasInvalidValueType;
+	if( !value )
+		return PicamError_InvalidPointer;
+	PicamRoi full = { 0, SensorWidth, 1, 0, SensorHeight, 1 };
+	*value = CopyRois( std::vector<PicamRoi>( 1, full ) );
+	return PicamError_None;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Parameter online and hardware access
+////////////////////////////////////////////////////////////////////////////////
+PicamError PIL_CALL Picam_CanSetParameterOnline( PicamHandle camera, PicamParameter parameter, pibln* onlineable )
+{
+	SimCamera* cam = FindCamera( camera );
+	const ParamInfo* info;
+	PicamError error = CheckParameter( cam, parameter, &info );
+	if( error != PicamError_None )
+		return error;
+	if( !onlineable )
+		return PicamError_InvalidPointer;
+	*onlineable = info->onlineable;
+	return PicamError_None;
+}
+
+PicamError PIL_CALL Picam_SetParameterIntegerValueOnline( PicamHandle camera, PicamParameter parameter, piint value )
+{
+	return SetValue( camera, parameter, PicamValueType_Integer, value, true );
+}
+
+PicamError PIL_CALL Picam_SetParameterFloatingPointValueOnline( PicamHandle camera, PicamParameter parameter, piflt value )
+{
+	return SetValue( camera, parameter, PicamValueType_FloatingPoint, value, true );
+}
+
+PicamError PIL_CALL Picam_CanReadParameter( PicamHandle camera, PicamParameter parameter, pibln* readable )
+{
+	SimCamera* cam = FindCamera( camera );
+	const ParamInfo* info;
+	PicamError error = CheckParameter( cam, parameter, &info );
+	if( error != PicamError_None )
+		return error;
+	if( !readable )
+		return PicamError_InvalidPointer;
+	*readable = info->readable;
+	return PicamError_None;
+}
+
+PicamError PIL_CALL Picam_ReadParameterIntegerValue( PicamHandle camera, PicamParameter parameter, piint* value )
+{
+	piflt v;
+	PicamError error = ReadValue( camera, parameter, PicamValueType_Integer, &v );
+	if( error == PicamError_None && value )
+		*value = (piint)v;
+	return error;
+}
+
+PicamError PIL_CALL Picam_ReadParameterFloatingPointValue( PicamHandle camera, PicamParameter parameter, piflt* value )
+{
+	return ReadValue( camera, parameter, PicamValueType_FloatingPoint, value );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Parameter characteristics
+////////////////////////////////////////////////////////////////////////////////
+PicamError PIL_CALL Picam_DestroyParameters( const PicamParameter* parameter_array )
+{
+	delete[] parameter_array;
+	return PicamError_None;
+}
+
+PicamError PIL_CALL Picam_GetParameters( PicamHandle camera, const PicamParameter** parameter_array, piint* parameter_count )
+{
+	if( !FindCamera( camera ) )
+		return PicamError_InvalidHandle;
+	if( !parameter_array || !parameter_count )
+		return PicamError_InvalidPointer;
+	const std::vector<ParamInfo>& table = ParamTable();
+	PicamParameter* parameters = new PicamParameter[table.size() + 1];
+	for( size_t i = 0; i < table.size(); ++i )
+		parameters[i] = table[i].parameter;
+	parameters[table.size()] = PicamParameter_Rois;
+	*parameter_array = parameters;
+	*parameter_count = (piint)table.size() + 1;
+	return PicamError_None;
+}
+
+PicamError PIL_CALL Picam_DoesParameterExist( PicamHandle camera, PicamParameter parameter, pibln* exists )
+{
+	if( !FindCamera( camera ) )
+		return PicamError_InvalidHandle;
+	if( !exists )
+		return PicamError_InvalidPointer;
+	*exists = parameter == PicamParameter_Rois || FindParam( parameter ) != 0;
+	return PicamError_None;
+}
+
+PicamError PIL_CALL Picam_IsParameterRelevant( PicamHandle camera, PicamParameter parameter, pibln* relevant )
+{
+	SimCamera* cam = FindCamera( camera );
+	if( !cam )
+		return PicamError_InvalidHandle;
+	if( !relevant )
+		return PicamError_InvalidPointer;
+	std::lock_guard<std::mutex> guard( cam->lock );
+	*relevant = parameter != PicamParameter_KineticsWindowHeight ||
+	            Get( cam->values, PicamParameter_ReadoutControlMode ) == PicamReadoutControlMode_Kinetics;
+	return PicamError_None;
+}
+
+PicamError PIL_CALL Picam_GetParameterValueType( PicamHandle camera, PicamParameter parameter, PicamValueType* type )
+{
+	if( !FindCamera( camera ) )
+		return PicamError_InvalidHandle;
+	if( !type )
+		return PicamError_InvalidPointer;
+	*type = ValueTypeOf( parameter );
+	return PicamError_None;
+}
+
+PicamError PIL_CALL Picam_GetParameterValueAccess( PicamHandle camera, PicamParameter parameter, PicamValueAccess* access )
+{
+	SimCamera* cam = FindCamera( camera );
+	if( !cam )
+		return PicamError_InvalidHandle;
+	if( !access )
+		return PicamError_InvalidPointer;
+	if( parameter == PicamParameter_Rois )
+	{
+		*access = PicamValueAccess_ReadWrite;
+		return PicamError_None;
+	}
+	const ParamInfo* info;
+	PicamError error = CheckParameter( cam, parameter, &info );
+	if( error != PicamError_None )
+		return error;
+	*access = info->readOnly ? PicamValueAccess_ReadOnly : PicamValueAccess_ReadWrite;
+	return PicamError_None;
+}
+
+PicamError PIL_CALL Picam_GetParameterConstraintType( PicamHandle camera, PicamParameter parameter, PicamConstraintType* type )
+{
+	if( !FindCamera( camera ) )
+		return PicamError_InvalidHandle;
+	if( !type )
+		return PicamError_InvalidPointer;
+	*type = ConstraintTypeOf( parameter );
+	return PicamError_None;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Parameter constraints
+////////////////////////////////////////////////////////////////////////////////
+PicamError PIL_CALL Picam_DestroyCollectionConstraints( const PicamCollectionConstraint* constraint_array )
+{
+	if( constraint_array )
+	{
+		delete[] constraint_array->values_array;
+		delete constraint_array;
+	}
+	return PicamError_None;
+}
+
+PicamError PIL_CALL Picam_GetParameterCollectionConstraint( PicamHandle camera, PicamParameter parameter, PicamConstraintCategory category, const PicamCollectionConstraint** constraint )
+{
+	SimCamera* cam = FindCamera( camera );
+	const ParamInfo* info;
+	PicamError error = CheckParameter( cam, parameter, &info );
+	if( error != PicamError_None )
+		return error;
+	if( !constraint )
+		return PicamError_InvalidPointer;
+	if( category < PicamConstraintCategory_Capable || category > PicamConstraintCategory_Recommended )
+		return PicamError_InvalidConstraintCategory;
+	if( ConstraintTypeOf( parameter ) != PicamConstraintType_Collection )
+		return PicamError_ParameterHasInvalidConstraintType;
+	PicamCollectionConstraint* c = new PicamCollectionConstraint;
+	c->scope = PicamConstraintScope_Independent;
+	c->severity = PicamConstraintSeverity_Error;
+	piflt* values = new piflt[info->collection.size()];
+	std::copy( info->collection.begin(), info->collection.end(), values );
+	c->values_array = values;
+	c->values_count = (piint)info->collection.size();
+	*constraint = c;
+	return PicamError_None;
+}
+
+PicamError PIL_CALL Picam_DestroyRangeConstraints( const PicamRangeConstraint* constraint_array )
+{
+	delete constraint_array;
+	return PicamError_None;
+}
+
+PicamError PIL_CALL Picam_GetParameterRangeConstraint( PicamHandle camera, PicamParameter parameter, PicamConstraintCategory category, const PicamRangeConstraint** constraint )
+{
+	SimCamera* cam = FindCamera( camera );
+	const ParamInfo* info;
+	PicamError error = CheckParameter( cam, parameter, &info );
+	if( error != PicamError_None )
+		return error;
+	if( !constraint )
+		return PicamError_InvalidPointer;
+	if( category < PicamConstraintCategory_Capable || category > PicamConstraintCategory_Recommended )
+		return PicamError_InvalidConstraintCategory;
+	if( ConstraintTypeOf( parameter ) != PicamConstraintType_Range )
+		return PicamError_ParameterHasInvalidConstraintType;
+	*constraint = new PicamRangeConstraint( MakeRange( info->minimum, info->maximum, info->increment ) );
+	return PicamError_None;
+}
+
+PicamError PIL_CALL Picam_DestroyRoisConstraints( const PicamRoisConstraint* constraint_array )
+{
+	if( constraint_array )
+	{
+		delete[] constraint_array->x_binning_limits_array;
+		delete[] constraint_array->y_binning_limits_array;
+		delete constraint_array;
+	}
+	return PicamError_None;
+}
+
+PicamError PIL_CALL Picam_GetParameterRoisConstraint( PicamHandle camera, PicamParameter parameter, PicamConstraintCategory category, const PicamRoisConstraint** constraint )
+{
+	if( !FindCamera( camera ) )
+		return PicamError_InvalidHandle;
+	if( parameter != PicamParameter_Rois )
+		return PicamError_ParameterHasInvalidConstraintType;
+	if( !constraint )
+		return PicamError_InvalidPointer;
+	if( category < PicamConstraintCategory_Capable || category > PicamConstraintCategory_Recommended )
+		return PicamError_InvalidConstraintCategory;
+	PicamRoisConstraint* c = new PicamRoisConstraint;
+	c->scope = PicamConstraintScope_Independent;
+	c->severity = PicamConstraintSeverity_Error;
+	c->empty_set = false;
+	c->rules = (PicamRoisConstraintRulesMask)( PicamRoisConstraintRulesMask_XBinningAlignment |
+	                                           PicamRoisConstraintRulesMask_YBinningAlignment );
+	c->maximum_roi_count = MaximumRoiCount;
+	c->x_constraint = MakeRange( 0, SensorWidth - 1, 1 );
+	c->width_constraint = MakeRange( 1, SensorWidth, 1 );
+	c->y_constraint = MakeRange( 0, SensorHeight - 1, 1 );
+	c->height_constraint = MakeRange( 1, SensorHeight, 1 );
+	piint* x = new piint[BinningLimitCount];
+	piint* y = new piint[BinningLimitCount];
+	std::copy( BinningLimits, BinningLimits + BinningLimitCount, x );
+	std::copy( BinningLimits, BinningLimits + BinningLimitCount, y );
+	c->x_binning_limits_array = x;
+	c->x_binning_limits_count = BinningLimitCount;
+	c->y_binning_limits_array = y;
+	c->y_binning_limits_count = BinningLimitCount;
+	*constraint = c;
+	return PicamError_None;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Commitment
+////////////////////////////////////////////////////////////////////////////////
+PicamError PIL_CALL Picam_AreParametersCommitted( PicamHandle camera, pibln* committed )
+{
+	SimCamera* cam = FindCamera( camera );
+	if( !cam )
+		return PicamError_InvalidHandle;
+	if( !committed )
+		return PicamError_InvalidPointer;
+	std::lock_guard<std::mutex> guard( cam->lock );
+	*committed = cam->values == cam->committed && SameRois( cam->rois, cam->committedRois );
+	return PicamError_None;
+}
+
+PicamError PIL_CALL Picam_CommitParameters( PicamHandle camera, const PicamParameter** failed_parameter_array, piint* failed_parameter_count )
+{
+	SimCamera* cam = FindCamera( camera );
+	if( !cam )
+		return PicamError_InvalidHandle;
+	if( !failed_parameter_array || !failed_parameter_count )
+		return PicamError_InvalidPointer;
+	std::lock_guard<std::mutex> guard( cam->lock );
+	*failed_parameter_array = 0;
+	*failed_parameter_count = 0;
+	if( cam->running )
+		return PicamError_AcquisitionInProgress;
+
+	/* dependent rules: kinetics reads a single region through a window
+	   that must be a whole number of binned rows */
+	std::vector<PicamParameter> failed;
+	if( Get( cam->values, PicamParameter_ReadoutControlMode ) == PicamReadoutControlMode_Kinetics )
+	{
+		if( cam->rois.size() != 1 )
+			failed.push_back( PicamParameter_Rois );
+		else if( (piint)Get( cam->values, PicamParameter_KineticsWindowHeight ) % cam->rois[0].y_binning )
+			failed.push_back( PicamParameter_KineticsWindowHeight );
+	}
+	if( !failed.empty() )
+	{
+		PicamParameter* list = new PicamParameter[failed.size()];
+		std::copy( failed.begin(), failed.end(), list );
+		*failed_parameter_array = list;
+		*failed_parameter_count = (piint)failed.size();
+		return PicamError_InvalidParameterValues;
+	}
+
+	cam->committed = cam->values;
+	cam->committedRois = cam->rois;
+	return PicamError_None;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Acquisition
+////////////////////////////////////////////////////////////////////////////////
+PicamError PIL_CALL Picam_StartAcquisition( PicamHandle camera )
+{
+	SimCamera* cam = FindCamera( camera );
+	if( !cam )
+		return PicamError_InvalidHandle;
+	std::unique_lock<std::mutex> guard( cam->lock );
+	return StartLocked( cam, (pi64s)Get( cam->committed, PicamParameter_ReadoutCount ), false, guard );
+}
+
+PicamError PIL_CALL Picam_StopAcquisition( PicamHandle camera )
+{
+	SimCamera* cam = FindCamera( camera );
+	if( !cam )
+		return PicamError_InvalidHandle;
+	std::lock_guard<std::mutex> guard( cam->lock );
+	if( !cam->running )
+		return PicamError_AcquisitionNotInProgress;
+	cam->stopRequested = true;
+	cam->updated.notify_all();
+	return PicamError_None;
+}
+
+PicamError PIL_CALL Picam_IsAcquisitionRunning( PicamHandle camera, pibln* running )
+{
+	SimCamera* cam = FindCamera( camera );
+	if( !cam )
+		return PicamError_InvalidHandle;
+	if( !running )
+		return PicamError_InvalidPointer;
+	std::lock_guard<std::mutex> guard( cam->lock );
+	*running = cam->running;
+	return PicamError_None;
+}
+
+PicamError PIL_CALL Picam_WaitForAcquisitionUpdate( PicamHandle camera, piint readout_time_out, PicamAvailableData* available, PicamAcquisitionStatus* status )
+{
+	SimCamera* cam = FindCamera( camera );
+	if( !cam )
+		return PicamError_InvalidHandle;
+	if( !available || !status )
+		return PicamError_InvalidPointer;
+	std::unique_lock<std::mutex> guard( cam->lock );
+
+	/* data handed out by the previous call may now be overwritten */
+	cam->released = cam->consumed;
+
+	SimClock::time_point due = SimClock::now() + std::chrono::milliseconds( readout_time_out );
+	while( cam->running && cam->produced == cam->consumed )
+	{
+		if( readout_time_out < 0 )
+			cam->updated.wait( guard );
+		else if( cam->updated.wait_until( guard, due ) == std::cv_status::timeout && cam->produced == cam->consumed )
+		{
+			available->initial_readout = 0;
+			available->readout_count = 0;
+			status->running = true;
+			status->errors = PicamAcquisitionErrorsMask_None;
+			status->readout_rate = 0;
+			return PicamError_TimeOutOccurred;
+		}
+	}
+
+	pi64s first = cam->consumed % std::max<pi64s>( 1, cam->capacity );
+	pi64s count = std::min( cam->produced - cam->consumed, cam->capacity - first );
+	available->initial_readout = count > 0 ? cam->buffer + first * cam->layout.readoutStride : 0;
+	available->readout_count = count;
+	cam->consumed += count;
+
+	piflt elapsed = std::chrono::duration<piflt>( SimClock::now() - cam->startTime ).count();
+	status->running = cam->running || cam->produced > cam->consumed;
+	status->errors = (PicamAcquisitionErrorsMask)cam->errors;
+	status->readout_rate = elapsed > 0 ? cam->produced / elapsed : 0;
+	cam->errors = 0;
+	return PicamError_None;
+}
+
+PicamError PIL_CALL Picam_Acquire( PicamHandle camera, pi64s readout_count, piint readout_time_out, PicamAvailableData* available, PicamAcquisitionErrorsMask* errors )
+{
+	SimCamera* cam = FindCamera( camera );
+	if( !cam )
+		return PicamError_InvalidHandle;
+	if( !available || !errors )
+		return PicamError_InvalidPointer;
+	if( readout_count < 1 )
+		return PicamError_InvalidReadoutCount;
+
+	/* the whole run lands in one library-owned buffer */
+	std::unique_lock<std::mutex> guard( cam->lock );
+	PicamError error = StartLocked( cam, readout_count, true, guard );
+	if( error != PicamError_None )
+		return error;
+	pi64s seen = 0;
+	while( cam->running )
+	{
+		if( readout_time_out < 0 )
+			cam->updated.wait( guard );
+		else if( cam->updated.wait_for( guard, std::chrono::milliseconds( readout_time_out ) ) == std::cv_status::timeout &&
+		         cam->produced == seen )
+		{
+			cam->stopRequested = true;
+			cam->updated.notify_all();
+			guard.unlock();
+			JoinWorker( cam );
+			return PicamError_TimeOutOccurred;
+		}
+		seen = cam->produced;
+	}
+	available->initial_readout = cam->buffer;
+	available->readout_count = cam->produced;
+	*errors = (PicamAcquisitionErrorsMask)cam->errors;
+	cam->consumed = cam->released = cam->produced;
+	cam->errors = 0;
+	return PicamError_None;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Advanced
+////////////////////////////////////////////////////////////////////////////////
+PicamError PIL_CALL PicamAdvanced_GetCameraDevice( PicamHandle camera, PicamHandle* device )
+{
+	if( !FindCamera( camera ) )
+		return PicamError_InvalidHandle;
+	if( !device )
+		return PicamError_InvalidPointer;
+	*device = camera;
+	return PicamError_None;
+}
+
+PicamError PIL_CALL PicamAdvanced_GetAcquisitionBuffer( PicamHandle device, PicamAcquisitionBuffer* buffer )
+{
+	SimCamera* cam = FindCamera( device );
+	if( !cam )
+		return PicamError_InvalidHandle;
+	if( !buffer )
+		return PicamError_InvalidPointer;
+	std::lock_guard<std::mutex> guard( cam->lock );
+	*buffer = cam->userBuffer;
+	return PicamError_None;
+}
+
+PicamError PIL_CALL PicamAdvanced_SetAcquisitionBuffer( PicamHandle device, const PicamAcquisitionBuffer* buffer )
+{
+	SimCamera* cam = FindCamera( device );
+	if( !cam )
+		return PicamError_InvalidHandle;
+	std::lock_guard<std::mutex> guard( cam->lock );
+	if( cam->running )
+		return PicamError_AcquisitionInProgress;
+	if( buffer && ( ( buffer->memory == 0 ) != ( buffer->memory_size == 0 ) || buffer->memory_size < 0 ) )
+		return PicamError_InvalidAcquisitionBuffer;
+	if( buffer )
+		cam->userBuffer = *buffer;
+	else
+	{
+		cam->userBuffer.memory = 0;
+		cam->userBuffer.memory_size = 0;
+	}
+	return PicamError_None;
+}
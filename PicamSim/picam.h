@@ -0,0 +1,451 @@
+////////////////////////////////////////////////////////////////////////////////
+// PICAM Stand-in
+// - declares the subset of the Princeton Instruments PICAM API that
+//   ConfigAndCapture uses, with the same names, types and values as picam.h
+// - lets the tool be built and exercised on Linux with no camera or SDK
+// - the implementation (a synthetic PIXIS-like camera) is in PicamSim.cpp
+// - on the rig, build against the real SDK headers instead of this directory
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef PICAM_SIM_PICAM_H
+#define PICAM_SIM_PICAM_H
+
+#define PIL_CALL
+
+/* Basic types */
+typedef int                piint;
+typedef double             piflt;
+typedef bool               pibln;
+typedef char               pichar;
+typedef unsigned char      pibyte;
+typedef long long          pi64s;
+typedef void*              PicamHandle;
+
+/* Errors */
+typedef enum PicamError
+{
+	PicamError_None                              =  0,
+	PicamError_UnexpectedError                   =  4,
+	PicamError_UnexpectedNullPointer             =  3,
+	PicamError_InvalidPointer                    = 35,
+	PicamError_InvalidCount                      = 39,
+	PicamError_InvalidOperation                  = 42,
+	PicamError_OperationCanceled                 = 43,
+	PicamError_LibraryNotInitialized             =  1,
+	PicamError_LibraryAlreadyInitialized         =  5,
+	PicamError_InvalidEnumeratedType             = 16,
+	PicamError_EnumerationValueNotDefined        = 17,
+	PicamError_NoCamerasAvailable                = 34,
+	PicamError_CameraAlreadyOpened               =  7,
+	PicamError_InvalidCameraID                   =  8,
+	PicamError_InvalidHandle                     =  9,
+	PicamError_DeviceCommunicationFailed         = 15,
+	PicamError_DeviceDisconnected                = 23,
+	PicamError_DeviceOpenElsewhere               = 24,
+	PicamError_InvalidDemoModel                  =  6,
+	PicamError_InvalidDemoSerialNumber           = 21,
+	PicamError_DemoAlreadyConnected              = 22,
+	PicamError_ParameterHasInvalidValueType      = 11,
+	PicamError_ParameterHasInvalidConstraintType = 13,
+	PicamError_ParameterDoesNotExist             = 12,
+	PicamError_ParameterValueIsReadOnly          = 10,
+	PicamError_InvalidParameterValue             =  2,
+	PicamError_InvalidConstraintCategory         = 38,
+	PicamError_ParameterValueIsIrrelevant        = 14,
+	PicamError_ParameterIsNotOnlineable          = 25,
+	PicamError_ParameterIsNotReadable            = 26,
+	PicamError_InvalidParameterValues            = 28,
+	PicamError_ParametersNotCommitted            = 29,
+	PicamError_InvalidAcquisitionBuffer          = 30,
+	PicamError_InvalidReadoutCount               = 36,
+	PicamError_InvalidAcquisitionState           = 37,
+	PicamError_InsufficientMemory                = 31,
+	PicamError_AcquisitionInProgress             = 20,
+	PicamError_AcquisitionNotInProgress          = 27,
+	PicamError_TimeOutOccurred                   = 32
+} PicamError;
+
+/* Enumerated types known to Picam_GetEnumerationString */
+typedef enum PicamEnumeratedType
+{
+	PicamEnumeratedType_Error                   =  1,
+	PicamEnumeratedType_Model                   =  2,
+	PicamEnumeratedType_ComputerInterface       =  3,
+	PicamEnumeratedType_ValueType               =  4,
+	PicamEnumeratedType_ConstraintType          =  5,
+	PicamEnumeratedType_Parameter               =  6,
+	PicamEnumeratedType_AdcAnalogGain           =  7,
+	PicamEnumeratedType_AdcQuality              =  8,
+	PicamEnumeratedType_PixelFormat             = 14,
+	PicamEnumeratedType_ReadoutControlMode      = 15,
+	PicamEnumeratedType_SensorTemperatureStatus = 16,
+	PicamEnumeratedType_TimeStampsMask          = 19,
+	PicamEnumeratedType_TriggerDetermination    = 21,
+	PicamEnumeratedType_TriggerResponse         = 22,
+	PicamEnumeratedType_ValueAccess             = 28,
+	PicamEnumeratedType_ConstraintCategory      = 32,
+	PicamEnumeratedType_RoisConstraintRulesMask = 33,
+	PicamEnumeratedType_AcquisitionErrorsMask   = 35
+} PicamEnumeratedType;
+
+/* Camera identity */
+typedef enum PicamModel
+{
+	PicamModel_PixisSeries     =  0,
+	PicamModel_Pixis1024Series = 18,
+	PicamModel_Pixis1024F      = 19,
+	PicamModel_Pixis1024B      = 20,
+	PicamModel_Pixis1024BR     = 21,
+	PicamModel_Pixis1024BUV    = 22
+} PicamModel;
+
+typedef enum PicamComputerInterface
+{
+	PicamComputerInterface_Usb2            = 1,
+	PicamComputerInterface_1394A           = 2,
+	PicamComputerInterface_GigabitEthernet = 3
+} PicamComputerInterface;
+
+typedef enum PicamStringSize
+{
+	PicamStringSize_SensorName     =  64,
+	PicamStringSize_SerialNumber   =  64,
+	PicamStringSize_FirmwareName   =  64,
+	PicamStringSize_FirmwareDetail = 256
+} PicamStringSize;
+
+typedef struct PicamCameraID
+{
+	PicamModel             model;
+	PicamComputerInterface computer_interface;
+	pichar                 sensor_name[PicamStringSize_SensorName];
+	pichar                 serial_number[PicamStringSize_SerialNumber];
+} PicamCameraID;
+
+typedef struct PicamFirmwareDetail
+{
+	pichar name[PicamStringSize_FirmwareName];
+	pichar detail[PicamStringSize_FirmwareDetail];
+} PicamFirmwareDetail;
+
+/* Parameter values */
+typedef enum PicamValueType
+{
+	PicamValueType_Integer       = 1,
+	PicamValueType_FloatingPoint = 2,
+	PicamValueType_Boolean       = 3,
+	PicamValueType_Enumeration   = 4,
+	PicamValueType_Rois          = 5,
+	PicamValueType_LargeInteger  = 6
+} PicamValueType;
+
+typedef enum PicamConstraintType
+{
+	PicamConstraintType_None       = 1,
+	PicamConstraintType_Range      = 2,
+	PicamConstraintType_Collection = 3,
+	PicamConstraintType_Rois       = 4
+} PicamConstraintType;
+
+#define PICAM_PARAMETER( id, value_type, constraint_type ) \
+	(((PicamConstraintType_##constraint_type)<<24)+        \
+	 ((PicamValueType_##value_type)<<16)+                  \
+	 (id))
+
+typedef enum PicamParameter
+{
+	PicamParameter_ExposureTime                 = PICAM_PARAMETER( 23, FloatingPoint, Range      ),
+	PicamParameter_CleanSectionFinalHeight      = PICAM_PARAMETER( 17, Integer,       Range      ),
+	PicamParameter_CleanSectionFinalHeightCount = PICAM_PARAMETER( 18, Integer,       Range      ),
+	PicamParameter_CleanCycleCount              = PICAM_PARAMETER( 19, Integer,       Range      ),
+	PicamParameter_CleanCycleHeight             = PICAM_PARAMETER( 20, Integer,       Range      ),
+	PicamParameter_CleanUntilTrigger            = PICAM_PARAMETER( 22, Boolean,       Collection ),
+	PicamParameter_SensorTemperatureSetPoint    = PICAM_PARAMETER( 14, FloatingPoint, Range      ),
+	PicamParameter_SensorTemperatureReading     = PICAM_PARAMETER( 15, FloatingPoint, None       ),
+	PicamParameter_SensorTemperatureStatus      = PICAM_PARAMETER( 16, Enumeration,   None       ),
+	PicamParameter_ReadoutControlMode           = PICAM_PARAMETER( 26, Enumeration,   Collection ),
+	PicamParameter_ReadoutTimeCalculation       = PICAM_PARAMETER( 27, FloatingPoint, None       ),
+	PicamParameter_TriggerResponse              = PICAM_PARAMETER( 30, Enumeration,   Collection ),
+	PicamParameter_TriggerDetermination         = PICAM_PARAMETER( 31, Enumeration,   Collection ),
+	PicamParameter_AdcSpeed                     = PICAM_PARAMETER( 33, FloatingPoint, Collection ),
+	PicamParameter_AdcBitDepth                  = PICAM_PARAMETER( 34, Integer,       Collection ),
+	PicamParameter_AdcAnalogGain                = PICAM_PARAMETER( 35, Enumeration,   Collection ),
+	PicamParameter_AdcQuality                   = PICAM_PARAMETER( 36, Enumeration,   Collection ),
+	PicamParameter_Rois                         = PICAM_PARAMETER( 37, Rois,          Rois       ),
+	PicamParameter_ReadoutCount                 = PICAM_PARAMETER( 40, LargeInteger,  Range      ),
+	PicamParameter_PixelFormat                  = PICAM_PARAMETER( 41, Enumeration,   Collection ),
+	PicamParameter_FrameSize                    = PICAM_PARAMETER( 42, Integer,       None       ),
+	PicamParameter_FrameStride                  = PICAM_PARAMETER( 43, Integer,       None       ),
+	PicamParameter_FramesPerReadout             = PICAM_PARAMETER( 44, Integer,       None       ),
+	PicamParameter_ReadoutStride                = PICAM_PARAMETER( 45, Integer,       None       ),
+	PicamParameter_PixelBitDepth                = PICAM_PARAMETER( 48, Integer,       None       ),
+	PicamParameter_ReadoutRateCalculation       = PICAM_PARAMETER( 50, FloatingPoint, None       ),
+	PicamParameter_FrameRateCalculation         = PICAM_PARAMETER( 51, FloatingPoint, None       ),
+	PicamParameter_KineticsWindowHeight         = PICAM_PARAMETER( 56, Integer,       Range      ),
+	PicamParameter_SensorActiveWidth            = PICAM_PARAMETER( 59, Integer,       None       ),
+	PicamParameter_SensorActiveHeight           = PICAM_PARAMETER( 60, Integer,       None       ),
+	PicamParameter_TimeStamps                   = PICAM_PARAMETER( 68, Enumeration,   Collection ),
+	PicamParameter_TimeStampResolution          = PICAM_PARAMETER( 69, LargeInteger,  Collection ),
+	PicamParameter_TimeStampBitDepth            = PICAM_PARAMETER( 70, Integer,       Collection ),
+	PicamParameter_TrackFrames                  = PICAM_PARAMETER( 71, Boolean,       Collection ),
+	PicamParameter_FrameTrackingBitDepth        = PICAM_PARAMETER( 72, Integer,       Collection )
+} PicamParameter;
+
+typedef enum PicamAdcAnalogGain
+{
+	PicamAdcAnalogGain_Low    = 1,
+	PicamAdcAnalogGain_Medium = 2,
+	PicamAdcAnalogGain_High   = 3
+} PicamAdcAnalogGain;
+
+typedef enum PicamAdcQuality
+{
+	PicamAdcQuality_LowNoise       = 1,
+	PicamAdcQuality_HighCapacity   = 2
+} PicamAdcQuality;
+
+typedef enum PicamPixelFormat
+{
+	PicamPixelFormat_Monochrome16Bit = 1
+} PicamPixelFormat;
+
+typedef enum PicamReadoutControlMode
+{
+	PicamReadoutControlMode_FullFrame       = 1,
+	PicamReadoutControlMode_FrameTransfer   = 2,
+	PicamReadoutControlMode_Interline       = 5,
+	PicamReadoutControlMode_Kinetics        = 3,
+	PicamReadoutControlMode_SpectraKinetics = 4,
+	PicamReadoutControlMode_Dif             = 6
+} PicamReadoutControlMode;
+
+typedef enum PicamSensorTemperatureStatus
+{
+	PicamSensorTemperatureStatus_Unlocked = 1,
+	PicamSensorTemperatureStatus_Locked   = 2
+} PicamSensorTemperatureStatus;
+
+typedef enum PicamTimeStampsMask
+{
+	PicamTimeStampsMask_None            = 0x0,
+	PicamTimeStampsMask_ExposureStarted = 0x1,
+	PicamTimeStampsMask_ExposureEnded   = 0x2
+} PicamTimeStampsMask;
+
+typedef enum PicamTriggerResponse
+{
+	PicamTriggerResponse_NoResponse               = 1,
+	PicamTriggerResponse_ReadoutPerTrigger        = 2,
+	PicamTriggerResponse_ShiftPerTrigger          = 3,
+	PicamTriggerResponse_ExposeDuringTriggerPulse = 4,
+	PicamTriggerResponse_StartOnSingleTrigger     = 5
+} PicamTriggerResponse;
+
+typedef enum PicamTriggerDetermination
+{
+	PicamTriggerDetermination_PositivePolarity = 1,
+	PicamTriggerDetermination_NegativePolarity = 2,
+	PicamTriggerDetermination_RisingEdge       = 3,
+	PicamTriggerDetermination_FallingEdge      = 4
+} PicamTriggerDetermination;
+
+typedef enum PicamValueAccess
+{
+	PicamValueAccess_ReadOnly         = 1,
+	PicamValueAccess_ReadWriteTrivial = 3,
+	PicamValueAccess_ReadWrite        = 2
+} PicamValueAccess;
+
+/* Constraints */
+typedef enum PicamConstraintScope
+{
+	PicamConstraintScope_Independent = 1,
+	PicamConstraintScope_Dependent   = 2
+} PicamConstraintScope;
+
+typedef enum PicamConstraintSeverity
+{
+	PicamConstraintSeverity_Error   = 1,
+	PicamConstraintSeverity_Warning = 2
+} PicamConstraintSeverity;
+
+typedef enum PicamConstraintCategory
+{
+	PicamConstraintCategory_Capable     = 1,
+	PicamConstraintCategory_Required    = 2,
+	PicamConstraintCategory_Recommended = 3
+} PicamConstraintCategory;
+
+typedef struct PicamRangeConstraint
+{
+	PicamConstraintScope    scope;
+	PicamConstraintSeverity severity;
+	pibln                   empty_set;
+	piflt                   minimum;
+	piflt                   maximum;
+	piflt                   increment;
+	const piflt*            excluded_values_array;
+	piint                   excluded_values_count;
+	const piflt*            outlying_values_array;
+	piint                   outlying_values_count;
+} PicamRangeConstraint;
+
+typedef struct PicamCollectionConstraint
+{
+	PicamConstraintScope    scope;
+	PicamConstraintSeverity severity;
+	const piflt*            values_array;
+	piint                   values_count;
+} PicamCollectionConstraint;
+
+typedef struct PicamRoi
+{
+	piint x;
+	piint width;
+	piint x_binning;
+	piint y;
+	piint height;
+	piint y_binning;
+} PicamRoi;
+
+typedef struct PicamRois
+{
+	PicamRoi* roi_array;
+	piint     roi_count;
+} PicamRois;
+
+typedef enum PicamRoisConstraintRulesMask
+{
+	PicamRoisConstraintRulesMask_None                  = 0x00,
+	PicamRoisConstraintRulesMask_XBinningAlignment     = 0x01,
+	PicamRoisConstraintRulesMask_YBinningAlignment     = 0x02,
+	PicamRoisConstraintRulesMask_HorizontalSymmetry    = 0x04,
+	PicamRoisConstraintRulesMask_VerticalSymmetry      = 0x08,
+	PicamRoisConstraintRulesMask_SymmetryBoundsBinning = 0x10
+} PicamRoisConstraintRulesMask;
+
+typedef struct PicamRoisConstraint
+{
+	PicamConstraintScope         scope;
+	PicamConstraintSeverity      severity;
+	pibln                        empty_set;
+	PicamRoisConstraintRulesMask rules;
+	piint                        maximum_roi_count;
+	PicamRangeConstraint         x_constraint;
+	PicamRangeConstraint         width_constraint;
+	const piint*                 x_binning_limits_array;
+	piint                        x_binning_limits_count;
+	PicamRangeConstraint         y_constraint;
+	PicamRangeConstraint         height_constraint;
+	const piint*                 y_binning_limits_array;
+	piint                        y_binning_limits_count;
+} PicamRoisConstraint;
+
+/* Acquisition */
+typedef struct PicamAvailableData
+{
+	void* initial_readout;
+	pi64s readout_count;
+} PicamAvailableData;
+
+typedef enum PicamAcquisitionErrorsMask
+{
+	PicamAcquisitionErrorsMask_None           = 0x0,
+	PicamAcquisitionErrorsMask_DataLost       = 0x1,
+	PicamAcquisitionErrorsMask_ConnectionLost = 0x2
+} PicamAcquisitionErrorsMask;
+
+typedef struct PicamAcquisitionStatus
+{
+	pibln                      running;
+	PicamAcquisitionErrorsMask errors;
+	piflt                      readout_rate;
+} PicamAcquisitionStatus;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Library */
+PicamError PIL_CALL Picam_IsLibraryInitialized( pibln* inited );
+PicamError PIL_CALL Picam_InitializeLibrary( void );
+PicamError PIL_CALL Picam_UninitializeLibrary( void );
+PicamError PIL_CALL Picam_DestroyString( const pichar* s );
+PicamError PIL_CALL Picam_GetEnumerationString( PicamEnumeratedType type, piint value, const pichar** s );
+
+/* Cameras */
+PicamError PIL_CALL Picam_DestroyCameraIDs( const PicamCameraID* id_array );
+PicamError PIL_CALL Picam_GetAvailableCameraIDs( const PicamCameraID** id_array, piint* id_count );
+PicamError PIL_CALL Picam_GetUnavailableCameraIDs( const PicamCameraID** id_array, piint* id_count );
+PicamError PIL_CALL Picam_DestroyFirmwareDetails( const PicamFirmwareDetail* firmware_array );
+PicamError PIL_CALL Picam_GetFirmwareDetails( const PicamCameraID* id, const PicamFirmwareDetail** firmware_array, piint* firmware_count );
+PicamError PIL_CALL Picam_ConnectDemoCamera( PicamModel model, const pichar* serial_number, PicamCameraID* id );
+PicamError PIL_CALL Picam_DisconnectDemoCamera( const PicamCameraID* id );
+PicamError PIL_CALL Picam_IsDemoCamera( const PicamCameraID* id, pibln* demo );
+PicamError PIL_CALL Picam_OpenFirstCamera( PicamHandle* camera );
+PicamError PIL_CALL Picam_OpenCamera( const PicamCameraID* id, PicamHandle* camera );
+PicamError PIL_CALL Picam_CloseCamera( PicamHandle camera );
+PicamError PIL_CALL Picam_GetCameraID( PicamHandle camera, PicamCameraID* id );
+
+/* Parameter values */
+PicamError PIL_CALL Picam_GetParameterIntegerValue( PicamHandle camera, PicamParameter parameter, piint* value );
+PicamError PIL_CALL Picam_SetParameterIntegerValue( PicamHandle camera, PicamParameter parameter, piint value );
+PicamError PIL_CALL Picam_CanSetParameterIntegerValue( PicamHandle camera, PicamParameter parameter, piint value, pibln* settable );
+PicamError PIL_CALL Picam_GetParameterLargeIntegerValue( PicamHandle camera, PicamParameter parameter, pi64s* value );
+PicamError PIL_CALL Picam_SetParameterLargeIntegerValue( PicamHandle camera, PicamParameter parameter, pi64s value );
+PicamError PIL_CALL Picam_CanSetParameterLargeIntegerValue( PicamHandle camera, PicamParameter parameter, pi64s value, pibln* settable );
+PicamError PIL_CALL Picam_GetParameterFloatingPointValue( PicamHandle camera, PicamParameter parameter, piflt* value );
+PicamError PIL_CALL Picam_SetParameterFloatingPointValue( PicamHandle camera, PicamParameter parameter, piflt value );
+PicamError PIL_CALL Picam_CanSetParameterFloatingPointValue( PicamHandle camera, PicamParameter parameter, piflt value, pibln* settable );
+PicamError PIL_CALL Picam_DestroyRois( const PicamRois* rois );
+PicamError PIL_CALL Picam_GetParameterRoisValue( PicamHandle camera, PicamParameter parameter, const PicamRois** value );
+PicamError PIL_CALL Picam_SetParameterRoisValue( PicamHandle camera, PicamParameter parameter, const PicamRois* value );
+PicamError PIL_CALL Picam_CanSetParameterRoisValue( PicamHandle camera, PicamParameter parameter, const PicamRois* value, pibln* settable );
+
+/* Parameter defaults */
+PicamError PIL_CALL Picam_GetParameterIntegerDefaultValue( PicamHandle camera, PicamParameter parameter, piint* value );
+PicamError PIL_CALL Picam_GetParameterLargeIntegerDefaultValue( PicamHandle camera, PicamParameter parameter, pi64s* value );
+PicamError PIL_CALL Picam_GetParameterFloatingPointDefaultValue( PicamHandle camera, PicamParameter parameter, piflt* value );
+PicamError PIL_CALL Picam_GetParameterRoisDefaultValue( PicamHandle camera, PicamParameter parameter, const PicamRois** value );
+
+/* Parameter online and hardware access */
+PicamError PIL_CALL Picam_CanSetParameterOnline( PicamHandle camera, PicamParameter parameter, pibln* onlineable );
+PicamError PIL_CALL Picam_SetParameterIntegerValueOnline( PicamHandle camera, PicamParameter parameter, piint value );
+PicamError PIL_CALL Picam_SetParameterFloatingPointValueOnline( PicamHandle camera, PicamParameter parameter, piflt value );
+PicamError PIL_CALL Picam_CanReadParameter( PicamHandle camera, PicamParameter parameter, pibln* readable );
+PicamError PIL_CALL Picam_ReadParameterIntegerValue( PicamHandle camera, PicamParameter parameter, piint* value );
+PicamError PIL_CALL Picam_ReadParameterFloatingPointValue( PicamHandle camera, PicamParameter parameter, piflt* value );
+
+/* Parameter characteristics */
+PicamError PIL_CALL Picam_DestroyParameters( const PicamParameter* parameter_array );
+PicamError PIL_CALL Picam_GetParameters( PicamHandle camera, const PicamParameter** parameter_array, piint* parameter_count );
+PicamError PIL_CALL Picam_DoesParameterExist( PicamHandle camera, PicamParameter parameter, pibln* exists );
+PicamError PIL_CALL Picam_IsParameterRelevant( PicamHandle camera, PicamParameter parameter, pibln* relevant );
+PicamError PIL_CALL Picam_GetParameterValueType( PicamHandle camera, PicamParameter parameter, PicamValueType* type );
+PicamError PIL_CALL Picam_GetParameterValueAccess( PicamHandle camera, PicamParameter parameter, PicamValueAccess* access );
+PicamError PIL_CALL Picam_GetParameterConstraintType( PicamHandle camera, PicamParameter parameter, PicamConstraintType* type );
+
+/* Parameter constraints */
+PicamError PIL_CALL Picam_DestroyCollectionConstraints( const PicamCollectionConstraint* constraint_array );
+PicamError PIL_CALL Picam_GetParameterCollectionConstraint( PicamHandle camera, PicamParameter parameter, PicamConstraintCategory category, const PicamCollectionConstraint** constraint );
+PicamError PIL_CALL Picam_DestroyRangeConstraints( const PicamRangeConstraint* constraint_array );
+PicamError PIL_CALL Picam_GetParameterRangeConstraint( PicamHandle camera, PicamParameter parameter, PicamConstraintCategory category, const PicamRangeConstraint** constraint );
+PicamError PIL_CALL Picam_DestroyRoisConstraints( const PicamRoisConstraint* constraint_array );
+PicamError PIL_CALL Picam_GetParameterRoisConstraint( PicamHandle camera, PicamParameter parameter, PicamConstraintCategory category, const PicamRoisConstraint** constraint );
+
+/* Commitment */
+PicamError PIL_CALL Picam_AreParametersCommitted( PicamHandle camera, pibln* committed );
+PicamError PIL_CALL Picam_CommitParameters( PicamHandle camera, const PicamParameter** failed_parameter_array, piint* failed_parameter_count );
+
+/* Acquisition */
+PicamError PIL_CALL Picam_Acquire( PicamHandle camera, pi64s readout_count, piint readout_time_out, PicamAvailableData* available, PicamAcquisitionErrorsMask* errors );
+PicamError PIL_CALL Picam_StartAcquisition( PicamHandle camera );
+PicamError PIL_CALL Picam_StopAcquisition( PicamHandle camera );
+PicamError PIL_CALL Picam_IsAcquisitionRunning( PicamHandle camera, pibln* running );
+PicamError PIL_CALL Picam_WaitForAcquisitionUpdate( PicamHandle camera, piint readout_time_out, PicamAvailableData* available, PicamAcquisitionStatus* status );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
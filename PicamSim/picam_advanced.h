@@ -0,0 +1,30 @@
+////////////////////////////////////////////////////////////////////////////////
+// PICAM Advanced Stand-in
+// - declares the subset of picam_advanced.h used by ConfigAndCapture
+//   (user-allocated acquisition buffers)
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef PICAM_SIM_PICAM_ADVANCED_H
+#define PICAM_SIM_PICAM_ADVANCED_H
+
+#include "picam.h"
+
+typedef struct PicamAcquisitionBuffer
+{
+	void* memory;
+	pi64s memory_size;
+} PicamAcquisitionBuffer;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+PicamError PIL_CALL PicamAdvanced_GetCameraDevice( PicamHandle camera, PicamHandle* device );
+PicamError PIL_CALL PicamAdvanced_GetAcquisitionBuffer( PicamHandle device, PicamAcquisitionBuffer* buffer );
+PicamError PIL_CALL PicamAdvanced_SetAcquisitionBuffer( PicamHandle device, const PicamAcquisitionBuffer* buffer );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
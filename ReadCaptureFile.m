@@ -0,0 +1,255 @@
+function [Frames, Header, Map, Variance] = ReadCaptureFile(FilePath, RoiIndex)
+%%%% Reads a capture file written by ConfigAndCapture.exe.  The header at the
+%%%% start of the file describes the ROIs, bit depth and readout layout, so
+%%%% dx, dy and NFrames do not have to be known in advance.
+%%%% FilePath --- The capture file
+%%%% RoiIndex --- Which ROI to return (default 1)
+%%%% Frames --- rows x columns x frames (uint16; single for captures
+%%%%            corrected with --output-type=float32 or co-added with
+%%%%            --coadd, uint32 for --coadd-mode=sum), one frame per
+%%%%            readout unless the camera packs several frames into a readout
+%%%%            (kinetics: one frame per window)
+%%%% Header --- The header fields, with one Rois entry per ROI and, for
+%%%%           captures taken with --metadata, a Metadata table with one
+%%%%           row per frame (times in ms from the camera's time base)
+%%%%           and, for captures taken with --telemetry, a Telemetry table
+%%%%           with one row per temperature reading (ms from StartTime,
+%%%%           readouts acquired by then, degrees C, locked or not) and,
+%%%%           for --sequence captures, an Exposures table with one row per
+%%%%           frame (frame, exposure in ms, step exposure, step, measured)
+%%%%           and, for --stats captures, a Stats table with one row per
+%%%%           frame (min, max, saturated pixels, mean, std and a 16 bin
+%%%%           histogram of pixel >> HistogramShift) and, for --centroid
+%%%%           captures, a Spots table with one row per spot (frame, spot,
+%%%%           ROI, x and y in sensor pixels, flux, FWHM, background, pixels)
+%%%%           and, with --thumbnails, Thumbnails (size x size x spots).
+%%%%           --centroid-only captures hold no frames
+%%%% Map --- memmapfile over the readouts (Map.Data.Readouts, one column per
+%%%%         readout) for reading part of a long run without loading it all
+%%%% Variance --- for captures co-added with --variance, the per-pixel
+%%%%              variance of each group (single, same size as Frames)
+%%%%
+%%%% The same file can be mapped from numpy with
+%%%%   numpy.memmap(path, dtype='<u2', mode='r', offset=4096, shape=(N, dy, dx))
+%%%% for a single unbinned ROI without frame metadata.
+
+if(nargin < 2)
+    RoiIndex = 1;
+end
+
+FileID = fopen(FilePath, 'r', 'ieee-le');
+if(FileID < 0)
+    error(['Cannot open ' FilePath]);
+end
+Magic = fread(FileID, [1 8], '*char');
+if(~strcmp(Magic, 'PICAPTUR'))
+    fclose(FileID);
+    error([FilePath ' is not a capture file (written with --raw?)']);
+end
+Header.Version = fread(FileID, 1, 'uint32');
+Header.HeaderSize = fread(FileID, 1, 'uint32');
+Header.DataOffset = fread(FileID, 1, 'uint64');
+Header.ReadoutCount = fread(FileID, 1, 'uint64');
+Header.ReadoutStride = fread(FileID, 1, 'uint64');
+Header.FramesPerReadout = fread(FileID, 1, 'uint32');
+Header.FrameSize = fread(FileID, 1, 'uint32');
+Header.FrameStride = fread(FileID, 1, 'uint32');
+Header.PixelBitDepth = fread(FileID, 1, 'uint32');
+Header.PixelFormat = fread(FileID, 1, 'uint32');
+Header.BytesPerPixel = fread(FileID, 1, 'uint32');
+Header.RoiCount = fread(FileID, 1, 'uint32');
+Header.Complete = fread(FileID, 1, 'uint32') ~= 0;
+Header.ExposureTime = fread(FileID, 1, 'double');
+Header.ReadoutTime = fread(FileID, 1, 'double');
+Header.SensorTemperature = fread(FileID, 1, 'double');
+Header.SensorTemperatureSetPoint = fread(FileID, 1, 'double');
+Header.StartTime = fread(FileID, 1, 'int64');
+Header.EndTime = fread(FileID, 1, 'int64');
+Header.CameraModel = fread(FileID, 1, 'int32');
+fread(FileID, 1, 'uint32');
+Header.SerialNumber = deblank(fread(FileID, [1 64], '*char'));
+for kk = 1:Header.RoiCount
+    Roi = fread(FileID, 8, 'uint32');
+    Header.Rois(kk).X = Roi(1);
+    Header.Rois(kk).Width = Roi(2);
+    Header.Rois(kk).XBinning = Roi(3);
+    Header.Rois(kk).Y = Roi(4);
+    Header.Rois(kk).Height = Roi(5);
+    Header.Rois(kk).YBinning = Roi(6);
+    Header.Rois(kk).Columns = Roi(7);
+    Header.Rois(kk).Rows = Roi(8);
+    Header.Rois(kk).Offset = fread(FileID, 1, 'uint64');
+end
+if(Header.Version >= 2)
+    fseek(FileID, 832, 'bof');
+    Header.MetadataOffset = fread(FileID, 1, 'uint64');
+    Header.MetadataCount = fread(FileID, 1, 'uint64');
+    Header.TimeStampResolution = fread(FileID, 1, 'int64');
+    Header.MissingFrames = fread(FileID, 1, 'uint64');
+    Header.LongIntervals = fread(FileID, 1, 'uint64');
+    Corrections = fread(FileID, 1, 'uint32');
+    Header.DarkSubtracted = bitand(Corrections, 1) ~= 0;
+    Header.FlatFielded = bitand(Corrections, 2) ~= 0;
+    fread(FileID, 1, 'uint32');
+    Header.TriggerIntervalMean = fread(FileID, 1, 'double');
+    Header.TriggerIntervalStd = fread(FileID, 1, 'double');
+    Header.TriggerIntervalMin = fread(FileID, 1, 'double');
+    Header.TriggerIntervalMax = fread(FileID, 1, 'double');
+    if(Header.Version >= 4)
+        Header.PixelType = fread(FileID, 1, 'uint32');
+        Header.CoaddCount = fread(FileID, 1, 'uint32');
+        Header.CoaddMode = fread(FileID, 1, 'uint32');
+        Header.VarianceOffset = fread(FileID, 1, 'uint32');
+        Header.ClipSigma = fread(FileID, 1, 'double');
+        Header.ClippedValues = fread(FileID, 1, 'uint64');
+    end
+    if(Header.Version >= 5)
+        Header.Codec = fread(FileID, 1, 'uint32');
+        Header.CodecBlock = fread(FileID, 1, 'uint32');
+        Header.ChunkIndexOffset = fread(FileID, 1, 'uint64');
+        Header.CompressedBytes = fread(FileID, 1, 'uint64');
+    end
+    if(Header.Version >= 6)
+        Header.TelemetryOffset = fread(FileID, 1, 'uint64');
+        Header.TelemetryCount = fread(FileID, 1, 'uint64');
+        Header.TelemetryInterval = fread(FileID, 1, 'double');
+        Header.SensorTemperatureMin = fread(FileID, 1, 'double');
+        Header.SensorTemperatureMax = fread(FileID, 1, 'double');
+        Header.LockWait = fread(FileID, 1, 'double');
+        Header.UnlockedSamples = fread(FileID, 1, 'uint32');
+        fread(FileID, 1, 'uint32');
+    end
+    if(Header.Version >= 7)
+        Header.ExposureTableOffset = fread(FileID, 1, 'uint64');
+        Header.ExposureTableCount = fread(FileID, 1, 'uint64');
+        Header.SequenceSteps = fread(FileID, 1, 'uint32');
+        Header.SequenceOnline = fread(FileID, 1, 'uint32') ~= 0;
+    end
+    if(Header.Version >= 8)
+        ReadoutModes = {'full-frame', 'frame-transfer', 'kinetics'};
+        Header.ReadoutMode = ReadoutModes{fread(FileID, 1, 'uint32')};
+        Header.KineticsWindow = fread(FileID, 1, 'uint32');
+        Header.FrameRatePredicted = fread(FileID, 1, 'double');
+        Header.FrameRateAchieved = fread(FileID, 1, 'double');
+    end
+    if(Header.Version >= 9)
+        Header.StatsOffset = fread(FileID, 1, 'uint64');
+        Header.StatsCount = fread(FileID, 1, 'uint64');
+        Header.SaturationLevel = fread(FileID, 1, 'uint32');
+        Header.HistogramShift = fread(FileID, 1, 'uint32');
+        Header.Aborted = fread(FileID, 1, 'uint32') ~= 0;
+        fread(FileID, 1, 'uint32');
+    end
+    if(Header.Version >= 10)
+        Header.SpotTableOffset = fread(FileID, 1, 'uint64');
+        Header.SpotTableCount = fread(FileID, 1, 'uint64');
+        Header.SpotFrames = fread(FileID, 1, 'uint64');
+        Header.ThumbnailOffset = fread(FileID, 1, 'uint64');
+        Header.ThumbnailSize = fread(FileID, 1, 'uint32');
+        Header.SpotsOnly = fread(FileID, 1, 'uint32') ~= 0;
+        Header.SpotThreshold = fread(FileID, 1, 'double');
+    end
+    if(Header.MetadataOffset > 0 && Header.MetadataCount > 0)
+        fseek(FileID, Header.MetadataOffset, 'bof');
+        Table = double(fread(FileID, [4 Header.MetadataCount], '*int64'))';
+        Ticks = 1000 / Header.TimeStampResolution;
+        Header.Metadata.Index = Table(:, 1);
+        Header.Metadata.ExposureStart = Table(:, 2) * Ticks;
+        Header.Metadata.ExposureEnd = Table(:, 3) * Ticks;
+        Header.Metadata.Tracking = Table(:, 4);
+    end
+    if(isfield(Header, 'ExposureTableOffset') && Header.ExposureTableOffset > 0 && Header.ExposureTableCount > 0)
+        fseek(FileID, Header.ExposureTableOffset, 'bof');
+        Table = fread(FileID, [4 Header.ExposureTableCount], '*uint64')';
+        Header.Exposures.Frame = double(Table(:, 1)) + 1;
+        Header.Exposures.Exposure = typecast(Table(:, 2), 'double');
+        Header.Exposures.Requested = typecast(Table(:, 3), 'double');
+        Header.Exposures.Step = double(bitand(Table(:, 4), 4294967295)) + 1;
+        Header.Exposures.Measured = bitshift(Table(:, 4), -32) ~= 0;
+    end
+    if(isfield(Header, 'StatsOffset') && Header.StatsOffset > 0 && Header.StatsCount > 0)
+        fseek(FileID, Header.StatsOffset, 'bof');
+        Table = fread(FileID, [24 Header.StatsCount], '*uint32')';
+        Header.Stats.Frame = double(Table(:, 1)) + double(Table(:, 2)) * 2^32 + 1;
+        Header.Stats.Min = double(bitand(Table(:, 3), 65535));
+        Header.Stats.Max = double(bitshift(Table(:, 3), -16));
+        Header.Stats.Saturated = double(Table(:, 4));
+        Header.Stats.Mean = typecast(reshape(Table(:, 5:6)', [], 1), 'double');
+        Header.Stats.Std = typecast(reshape(Table(:, 7:8)', [], 1), 'double');
+        Header.Stats.Histogram = double(Table(:, 9:24));
+    end
+    if(isfield(Header, 'SpotTableOffset') && Header.SpotTableOffset > 0 && Header.SpotTableCount > 0)
+        fseek(FileID, Header.SpotTableOffset, 'bof');
+        Table = fread(FileID, [16 Header.SpotTableCount], '*uint32')';
+        Values = reshape(typecast(reshape(Table(:, 5:14)', [], 1), 'double'), 5, [])';
+        Header.Spots.Frame = double(Table(:, 1)) + double(Table(:, 2)) * 2^32 + 1;
+        Header.Spots.Spot = double(Table(:, 3)) + 1;
+        Header.Spots.Roi = double(Table(:, 4)) + 1;
+        Header.Spots.X = Values(:, 1);
+        Header.Spots.Y = Values(:, 2);
+        Header.Spots.Flux = Values(:, 3);
+        Header.Spots.FWHM = Values(:, 4);
+        Header.Spots.Background = Values(:, 5);
+        Header.Spots.Pixels = double(Table(:, 15));
+        if(Header.ThumbnailOffset > 0)
+            fseek(FileID, Header.ThumbnailOffset, 'bof');
+            Thumbnails = fread(FileID, Header.ThumbnailSize^2 * Header.SpotTableCount, '*uint16');
+            Header.Thumbnails = permute(reshape(Thumbnails, Header.ThumbnailSize, Header.ThumbnailSize, []), [2 1 3]);
+        end
+    end
+    if(isfield(Header, 'TelemetryOffset') && Header.TelemetryOffset > 0 && Header.TelemetryCount > 0)
+        fseek(FileID, Header.TelemetryOffset, 'bof');
+        Table = fread(FileID, [4 Header.TelemetryCount], '*uint64')';
+        Header.Telemetry.Time = double(typecast(Table(:, 1), 'int64') - Header.StartTime) / 1000;
+        Header.Telemetry.Readouts = double(Table(:, 2));
+        Header.Telemetry.Temperature = typecast(Table(:, 3), 'double');
+        Header.Telemetry.Locked = bitand(Table(:, 4), 4294967295) == 2;
+    end
+end
+fclose(FileID);
+
+if(isfield(Header, 'Codec') && Header.Codec ~= 0)
+    error([FilePath ' is compressed; write an uncompressed copy with ConfigAndCapture.exe --decompress=' FilePath]);
+end
+if(~Header.Complete)
+    warning(['Only ' int2str(Header.ReadoutCount) ' readouts of ' FilePath ' were captured']);
+end
+% Corrected and co-added captures hold float32 (or uint32) pixels
+if(isfield(Header, 'PixelType'))
+    PixelTypes = {'uint16', 'single', 'uint32'};
+    PixelType = PixelTypes{Header.PixelType + 1};
+elseif(Header.BytesPerPixel == 4)
+    PixelType = 'single';
+else
+    PixelType = 'uint16';
+end
+Variance = [];
+if(Header.ReadoutCount == 0)
+    Frames = zeros(0, 0, 0, PixelType);
+    Map = [];
+    return;
+end
+
+% Each readout is one column of the map; nothing is read until it is indexed
+Map = memmapfile(FilePath, 'Offset', Header.DataOffset, ...
+    'Format', {PixelType, [Header.ReadoutStride/Header.BytesPerPixel Header.ReadoutCount], 'Readouts'});
+
+Roi = Header.Rois(RoiIndex);
+Pixels = Roi.Columns * Roi.Rows;
+Frames = zeros(Roi.Rows, Roi.Columns, Header.ReadoutCount * Header.FramesPerReadout, PixelType);
+for ff = 1:Header.FramesPerReadout
+    First = ((ff - 1) * Header.FrameStride + Roi.Offset) / Header.BytesPerPixel + 1;
+    Block = reshape(Map.Data.Readouts(First:First + Pixels - 1, :), Roi.Columns, Roi.Rows, []);
+    Frames(:, :, ff:Header.FramesPerReadout:end) = permute(Block, [2 1 3]);
+end
+
+% Variance maps follow the frames of each readout and are always single
+if(isfield(Header, 'VarianceOffset') && Header.VarianceOffset > 0)
+    Variance = zeros(Roi.Rows, Roi.Columns, Header.ReadoutCount * Header.FramesPerReadout, 'single');
+    for ff = 1:Header.FramesPerReadout
+        First = (Header.VarianceOffset + (ff - 1) * Header.FrameStride + Roi.Offset) / 4 + 1;
+        Block = typecast(reshape(Map.Data.Readouts(First:First + Pixels - 1, :), [], 1), 'single');
+        Block = reshape(Block, Roi.Columns, Roi.Rows, []);
+        Variance(:, :, ff:Header.FramesPerReadout:end) = permute(Block, [2 1 3]);
+    end
+end
@@ -0,0 +1,21 @@
+function Reply = SendCaptureCommand(Command, Port)
+%%%% Sends one command line to a ConfigAndCapture server (started with
+%%%% --server) and blocks until the server replies.  A CAPTURE command is
+%%%% answered only once the file is flushed to disk, so no polling is needed.
+%%%% Command --- e.g. 'CAPTURE "C:\Data\" "image.raw" 0 0 1024 1024 6 5'
+%%%% Port --- The server's TCP port on this machine (default 5757)
+%%%% Reply --- 'OK <file>' on success, 'ERROR <code> <reason>' otherwise (code
+%%%%           as the executeable's exit code, 1 for invalid arguments)
+
+if(nargin < 2)
+    Port = 5757;
+end
+
+Socket = java.net.Socket('127.0.0.1', Port);
+Cleanup = onCleanup(@() Socket.close());
+
+Out = java.io.PrintWriter(Socket.getOutputStream(), true);
+In = java.io.BufferedReader(java.io.InputStreamReader(Socket.getInputStream()));
+
+Out.println(Command);
+Reply = char(In.readLine());
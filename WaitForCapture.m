@@ -0,0 +1,54 @@
+function [Saved, Reply] = WaitForCapture(Listener, Timeout)
+%%%% Blocks until ConfigAndCapture.exe, started with --notify=PORT, reports
+%%%% that its capture is over.  The executeable connects to the listener,
+%%%% sends PROGRESS lines while frames arrive and finally DONE <file> (once
+%%%% the file is complete, flushed and renamed into place) or
+%%%% FAILED <code> <reason>.
+%%%% Listener --- java.net.ServerSocket opened before launching the
+%%%%              executeable, e.g.
+%%%%   Listener = java.net.ServerSocket(0, 1, java.net.InetAddress.getByName('127.0.0.1'));
+%%%%   Port = Listener.getLocalPort();
+%%%% Timeout --- Seconds without any word from the executeable before giving
+%%%%             up (default 60).  It reports at least every 10 seconds
+%%%%             while waiting on the camera.
+%%%% Saved --- true if the file was saved
+%%%% Reply --- The final DONE or FAILED line
+
+if(nargin < 2)
+    Timeout = 60;
+end
+Cleanup = onCleanup(@() Listener.close());
+
+Listener.setSoTimeout(Timeout * 1000);
+try
+    Socket = Listener.accept();
+catch
+    error(['ConfigAndCapture did not connect within ' num2str(Timeout) ' seconds']);
+end
+SocketCleanup = onCleanup(@() Socket.close());
+Socket.setSoTimeout(Timeout * 1000);
+In = java.io.BufferedReader(java.io.InputStreamReader(Socket.getInputStream()));
+
+Saved = false;
+Reply = '';
+while(true)
+    try
+        Line = In.readLine();
+    catch
+        error(['No word from ConfigAndCapture for ' num2str(Timeout) ' seconds']);
+    end
+    if(isempty(Line))
+        Reply = 'FAILED ConfigAndCapture exited without reporting';
+        return;
+    end
+    Line = char(Line);
+    if(strncmp(Line, 'PROGRESS', 8))
+        Counts = sscanf(Line(9:end), '%d');
+        fprintf('\r%d of %d frames', Counts(1), Counts(2));
+    else
+        fprintf('\n');
+        Reply = Line;
+        Saved = strncmp(Line, 'DONE', 4);
+        return;
+    end
+end